@@ -10,3 +10,24 @@ arm-linux-gnueabihf-gcc ${FLAGS} ${DEFS} -o mp4mux_stream_arm_gcc  src/mp4mux.c
 arm-linux-gnueabihf-gcc ${FLAGS} ${DEFS} -o mp4mux_file_arm_gcc  src/mp4mux.c -Dmp4mux_test -DMP4E_CAN_USE_RANDOM_FILE_ACCESS=1
 arm-linux-gnueabihf-gcc ${FLAGS} ${DEFS} -o mp4demux_arm_gcc  src/mp4demux.c   -Dmp4demux_test
 arm-linux-gnueabihf-gcc ${FLAGS} ${DEFS} -o mp4transcode_arm_gcc  test/mp4transcode_test.c src/mp4mux.c src/mp4demux.c -Isrc
+arm-linux-gnueabihf-gcc ${FLAGS} ${DEFS} -o mp4arena_arm_gcc  test/mp4arena_test.c test/mp4test_util.c src/mp4mux.c src/mp4demux.c src/mp4arena.c -Isrc
+arm-linux-gnueabihf-gcc ${FLAGS} ${DEFS} -o mp4writer_arm_gcc  test/mp4writer_test.c src/mp4mux.c src/mp4demux.c src/mp4writer.c src/mp4uring.c -Isrc -pthread
+arm-linux-gnueabihf-gcc ${FLAGS} ${DEFS} -o mp4queue_arm_gcc  test/mp4queue_test.c test/mp4test_util.c src/mp4mux.c src/mp4demux.c src/mp4queue.c -Isrc -pthread
+arm-linux-gnueabihf-gcc ${FLAGS} ${DEFS} -o mp4mux_ts_arm_gcc  test/mp4mux_ts_test.c test/mp4test_util.c src/mp4mux.c src/mp4demux.c -Isrc
+arm-linux-gnueabihf-gcc ${FLAGS} ${DEFS} -o mp4cmaf_arm_gcc  test/mp4cmaf_test.c test/mp4test_util.c src/mp4mux.c -Isrc
+arm-linux-gnueabihf-gcc ${FLAGS} ${DEFS} -o mp4segment_arm_gcc  test/mp4segment_test.c test/mp4test_util.c src/mp4mux.c -Isrc
+arm-linux-gnueabihf-gcc ${FLAGS} ${DEFS} -o mp4fragment_arm_gcc  test/mp4fragment_test.c test/mp4test_util.c src/mp4mux.c src/mp4demux.c -Isrc
+arm-linux-gnueabihf-gcc ${FLAGS} ${DEFS} -o mp4checkpoint_arm_gcc  test/mp4checkpoint_test.c test/mp4test_util.c src/mp4mux.c src/mp4demux.c -Isrc
+arm-linux-gnueabihf-gcc ${FLAGS} ${DEFS} -o mp4recover_arm_gcc  test/mp4recover_test.c test/mp4test_util.c src/mp4mux.c src/mp4demux.c -Isrc -DMP4E_CAN_USE_RANDOM_FILE_ACCESS=0
+arm-linux-gnueabihf-gcc ${FLAGS} ${DEFS} -o mp4rotate_arm_gcc  test/mp4rotate_test.c test/mp4test_util.c src/mp4mux.c src/mp4demux.c -Isrc
+arm-linux-gnueabihf-gcc ${FLAGS} ${DEFS} -o mp4tee_arm_gcc  test/mp4tee_test.c test/mp4test_util.c src/mp4tee.c src/mp4mux.c src/mp4demux.c -Isrc
+arm-linux-gnueabihf-gcc ${FLAGS} ${DEFS} -o mp4nonblock_arm_gcc  test/mp4nonblock_test.c test/mp4test_util.c src/mp4mux.c src/mp4demux.c -Isrc
+arm-linux-gnueabihf-gcc ${FLAGS} ${DEFS} -o mp4feed_arm_gcc  test/mp4feed_test.c src/mp4demux.c -Isrc
+arm-linux-gnueabihf-gcc ${FLAGS} ${DEFS} -o mp4pull_arm_gcc  test/mp4pull_test.c test/mp4test_util.c src/mp4mux.c src/mp4demux.c -Isrc
+arm-linux-gnueabihf-gcc ${FLAGS} ${DEFS} -o mp4index_arm_gcc  test/mp4index_test.c test/mp4test_util.c src/mp4index.c src/mp4mux.c src/mp4demux.c -Isrc
+arm-linux-gnueabihf-gcc ${FLAGS} ${DEFS} -o mp4cache_arm_gcc  test/mp4cache_test.c src/mp4cache.c src/mp4demux.c -Isrc -pthread
+arm-linux-gnueabihf-gcc ${FLAGS} ${DEFS} -o mp4read_arm_gcc  test/mp4read_test.c src/mp4demux.c -Isrc -pthread
+arm-linux-gnueabihf-gcc ${FLAGS} ${DEFS} -o mp4probe_arm_gcc  test/mp4probe_test.c test/mp4test_util.c src/mp4mux.c src/mp4demux.c -Isrc
+arm-linux-gnueabihf-gcc ${FLAGS} ${DEFS} -o mp4filter_arm_gcc  test/mp4filter_test.c test/mp4test_util.c src/mp4mux.c src/mp4demux.c -Isrc
+arm-linux-gnueabihf-gcc ${FLAGS} ${DEFS} -o mp4lazy_arm_gcc  test/mp4lazy_test.c test/mp4test_util.c src/mp4mux.c src/mp4demux.c -Isrc
+arm-linux-gnueabihf-gcc ${FLAGS} ${DEFS} -o mp4compact_arm_gcc  test/mp4compact_test.c test/mp4test_util.c src/mp4mux.c src/mp4demux.c -Isrc
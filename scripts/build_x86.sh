@@ -10,3 +10,27 @@ gcc ${FLAGS} ${DEFS} -o mp4mux_stream_x86  src/mp4mux.c  -Dmp4mux_test -DMP4E_CA
 gcc ${FLAGS} ${DEFS} -o mp4mux_file_x86  src/mp4mux.c -Dmp4mux_test -DMP4E_CAN_USE_RANDOM_FILE_ACCESS=1
 gcc ${FLAGS} ${DEFS} -o mp4demux_x86  src/mp4demux.c   -Dmp4demux_test
 gcc ${FLAGS} ${DEFS} -o mp4transcode_x86  test/mp4transcode_test.c src/mp4mux.c src/mp4demux.c -Isrc
+gcc ${FLAGS} ${DEFS} -o mp4arena_x86  test/mp4arena_test.c test/mp4test_util.c src/mp4mux.c src/mp4demux.c src/mp4arena.c -Isrc
+gcc ${FLAGS} ${DEFS} -o mp4writer_x86  test/mp4writer_test.c src/mp4mux.c src/mp4demux.c src/mp4writer.c src/mp4uring.c -Isrc -pthread
+gcc ${FLAGS} ${DEFS} -o mp4uring_bench_x86  test/mp4uring_bench.c test/mp4test_util.c src/mp4mux.c src/mp4uring.c -Isrc
+gcc ${FLAGS} ${DEFS} -o mp4queue_x86  test/mp4queue_test.c test/mp4test_util.c src/mp4mux.c src/mp4demux.c src/mp4queue.c -Isrc -pthread
+gcc ${FLAGS} ${DEFS} -o mp4mux_ts_x86  test/mp4mux_ts_test.c test/mp4test_util.c src/mp4mux.c src/mp4demux.c -Isrc
+gcc ${FLAGS} ${DEFS} -o mp4cmaf_x86  test/mp4cmaf_test.c test/mp4test_util.c src/mp4mux.c -Isrc
+gcc ${FLAGS} ${DEFS} -o mp4segment_x86  test/mp4segment_test.c test/mp4test_util.c src/mp4mux.c -Isrc
+gcc ${FLAGS} ${DEFS} -o mp4fragment_x86  test/mp4fragment_test.c test/mp4test_util.c src/mp4mux.c src/mp4demux.c -Isrc
+gcc ${FLAGS} ${DEFS} -o mp4checkpoint_x86  test/mp4checkpoint_test.c test/mp4test_util.c src/mp4mux.c src/mp4demux.c -Isrc
+gcc ${FLAGS} ${DEFS} -o mp4recover_x86  test/mp4recover_test.c test/mp4test_util.c src/mp4mux.c src/mp4demux.c -Isrc -DMP4E_CAN_USE_RANDOM_FILE_ACCESS=0
+gcc ${FLAGS} ${DEFS} -o mp4rotate_x86  test/mp4rotate_test.c test/mp4test_util.c src/mp4mux.c src/mp4demux.c -Isrc
+gcc ${FLAGS} ${DEFS} -o mp4tee_x86  test/mp4tee_test.c test/mp4test_util.c src/mp4tee.c src/mp4mux.c src/mp4demux.c -Isrc
+gcc ${FLAGS} ${DEFS} -o mp4nonblock_x86  test/mp4nonblock_test.c test/mp4test_util.c src/mp4mux.c src/mp4demux.c -Isrc
+gcc ${FLAGS} ${DEFS} -o mp4feed_x86  test/mp4feed_test.c src/mp4demux.c -Isrc
+gcc ${FLAGS} ${DEFS} -o mp4pull_x86  test/mp4pull_test.c test/mp4test_util.c src/mp4mux.c src/mp4demux.c -Isrc
+gcc ${FLAGS} ${DEFS} -o mp4index_x86  test/mp4index_test.c test/mp4test_util.c src/mp4index.c src/mp4mux.c src/mp4demux.c -Isrc
+gcc ${FLAGS} ${DEFS} -o mp4cache_x86  test/mp4cache_test.c src/mp4cache.c src/mp4demux.c -Isrc -pthread
+gcc ${FLAGS} ${DEFS} -o mp4read_x86  test/mp4read_test.c src/mp4demux.c -Isrc -pthread
+gcc ${FLAGS} ${DEFS} -o mp4batch_bench_x86  test/mp4batch_bench.c test/mp4test_util.c src/mp4batch.c src/mp4mux.c src/mp4demux.c -Isrc -pthread
+gcc ${FLAGS} ${DEFS} -o mp4probe_x86  test/mp4probe_test.c test/mp4test_util.c src/mp4mux.c src/mp4demux.c -Isrc
+gcc ${FLAGS} ${DEFS} -o mp4filter_x86  test/mp4filter_test.c test/mp4test_util.c src/mp4mux.c src/mp4demux.c -Isrc
+gcc ${FLAGS} ${DEFS} -o mp4lazy_x86  test/mp4lazy_test.c test/mp4test_util.c src/mp4mux.c src/mp4demux.c -Isrc
+gcc ${FLAGS} ${DEFS} -o mp4compact_x86  test/mp4compact_test.c test/mp4test_util.c src/mp4mux.c src/mp4demux.c -Isrc
+gcc ${FLAGS} ${DEFS} -o mp4recover  src/mp4recover.c src/mp4mux.c src/mp4demux.c -Isrc
@@ -64,6 +64,122 @@ then
     echo test failed
     exit 1
 fi
+if ! ./mp4arena_x86
+then
+    echo test failed
+    exit 1
+fi
+if ! ./mp4writer_x86 mp4mux_file.mp4
+then
+    echo test failed
+    exit 1
+fi
+if ! ./mp4uring_bench_x86 . 30 1 8 >/dev/null
+then
+    echo test failed
+    exit 1
+fi
+if ! ./mp4queue_x86
+then
+    echo test failed
+    exit 1
+fi
+if ! ./mp4mux_ts_x86
+then
+    echo test failed
+    exit 1
+fi
+if ! ./mp4cmaf_x86
+then
+    echo test failed
+    exit 1
+fi
+if ! ./mp4segment_x86
+then
+    echo test failed
+    exit 1
+fi
+if ! ./mp4fragment_x86
+then
+    echo test failed
+    exit 1
+fi
+if ! ./mp4checkpoint_x86
+then
+    echo test failed
+    exit 1
+fi
+if ! ./mp4recover_x86
+then
+    echo test failed
+    exit 1
+fi
+if ! ./mp4rotate_x86
+then
+    echo test failed
+    exit 1
+fi
+if ! ./mp4tee_x86
+then
+    echo test failed
+    exit 1
+fi
+if ! ./mp4nonblock_x86
+then
+    echo test failed
+    exit 1
+fi
+if ! ./mp4feed_x86
+then
+    echo test failed
+    exit 1
+fi
+if ! ./mp4pull_x86
+then
+    echo test failed
+    exit 1
+fi
+if ! ./mp4index_x86
+then
+    echo test failed
+    exit 1
+fi
+if ! ./mp4cache_x86
+then
+    echo test failed
+    exit 1
+fi
+if ! ./mp4read_x86
+then
+    echo test failed
+    exit 1
+fi
+if ! ./mp4batch_bench_x86 . 16 60 1 4 >/dev/null
+then
+    echo test failed
+    exit 1
+fi
+if ! ./mp4probe_x86
+then
+    echo test failed
+    exit 1
+fi
+if ! ./mp4filter_x86
+then
+    echo test failed
+    exit 1
+fi
+if ! ./mp4lazy_x86
+then
+    echo test failed
+    exit 1
+fi
+if ! ./mp4compact_x86
+then
+    echo test failed
+    exit 1
+fi
+
 rm mp4mux_stream.mp4
 rm mp4mux_file.mp4
 rm transcoded.mp4
@@ -130,6 +246,112 @@ then
     exit 1
 fi
 
+if ! qemu-arm ./mp4arena_arm_gcc
+then
+    echo test failed
+    exit 1
+fi
+if ! qemu-arm ./mp4writer_arm_gcc mp4mux_file.mp4
+then
+    echo test failed
+    exit 1
+fi
+if ! qemu-arm ./mp4queue_arm_gcc
+then
+    echo test failed
+    exit 1
+fi
+if ! qemu-arm ./mp4mux_ts_arm_gcc
+then
+    echo test failed
+    exit 1
+fi
+if ! qemu-arm ./mp4cmaf_arm_gcc
+then
+    echo test failed
+    exit 1
+fi
+if ! qemu-arm ./mp4segment_arm_gcc
+then
+    echo test failed
+    exit 1
+fi
+if ! qemu-arm ./mp4fragment_arm_gcc
+then
+    echo test failed
+    exit 1
+fi
+if ! qemu-arm ./mp4checkpoint_arm_gcc
+then
+    echo test failed
+    exit 1
+fi
+if ! qemu-arm ./mp4recover_arm_gcc
+then
+    echo test failed
+    exit 1
+fi
+if ! qemu-arm ./mp4rotate_arm_gcc
+then
+    echo test failed
+    exit 1
+fi
+if ! qemu-arm ./mp4tee_arm_gcc
+then
+    echo test failed
+    exit 1
+fi
+if ! qemu-arm ./mp4nonblock_arm_gcc
+then
+    echo test failed
+    exit 1
+fi
+if ! qemu-arm ./mp4feed_arm_gcc
+then
+    echo test failed
+    exit 1
+fi
+if ! qemu-arm ./mp4pull_arm_gcc
+then
+    echo test failed
+    exit 1
+fi
+if ! qemu-arm ./mp4index_arm_gcc
+then
+    echo test failed
+    exit 1
+fi
+if ! qemu-arm ./mp4cache_arm_gcc
+then
+    echo test failed
+    exit 1
+fi
+if ! qemu-arm ./mp4read_arm_gcc
+then
+    echo test failed
+    exit 1
+fi
+if ! qemu-arm ./mp4probe_arm_gcc
+then
+    echo test failed
+    exit 1
+fi
+if ! qemu-arm ./mp4filter_arm_gcc
+then
+    echo test failed
+    exit 1
+fi
+if ! qemu-arm ./mp4lazy_arm_gcc
+then
+    echo test failed
+    exit 1
+fi
+if ! qemu-arm ./mp4compact_arm_gcc
+then
+    echo test failed
+    exit 1
+fi
+
 rm mp4mux_stream.mp4
 rm mp4mux_file.mp4
 rm transcoded.mp4
@@ -0,0 +1,122 @@
+/** 18.10.2026 @file
+*
+*   Block layout: [header: block size][data] ... [header: block size][data]
+*   Both header and data are aligned to MP4_ARENA_ALIGN bytes.
+*/
+
+#include "mp4arena.h"
+#include <string.h>
+
+/************************************************************************/
+/*      Build config                                                    */
+/************************************************************************/
+// Alignment of returned memory; must be a power of 2, not less than sizeof(size_t)
+#ifndef MP4_ARENA_ALIGN
+#define MP4_ARENA_ALIGN 16
+#endif
+
+#define ARENA_ROUND(x) (((x) + (MP4_ARENA_ALIGN - 1)) & ~(size_t)(MP4_ARENA_ALIGN - 1))
+
+/**
+*   Return size of the block, stored in the block header
+*/
+static size_t mp4_arena_block_size(const void * ptr)
+{
+    return *(const size_t *)((const unsigned char *)ptr - MP4_ARENA_ALIGN);
+}
+
+/**
+*   Allocate block at the arena top
+*/
+static void * mp4_arena_allocate(void * context, size_t bytes)
+{
+    MP4_arena_t * arena = (MP4_arena_t *)context;
+    size_t need = MP4_ARENA_ALIGN + ARENA_ROUND(bytes);
+    unsigned char * p;
+    if (need < bytes || arena->capacity - arena->used < need)
+    {
+        return NULL;
+    }
+    p = arena->base + arena->used;
+    *(size_t *)p = bytes;
+    arena->last = arena->used + MP4_ARENA_ALIGN;
+    arena->used += need;
+    return p + MP4_ARENA_ALIGN;
+}
+
+/**
+*   Resize the most recent block in place, otherwise allocate new block and copy data
+*/
+static void * mp4_arena_reallocate(void * context, void * ptr, size_t bytes)
+{
+    MP4_arena_t * arena = (MP4_arena_t *)context;
+    size_t old_bytes;
+    void * p;
+    if (!ptr)
+    {
+        return mp4_arena_allocate(context, bytes);
+    }
+    old_bytes = mp4_arena_block_size(ptr);
+    if ((unsigned char *)ptr == arena->base + arena->last)
+    {
+        size_t need = ARENA_ROUND(bytes);
+        if (need < bytes || arena->capacity - arena->last < need)
+        {
+            return NULL;
+        }
+        *(size_t *)((unsigned char *)ptr - MP4_ARENA_ALIGN) = bytes;
+        arena->used = arena->last + need;
+        return ptr;
+    }
+    p = mp4_arena_allocate(context, bytes);
+    if (p)
+    {
+        memcpy(p, ptr, old_bytes < bytes ? old_bytes : bytes);
+    }
+    return p;
+}
+
+/**
+*   Reclaim memory, only if it is the most recent block
+*/
+static void mp4_arena_deallocate(void * context, void * ptr)
+{
+    MP4_arena_t * arena = (MP4_arena_t *)context;
+    if (ptr && (unsigned char *)ptr == arena->base + arena->last)
+    {
+        arena->used = arena->last - MP4_ARENA_ALIGN;
+        arena->last = 0;
+    }
+}
+
+/************************************************************************/
+/*      Exported API functions                                          */
+/************************************************************************/
+
+/**
+*   Initialize arena over given memory block.
+*/
+void MP4__arena_init(MP4_arena_t * arena, void * memory, size_t capacity)
+{
+    size_t skip = (MP4_ARENA_ALIGN - ((size_t)memory & (MP4_ARENA_ALIGN - 1))) & (MP4_ARENA_ALIGN - 1);
+    if (!memory || capacity < skip)
+    {
+        skip = capacity = 0;
+    }
+    arena->allocator.allocate = mp4_arena_allocate;
+    arena->allocator.reallocate = mp4_arena_reallocate;
+    arena->allocator.deallocate = mp4_arena_deallocate;
+    arena->allocator.context = arena;
+    arena->base = (unsigned char *)memory + skip;
+    arena->capacity = (capacity - skip) & ~(size_t)(MP4_ARENA_ALIGN - 1);
+    MP4__arena_reset(arena);
+}
+
+/**
+*   Release all allocations at once.
+*/
+void MP4__arena_reset(MP4_arena_t * arena)
+{
+    arena->used = 0;
+    arena->last = 0;
+}
@@ -0,0 +1,61 @@
+/** 18.10.2026 @file
+*
+*   Fixed-capacity 'bump' memory arena for MP4 multiplexer & demultiplexer
+*
+*   Arena serves all allocations from the single application-supplied memory
+*   block, so the library can be used without heap. Memory is released all at
+*   once with MP4__arena_reset(); deallocation of individual blocks only
+*   reclaims the most recent block.
+*
+*   Example:
+*
+*       static unsigned char memory[64*1024];
+*       MP4_arena_t arena;
+*       MP4D_params_t params = {0,};
+*       MP4__arena_init(&arena, memory, sizeof(memory));
+*       params.allocator = &arena.allocator;
+*       MP4D__open_ex(&mp4, file, &params);
+*       ...
+*       MP4D__close(&mp4);
+*       MP4__arena_reset(&arena);
+*/
+
+#ifndef mp4arena_H_INCLUDED
+#define mp4arena_H_INCLUDED
+
+#include "mp4defs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif  //__cplusplus
+
+typedef struct
+{
+    // Allocator interface: pass &arena.allocator to MP4E__open_ex()/MP4D__open_ex()
+    MP4_allocator_t allocator;
+
+    unsigned char * base;           // application-supplied memory (aligned)
+    size_t capacity;                // usable bytes at base
+    size_t used;                    // allocated bytes, including block headers
+    size_t last;                    // offset of the most recent block, 0 if none
+} MP4_arena_t;
+
+
+/**
+*   Initialize arena over given memory block.
+*   The memory is not owned by the arena, and must outlive all allocations.
+*/
+void MP4__arena_init(MP4_arena_t * arena, void * memory, size_t capacity);
+
+
+/**
+*   Release all allocations at once.
+*/
+void MP4__arena_reset(MP4_arena_t * arena);
+
+
+#ifdef __cplusplus
+}
+#endif //__cplusplus
+
+#endif //mp4arena_H_INCLUDED
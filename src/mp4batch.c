@@ -0,0 +1,251 @@
+/** 18.10.2026 @file
+*
+*   Workers take the files from the shared counter. Each worker keeps two
+*   files: the parsed one, and the next one, which is opened and prefetched
+*   before the current file is parsed. The calling thread is one of the
+*   workers, so the batch is processed, even if thread creation fails.
+**/
+
+#include "mp4batch.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+/************************************************************************/
+/*      Build config                                                    */
+/************************************************************************/
+// Default stdio buffer size per file
+#ifndef MP4B_DEFAULT_READ_BUFFER_BYTES
+#define MP4B_DEFAULT_READ_BUFFER_BYTES  (64*1024)
+#endif
+
+// Default read-ahead size at the head and at the tail of the file
+#ifndef MP4B_DEFAULT_PREFETCH_BYTES
+#define MP4B_DEFAULT_PREFETCH_BYTES     (1024*1024)
+#endif
+
+// Max number of threads
+#ifndef MP4B_MAX_THREADS
+#define MP4B_MAX_THREADS                256
+#endif
+
+/*
+*   Shared state of the batch
+*/
+typedef struct
+{
+    MP4B_file_t * files;
+    unsigned count;
+    unsigned next;              // next file to take
+    unsigned parsed;            // # of parsed files
+    pthread_mutex_t lock;
+    MP4B_params_t params;
+    MP4D_params_t demux_params; // copy without lazy mode
+} mp4b_batch_t;
+
+/*
+*   Opened file, not parsed yet
+*/
+typedef struct
+{
+    MP4B_file_t * file;
+    FILE * f;
+    char * buffer;              // stdio buffer
+} mp4b_slot_t;
+
+/************************************************************************/
+/*      Worker                                                          */
+/************************************************************************/
+
+/**
+*   Ask the kernel to read the head and the tail of the file
+*/
+static void mp4b_prefetch(FILE * f, size_t bytes)
+{
+#ifdef POSIX_FADV_WILLNEED
+    struct stat st;
+    int fd = fileno(f);
+    if (!fstat(fd, &st))
+    {
+        posix_fadvise(fd, 0, (off_t)bytes, POSIX_FADV_WILLNEED);
+        if (st.st_size > (off_t)bytes)
+        {
+            posix_fadvise(fd, st.st_size - (off_t)bytes, (off_t)bytes, POSIX_FADV_WILLNEED);
+        }
+    }
+#else
+    (void)f;
+    (void)bytes;
+#endif
+}
+
+/**
+*   Take next file of the batch, and open it
+*   return 0, if no files left
+*/
+static int mp4b_take(mp4b_batch_t * batch, mp4b_slot_t * slot)
+{
+    MP4B_file_t * file;
+    pthread_mutex_lock(&batch->lock);
+    file = batch->next < batch->count ? batch->files + batch->next++ : NULL;
+    pthread_mutex_unlock(&batch->lock);
+    slot->file = file;
+    if (!file)
+    {
+        return 0;
+    }
+    memset(&file->mp4, 0, sizeof(file->mp4));
+    file->sys_errno = 0;
+    slot->f = fopen(file->path, "rb");
+    if (!slot->f)
+    {
+        file->status = MP4B_STATUS_OPEN_FAILED;
+        file->sys_errno = errno;
+        return 1;
+    }
+    if (slot->buffer)
+    {
+        setvbuf(slot->f, slot->buffer, _IOFBF, batch->params.read_buffer_bytes);
+    }
+    if (!batch->params.disable_prefetch)
+    {
+        mp4b_prefetch(slot->f, batch->params.prefetch_bytes);
+    }
+    return 1;
+}
+
+/**
+*   Parse opened file, and close it
+*/
+static void mp4b_parse(mp4b_batch_t * batch, mp4b_slot_t * slot)
+{
+    MP4B_file_t * file = slot->file;
+    if (slot->f)
+    {
+        file->status = MP4D__open_ex(&file->mp4, slot->f, batch->params.demux_params) ? MP4B_STATUS_OK : MP4B_STATUS_PARSE_FAILED;
+        fclose(slot->f);
+        slot->f = NULL;
+        if (file->status == MP4B_STATUS_OK)
+        {
+            pthread_mutex_lock(&batch->lock);
+            batch->parsed++;
+            pthread_mutex_unlock(&batch->lock);
+        }
+    }
+    if (batch->params.callback)
+    {
+        batch->params.callback(batch->params.token, file);
+    }
+}
+
+static void * mp4b_worker(void * arg)
+{
+    mp4b_batch_t * batch = (mp4b_batch_t *)arg;
+    mp4b_slot_t slot[2];
+    int cur = 0;
+    memset(slot, 0, sizeof(slot));
+    // without the buffers, default stdio buffering is used
+    slot[0].buffer = (char *)malloc(batch->params.read_buffer_bytes);
+    slot[1].buffer = (char *)malloc(batch->params.read_buffer_bytes);
+
+    mp4b_take(batch, slot + cur);
+    while (slot[cur].file)
+    {
+        // open the next file, so the kernel reads it, while this one is parsed
+        mp4b_take(batch, slot + (cur ^ 1));
+        mp4b_parse(batch, slot + cur);
+        cur ^= 1;
+    }
+    free(slot[0].buffer);
+    free(slot[1].buffer);
+    return NULL;
+}
+
+/************************************************************************/
+/*      API                                                             */
+/************************************************************************/
+
+/**
+*   Open and parse the files on the thread pool
+*/
+unsigned MP4B__open(MP4B_file_t * files, unsigned count, const MP4B_params_t * params)
+{
+    mp4b_batch_t batch;
+    pthread_t threads[MP4B_MAX_THREADS];
+    unsigned thread_count, i, created = 0;
+    if (!files || !count)
+    {
+        return 0;
+    }
+    memset(&batch, 0, sizeof(batch));
+    if (params)
+    {
+        batch.params = *params;
+    }
+    if (batch.params.demux_params && batch.params.demux_params->lazy)
+    {
+        // lazy tables need the file, which is closed after parsing
+        batch.demux_params = *batch.params.demux_params;
+        batch.demux_params.lazy = 0;
+        batch.params.demux_params = &batch.demux_params;
+    }
+    if (!batch.params.read_buffer_bytes)
+    {
+        batch.params.read_buffer_bytes = MP4B_DEFAULT_READ_BUFFER_BYTES;
+    }
+    if (!batch.params.prefetch_bytes)
+    {
+        batch.params.prefetch_bytes = MP4B_DEFAULT_PREFETCH_BYTES;
+    }
+    thread_count = batch.params.thread_count;
+    if (!thread_count)
+    {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        thread_count = cpus > 0 ? (unsigned)cpus : 1;
+    }
+    if (thread_count > count)
+    {
+        thread_count = count;
+    }
+    if (thread_count > MP4B_MAX_THREADS)
+    {
+        thread_count = MP4B_MAX_THREADS;
+    }
+    batch.files = files;
+    batch.count = count;
+    pthread_mutex_init(&batch.lock, NULL);
+
+    for (i = 1; i < thread_count; i++)
+    {
+        if (!pthread_create(threads + created, NULL, mp4b_worker, &batch))
+        {
+            created++;
+        }
+    }
+    mp4b_worker(&batch);
+    for (i = 0; i < created; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    pthread_mutex_destroy(&batch.lock);
+    return batch.parsed;
+}
+
+/**
+*   Close parsed files
+*/
+void MP4B__close(MP4B_file_t * files, unsigned count)
+{
+    unsigned i;
+    for (i = 0; files && i < count; i++)
+    {
+        if (files[i].status == MP4B_STATUS_OK)
+        {
+            MP4D__close(&files[i].mp4);
+        }
+    }
+}
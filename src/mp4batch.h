@@ -0,0 +1,112 @@
+/** 18.10.2026 @file
+*
+*   Parallel open of many MP4 files
+*
+*   Portability note: this module uses POSIX threads, and posix_fadvise()
+*   read-ahead hints, if available.
+*
+*   Batch jobs, which parse large file archives, open the files with
+*   MP4D__open_ex() on a pool of worker threads. Each worker opens its next
+*   file, and asks the kernel to read ahead the head and the tail of the file
+*   (where the 'moov' box is), while it parses the current one, so disk reads
+*   overlap with parsing. Files are parsed with large stdio buffers.
+*
+*   Result of each file is stored to its MP4B_file_t. Jobs, which do not keep
+*   all files open, process and close each file in the callback, on the worker
+*   thread.
+*
+*   Example:
+*
+*       static void on_file(void * token, MP4B_file_t * file)
+*       {
+*           if (file->status == MP4B_STATUS_OK)
+*           {
+*               ... use file->mp4
+*               MP4D__close(&file->mp4);
+*           }
+*       }
+*       ...
+*       for (i = 0; i < count; i++)
+*       {
+*           files[i].path = path[i];
+*       }
+*       params.callback = on_file;
+*       MP4B__open(files, count, &params);
+*/
+
+#ifndef mp4batch_H_INCLUDED
+#define mp4batch_H_INCLUDED
+
+#include "mp4demux.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif  //__cplusplus
+
+/*
+*   Result of the file open, see MP4B_file_t
+*/
+#define MP4B_STATUS_OK              0   // file is parsed
+#define MP4B_STATUS_OPEN_FAILED     1   // file can't be opened, see sys_errno
+#define MP4B_STATUS_PARSE_FAILED    2   // MP4D__open_ex() failed
+
+/*
+*   File of the batch
+*/
+typedef struct
+{
+    const char * path;          // [IN] file name
+    MP4D_demux_t mp4;           // parsed file, if status is MP4B_STATUS_OK
+    int status;                 // MP4B_STATUS_*
+    int sys_errno;              // errno of fopen(), if status is MP4B_STATUS_OPEN_FAILED
+} MP4B_file_t;
+
+/*
+*   Batch parameters; zero-initialized members select defaults
+*/
+typedef struct
+{
+    // Number of parsing threads, including the calling thread. Default is number of online CPUs
+    unsigned thread_count;
+
+    // stdio buffer size per opened file. Default is 64 KB
+    size_t read_buffer_bytes;
+
+    // Bytes at the head and at the tail of the next file, which the kernel reads ahead,
+    // while the current file is parsed. Default is 1 MB
+    size_t prefetch_bytes;
+
+    // Flag: don't read ahead
+    int disable_prefetch;
+
+    // Demultiplexer parameters; may be NULL. The allocator must be thread-safe. Lazy mode is
+    // ignored: the files are closed after parsing
+    const MP4D_params_t * demux_params;
+
+    // Called on the worker thread, when the file is opened or failed; may be NULL.
+    // The callback may close file->mp4 with MP4D__close()
+    void (*callback)(void * token, MP4B_file_t * file);
+    void * token;
+} MP4B_params_t;
+
+
+/**
+*   Open and parse the files on the thread pool. Returns, when all files are
+*   processed. params may be NULL.
+*
+*   return number of parsed files
+*/
+unsigned MP4B__open(MP4B_file_t * files, unsigned count, const MP4B_params_t * params);
+
+
+/**
+*   Close parsed files
+*/
+void MP4B__close(MP4B_file_t * files, unsigned count);
+
+
+#ifdef __cplusplus
+}
+#endif //__cplusplus
+
+#endif //mp4batch_H_INCLUDED
@@ -0,0 +1,393 @@
+/** 18.10.2026 @file
+*
+*   Cache entries are in the hash table, keyed by path, and in the LRU list,
+*   most recently used first. Entry, which is removed from the cache (evicted,
+*   or replaced by the changed file), while its handle is in use, is freed by
+*   the last MP4C__release().
+*
+*   Files are parsed without the lock, so the lookups of other threads are not
+*   blocked. If two threads parse the same file at once, the 1st inserted
+*   demultiplexer is used, and the other one is closed.
+**/
+
+#include "mp4cache.h"
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+/************************************************************************/
+/*      Build config                                                    */
+/************************************************************************/
+// Default memory budget
+#ifndef MP4C_DEFAULT_BUDGET_BYTES
+#define MP4C_DEFAULT_BUDGET_BYTES   (256*1024*1024)
+#endif
+
+// Hash table size, power of 2
+#ifndef MP4C_BUCKET_COUNT
+#define MP4C_BUCKET_COUNT           1024
+#endif
+
+/*
+*   File identity and version
+*/
+typedef struct
+{
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+} mp4c_stamp_t;
+
+/*
+*   Cached demultiplexer
+*/
+typedef struct mp4c_entry_tag
+{
+    MP4D_demux_t mp4;               // the handle: must be the 1st member
+    char * path;
+    unsigned hash;                  // path hash
+    mp4c_stamp_t stamp;
+    size_t bytes;                   // memory size
+    int refs;                       // # of handles in use
+    int cached;                     // flag: entry is in the cache
+    struct mp4c_entry_tag * next;   // next entry in the hash bucket, or in the free list
+    struct mp4c_entry_tag * lru_prev;
+    struct mp4c_entry_tag * lru_next;
+} mp4c_entry_t;
+
+struct MP4C_cache_tag
+{
+    pthread_mutex_t lock;
+    mp4c_entry_t * bucket[MP4C_BUCKET_COUNT];
+    mp4c_entry_t * lru_head;        // most recently used
+    mp4c_entry_t * lru_tail;        // least recently used
+    size_t budget;
+    MP4C_stats_t stats;
+};
+
+/************************************************************************/
+/*      Cache entry                                                     */
+/************************************************************************/
+
+static unsigned mp4c_hash(const char * path)
+{
+    // FNV-1a
+    unsigned hash = 2166136261u;
+    while (*path)
+    {
+        hash = (hash ^ (unsigned char)*path++)*16777619u;
+    }
+    return hash;
+}
+
+static void mp4c_get_stamp(const struct stat * st, mp4c_stamp_t * stamp)
+{
+    stamp->dev = st->st_dev;
+    stamp->ino = st->st_ino;
+    stamp->size = st->st_size;
+    stamp->mtime = st->st_mtim;
+}
+
+/**
+*   Return 1, if the stamps are of the same version of the file
+*/
+static int mp4c_same_stamp(const mp4c_stamp_t * a, const mp4c_stamp_t * b)
+{
+    return a->dev == b->dev && a->ino == b->ino && a->size == b->size &&
+           a->mtime.tv_sec == b->mtime.tv_sec && a->mtime.tv_nsec == b->mtime.tv_nsec;
+}
+
+/**
+*   Memory size of the demultiplexer
+*/
+static size_t mp4c_demux_bytes(const MP4D_demux_t * mp4)
+{
+    size_t bytes = mp4->track_count*sizeof(MP4D_track_t);
+    unsigned i;
+    for (i = 0; i < mp4->track_count; i++)
+    {
+        const MP4D_track_t * tr = mp4->track + i;
+        bytes += tr->sample_count*3*sizeof(unsigned) + tr->dsi_bytes +
+                 tr->sample_to_chunk_count*sizeof(MP4D_sample_to_chunk_t) +
+                 tr->chunk_count*sizeof(mp4d_size_t) + tr->random_access_count*sizeof(MP4D_random_access_t);
+    }
+    return bytes;
+}
+
+static void mp4c_entry_free(mp4c_entry_t * e)
+{
+    MP4D__close(&e->mp4);
+    free(e->path);
+    free(e);
+}
+
+/**
+*   Parse the file
+*   return new entry, or NULL on failure
+*/
+static mp4c_entry_t * mp4c_entry_create(const char * path, unsigned hash)
+{
+    mp4c_entry_t * e = (mp4c_entry_t *)calloc(1, sizeof(mp4c_entry_t));
+    FILE * f = fopen(path, "rb");
+    struct stat st;
+    int success = e && f && !fstat(fileno(f), &st) && (e->path = strdup(path)) != NULL;
+    if (success)
+    {
+        success = MP4D__open(&e->mp4, f);
+    }
+    if (f)
+    {
+        fclose(f);
+    }
+    if (!success)
+    {
+        if (e)
+        {
+            free(e->path);
+            free(e);
+        }
+        return NULL;
+    }
+    e->hash = hash;
+    mp4c_get_stamp(&st, &e->stamp);
+    e->bytes = sizeof(mp4c_entry_t) + strlen(path) + 1 + mp4c_demux_bytes(&e->mp4);
+    e->refs = 1;
+    return e;
+}
+
+/************************************************************************/
+/*      Hash table and LRU list (called with the lock)                  */
+/************************************************************************/
+
+static mp4c_entry_t * mp4c_find(MP4C_cache_t * cache, const char * path, unsigned hash)
+{
+    mp4c_entry_t * e = cache->bucket[hash & (MP4C_BUCKET_COUNT - 1)];
+    while (e && (e->hash != hash || strcmp(e->path, path)))
+    {
+        e = e->next;
+    }
+    return e;
+}
+
+static void mp4c_lru_unlink(MP4C_cache_t * cache, mp4c_entry_t * e)
+{
+    *(e->lru_prev ? &e->lru_prev->lru_next : &cache->lru_head) = e->lru_next;
+    *(e->lru_next ? &e->lru_next->lru_prev : &cache->lru_tail) = e->lru_prev;
+    e->lru_prev = e->lru_next = NULL;
+}
+
+static void mp4c_lru_push(MP4C_cache_t * cache, mp4c_entry_t * e)
+{
+    e->lru_prev = NULL;
+    e->lru_next = cache->lru_head;
+    *(cache->lru_head ? &cache->lru_head->lru_prev : &cache->lru_tail) = e;
+    cache->lru_head = e;
+}
+
+static void mp4c_insert(MP4C_cache_t * cache, mp4c_entry_t * e)
+{
+    mp4c_entry_t ** bucket = cache->bucket + (e->hash & (MP4C_BUCKET_COUNT - 1));
+    e->next = *bucket;
+    *bucket = e;
+    e->cached = 1;
+    mp4c_lru_push(cache, e);
+    cache->stats.bytes += e->bytes;
+    cache->stats.entries++;
+}
+
+/**
+*   Remove the entry from the cache
+*   return 1, if the entry is not in use, and should be freed
+*/
+static int mp4c_remove(MP4C_cache_t * cache, mp4c_entry_t * e)
+{
+    mp4c_entry_t ** p = cache->bucket + (e->hash & (MP4C_BUCKET_COUNT - 1));
+    while (*p != e)
+    {
+        p = &(*p)->next;
+    }
+    *p = e->next;
+    e->next = NULL;
+    e->cached = 0;
+    mp4c_lru_unlink(cache, e);
+    cache->stats.bytes -= e->bytes;
+    cache->stats.entries--;
+    return !e->refs;
+}
+
+/**
+*   Evict least recently used entries, which are not in use, to fit the budget
+*   return list of evicted entries, to be freed without the lock
+*/
+static mp4c_entry_t * mp4c_evict(MP4C_cache_t * cache)
+{
+    mp4c_entry_t * e = cache->lru_tail, * evicted = NULL;
+    while (e && cache->stats.bytes > cache->budget)
+    {
+        mp4c_entry_t * prev = e->lru_prev;
+        if (!e->refs)
+        {
+            mp4c_remove(cache, e);
+            e->next = evicted;
+            evicted = e;
+            cache->stats.evictions++;
+        }
+        e = prev;
+    }
+    return evicted;
+}
+
+static void mp4c_free_list(mp4c_entry_t * e)
+{
+    while (e)
+    {
+        mp4c_entry_t * next = e->next;
+        mp4c_entry_free(e);
+        e = next;
+    }
+}
+
+/************************************************************************/
+/*      API                                                             */
+/************************************************************************/
+
+/**
+*   Create the cache
+*/
+MP4C_cache_t * MP4C__open(const MP4C_params_t * params)
+{
+    MP4C_cache_t * cache = (MP4C_cache_t *)calloc(1, sizeof(MP4C_cache_t));
+    if (cache)
+    {
+        cache->budget = (params && params->memory_budget_bytes) ? params->memory_budget_bytes : MP4C_DEFAULT_BUDGET_BYTES;
+        pthread_mutex_init(&cache->lock, NULL);
+    }
+    return cache;
+}
+
+/**
+*   Get cached or parsed demultiplexer
+*/
+const MP4D_demux_t * MP4C__get(MP4C_cache_t * cache, const char * path)
+{
+    mp4c_entry_t * e, * parsed, * stale = NULL;
+    mp4c_stamp_t stamp;
+    struct stat st;
+    unsigned hash;
+    if (!cache || !path || stat(path, &st))
+    {
+        return NULL;
+    }
+    mp4c_get_stamp(&st, &stamp);
+    hash = mp4c_hash(path);
+
+    pthread_mutex_lock(&cache->lock);
+    e = mp4c_find(cache, path, hash);
+    if (e && mp4c_same_stamp(&e->stamp, &stamp))
+    {
+        e->refs++;
+        mp4c_lru_unlink(cache, e);
+        mp4c_lru_push(cache, e);
+        cache->stats.hits++;
+        pthread_mutex_unlock(&cache->lock);
+        return &e->mp4;
+    }
+    pthread_mutex_unlock(&cache->lock);
+
+    parsed = mp4c_entry_create(path, hash);
+    if (!parsed)
+    {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&cache->lock);
+    e = mp4c_find(cache, path, hash);
+    if (e && mp4c_same_stamp(&e->stamp, &parsed->stamp))
+    {
+        // parsed by other thread meanwhile
+        e->refs++;
+        mp4c_lru_unlink(cache, e);
+        mp4c_lru_push(cache, e);
+        cache->stats.hits++;
+        stale = parsed;
+    }
+    else
+    {
+        if (e && mp4c_remove(cache, e))
+        {
+            // file is changed
+            stale = e;
+        }
+        e = parsed;
+        mp4c_insert(cache, e);
+        cache->stats.misses++;
+    }
+    parsed = mp4c_evict(cache);
+    pthread_mutex_unlock(&cache->lock);
+
+    if (stale)
+    {
+        mp4c_entry_free(stale);
+    }
+    mp4c_free_list(parsed);
+    return &e->mp4;
+}
+
+/**
+*   Release demultiplexer handle
+*/
+void MP4C__release(MP4C_cache_t * cache, const MP4D_demux_t * mp4)
+{
+    mp4c_entry_t * e = (mp4c_entry_t *)(void *)mp4, * evicted = NULL;
+    int free_entry;
+    if (!cache || !e)
+    {
+        return;
+    }
+    pthread_mutex_lock(&cache->lock);
+    e->refs--;
+    free_entry = !e->refs && !e->cached;
+    if (!free_entry)
+    {
+        evicted = mp4c_evict(cache);
+    }
+    pthread_mutex_unlock(&cache->lock);
+    if (free_entry)
+    {
+        mp4c_entry_free(e);
+    }
+    mp4c_free_list(evicted);
+}
+
+/**
+*   Get cache counters
+*/
+void MP4C__get_stats(MP4C_cache_t * cache, MP4C_stats_t * stats)
+{
+    if (cache && stats)
+    {
+        pthread_mutex_lock(&cache->lock);
+        *stats = cache->stats;
+        pthread_mutex_unlock(&cache->lock);
+    }
+}
+
+/**
+*   Close cached demultiplexers, and de-allocate the cache
+*/
+void MP4C__close(MP4C_cache_t * cache)
+{
+    if (cache)
+    {
+        while (cache->lru_head)
+        {
+            mp4c_entry_t * e = cache->lru_head;
+            mp4c_remove(cache, e);
+            mp4c_entry_free(e);
+        }
+        pthread_mutex_destroy(&cache->lock);
+        free(cache);
+    }
+}
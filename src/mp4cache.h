@@ -0,0 +1,112 @@
+/** 18.10.2026 @file
+*
+*   Thread-safe cache of opened MP4 demultiplexers
+*
+*   Portability note: this module uses POSIX threads and stat().
+*
+*   Servers, which handle many requests for the same files, get the parsed
+*   demultiplexer from the cache instead of MP4D__open() per request. Entry is
+*   keyed by the file path, and validated by device, inode, size and modification
+*   time of the file, so the replaced file is parsed again. Demultiplexer handle
+*   is reference-counted: it stays valid until released, even if the entry is
+*   evicted or replaced meanwhile. Unused entries are evicted in least recently
+*   used order, when total size of the cached sample tables exceeds the memory
+*   budget.
+*
+*   Demultiplexer is read-only after MP4D__open(), so the handle may be used
+*   from several threads at once with read-only functions: MP4D__frame_offset(),
+*   MP4D__read_sample(), MP4D__seek_fragment(), MP4D__read_sps(), MP4D__read_pps().
+*
+*   Example:
+*
+*       MP4C_cache_t * cache = MP4C__open(NULL);
+*       ...
+*       // request handler threads
+*       const MP4D_demux_t * mp4 = MP4C__get(cache, path);
+*       if (mp4)
+*       {
+*           offset = MP4D__frame_offset(mp4, ntrack, nsample, &bytes, NULL, NULL);
+*           ...
+*           MP4C__release(cache, mp4);
+*       }
+*       ...
+*       MP4C__close(cache);
+*/
+
+#ifndef mp4cache_H_INCLUDED
+#define mp4cache_H_INCLUDED
+
+#include "mp4demux.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif  //__cplusplus
+
+typedef struct MP4C_cache_tag MP4C_cache_t;
+
+/*
+*   Cache parameters; zero-initialized members select defaults
+*/
+typedef struct
+{
+    // Max total size of cached demultiplexers (sample tables). Demultiplexers in use are not
+    // evicted, so the budget may be exceeded, while they are used. Default is 256 MB
+    size_t memory_budget_bytes;
+} MP4C_params_t;
+
+/*
+*   Cache counters, see MP4C__get_stats()
+*/
+typedef struct
+{
+    unsigned long long hits;        // MP4C__get() with parsed demultiplexer
+    unsigned long long misses;      // MP4C__get(), which parsed the file
+    unsigned long long evictions;   // entries, removed to fit the memory budget
+    size_t bytes;                   // total size of cached demultiplexers
+    unsigned entries;               // # of cached demultiplexers
+} MP4C_stats_t;
+
+
+/**
+*   Create the cache.
+*   params may be NULL.
+*
+*   return cache handle on success; NULL on failure
+*/
+MP4C_cache_t * MP4C__open(const MP4C_params_t * params);
+
+
+/**
+*   Get demultiplexer of the file: cached, if the file is not changed since it
+*   was parsed, or parsed with MP4D__open(). The handle must be released with
+*   MP4C__release().
+*
+*   return demultiplexer handle; NULL, if the file can't be opened or parsed
+*/
+const MP4D_demux_t * MP4C__get(MP4C_cache_t * cache, const char * path);
+
+
+/**
+*   Release demultiplexer handle, returned by MP4C__get()
+*/
+void MP4C__release(MP4C_cache_t * cache, const MP4D_demux_t * mp4);
+
+
+/**
+*   Get cache counters
+*/
+void MP4C__get_stats(MP4C_cache_t * cache, MP4C_stats_t * stats);
+
+
+/**
+*   Close all cached demultiplexers, and de-allocate the cache.
+*   All handles must be released before.
+*/
+void MP4C__close(MP4C_cache_t * cache);
+
+
+#ifdef __cplusplus
+}
+#endif //__cplusplus
+
+#endif //mp4cache_H_INCLUDED
@@ -20,6 +20,25 @@
 #ifndef mp4defs_H_INCLUDED
 #define mp4defs_H_INCLUDED
 
+#include <stddef.h>
+
+/************************************************************************/
+/*          Memory allocator interface                                  */
+/************************************************************************/
+/*
+*   Application-supplied memory allocator, used by both multiplexer and
+*   demultiplexer instead of malloc()/realloc()/free(). Functions have the
+*   same semantics as the standard ones, with extra 'context' argument.
+*   See mp4arena.h for fixed-capacity allocator, which needs no heap.
+*/
+typedef struct
+{
+    void * (*allocate)(void * context, size_t bytes);
+    void * (*reallocate)(void * context, void * ptr, size_t bytes);
+    void   (*deallocate)(void * context, void * ptr);
+    void * context;
+} MP4_allocator_t;
+
 /************************************************************************/
 /*          Some values of MP4X_track_t::object_type_indication         */
 /************************************************************************/
@@ -154,7 +173,13 @@ enum
     BOX_traf    = FOUR_CHAR_INT( 't', 'r', 'a', 'f' ),//TrackFragmentAtomType
     BOX_tfhd    = FOUR_CHAR_INT( 't', 'f', 'h', 'd' ),//TrackFragmentHeaderAtomType
     BOX_trun    = FOUR_CHAR_INT( 't', 'r', 'u', 'n' ),//TrackFragmentRunAtomType
+    BOX_tfdt    = FOUR_CHAR_INT( 't', 'f', 'd', 't' ),//TrackFragmentBaseMediaDecodeTimeBox
     BOX_mehd    = FOUR_CHAR_INT( 'm', 'e', 'h', 'd' ),//MovieExtendsHeaderBox
+    BOX_styp    = FOUR_CHAR_INT( 's', 't', 'y', 'p' ),//SegmentTypeBox
+    BOX_sidx    = FOUR_CHAR_INT( 's', 'i', 'd', 'x' ),//SegmentIndexBox
+    BOX_mfra    = FOUR_CHAR_INT( 'm', 'f', 'r', 'a' ),//MovieFragmentRandomAccessBox
+    BOX_tfra    = FOUR_CHAR_INT( 't', 'f', 'r', 'a' ),//TrackFragmentRandomAccessBox
+    BOX_mfro    = FOUR_CHAR_INT( 'm', 'f', 'r', 'o' ),//MovieFragmentRandomAccessOffsetBox
 
     // Object Descriptors (OD) data coding
     // These takes only 1 byte; this implementation translate <od_tag> to
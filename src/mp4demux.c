@@ -26,10 +26,149 @@
 #   define MP4D_TRACE(x)
 #endif
 
+// pread()-based sample read, see MP4D__read_sample()
+#ifndef MP4D_USE_PREAD
+#   if defined(__unix__) || defined(__APPLE__)
+#       define MP4D_USE_PREAD   1
+#   else
+#       define MP4D_USE_PREAD   0
+#   endif
+#endif
+
+#if MP4D_USE_PREAD
+#   include <unistd.h>  // pread
+#   include <errno.h>
+#endif
+
+// Lazy mode: samples per decoded window of the table, power of 2
+#ifndef MP4D_LAZY_WINDOW_SAMPLES
+#   define MP4D_LAZY_WINDOW_SAMPLES     1024
+#endif
+
+// Lazy mode: default number of decoded windows
+#ifndef MP4D_LAZY_DEFAULT_WINDOWS
+#   define MP4D_LAZY_DEFAULT_WINDOWS    16
+#endif
+
+// Compact mode: entries per packed block, multiple of 32
+#ifndef MP4D_PACKED_BLOCK_ENTRIES
+#   define MP4D_PACKED_BLOCK_ENTRIES    128
+#endif
+
 // Box type: ATOM box, or 'Object Descriptor' box inside the atom.
 typedef enum {BOX_ATOM, BOX_OD} mp4d_boxtype_t;
 
 
+// Lazy mode tables, decoded in windows
+enum { MP4D_LAZY_ENTRY_SIZE, MP4D_LAZY_CHUNK_OFFSET, MP4D_LAZY_TIMING };
+
+/*
+*   Lazy mode: 'stts' decoding state at the window start
+*/
+typedef struct
+{
+    unsigned entry;             // 'stts' entry
+    unsigned done;              // samples of the entry before the window
+    unsigned timestamp;         // 1st sample of the window
+} mp4d_stts_point_t;
+
+/*
+*   Lazy mode: sample table boxes of the track, read on demand
+*/
+typedef struct mp4d_lazy_track_tag
+{
+    mp4d_size_t entry_size_pos;     // 'stsz'/'stz2' entries
+    unsigned constant_size;         // 'stsz' sample_size: size of all samples, if not 0
+    unsigned field_bits;            // entry size: 32 for 'stsz'; 4, 8 or 16 for 'stz2'
+    mp4d_size_t chunk_offset_pos;   // 'stco'/'co64' entries
+    unsigned chunk_offset_bytes;    // 4 for 'stco', 8 for 'co64'
+    mp4d_size_t stts_pos;           // 'stts' entries
+    unsigned stts_count;
+    mp4d_stts_point_t * stts_point; // [point_capacity] decoding state at the start of the windows
+    unsigned point_count;           // # of known points: windows are passed in order
+    unsigned point_capacity;        // # of windows
+} mp4d_lazy_track_t;
+
+/*
+*   Lazy mode: decoded window of the table
+*/
+typedef struct
+{
+    unsigned ntrack;
+    int table;                  // MP4D_LAZY_*, or -1 if not used
+    unsigned index;             // window index: 1st entry / MP4D_LAZY_WINDOW_SAMPLES
+    unsigned last_use;
+    void * data;                // entry sizes; chunk offsets; or timestamps, followed by durations
+} mp4d_window_t;
+
+/*
+*   Lazy mode state
+*/
+typedef struct mp4d_lazy_tag
+{
+    FILE * f;
+    unsigned window_count;
+    unsigned clock;             // window use counter
+    mp4d_window_t * window;     // [window_count]
+} mp4d_lazy_t;
+
+
+/*
+*   Compact mode: block of the packed table. Entry j of the block is
+*   base + j*step + residual j; residuals are packed with the same bit width,
+*   LSB first, so the block is decoded with one loop without branches.
+*/
+typedef struct
+{
+    mp4d_size_t base;
+    unsigned step;
+    unsigned offset;            // 1st word of the residuals in bits[]
+    unsigned width;             // residual bits, 0..32
+} mp4d_packed_block_t;
+
+/*
+*   Compact mode: packed table
+*/
+typedef struct
+{
+    mp4d_packed_block_t * block;    // [(count + MP4D_PACKED_BLOCK_ENTRIES - 1)/MP4D_PACKED_BLOCK_ENTRIES]
+    uint32_t * bits;                // residuals, and padding word
+} mp4d_packed_t;
+
+/*
+*   Compact mode: packed sample tables of the track
+*/
+typedef struct mp4d_packed_track_tag
+{
+    mp4d_packed_t entry_size;
+    mp4d_packed_t timestamp;
+    mp4d_packed_t duration;
+    mp4d_packed_t chunk_offset;     // not packed, if offsets of the block do not fit 32-bit residuals
+    unsigned timing_count;          // # of samples, covered by 'stts'
+} mp4d_packed_track_t;
+
+
+/************************************************************************/
+/*      Default memory allocator                                        */
+/************************************************************************/
+static void * mp4d_default_allocate(void * context, size_t bytes)
+{
+    (void)context;
+    return malloc(bytes);
+}
+
+static void * mp4d_default_reallocate(void * context, void * ptr, size_t bytes)
+{
+    (void)context;
+    return realloc(ptr, bytes);
+}
+
+static void mp4d_default_deallocate(void * context, void * ptr)
+{
+    (void)context;
+    free(ptr);
+}
+
 /************************************************************************/
 /*      File input (non-portable) stuff                                 */
 /************************************************************************/
@@ -69,22 +208,6 @@ static unsigned mp4d_read(FILE * f, int nb, int * eof_flag)
     return v;
 }
 
-/**
-*   Read given number of bytes, but no more than *payload_bytes specifies...
-*   Used to read box payload
-*/
-static uint32_t mp4d_read_payload(FILE * f, unsigned nb, mp4d_size_t * payload_bytes, int * eof_flag)
-{
-    if (*payload_bytes < nb)
-    {
-        *eof_flag = 1;
-        nb = (int)*payload_bytes;
-    }
-    *payload_bytes -= nb;
-
-    return mp4d_read(f, nb, eof_flag);
-}
-
 /**
 *   Skips given number of bytes.
 */
@@ -102,20 +225,94 @@ static void mp4d_skip_bytes(FILE * f, mp4d_size_t skip, int * eof_flag)
     }
 }
 
+/*
+*   Parser input: the file, or memory buffer of the push parser
+*/
+typedef struct
+{
+    FILE * f;                       // file input; NULL for memory input
+    const unsigned char * data;     // memory input
+    mp4d_size_t bytes;              // memory input bytes left
+    mp4d_size_t pos;                // stream position of the next byte
+    mp4d_size_t skip;               // memory input: bytes to skip after the buffer end
+} mp4d_input_t;
+
+/**
+*   Read given number of bytes from the parser input
+*/
+static unsigned mp4d_input_read(mp4d_input_t * in, int nb, int * eof_flag)
+{
+    uint32_t v = 0;
+    in->pos += nb;
+    if (in->f)
+    {
+        return mp4d_read(in->f, nb, eof_flag);
+    }
+    while (nb-- > 0)
+    {
+        if (!in->bytes)
+        {
+            *eof_flag = 1;
+            return v;
+        }
+        v = (v << 8) | *in->data++;
+        in->bytes--;
+    }
+    return v;
+}
+
+/**
+*   Skip given number of bytes of the parser input. Memory input records
+*   the bytes after the buffer end, to be skipped by the push parser caller.
+*/
+static void mp4d_input_skip(mp4d_input_t * in, mp4d_size_t skip, int * eof_flag)
+{
+    in->pos += skip;
+    if (in->f)
+    {
+        mp4d_skip_bytes(in->f, skip, eof_flag);
+    }
+    else if (skip > in->bytes)
+    {
+        in->skip += skip - in->bytes;
+        in->data += in->bytes;
+        in->bytes = 0;
+    }
+    else
+    {
+        in->data += skip;
+        in->bytes -= skip;
+    }
+}
+
+/**
+*   Read given number of bytes, but no more than *payload_bytes specifies...
+*   Used to read box payload
+*/
+static uint32_t mp4d_read_payload(mp4d_input_t * in, unsigned nb, mp4d_size_t * payload_bytes, int * eof_flag)
+{
+    if (*payload_bytes < nb)
+    {
+        *eof_flag = 1;
+        nb = (int)*payload_bytes;
+    }
+    *payload_bytes -= nb;
+
+    return mp4d_input_read(in, nb, eof_flag);
+}
+
 
-#define READ(n) mp4d_read_payload(f, n, &payload_bytes, &eof_flag)
-#define SKIP(n) {mp4d_size_t t = payload_bytes < (n) ? payload_bytes : (n); mp4d_skip_bytes(f, t, &eof_flag); payload_bytes -= t;}
-#define MP4D_MALLOC(p, size) p = malloc(size); if (!(p)) {MP4D_ERROR("out of memory");}
-#define MP4D_REALLOC(p, size) {void * r = realloc(p, size); if (!(r)) {MP4D_ERROR("out of memory");} else p = r;};
+#define READ(n) mp4d_read_payload(in, n, &payload_bytes, &eof_flag)
+#define SKIP(n) {mp4d_size_t t = payload_bytes < (n) ? payload_bytes : (n); mp4d_input_skip(in, t, &eof_flag); payload_bytes -= t;}
+#define MP4D_MALLOC(p, size) p = mp4->allocator.allocate(mp4->allocator.context, size); if (!(p)) {MP4D_ERROR("out of memory");}
+#define MP4D_REALLOC(p, size) {void * r = mp4->allocator.reallocate(mp4->allocator.context, p, size); if (!(r)) {MP4D_ERROR("out of memory");} else p = r;};
 
 /*
-*   On error: release resources, rewind the file.
+*   On error: stop parsing; the caller releases resources, and rewinds the file.
 */
 #define MP4D_RETURN_ERROR(mess) {       \
     MP4D_TRACE(("\nMP4 ERROR: " mess)); \
-    fseek(f, 0, SEEK_SET);              \
-    MP4D__close(mp4);                   \
-    return 0;                           \
+    return MP4D_PARSE_ERROR;            \
 }
 
 /*
@@ -123,22 +320,219 @@ static void mp4d_skip_bytes(FILE * f, mp4d_size_t skip, int * eof_flag)
 */
 #define MP4D_ERROR(mess)            \
     if (!depth)                     \
-        break;                      \
+        return MP4D_PARSE_END;      \
     else                            \
         MP4D_RETURN_ERROR(mess);
 
 
 
 /************************************************************************/
-/*      Exported API functions                                          */
+/*      Fragmented file index                                           */
 /************************************************************************/
 
 /**
-*   Parse given file as MP4 file.  Allocate and store data indexes.
+*   Return track with given track_ID, or NULL
 */
-int MP4D__open(MP4D_demux_t * mp4, FILE * f)
+static MP4D_track_t * mp4d_find_track(MP4D_demux_t * mp4, unsigned track_id)
+{
+    unsigned i;
+    for (i = 0; i < mp4->track_count; i++)
+    {
+        // track_ID is track number, if 'tkhd' box is missing
+        if ((mp4->track[i].track_id ? mp4->track[i].track_id : i + 1) == track_id)
+        {
+            return mp4->track + i;
+        }
+    }
+    return NULL;
+}
+
+/**
+*   Append random access point to the track list
+*   return 1 on success, 0 if out of memory
+*/
+static int mp4d_add_random_access(MP4D_demux_t * mp4, MP4D_track_t * tr, mp4d_size_t time, mp4d_size_t moof_offset)
+{
+    unsigned n = tr->random_access_count;
+    if (!(n & (n - 1)))
+    {
+        // grow at power of 2 sizes
+        void * p = mp4->allocator.reallocate(mp4->allocator.context, tr->random_access, (n ? 2*n : 1)*sizeof(MP4D_random_access_t));
+        if (!p)
+        {
+            return 0;
+        }
+        tr->random_access = (MP4D_random_access_t *)p;
+    }
+    tr->random_access[n].time = time;
+    tr->random_access[n].moof_offset = moof_offset;
+    tr->random_access_count++;
+    return 1;
+}
+
+/**
+*   Read 32-bit or 64-bit value from the file
+*/
+static mp4d_size_t mp4d_read_u64(FILE * f, int is_64, int * eof_flag)
+{
+    mp4d_size_t v = mp4d_read(f, 4, eof_flag);
+    if (is_64)
+    {
+        v = (v << 32) | mp4d_read(f, 4, eof_flag);
+    }
+    return v;
+}
+
+/**
+*   Read random access points from 'tfra' boxes of 'mfra' box, which is
+*   found by 'mfro' box at the end of file. 
+*   return 1 on success, 0 if there is no valid 'mfra' box
+*/
+static int mp4d_read_mfra(MP4D_demux_t * mp4, FILE * f, off_t file_size)
+{
+    int eof_flag = 0;
+    mp4d_size_t mfra_bytes, box_bytes, pos;
+    off_t mfra_pos;
+
+    if (file_size < 8 + 16 || fseek(f, (long)(file_size - 16), SEEK_SET) ||
+        mp4d_read(f, 4, &eof_flag) != 16 || mp4d_read(f, 4, &eof_flag) != BOX_mfro)
+    {
+        return 0;
+    }
+    mp4d_read(f, 4, &eof_flag);             // version and flags
+    mfra_bytes = mp4d_read(f, 4, &eof_flag);
+    mfra_pos = file_size - (off_t)mfra_bytes;
+    if (eof_flag || mfra_bytes < 8 + 16 || mfra_bytes > (mp4d_size_t)file_size || fseek(f, (long)mfra_pos, SEEK_SET) ||
+        mp4d_read(f, 4, &eof_flag) != mfra_bytes || mp4d_read(f, 4, &eof_flag) != BOX_mfra)
+    {
+        return 0;
+    }
+
+    for (pos = 8; pos + 8 <= mfra_bytes && !eof_flag; pos += box_bytes)
+    {
+        uint32_t box_name;
+        if (fseek(f, (long)(mfra_pos + pos), SEEK_SET))
+        {
+            return 0;
+        }
+        box_bytes = mp4d_read(f, 4, &eof_flag);
+        box_name = mp4d_read(f, 4, &eof_flag);
+        if (box_bytes < 8 || pos + box_bytes > mfra_bytes)
+        {
+            return 0;
+        }
+        if (box_name == BOX_tfra)
+        {
+            int is_64 = (mp4d_read(f, 4, &eof_flag) >> 24) == 1;
+            MP4D_track_t * tr = mp4d_find_track(mp4, mp4d_read(f, 4, &eof_flag));
+            unsigned lengths = mp4d_read(f, 4, &eof_flag);
+            unsigned i, count = mp4d_read(f, 4, &eof_flag);
+            if (tr)
+            {
+                // replace random access points from 'sidx' boxes, if any
+                tr->random_access_count = 0;
+            }
+            for (i = 0; i < count && !eof_flag; i++)
+            {
+                mp4d_size_t time = mp4d_read_u64(f, is_64, &eof_flag);
+                mp4d_size_t moof_offset = mp4d_read_u64(f, is_64, &eof_flag);
+                mp4d_read(f, ((lengths >> 4) & 3) + 1, &eof_flag);    // traf_number
+                mp4d_read(f, ((lengths >> 2) & 3) + 1, &eof_flag);    // trun_number
+                mp4d_read(f, (lengths & 3) + 1, &eof_flag);           // sample_number
+                if (tr && !eof_flag && !mp4d_add_random_access(mp4, tr, time, moof_offset))
+                {
+                    return 0;
+                }
+            }
+        }
+    }
+    return !eof_flag;
+}
+
+
+/************************************************************************/
+/*      Box parser                                                      */
+/************************************************************************/
+
+// List of boxes, derived from 'FullBox'
+//                ~~~~~~~~~~~~~~~~~~~~~
+// need read version field and check version for these boxes
+static const struct
+{
+    uint32_t name;
+    unsigned max_version;
+    unsigned use_track_flag;
+} g_fullbox[] =
+{
+    {BOX_mdhd, 1, 1},
+    {BOX_mvhd, 1, 0},
+    {BOX_tkhd, 1, 1},
+    {BOX_sidx, 1, 0},
+    {BOX_hdlr, 0, 0},
+    {BOX_meta, 0, 0},
+    {BOX_stts, 0, 0},
+    {BOX_ctts, 0, 0},
+    {BOX_stz2, 0, 1},
+    {BOX_stsz, 0, 1},
+    {BOX_stsc, 0, 1},
+    {BOX_stco, 0, 1},
+    {BOX_co64, 0, 1},
+    {BOX_stsd, 0, 0},
+    {BOX_esds, 0, 1}    // esds does not use track, but switches to OD mode. Check here, to avoid OD check
+};
+
+// List of boxes, which contains other boxes ('envelopes')
+// Parser will descend down for boxes in this list, otherwise parsing will proceed to 
+// the next sibling box
+// OD boxes handled in the same way as atom boxes...
+static const struct
+{
+    uint32_t name;
+    mp4d_boxtype_t type;
+} g_envelope_box[] =
+{
+    {BOX_esds, BOX_OD},     // TODO: BOX_esds can be used for both audio and video, but this code supports audio only!
+    {OD_ESD,   BOX_OD},
+    {OD_DCD,   BOX_OD},
+    {OD_DSI,   BOX_OD},
+    {BOX_trak, BOX_ATOM},
+    {BOX_moov, BOX_ATOM},
+    {BOX_mdia, BOX_ATOM},
+    {BOX_tref, BOX_ATOM},
+    {BOX_minf, BOX_ATOM},
+    {BOX_dinf, BOX_ATOM},
+    {BOX_stbl, BOX_ATOM},
+    {BOX_stsd, BOX_ATOM},
+    {BOX_mp4a, BOX_ATOM},
+    {BOX_mp4s, BOX_ATOM},
+    {BOX_mp4v, BOX_ATOM},
+    {BOX_avc1, BOX_ATOM},
+    {BOX_udta, BOX_ATOM},
+    {BOX_meta, BOX_ATOM},
+    {BOX_ilst, BOX_ATOM}
+};
+
+// Boxes, which payload is read by the parser, listed in mp4d_parse_box() switch. 
+// The push parser buffers these boxes, and passes headers of other boxes only.
+static const uint32_t g_read_box[] =
+{
+    BOX_stz2, BOX_stsz, BOX_stsc, BOX_stts, BOX_ctts, BOX_stco, BOX_co64,
+    BOX_mvhd, BOX_tkhd, BOX_sidx, BOX_mdhd, BOX_hdlr, BOX_btrt,
+    BOX_calb, BOX_cART, BOX_cnam, BOX_cday, BOX_ccmt, BOX_cgen,
+    BOX_stsd, BOX_mp4s, BOX_mp4a, BOX_mp4v, BOX_avc1, BOX_avcC, BOX_esds
+};
+
+// mp4d_parse_box() status
+#define MP4D_PARSE_CONTINUE     1
+#define MP4D_PARSE_END          0   // normal exit, or broken top-level box
+#define MP4D_PARSE_ERROR       -1
+
+/*
+*   Box parser state, kept between the boxes
+*/
+typedef struct
 {
-    int depth = 0;              // box stack size
+    int depth;                  // box stack size
 
     // box stack
     struct
@@ -151,658 +545,1521 @@ int MP4D__open(MP4D_demux_t * mp4, FILE * f)
 
     } stack[MP4D_MAX_CHUNKS_DEPTH];
 
-    off_t file_size = mp4d_fsize(f);
-    int eof_flag = 0;
-    unsigned i;
-    MP4D_track_t * tr = NULL;
+    MP4D_track_t * tr;          // current track
+    mp4d_size_t file_size;      // ~0 if not known
+    int fragmented;             // flag: 'mvex' box found
+    int mfra_checked;           // flag: tried to read 'mfra' box
+    uint32_t top_box_name;      // last box at the top level
+    int probe;                  // flag: read the table entry counts only, see MP4D_params_t
+    uint32_t handler_type;      // track filter, see MP4D_params_t
+    unsigned object_type_indication;
+    uint32_t track_mask;
+    int lazy;                   // flag: record the table positions, see MP4D_params_t
+    int compact;                // flag: pack the tables after parsing, see MP4D_params_t
 
 #if MP4D_DEBUG_TRACE
     // path of current element: List0/List1/... etc
     uint32_t box_path[MP4D_MAX_CHUNKS_DEPTH];
 #endif
+} mp4d_parser_t;
 
-    if (!f || !mp4)
+/**
+*   Initialize the parser state
+*/
+static void mp4d_parser_init(mp4d_parser_t * parser, mp4d_size_t file_size)
+{
+    memset(parser, 0, sizeof(mp4d_parser_t));
+    parser->stack[0].format = BOX_ATOM;   // start with atom box
+    parser->stack[0].bytes = 0;           // never accessed
+    parser->file_size = file_size;
+}
+
+/**
+*   Set the parser options
+*/
+static void mp4d_parser_set_params(mp4d_parser_t * parser, const MP4D_params_t * params)
+{
+    if (params)
     {
-        MP4D_TRACE(("\nERROR: invlaid arguments!"));
-        return 0;
+        parser->probe = params->probe;
+        parser->handler_type = params->handler_type;
+        parser->object_type_indication = params->object_type_indication;
+        parser->track_mask = params->track_mask;
     }
+}
 
-    if (fseek(f, 0, SEEK_SET))  // some platforms missing rewind()
+/**
+*   Return 1, if sample tables of the track are not read: probe mode, or the
+*   track is not selected by the filter. Handler and object type are known at
+*   the tables: 'hdlr' and 'stsd' boxes precede them.
+*/
+static int mp4d_skip_tables(const mp4d_parser_t * parser, const MP4D_demux_t * mp4, const MP4D_track_t * tr)
+{
+    unsigned ntrack = (unsigned)(tr - mp4->track);
+    return parser->probe ||
+        (parser->handler_type && tr->handler_type != parser->handler_type) ||
+        (parser->object_type_indication && tr->object_type_indication != parser->object_type_indication) ||
+        (parser->track_mask && (ntrack >= 32 || !((parser->track_mask >> ntrack) & 1)));
+}
+
+/**
+*   Lazy mode table positions of the track
+*   return NULL, if out of memory
+*/
+static mp4d_lazy_track_t * mp4d_lazy_track(MP4D_demux_t * mp4, MP4D_track_t * tr)
+{
+    if (!tr->lazy)
     {
-        return 0;
+        tr->lazy = (mp4d_lazy_track_t *)mp4->allocator.allocate(mp4->allocator.context, sizeof(mp4d_lazy_track_t));
+        if (tr->lazy)
+        {
+            memset(tr->lazy, 0, sizeof(mp4d_lazy_track_t));
+        }
     }
+    return tr->lazy;
+}
 
-    memset(mp4, 0, sizeof(MP4D_demux_t));
-
-    stack[0].format = BOX_ATOM;   // start with atom box
-    stack[0].bytes = 0;           // never accessed
+/**
+*   Compact mode packed tables of the track
+*   return NULL, if out of memory
+*/
+static mp4d_packed_track_t * mp4d_packed_track(MP4D_demux_t * mp4, MP4D_track_t * tr)
+{
+    if (!tr->packed)
+    {
+        tr->packed = (mp4d_packed_track_t *)mp4->allocator.allocate(mp4->allocator.context, sizeof(mp4d_packed_track_t));
+        if (tr->packed)
+        {
+            memset(tr->packed, 0, sizeof(mp4d_packed_track_t));
+        }
+    }
+    return tr->packed;
+}
 
-    do
+/**
+*   Parse one box from the input: read box header, and the payload, if the 
+*   box is not an envelope; store data indexes.
+*   return MP4D_PARSE_*
+*/
+static int mp4d_parse_box(MP4D_demux_t * mp4, mp4d_parser_t * parser, mp4d_input_t * in)
+{
+    int depth = parser->depth;
+    MP4D_track_t * tr = parser->tr;
+    int eof_flag = 0;
+    unsigned i;
+    uint32_t FullAtomVersionAndFlags = 0;
+    mp4d_size_t payload_bytes;
+    mp4d_size_t box_bytes;
+    uint32_t box_name;
+    unsigned char ** ptag = NULL;
+    int read_bytes = 0;
+
+    // Read header box type and it's length
+    if (parser->stack[depth].format == BOX_ATOM)
     {
-        // List of boxes, derived from 'FullBox'
-        //                ~~~~~~~~~~~~~~~~~~~~~
-        // need read version field and check version for these boxes
-        static const struct
-        {
-            uint32_t name;
-            unsigned max_version;
-            unsigned use_track_flag;
-        } g_fullbox[] =
-        {
-            {BOX_mdhd, 1, 1},
-            {BOX_mvhd, 1, 0},
-            {BOX_hdlr, 0, 0},
-            {BOX_meta, 0, 0},
-            {BOX_stts, 0, 0},
-            {BOX_ctts, 0, 0},
-            {BOX_stz2, 0, 1},
-            {BOX_stsz, 0, 1},
-            {BOX_stsc, 0, 1},
-            {BOX_stco, 0, 1},
-            {BOX_co64, 0, 1},
-            {BOX_stsd, 0, 0},
-            {BOX_esds, 0, 1}    // esds does not use track, but switches to OD mode. Check here, to avoid OD check
-        };
-
-        // List of boxes, which contains other boxes ('envelopes')
-        // Parser will descend down for boxes in this list, otherwise parsing will proceed to 
-        // the next sibling box
-        // OD boxes handled in the same way as atom boxes...
-        static const struct
-        {
-            uint32_t name;
-            mp4d_boxtype_t type;
-        } g_envelope_box[] =
-        {
-            {BOX_esds, BOX_OD},     // TODO: BOX_esds can be used for both audio and video, but this code supports audio only!
-            {OD_ESD,   BOX_OD},
-            {OD_DCD,   BOX_OD},
-            {OD_DSI,   BOX_OD},
-            {BOX_trak, BOX_ATOM},
-            {BOX_moov, BOX_ATOM},
-            {BOX_mdia, BOX_ATOM},
-            {BOX_tref, BOX_ATOM},
-            {BOX_minf, BOX_ATOM},
-            {BOX_dinf, BOX_ATOM},
-            {BOX_stbl, BOX_ATOM},
-            {BOX_stsd, BOX_ATOM},
-            {BOX_mp4a, BOX_ATOM},
-            {BOX_mp4s, BOX_ATOM},
-            {BOX_mp4v, BOX_ATOM},
-            {BOX_avc1, BOX_ATOM},
-            {BOX_udta, BOX_ATOM},
-            {BOX_meta, BOX_ATOM},
-            {BOX_ilst, BOX_ATOM}
-        };
-
-        uint32_t FullAtomVersionAndFlags = 0;
-        mp4d_size_t payload_bytes;
-        mp4d_size_t box_bytes;
-        uint32_t box_name;
-        unsigned char ** ptag = NULL;
-        int read_bytes = 0;
+        box_bytes = mp4d_input_read(in, 4, &eof_flag);
+        if (eof_flag)
+        {
+            return MP4D_PARSE_END;  // normal exit
+        }
 
-        // Read header box type and it's length
-        if (stack[depth].format == BOX_ATOM)
+        if (box_bytes >= 2 && box_bytes < 8)
         {
-            box_bytes = mp4d_read(f, 4, &eof_flag);
-            if (eof_flag)
-            {
-                break;  // normal exit
-            }
+            MP4D_ERROR("invalid box size (broken file?)");
+        }
 
-            if (box_bytes >= 2 && box_bytes < 8)
-            {
-                MP4D_ERROR("invalid box size (broken file?)");
-            }
+        box_name  = mp4d_input_read(in, 4, &eof_flag);
+        read_bytes = 8;
 
-            box_name  = mp4d_read(f, 4, &eof_flag);
-            read_bytes = 8;
+        // Decode box size
+        if (box_bytes == 0 ||                         // standard indication of 'till eof' size
+            box_bytes == (mp4d_size_t)0xFFFFFFFFU       // some files uses non-standard 'till eof' signaling
+            )
+        {
+            box_bytes = ~(mp4d_size_t)0;
+        }
 
-            // Decode box size
-            if (box_bytes == 0 ||                         // standard indication of 'till eof' size
-                box_bytes == (mp4d_size_t)0xFFFFFFFFU       // some files uses non-standard 'till eof' signaling
-                )
+        payload_bytes = box_bytes - 8;
+
+        if (box_bytes == 1)           // 64-bit sizes
+        {
+            box_bytes = mp4d_input_read(in, 4, &eof_flag);
+            box_bytes <<= 32;
+            box_bytes |= mp4d_input_read(in, 4, &eof_flag);
+            if (box_bytes < 16)
             {
-                box_bytes = ~(mp4d_size_t)0;
+                MP4D_ERROR("invalid box size (broken file?)");
             }
+            payload_bytes = box_bytes - 16;
+        }
 
-            payload_bytes = box_bytes - 8;
-
-            if (box_bytes == 1)           // 64-bit sizes
+        // Read and check box version for some boxes
+        for (i = 0; i < sizeof(g_fullbox)/sizeof(g_fullbox[0]); i++)
+        {
+            if (box_name == g_fullbox[i].name)
             {
-                box_bytes = mp4d_read(f, 4, &eof_flag);
-                box_bytes <<= 32;
-                box_bytes |= mp4d_read(f, 4, &eof_flag);
-                if (box_bytes < 16)
+                FullAtomVersionAndFlags = READ(4);
+                read_bytes += 4;
+
+                if ((FullAtomVersionAndFlags >> 24) > g_fullbox[i].max_version)
                 {
-                    MP4D_ERROR("invalid box size (broken file?)");
+                    MP4D_ERROR("unsupported box version!");
                 }
-                payload_bytes = box_bytes - 16;
-            }
-
-            // Read and check box version for some boxes
-            for (i = 0; i < sizeof(g_fullbox)/sizeof(g_fullbox[0]); i++)
-            {
-                if (box_name == g_fullbox[i].name)
+                if (g_fullbox[i].use_track_flag && !tr)
                 {
-                    FullAtomVersionAndFlags = READ(4);
-                    read_bytes += 4;
-
-                    if ((FullAtomVersionAndFlags >> 24) > g_fullbox[i].max_version)
-                    {
-                        MP4D_ERROR("unsupported box version!");
-                    }
-                    if (g_fullbox[i].use_track_flag && !tr)
-                    {
-                        MP4D_ERROR("broken file structure!");
-                    }
+                    MP4D_ERROR("broken file structure!");
                 }
             }
         }
-        else // stack[depth].format == BOX_OD
+    }
+    else // parser->stack[depth].format == BOX_OD
+    {
+        int val;
+        box_name = OD_BASE + mp4d_input_read(in, 1, &eof_flag);     // 1-byte box type
+        read_bytes += 1;
+        if (eof_flag)
+        {
+            return MP4D_PARSE_END;
+        }
+
+        payload_bytes = 0;
+        box_bytes = 1;
+        do
         {
-            int val;
-            box_name = OD_BASE + mp4d_read(f, 1, &eof_flag);     // 1-byte box type
+            val = mp4d_input_read(in, 1, &eof_flag);
             read_bytes += 1;
             if (eof_flag)
             {
-                break;
+                MP4D_ERROR("premature EOF!");
             }
-
-            payload_bytes = 0;
-            box_bytes = 1;
-            do
-            {
-                val = mp4d_read(f, 1, &eof_flag);
-                read_bytes += 1;
-                if (eof_flag)
-                {
-                    MP4D_ERROR("premature EOF!");
-                }
-                payload_bytes = (payload_bytes << 7) | (val & 0x7F);
-                box_bytes++;
-            } while (val & 0x80);
-            box_bytes += payload_bytes;
-        }
+            payload_bytes = (payload_bytes << 7) | (val & 0x7F);
+            box_bytes++;
+        } while (val & 0x80);
+        box_bytes += payload_bytes;
+    }
 
 #if MP4D_DEBUG_TRACE
-        box_path[depth] = (box_name >> 24) | (box_name << 24) | ((box_name >> 8) & 0x0000FF00) | ((box_name << 8) & 0x00FF0000);
-        MP4D_TRACE(("%2d  %8d %.*s  (%d bytes remains for sibilings) \n", depth, (int)box_bytes, depth*4, (char*)box_path, (int)stack[depth].bytes));
+    parser->box_path[depth] = (box_name >> 24) | (box_name << 24) | ((box_name >> 8) & 0x0000FF00) | ((box_name << 8) & 0x00FF0000);
+    MP4D_TRACE(("%2d  %8d %.*s  (%d bytes remains for sibilings) \n", depth, (int)box_bytes, depth*4, (char*)parser->box_path, (int)parser->stack[depth].bytes));
 #endif
 
-        // Check that box size <= parent size
-        if (depth)
+    if (!depth)
+    {
+        parser->top_box_name = box_name;
+    }
+
+    // Check that box size <= parent size
+    if (depth)
+    {
+        // Skip box with bad size
+        assert(box_bytes > 0);
+        if (box_bytes > parser->stack[depth].bytes)
         {
-            // Skip box with bad size
-            assert(box_bytes > 0);
-            if (box_bytes > stack[depth].bytes)
-            {
-                MP4D_TRACE(("Wrong %c%c%c%c box size: broken file?\n", (box_name >> 24)&255, (box_name >> 16)&255, (box_name >> 8)&255, box_name&255));
-                box_bytes = stack[depth].bytes;
-                box_name = 0;
-                payload_bytes = box_bytes - read_bytes;
-            }
-            stack[depth].bytes -= box_bytes;
+            MP4D_TRACE(("Wrong %c%c%c%c box size: broken file?\n", (box_name >> 24)&255, (box_name >> 16)&255, (box_name >> 8)&255, box_name&255));
+            box_bytes = parser->stack[depth].bytes;
+            box_name = 0;
+            payload_bytes = box_bytes - read_bytes;
         }
+        parser->stack[depth].bytes -= box_bytes;
+    }
 
-        // Read box header
-        switch(box_name)
+    // Read box header
+    switch(box_name)
+    {
+    case BOX_stz2:  //ISO/IEC 14496-1 Page 38. Section 8.17.2 - Sample Size Box.
+    case BOX_stsz:
         {
-        case BOX_stz2:  //ISO/IEC 14496-1 Page 38. Section 8.17.2 - Sample Size Box.
-        case BOX_stsz:
+            int carry_size = 0;
+            uint32_t sample_size = READ(4);
+            tr->sample_count = READ(4);
+            if (mp4d_skip_tables(parser, mp4, tr))
+            {
+                break;
+            }
+            if (parser->lazy)
             {
-                int carry_size = 0;
-                uint32_t sample_size = READ(4);
-                tr->sample_count = READ(4);
-                MP4D_MALLOC(tr->entry_size, tr->sample_count*4);
-                for (i = 0; i < tr->sample_count; i++)
+                // entries are read on demand
+                mp4d_lazy_track_t * lazy = mp4d_lazy_track(mp4, tr);
+                if (!lazy)
                 {
-                    if (box_name == BOX_stsz)
-                    {
-                       tr->entry_size[i] = (sample_size?sample_size:READ(4));
-                    }
-                    else
+                    MP4D_ERROR("out of memory");
+                }
+                lazy->entry_size_pos = in->pos;
+                lazy->constant_size = box_name == BOX_stsz ? sample_size : 0;
+                lazy->field_bits = box_name == BOX_stsz ? 32 : (sample_size & 0xFF);
+                break;
+            }
+            MP4D_MALLOC(tr->entry_size, tr->sample_count*4);
+            for (i = 0; i < tr->sample_count; i++)
+            {
+                if (box_name == BOX_stsz)
+                {
+                   tr->entry_size[i] = (sample_size?sample_size:READ(4));
+                }
+                else
+                {
+                    switch (sample_size & 0xFF)
                     {
-                        switch (sample_size & 0xFF)
+                    case 16:
+                        tr->entry_size[i] = READ(2);
+                        break;
+                    case  8:
+                        tr->entry_size[i] = READ(1);
+                        break;
+                    case  4:
+                        if (i&1)
+                        {
+                            tr->entry_size[i] = carry_size & 15;
+                        }
+                        else
                         {
-                        case 16:
-                            tr->entry_size[i] = READ(2);
-                            break;
-                        case  8:
-                            tr->entry_size[i] = READ(1);
-                            break;
-                        case  4:
-                            if (i&1)
-                            {
-                                tr->entry_size[i] = carry_size & 15;
-                            }
-                            else
-                            {
-                                carry_size = READ(1);
-                                tr->entry_size[i] = (carry_size >> 4);
-                            }
-                            break;
+                            carry_size = READ(1);
+                            tr->entry_size[i] = (carry_size >> 4);
                         }
+                        break;
                     }
                 }
             }
-            break;
+        }
+        break;
 
-        case BOX_stsc:  //ISO/IEC 14496-12 Page 38. Section 8.18 - Sample To Chunk Box.
-            tr->sample_to_chunk_count = READ(4);
-            MP4D_MALLOC(tr->sample_to_chunk, tr->sample_to_chunk_count*sizeof(tr->sample_to_chunk[0]));
-            for (i = 0; i < tr->sample_to_chunk_count; i++)
-            {
-                tr->sample_to_chunk[i].first_chunk = READ(4);
-                tr->sample_to_chunk[i].samples_per_chunk = READ(4);
-                SKIP(4);    // sample_description_index
-            }
+    case BOX_stsc:  //ISO/IEC 14496-12 Page 38. Section 8.18 - Sample To Chunk Box.
+        if (mp4d_skip_tables(parser, mp4, tr))
+        {
             break;
+        }
+        tr->sample_to_chunk_count = READ(4);
+        MP4D_MALLOC(tr->sample_to_chunk, tr->sample_to_chunk_count*sizeof(tr->sample_to_chunk[0]));
+        for (i = 0; i < tr->sample_to_chunk_count; i++)
+        {
+            tr->sample_to_chunk[i].first_chunk = READ(4);
+            tr->sample_to_chunk[i].samples_per_chunk = READ(4);
+            SKIP(4);    // sample_description_index
+        }
+        break;
 
-        case BOX_stts:
+    case BOX_stts:
+        if (tr && !mp4d_skip_tables(parser, mp4, tr))
+        {
+            unsigned count = READ(4);
+            unsigned j, k = 0, ts = 0, ts_count = count;
+            if (parser->lazy)
             {
-                unsigned count = READ(4);
-                unsigned j, k = 0, ts = 0, ts_count = count;
-                MP4D_MALLOC(tr->timestamp, ts_count*4);
-                MP4D_MALLOC(tr->duration, ts_count*4);
-
-                for (i = 0; i < count; i++)
+                mp4d_lazy_track_t * lazy = mp4d_lazy_track(mp4, tr);
+                if (!lazy)
                 {
-                    unsigned sc = READ(4);
-                    int d =  READ(4);
-                    MP4D_TRACE(("sample %8d count %8d duration %8d\n",i,sc,d));
-                    if (k + sc > ts_count)
-                    {
-                        ts_count = k + sc;
-                        MP4D_REALLOC(tr->timestamp, ts_count * sizeof(unsigned));
-                        MP4D_REALLOC(tr->duration, ts_count * sizeof(unsigned));
-                    }
-                    for (j = 0; j < sc; j++)
-                    {
-                        tr->duration[k] = d;
-                        tr->timestamp[k++] = ts;
-                        ts += d;
-                    }
+                    MP4D_ERROR("out of memory");
                 }
+                lazy->stts_pos = in->pos;
+                lazy->stts_count = count;
+                break;
             }
-            break;
+            MP4D_MALLOC(tr->timestamp, ts_count*4);
+            MP4D_MALLOC(tr->duration, ts_count*4);
 
-        case BOX_ctts:
+            for (i = 0; i < count; i++)
             {
-                unsigned count = READ(4);
-                for (i = 0; i < count; i++)
+                unsigned sc = READ(4);
+                int d =  READ(4);
+                MP4D_TRACE(("sample %8d count %8d duration %8d\n",i,sc,d));
+                if (k + sc > ts_count)
+                {
+                    ts_count = k + sc;
+                    MP4D_REALLOC(tr->timestamp, ts_count * sizeof(unsigned));
+                    MP4D_REALLOC(tr->duration, ts_count * sizeof(unsigned));
+                }
+                for (j = 0; j < sc; j++)
                 {
-                    int sc = READ(4);
-                    int d =  READ(4);
-                    (void)sc;
-                    (void)d;
-                    MP4D_TRACE(("sample %8d count %8d decoding to composition offset %8d\n",i,sc,d));
+                    tr->duration[k] = d;
+                    tr->timestamp[k++] = ts;
+                    ts += d;
                 }
             }
-            break;
-
-        case BOX_stco:  //ISO/IEC 14496-12 Page 39. Section 8.19 - Chunk Offset Box.
-        case BOX_co64:
-            tr->chunk_count = READ(4);
-            MP4D_MALLOC(tr->chunk_offset, tr->chunk_count*sizeof(mp4d_size_t));
-            for (i = 0; i < tr->chunk_count; i++)
+            if (parser->compact)
             {
-                tr->chunk_offset[i] = READ(4);
-                if (box_name == BOX_co64)
+                // length of timestamp[] to pack: sample_count is not known yet
+                mp4d_packed_track_t * packed = mp4d_packed_track(mp4, tr);
+                if (!packed)
                 {
-                    // 64-bit chunk_offset 
-                    tr->chunk_offset[i] <<= 32;
-                    tr->chunk_offset[i] |= READ(4);
+                    MP4D_ERROR("out of memory");
                 }
+                packed->timing_count = k;
             }
-            break;
-
-        case BOX_mvhd:
-            SKIP(((FullAtomVersionAndFlags >> 24) == 1) ? 8+8 : 4+4);
-            mp4->timescale = READ(4);
-            mp4->duration_hi = ((FullAtomVersionAndFlags >> 24) == 1) ? READ(4) : 0;
-            mp4->duration_lo = READ(4);
-            SKIP(4+2+2+4*2+4*9+4*6+4);
-            break;
-
-        case BOX_mdhd:
-            SKIP(((FullAtomVersionAndFlags >> 24) == 1) ? 8+8 : 4+4);
-            tr->timescale = READ(4);
-            tr->duration_hi = ((FullAtomVersionAndFlags >> 24) == 1) ? READ(4) : 0;
-            tr->duration_lo = READ(4);
+        }
+        break;
 
+    case BOX_ctts:
+        if (tr && !mp4d_skip_tables(parser, mp4, tr) && !parser->lazy)
+        {
+            unsigned count = READ(4);
+            for (i = 0; i < count; i++)
             {
-                int ISO_639_2_T = READ(2);
-                tr->language[2] = (ISO_639_2_T & 31) + 0x60;ISO_639_2_T >>= 5;
-                tr->language[1] = (ISO_639_2_T & 31) + 0x60;ISO_639_2_T >>= 5;
-                tr->language[0] = (ISO_639_2_T & 31) + 0x60;
+                int sc = READ(4);
+                int d =  READ(4);
+                (void)sc;
+                (void)d;
+                MP4D_TRACE(("sample %8d count %8d decoding to composition offset %8d\n",i,sc,d));
             }
-            // the rest of this box is skipped by default ...
-            break;
+        }
+        break;
 
-        case BOX_hdlr:
-            if (tr) // When this box is within 'meta' box, the track may not be avaialable
-            {
-                SKIP(4);            // pre_defined
-                tr->handler_type = READ(4);
-            }
-            // typically hdlr box does not contain any useful info.
-            // the rest of this box is skipped by default ...
+    case BOX_stco:  //ISO/IEC 14496-12 Page 39. Section 8.19 - Chunk Offset Box.
+    case BOX_co64:
+        if (mp4d_skip_tables(parser, mp4, tr))
+        {
             break;
-
-        case BOX_btrt:
-            if (!tr)
+        }
+        tr->chunk_count = READ(4);
+        if (parser->lazy)
+        {
+            mp4d_lazy_track_t * lazy = mp4d_lazy_track(mp4, tr);
+            if (!lazy)
             {
-                MP4D_ERROR("broken file structure!");
+                MP4D_ERROR("out of memory");
             }
-
-            SKIP(4+4);
-            tr->avg_bitrate_bps = READ(4);
-            break;
-
-            // Set pointer to tag to be read...
-        case BOX_calb: ptag = &mp4->tag.album; break;
-        case BOX_cART: ptag = &mp4->tag.artist; break;
-        case BOX_cnam: ptag = &mp4->tag.title; break;
-        case BOX_cday: ptag = &mp4->tag.year; break;
-        case BOX_ccmt: ptag = &mp4->tag.comment; break;
-        case BOX_cgen: ptag = &mp4->tag.genre; break;
-
-        case BOX_stsd:
-            SKIP(4); // entry_count, BOX_mp4a & BOX_mp4v boxes follows immediately
+            lazy->chunk_offset_pos = in->pos;
+            lazy->chunk_offset_bytes = box_name == BOX_co64 ? 8 : 4;
             break;
-
-        case BOX_mp4s:  // private stream
-            if (!tr)
+        }
+        MP4D_MALLOC(tr->chunk_offset, tr->chunk_count*sizeof(mp4d_size_t));
+        for (i = 0; i < tr->chunk_count; i++)
+        {
+            tr->chunk_offset[i] = READ(4);
+            if (box_name == BOX_co64)
             {
-                MP4D_ERROR("broken file structure!");
+                // 64-bit chunk_offset 
+                tr->chunk_offset[i] <<= 32;
+                tr->chunk_offset[i] |= READ(4);
             }
-            SKIP(6*1+2/*Base SampleEntry*/);
-            break;
-
-        case BOX_mp4a:
-            if (!tr)
+        }
+        break;
+
+    case BOX_mvhd:
+        SKIP(((FullAtomVersionAndFlags >> 24) == 1) ? 8+8 : 4+4);
+        mp4->timescale = READ(4);
+        mp4->duration_hi = ((FullAtomVersionAndFlags >> 24) == 1) ? READ(4) : 0;
+        mp4->duration_lo = READ(4);
+        SKIP(4+2+2+4*2+4*9+4*6+4);
+        break;
+
+    case BOX_tkhd:
+        SKIP(((FullAtomVersionAndFlags >> 24) == 1) ? 8+8 : 4+4);
+        tr->track_id = READ(4);
+        break;
+
+    case BOX_mvex:
+        parser->fragmented = 1;
+        break;
+
+    case BOX_moof:
+        if (!depth && parser->fragmented && !parser->mfra_checked && in->f)
+        {
+            // movie fragments follow: random access index at the end of file
+            // makes scanning of fragments unnecessary
+            long pos = ftell(in->f);
+            parser->mfra_checked = 1;
+            if (mp4d_read_mfra(mp4, in->f, (off_t)parser->file_size) || fseek(in->f, pos, SEEK_SET))
             {
-                MP4D_ERROR("broken file structure!");
+                eof_flag = 1;   // index is read: stop here
             }
-            SKIP(6*1+2/*Base SampleEntry*/  + 4*2);
-            tr->SampleDescription.audio.channelcount = READ(2);
-            SKIP(2/*samplesize*/ + 2 + 2);
-            tr->SampleDescription.audio.samplerate_hz = READ(4) >> 16;
-            break;
+        }
+        break;
 
-        // vvvvvvvvvvvvv AVC support vvvvvvvvvvvvv
-        case BOX_avc1:  // AVCSampleEntry extends VisualSampleEntry 
-//         case BOX_avc2:   - no test
-//         case BOX_svc1:   - no test
-        case BOX_mp4v:
-            if (!tr)
+    case BOX_sidx:  // ISO/IEC 14496-12 Section 8.16.3 - Segment Index Box
+        {
+            int is_64 = (FullAtomVersionAndFlags >> 24) == 1;
+            unsigned reference_id = READ(4);
+            MP4D_track_t * ref_tr = mp4d_find_track(mp4, reference_id);
+            mp4d_size_t time, offset;
+            unsigned count;
+            SKIP(4);    // timescale
+            time = READ(4);
+            if (is_64)
             {
-                MP4D_ERROR("broken file structure!");
+                time = (time << 32) | READ(4);
             }
-            SKIP(6*1 + 2/*Base SampleEntry*/ + 2 + 2 + 4*3);
-            tr->SampleDescription.video.width = READ(2);
-            tr->SampleDescription.video.height = READ(2);
-            // frame_count is always 1
-            // compressorname is rarely set..
-            SKIP(4 + 4 + 4 + 2/*frame_count*/ + 32/*compressorname*/ + 2 + 2);
-            // ^^^ end of VisualSampleEntry 
-            // now follows for BOX_avc1:
-            //      BOX_avcC
-            //      BOX_btrt (optional)
-            //      BOX_m4ds (optional)
-            // for BOX_mp4v:
-            //      BOX_esds        
-            break;
-        
-        case BOX_avcC:  // AVCDecoderConfigurationRecord()
-            // hack: AAC-specific DSI field reused (for it have same purpose as sps/pps)
-            // TODO: check this hack if BOX_esds co-exist with BOX_avcC 
-            tr->object_type_indication = MP4_OBJECT_TYPE_AVC;
-            tr->dsi = malloc((size_t)box_bytes);
-            tr->dsi_bytes = (unsigned)box_bytes;
+            offset = READ(4);
+            if (is_64)
             {
-                int spspps;
-                unsigned char * p = tr->dsi;
-                unsigned int configurationVersion = READ(1);
-                unsigned int AVCProfileIndication = READ(1);
-                unsigned int profile_compatibility = READ(1);
-                unsigned int AVCLevelIndication = READ(1);
-                //bit(6) reserved = 111111b;
-                unsigned int lengthSizeMinusOne = READ(1) & 3;
-                
-                (void)configurationVersion;
-                (void)AVCProfileIndication;
-                (void)profile_compatibility;
-                (void)AVCLevelIndication;
-                (void)lengthSizeMinusOne;
-                for (spspps = 0; spspps < 2; spspps++)
-                {
-                    unsigned int numOfSequenceParameterSets= READ(1);
-                    if (!spspps)
-                    {
-                         numOfSequenceParameterSets &= 31;  // clears 3 msb for SPS
-                    }
-                    *p++ = numOfSequenceParameterSets;
-                    for (i=0; i< numOfSequenceParameterSets; i++) {
-                        unsigned k, sequenceParameterSetLength  = READ(2);
-                        *p++ = sequenceParameterSetLength >> 8;
-                        *p++ = sequenceParameterSetLength ;
-                        for (k = 0; k < sequenceParameterSetLength ; k++)
-                        {
-                            *p++ = READ(1);
-                        }
-                    }
-                }
+                offset = (offset << 32) | READ(4);
             }
-            break;
-        // ^^^^^^^^^^^^^ AVC support ^^^^^^^^^^^^^
-
-        case OD_ESD:
+            SKIP(2);    // reserved
+            count = READ(2);
+            // first_offset is counted from the end of the box
+            offset += in->pos + payload_bytes;
+            for (i = 0; i < count && ref_tr && !eof_flag; i++)
             {
-                unsigned flags = READ(3);   // ES_ID(2) + flags(1)
-
-                if (flags & 0x80)       // steamdependflag
+                unsigned referenced_size = READ(4);
+                unsigned duration = READ(4);
+                SKIP(4);    // SAP
+                if (!(referenced_size >> 31) && !mp4d_add_random_access(mp4, ref_tr, time, offset))
                 {
-                    SKIP(2);            // dependsOnESID
+                    MP4D_ERROR("out of memory");
                 }
-                if (flags & 0x40)       // urlflag
-                {
-                    unsigned bytecount = READ(1);
-                    SKIP(bytecount);    // skip URL
-                }
-                if (flags & 0x20)       // ocrflag (was reserved in MPEG-4 v.1)
-                {
-                    SKIP(2);            // OCRESID
-                }
-                break;
+                time += duration;
+                offset += referenced_size & 0x7FFFFFFF;
             }
+        }
+        break;
 
-        case OD_DCD:        //ISO/IEC 14496-1 Page 28. Section 8.6.5 - DecoderConfigDescriptor.
-            assert(tr);     // ensured by g_fullbox[] check
-            tr->object_type_indication = READ(1);
-            tr->stream_type = READ(1) >> 2;
-            SKIP(3/*bufferSizeDB*/ + 4/*maxBitrate*/);
-            tr->avg_bitrate_bps = READ(4);
-            break;
-
-        case OD_DSI:        //ISO/IEC 14496-1 Page 28. Section 8.6.5 - DecoderConfigDescriptor.
-            assert(tr);     // ensured by g_fullbox[] check
-            if (!tr->dsi && payload_bytes)
-            {
-                MP4D_MALLOC(tr->dsi, (int)payload_bytes);
-                for (i = 0; i < payload_bytes; i++)
-                {
-                    tr->dsi[i] = mp4d_read(f, 1, &eof_flag);    // These bytes available due to check above
-                }
-                tr->dsi_bytes = i;
-                payload_bytes -= i;
-                break;
-            }
+    case BOX_mdhd:
+        SKIP(((FullAtomVersionAndFlags >> 24) == 1) ? 8+8 : 4+4);
+        tr->timescale = READ(4);
+        tr->duration_hi = ((FullAtomVersionAndFlags >> 24) == 1) ? READ(4) : 0;
+        tr->duration_lo = READ(4);
 
-        default:
-            MP4D_TRACE(("[%c%c%c%c]  %d\n", box_name>>24, box_name>>16, box_name>>8, box_name, (int)payload_bytes));
+        {
+            int ISO_639_2_T = READ(2);
+            tr->language[2] = (ISO_639_2_T & 31) + 0x60;ISO_639_2_T >>= 5;
+            tr->language[1] = (ISO_639_2_T & 31) + 0x60;ISO_639_2_T >>= 5;
+            tr->language[0] = (ISO_639_2_T & 31) + 0x60;
         }
+        // the rest of this box is skipped by default ...
+        break;
 
-        // Read tag is tag pointer is set
-        if (ptag && !*ptag && payload_bytes > 16)
+    case BOX_hdlr:
+        if (tr) // When this box is within 'meta' box, the track may not be avaialable
         {
-            SKIP(4+4+4+4);
-            MP4D_MALLOC(*ptag, (unsigned)payload_bytes + 1);
-            for (i = 0; payload_bytes != 0; i++)
-            {
-                (*ptag)[i] = READ(1);
-            }
-            (*ptag)[i] = 0; // zero-terminated string
+            SKIP(4);            // pre_defined
+            tr->handler_type = READ(4);
         }
+        // typically hdlr box does not contain any useful info.
+        // the rest of this box is skipped by default ...
+        break;
 
-        if (box_name == BOX_trak)
+    case BOX_btrt:
+        if (!tr)
         {
-            // New track found: allocate memory using realloc()
-            // Typically there are 1 audio track for AAC audio file,
-            // 4 tracks for movie file,
-            // 3-5 tracks for scalable audio (CELP+AAC)
-            // and up to 50 tracks for BSAC scalable audio
-            MP4D_REALLOC(mp4->track, (mp4->track_count + 1)*sizeof(MP4D_track_t));
-            tr = mp4->track + mp4->track_count++;
-            memset(tr, 0, sizeof(MP4D_track_t));
+            MP4D_ERROR("broken file structure!");
         }
-        else if (box_name == BOX_meta)
+
+        SKIP(4+4);
+        tr->avg_bitrate_bps = READ(4);
+        break;
+
+        // Set pointer to tag to be read...
+    case BOX_calb: ptag = &mp4->tag.album; break;
+    case BOX_cART: ptag = &mp4->tag.artist; break;
+    case BOX_cnam: ptag = &mp4->tag.title; break;
+    case BOX_cday: ptag = &mp4->tag.year; break;
+    case BOX_ccmt: ptag = &mp4->tag.comment; break;
+    case BOX_cgen: ptag = &mp4->tag.genre; break;
+
+    case BOX_stsd:
+        SKIP(4); // entry_count, BOX_mp4a & BOX_mp4v boxes follows immediately
+        break;
+
+    case BOX_mp4s:  // private stream
+        if (!tr)
         {
-            tr = NULL;  // Avoid update of 'hdlr' box, which may contains in the 'meta' box
+            MP4D_ERROR("broken file structure!");
         }
+        SKIP(6*1+2/*Base SampleEntry*/);
+        break;
 
-        // If this box is envelope, save it's size in box stack
-        for (i = 0; i < sizeof(g_envelope_box)/sizeof(g_envelope_box[0]); i++)
+    case BOX_mp4a:
+        if (!tr)
+        {
+            MP4D_ERROR("broken file structure!");
+        }
+        SKIP(6*1+2/*Base SampleEntry*/  + 4*2);
+        tr->SampleDescription.audio.channelcount = READ(2);
+        SKIP(2/*samplesize*/ + 2 + 2);
+        tr->SampleDescription.audio.samplerate_hz = READ(4) >> 16;
+        break;
+
+    // vvvvvvvvvvvvv AVC support vvvvvvvvvvvvv
+    case BOX_avc1:  // AVCSampleEntry extends VisualSampleEntry 
+//         case BOX_avc2:   - no test
+//         case BOX_svc1:   - no test
+    case BOX_mp4v:
+        if (!tr)
+        {
+            MP4D_ERROR("broken file structure!");
+        }
+        SKIP(6*1 + 2/*Base SampleEntry*/ + 2 + 2 + 4*3);
+        tr->SampleDescription.video.width = READ(2);
+        tr->SampleDescription.video.height = READ(2);
+        // frame_count is always 1
+        // compressorname is rarely set..
+        SKIP(4 + 4 + 4 + 2/*frame_count*/ + 32/*compressorname*/ + 2 + 2);
+        // ^^^ end of VisualSampleEntry 
+        // now follows for BOX_avc1:
+        //      BOX_avcC
+        //      BOX_btrt (optional)
+        //      BOX_m4ds (optional)
+        // for BOX_mp4v:
+        //      BOX_esds        
+        break;
+    
+    case BOX_avcC:  // AVCDecoderConfigurationRecord()
+        // hack: AAC-specific DSI field reused (for it have same purpose as sps/pps)
+        // TODO: check this hack if BOX_esds co-exist with BOX_avcC 
+        tr->object_type_indication = MP4_OBJECT_TYPE_AVC;
+        MP4D_MALLOC(tr->dsi, (size_t)box_bytes);
+        tr->dsi_bytes = (unsigned)box_bytes;
         {
-            if (box_name == g_envelope_box[i].name)
+            int spspps;
+            unsigned char * p = tr->dsi;
+            unsigned int configurationVersion = READ(1);
+            unsigned int AVCProfileIndication = READ(1);
+            unsigned int profile_compatibility = READ(1);
+            unsigned int AVCLevelIndication = READ(1);
+            //bit(6) reserved = 111111b;
+            unsigned int lengthSizeMinusOne = READ(1) & 3;
+            
+            (void)configurationVersion;
+            (void)AVCProfileIndication;
+            (void)profile_compatibility;
+            (void)AVCLevelIndication;
+            (void)lengthSizeMinusOne;
+            for (spspps = 0; spspps < 2; spspps++)
             {
-                if (++depth >= MP4D_MAX_CHUNKS_DEPTH)
+                unsigned int numOfSequenceParameterSets= READ(1);
+                if (!spspps)
                 {
-                    MP4D_ERROR("too deep atoms nesting!");
+                     numOfSequenceParameterSets &= 31;  // clears 3 msb for SPS
                 }
-                stack[depth].bytes = payload_bytes;
-                stack[depth].format = g_envelope_box[i].type;
-                break;
+                *p++ = numOfSequenceParameterSets;
+                for (i=0; i< numOfSequenceParameterSets; i++) {
+                    unsigned k, sequenceParameterSetLength  = READ(2);
+                    *p++ = sequenceParameterSetLength >> 8;
+                    *p++ = sequenceParameterSetLength ;
+                    for (k = 0; k < sequenceParameterSetLength ; k++)
+                    {
+                        *p++ = READ(1);
+                    }
+                }
+            }
+        }
+        break;
+    // ^^^^^^^^^^^^^ AVC support ^^^^^^^^^^^^^
+
+    case OD_ESD:
+        {
+            unsigned flags = READ(3);   // ES_ID(2) + flags(1)
+
+            if (flags & 0x80)       // steamdependflag
+            {
+                SKIP(2);            // dependsOnESID
+            }
+            if (flags & 0x40)       // urlflag
+            {
+                unsigned bytecount = READ(1);
+                SKIP(bytecount);    // skip URL
             }
+            if (flags & 0x20)       // ocrflag (was reserved in MPEG-4 v.1)
+            {
+                SKIP(2);            // OCRESID
+            }
+            break;
         }
 
-        // if box is not envelope, just skip it
-        if (i == sizeof(g_envelope_box)/sizeof(g_envelope_box[0]))
+    case OD_DCD:        //ISO/IEC 14496-1 Page 28. Section 8.6.5 - DecoderConfigDescriptor.
+        assert(tr);     // ensured by g_fullbox[] check
+        tr->object_type_indication = READ(1);
+        tr->stream_type = READ(1) >> 2;
+        SKIP(3/*bufferSizeDB*/ + 4/*maxBitrate*/);
+        tr->avg_bitrate_bps = READ(4);
+        break;
+
+    case OD_DSI:        //ISO/IEC 14496-1 Page 28. Section 8.6.5 - DecoderConfigDescriptor.
+        assert(tr);     // ensured by g_fullbox[] check
+        if (!tr->dsi && payload_bytes)
         {
-            if (payload_bytes > file_size)
+            MP4D_MALLOC(tr->dsi, (int)payload_bytes);
+            for (i = 0; i < payload_bytes; i++)
             {
-                eof_flag = 1;
+                tr->dsi[i] = mp4d_input_read(in, 1, &eof_flag);    // These bytes available due to check above
             }
-            else
+            tr->dsi_bytes = i;
+            payload_bytes -= i;
+            break;
+        }
+
+    default:
+        MP4D_TRACE(("[%c%c%c%c]  %d\n", box_name>>24, box_name>>16, box_name>>8, box_name, (int)payload_bytes));
+    }
+
+    // Read tag is tag pointer is set
+    if (ptag && !*ptag && payload_bytes > 16)
+    {
+        SKIP(4+4+4+4);
+        MP4D_MALLOC(*ptag, (unsigned)payload_bytes + 1);
+        for (i = 0; payload_bytes != 0; i++)
+        {
+            (*ptag)[i] = READ(1);
+        }
+        (*ptag)[i] = 0; // zero-terminated string
+    }
+
+    if (box_name == BOX_trak)
+    {
+        // New track found: allocate memory using realloc()
+        // Typically there are 1 audio track for AAC audio file,
+        // 4 tracks for movie file,
+        // 3-5 tracks for scalable audio (CELP+AAC)
+        // and up to 50 tracks for BSAC scalable audio
+        MP4D_REALLOC(mp4->track, (mp4->track_count + 1)*sizeof(MP4D_track_t));
+        tr = mp4->track + mp4->track_count++;
+        memset(tr, 0, sizeof(MP4D_track_t));
+    }
+    else if (box_name == BOX_meta)
+    {
+        tr = NULL;  // Avoid update of 'hdlr' box, which may contains in the 'meta' box
+    }
+
+    // If this box is envelope, save it's size in box stack
+    for (i = 0; i < sizeof(g_envelope_box)/sizeof(g_envelope_box[0]); i++)
+    {
+        if (box_name == g_envelope_box[i].name)
+        {
+            if (++depth >= MP4D_MAX_CHUNKS_DEPTH)
             {
-                SKIP(payload_bytes);
+                MP4D_ERROR("too deep atoms nesting!");
             }
+            parser->stack[depth].bytes = payload_bytes;
+            parser->stack[depth].format = g_envelope_box[i].type;
+            break;
         }
+    }
 
-        // remove empty boxes from stack
-        // don't touch box with index 0 (which indicates whole file)
-        while (depth > 0 && !stack[depth].bytes)
+    // if box is not envelope, just skip it
+    if (i == sizeof(g_envelope_box)/sizeof(g_envelope_box[0]))
+    {
+        if (payload_bytes > parser->file_size)
         {
-            depth--;
+            eof_flag = 1;
         }
+        else
+        {
+            SKIP(payload_bytes);
+        }
+    }
 
-    } while(!eof_flag);
+    // remove empty boxes from stack
+    // don't touch box with index 0 (which indicates whole file)
+    while (depth > 0 && !parser->stack[depth].bytes)
+    {
+        depth--;
+    }
 
-    if (!mp4->track_count)
+    if (parser->probe && !depth && parser->top_box_name == BOX_moov)
     {
-        MP4D_RETURN_ERROR("no tracks found");
+        eof_flag = 1;   // probe: 'moov' box is read
     }
-    fseek(f, 0, SEEK_SET);
-    return 1;
+
+    parser->depth = depth;
+    parser->tr = tr;
+    return eof_flag ? MP4D_PARSE_END : MP4D_PARSE_CONTINUE;
 }
 
+
+/************************************************************************/
+/*      Lazy sample tables                                              */
+/************************************************************************/
+
 /**
-*   Find chunk, containing given sample.
-*   Returns chunk number, and first sample in this chunk.
+*   Allocate the windows, and 'stts' decoding state of the tracks
+*   return 0, if out of memory
 */
-static int mp4d_sample_to_chunk(MP4D_track_t * tr, unsigned nsample, unsigned * nfirst_sample_in_chunk)
+static int mp4d_lazy_init(MP4D_demux_t * mp4, FILE * f, unsigned window_count)
 {
-    unsigned chunk_group = 0, nc;
-    unsigned sum = 0;
-    *nfirst_sample_in_chunk = 0;
-    if (tr->chunk_count <= 1)
+    mp4d_lazy_t * lazy;
+    unsigned i;
+    if (!window_count)
+    {
+        window_count = MP4D_LAZY_DEFAULT_WINDOWS;
+    }
+    lazy = (mp4d_lazy_t *)mp4->allocator.allocate(mp4->allocator.context, sizeof(mp4d_lazy_t));
+    if (!lazy)
+    {
+        return 0;
+    }
+    memset(lazy, 0, sizeof(mp4d_lazy_t));
+    mp4->lazy = lazy;
+    lazy->f = f;
+    lazy->window = (mp4d_window_t *)mp4->allocator.allocate(mp4->allocator.context, window_count*sizeof(mp4d_window_t));
+    if (!lazy->window)
     {
         return 0;
     }
-    for (nc = 0; nc < tr->chunk_count; nc++)
+    memset(lazy->window, 0, window_count*sizeof(mp4d_window_t));
+    lazy->window_count = window_count;
+    for (i = 0; i < window_count; i++)
+    {
+        lazy->window[i].table = -1;
+    }
+    for (i = 0; i < mp4->track_count; i++)
     {
-        if (chunk_group+1 < tr->sample_to_chunk_count     // stuck at last entry till EOF
-            && nc + 1 ==    // Chunks counted starting with '1'
-               tr->sample_to_chunk[chunk_group+1].first_chunk)    // next group?
+        MP4D_track_t * tr = mp4->track + i;
+        mp4d_lazy_track_t * lt = tr->lazy;
+        if (lt && lt->stts_count && tr->sample_count)
         {
-            chunk_group++;
+            // state at the start of the 1st window; next ones are recorded, when passed
+            lt->point_capacity = (tr->sample_count + MP4D_LAZY_WINDOW_SAMPLES - 1) / MP4D_LAZY_WINDOW_SAMPLES;
+            lt->stts_point = (mp4d_stts_point_t *)mp4->allocator.allocate(mp4->allocator.context, lt->point_capacity*sizeof(mp4d_stts_point_t));
+            if (!lt->stts_point)
+            {
+                return 0;
+            }
+            memset(lt->stts_point, 0, sizeof(mp4d_stts_point_t));
+            lt->point_count = 1;
         }
+    }
+    return 1;
+}
+
+/**
+*   Read table bytes from given file position
+*   return 1 on success
+*/
+static int mp4d_lazy_read(const mp4d_lazy_t * lazy, mp4d_size_t pos, void * buf, size_t bytes)
+{
+    return !fseek(lazy->f, (long)pos, SEEK_SET) && fread(buf, 1, bytes, lazy->f) == bytes;
+}
 
-        sum += tr->sample_to_chunk[chunk_group].samples_per_chunk;
-        if (nsample < sum)
+/**
+*   Decode entry sizes of the window. Entries are read into the window
+*   buffer, and expanded in place, starting from the last one.
+*/
+static int mp4d_lazy_entry_size(const mp4d_lazy_t * lazy, const mp4d_lazy_track_t * lt, unsigned first, unsigned count, unsigned * data)
+{
+    const unsigned char * p = (const unsigned char *)data;
+    unsigned i = count;
+    if (!mp4d_lazy_read(lazy, lt->entry_size_pos + ((mp4d_size_t)first*lt->field_bits >> 3), data, ((size_t)count*lt->field_bits + 7) >> 3))
+    {
+        return 0;
+    }
+    while (i-- > 0)
+    {
+        switch (lt->field_bits)
         {
-            return nc;
+        case 32:
+            data[i] = ((unsigned)p[4*i] << 24) | ((unsigned)p[4*i + 1] << 16) | ((unsigned)p[4*i + 2] << 8) | p[4*i + 3];
+            break;
+        case 16:
+            data[i] = ((unsigned)p[2*i] << 8) | p[2*i + 1];
+            break;
+        case 8:
+            data[i] = p[i];
+            break;
+        case 4:
+            // first is even: window size is even
+            data[i] = (i & 1) ? (p[i >> 1] & 15) : (p[i >> 1] >> 4);
+            break;
+        default:
+            return 0;
         }
-
-        // TODO: this can be calculated once per file
-        *nfirst_sample_in_chunk = sum;
     }
-    return -1;
+    return 1;
 }
 
 /**
-*   Return position and size for given sample from given track.
+*   Decode chunk offsets of the window
 */
-mp4d_size_t MP4D__frame_offset(const MP4D_demux_t * mp4, unsigned ntrack, unsigned nsample, unsigned * frame_bytes, unsigned * timestamp, unsigned * duration)
+static int mp4d_lazy_chunk_offset(const mp4d_lazy_t * lazy, const mp4d_lazy_track_t * lt, unsigned first, unsigned count, mp4d_size_t * data)
 {
-    MP4D_track_t * tr = mp4->track + ntrack;
-    unsigned ns;
-    int nchunk = mp4d_sample_to_chunk(tr, nsample, &ns);
-    mp4d_size_t offset;
-
-    if (nchunk < 0)
+    const unsigned char * p = (const unsigned char *)data;
+    unsigned i = count, k, bytes = lt->chunk_offset_bytes;
+    if (!mp4d_lazy_read(lazy, lt->chunk_offset_pos + (mp4d_size_t)first*bytes, data, (size_t)count*bytes))
     {
-        *frame_bytes = 0;
         return 0;
     }
-
-    offset = tr->chunk_offset[nchunk];
-    for (;ns < nsample; ns++)
+    while (i-- > 0)
     {
-        offset += tr->entry_size[ns];
+        mp4d_size_t v = 0;
+        for (k = 0; k < bytes; k++)
+        {
+            v = (v << 8) | p[i*bytes + k];
+        }
+        data[i] = v;
     }
+    return 1;
+}
 
-    *frame_bytes = tr->entry_size[ns];
-
-    if (timestamp)
+/**
+*   Decode timestamps and durations of the window: data[] is followed by
+*   data[MP4D_LAZY_WINDOW_SAMPLES + ...]. 'stts' is run-length coded, so the
+*   entries are walked from the nearest known window start, and the state
+*   at the start of passed windows is recorded.
+*/
+static int mp4d_lazy_timing(const mp4d_lazy_t * lazy, mp4d_lazy_track_t * lt, unsigned sample_count, unsigned index, unsigned * data)
+{
+    unsigned k, n, end, sc = 0, d = 0;
+    int eof_flag = 0;
+    mp4d_stts_point_t p;
+    memset(data, 0, 2*MP4D_LAZY_WINDOW_SAMPLES*sizeof(unsigned));
+    if (!lt->point_count)
     {
-        *timestamp = tr->timestamp[ns];
+        // no 'stts' box
+        return 1;
     }
-    if (duration)
+    k = index < lt->point_count ? index : lt->point_count - 1;
+    p = lt->stts_point[k];
+    n = k*MP4D_LAZY_WINDOW_SAMPLES;
+    end = (index + 1)*MP4D_LAZY_WINDOW_SAMPLES;
+    if (end > sample_count)
     {
-        *duration = tr->duration[ns];
+        end = sample_count;
     }
-
-    return offset;
+    if (p.entry < lt->stts_count)
+    {
+        if (fseek(lazy->f, (long)(lt->stts_pos + (mp4d_size_t)p.entry*8), SEEK_SET))
+        {
+            return 0;
+        }
+        sc = mp4d_read(lazy->f, 4, &eof_flag);
+        d = mp4d_read(lazy->f, 4, &eof_flag);
+    }
+    while (n < end && !eof_flag)
+    {
+        unsigned step = (n / MP4D_LAZY_WINDOW_SAMPLES + 1)*MP4D_LAZY_WINDOW_SAMPLES - n;
+        if (p.done == sc)
+        {
+            if (++p.entry >= lt->stts_count)
+            {
+                // samples, not covered by 'stts', have zero time
+                break;
+            }
+            p.done = 0;
+            sc = mp4d_read(lazy->f, 4, &eof_flag);
+            d = mp4d_read(lazy->f, 4, &eof_flag);
+            continue;
+        }
+        if (step > sc - p.done)
+        {
+            step = sc - p.done;
+        }
+        if (step > end - n)
+        {
+            step = end - n;
+        }
+        if (n >= index*MP4D_LAZY_WINDOW_SAMPLES)
+        {
+            unsigned j, i = n - index*MP4D_LAZY_WINDOW_SAMPLES;
+            for (j = 0; j < step; j++)
+            {
+                data[i + j] = p.timestamp + j*d;
+                data[MP4D_LAZY_WINDOW_SAMPLES + i + j] = d;
+            }
+        }
+        p.timestamp += step*d;
+        p.done += step;
+        n += step;
+        if (!(n % MP4D_LAZY_WINDOW_SAMPLES) && n / MP4D_LAZY_WINDOW_SAMPLES == lt->point_count && lt->point_count < lt->point_capacity)
+        {
+            lt->stts_point[lt->point_count++] = p;
+        }
+    }
+    return !eof_flag;
 }
 
 /**
-*   De-allocated memory
+*   Return decoded window of the table, containing given entry: from the
+*   window cache, or read from the file in place of least recently used one
+*   return NULL on error
 */
-void MP4D__close(MP4D_demux_t * mp4)
+static void * mp4d_lazy_window(const MP4D_demux_t * mp4, unsigned ntrack, int table, unsigned nentry)
 {
-#define FREE(x) if (x) {free(x); x = NULL;}
-    while (mp4->track_count)
+    mp4d_lazy_t * lazy = mp4->lazy;
+    const MP4D_track_t * tr = mp4->track + ntrack;
+    mp4d_window_t * w = lazy->window, * victim = lazy->window;
+    unsigned i, index = nentry / MP4D_LAZY_WINDOW_SAMPLES, first = index*MP4D_LAZY_WINDOW_SAMPLES, count;
+    int ok;
+
+    lazy->clock++;
+    for (i = 0; i < lazy->window_count; i++, w++)
     {
-        MP4D_track_t *tr = mp4->track + --mp4->track_count;
-        FREE(tr->entry_size);
-        FREE(tr->timestamp);
-        FREE(tr->duration);
+        if (w->table == table && w->ntrack == ntrack && w->index == index)
+        {
+            w->last_use = lazy->clock;
+            return w->data;
+        }
+        if (w->last_use < victim->last_use)
+        {
+            victim = w;
+        }
+    }
+    if (!victim->data)
+    {
+        // largest window: chunk offsets, or timestamps and durations
+        victim->data = mp4->allocator.allocate(mp4->allocator.context, MP4D_LAZY_WINDOW_SAMPLES*sizeof(mp4d_size_t));
+        if (!victim->data)
+        {
+            return NULL;
+        }
+    }
+    count = (table == MP4D_LAZY_CHUNK_OFFSET ? tr->chunk_count : tr->sample_count) - first;
+    if (count > MP4D_LAZY_WINDOW_SAMPLES)
+    {
+        count = MP4D_LAZY_WINDOW_SAMPLES;
+    }
+    switch (table)
+    {
+    case MP4D_LAZY_ENTRY_SIZE:
+        ok = mp4d_lazy_entry_size(lazy, tr->lazy, first, count, (unsigned *)victim->data);
+        break;
+    case MP4D_LAZY_CHUNK_OFFSET:
+        ok = mp4d_lazy_chunk_offset(lazy, tr->lazy, first, count, (mp4d_size_t *)victim->data);
+        break;
+    default:
+        ok = mp4d_lazy_timing(lazy, tr->lazy, tr->sample_count, index, (unsigned *)victim->data);
+        break;
+    }
+    victim->table = ok ? table : -1;
+    victim->ntrack = ntrack;
+    victim->index = index;
+    victim->last_use = ok ? lazy->clock : 0;
+    return ok ? victim->data : NULL;
+}
+
+
+/************************************************************************/
+/*      Compact sample tables                                           */
+/************************************************************************/
+
+/**
+*   Return entry i of the packed table: O(1)
+*/
+static mp4d_size_t mp4d_packed_get(const mp4d_packed_t * p, unsigned i)
+{
+    const mp4d_packed_block_t * b = p->block + i / MP4D_PACKED_BLOCK_ENTRIES;
+    unsigned j = i % MP4D_PACKED_BLOCK_ENTRIES, bit = j*b->width;
+    const uint32_t * w = p->bits + b->offset + (bit >> 5);
+    uint64_t v;
+    if (!b->width)
+    {
+        return b->base + (mp4d_size_t)j*b->step;
+    }
+    v = (((uint64_t)w[1] << 32) | w[0]) >> (bit & 31);
+    return b->base + (mp4d_size_t)j*b->step + (v & (0xFFFFFFFFu >> (32 - b->width)));
+}
+
+/**
+*   Return sum of count entries of the packed table, starting from first.
+*   Base and step of the block are summed in closed form, and residuals in
+*   the loop, which compiler may vectorize.
+*/
+static mp4d_size_t mp4d_packed_sum(const mp4d_packed_t * p, unsigned first, unsigned count)
+{
+    mp4d_size_t sum = 0;
+    while (count)
+    {
+        const mp4d_packed_block_t * b = p->block + first / MP4D_PACKED_BLOCK_ENTRIES;
+        unsigned j = first % MP4D_PACKED_BLOCK_ENTRIES, n = MP4D_PACKED_BLOCK_ENTRIES - j, k;
+        if (n > count)
+        {
+            n = count;
+        }
+        // sum of base + k*step for k in [j, j + n)
+        sum += (mp4d_size_t)n*b->base + (mp4d_size_t)b->step*((mp4d_size_t)n*j + (mp4d_size_t)n*(n - 1)/2);
+        if (b->width)
+        {
+            const uint32_t * w = p->bits + b->offset;
+            uint32_t mask = 0xFFFFFFFFu >> (32 - b->width);
+            for (k = j; k < j + n; k++)
+            {
+                unsigned bit = k*b->width;
+                sum += ((((uint64_t)w[(bit >> 5) + 1] << 32) | w[bit >> 5]) >> (bit & 31)) & mask;
+            }
+        }
+        first += n;
+        count -= n;
+    }
+    return sum;
+}
+
+/**
+*   Pack the table of 32-bit (v32) or 64-bit (v64) entries
+*   return 0 if out of memory, or 64-bit residuals do not fit 32 bits
+*/
+static int mp4d_pack(MP4D_demux_t * mp4, mp4d_packed_t * p, const unsigned * v32, const mp4d_size_t * v64, unsigned count)
+{
+#define MP4D_PACKED_VALUE(i) (v32 ? (mp4d_size_t)v32[i] : v64[i])
+    unsigned nblock, words = 0, i, j;
+    mp4d_packed_block_t * b;
+
+    nblock = (count + MP4D_PACKED_BLOCK_ENTRIES - 1) / MP4D_PACKED_BLOCK_ENTRIES;
+    p->block = (mp4d_packed_block_t *)mp4->allocator.allocate(mp4->allocator.context, (nblock ? nblock : 1)*sizeof(mp4d_packed_block_t));
+    if (!p->block)
+    {
+        return 0;
+    }
+    for (i = 0, b = p->block; i < nblock; i++, b++)
+    {
+        unsigned first = i*MP4D_PACKED_BLOCK_ENTRIES, n = count - first;
+        mp4d_size_t step, max = 0;
+        if (n > MP4D_PACKED_BLOCK_ENTRIES)
+        {
+            n = MP4D_PACKED_BLOCK_ENTRIES;
+        }
+        // step is the min difference of increasing entries, or 0
+        step = 0xFFFFFFFFu;
+        for (j = 1; j < n && step; j++)
+        {
+            mp4d_size_t x = MP4D_PACKED_VALUE(first + j - 1), y = MP4D_PACKED_VALUE(first + j);
+            step = y < x ? 0 : (y - x < step ? y - x : step);
+        }
+        b->step = n > 1 ? (unsigned)step : 0;
+        b->base = MP4D_PACKED_VALUE(first);
+        for (j = 1; j < n; j++)
+        {
+            mp4d_size_t x = MP4D_PACKED_VALUE(first + j) - (mp4d_size_t)j*b->step;
+            b->base = x < b->base ? x : b->base;
+        }
+        for (j = 0; j < n; j++)
+        {
+            mp4d_size_t r = MP4D_PACKED_VALUE(first + j) - (mp4d_size_t)j*b->step - b->base;
+            max = r > max ? r : max;
+        }
+        if (max >> 32)
+        {
+            return 0;
+        }
+        for (b->width = 0; max >> b->width; b->width++) {}
+        b->offset = words;
+        words += MP4D_PACKED_BLOCK_ENTRIES/32*b->width;
+    }
+    p->bits = (uint32_t *)mp4->allocator.allocate(mp4->allocator.context, (words + 1)*sizeof(uint32_t));
+    if (!p->bits)
+    {
+        return 0;
+    }
+    memset(p->bits, 0, (words + 1)*sizeof(uint32_t));
+    for (i = 0; i < count; i++)
+    {
+        b = p->block + i / MP4D_PACKED_BLOCK_ENTRIES;
+        j = i % MP4D_PACKED_BLOCK_ENTRIES;
+        if (b->width)
+        {
+            unsigned bit = j*b->width;
+            uint32_t * w = p->bits + b->offset + (bit >> 5);
+            uint64_t r = (uint64_t)(MP4D_PACKED_VALUE(i) - (mp4d_size_t)j*b->step - b->base) << (bit & 31);
+            w[0] |= (uint32_t)r;
+            w[1] |= (uint32_t)(r >> 32);
+        }
+    }
+    return 1;
+#undef MP4D_PACKED_VALUE
+}
+
+/**
+*   Free the packed table
+*/
+static void mp4d_packed_free(MP4D_demux_t * mp4, mp4d_packed_t * p)
+{
+    if (p->block)
+    {
+        mp4->allocator.deallocate(mp4->allocator.context, p->block);
+    }
+    if (p->bits)
+    {
+        mp4->allocator.deallocate(mp4->allocator.context, p->bits);
+    }
+    p->block = NULL;
+    p->bits = NULL;
+}
+
+/**
+*   Replace the sample tables of the parsed tracks with packed ones
+*   return 0 if out of memory
+*/
+static int mp4d_pack_tables(MP4D_demux_t * mp4)
+{
+    unsigned i;
+    for (i = 0; i < mp4->track_count; i++)
+    {
+        MP4D_track_t * tr = mp4->track + i;
+        mp4d_packed_track_t * packed;
+        if (!tr->entry_size || !tr->chunk_offset)
+        {
+            // no tables: probe mode, filtered track, or broken file
+            continue;
+        }
+        packed = mp4d_packed_track(mp4, tr);
+        if (!packed || !mp4d_pack(mp4, &packed->entry_size, tr->entry_size, NULL, tr->sample_count))
+        {
+            return 0;
+        }
+        mp4->allocator.deallocate(mp4->allocator.context, tr->entry_size);
+        tr->entry_size = NULL;
+        if (tr->timestamp)
+        {
+            if (!mp4d_pack(mp4, &packed->timestamp, tr->timestamp, NULL, packed->timing_count) ||
+                !mp4d_pack(mp4, &packed->duration, tr->duration, NULL, packed->timing_count))
+            {
+                return 0;
+            }
+            mp4->allocator.deallocate(mp4->allocator.context, tr->timestamp);
+            mp4->allocator.deallocate(mp4->allocator.context, tr->duration);
+            tr->timestamp = NULL;
+            tr->duration = NULL;
+        }
+        if (mp4d_pack(mp4, &packed->chunk_offset, NULL, tr->chunk_offset, tr->chunk_count))
+        {
+            mp4->allocator.deallocate(mp4->allocator.context, tr->chunk_offset);
+            tr->chunk_offset = NULL;
+        }
+        else
+        {
+            // keep the array
+            mp4d_packed_free(mp4, &packed->chunk_offset);
+        }
+    }
+    return 1;
+}
+
+
+/************************************************************************/
+/*      Exported API functions                                          */
+/************************************************************************/
+
+/**
+*   Initialize empty demultiplexer
+*/
+static void mp4d_init(MP4D_demux_t * mp4, const MP4D_params_t * params)
+{
+    static const MP4_allocator_t default_allocator = 
+    {
+        mp4d_default_allocate, mp4d_default_reallocate, mp4d_default_deallocate, NULL
+    };
+    memset(mp4, 0, sizeof(MP4D_demux_t));
+    mp4->allocator = (params && params->allocator) ? *params->allocator : default_allocator;
+}
+
+/**
+*   Parse given file as MP4 file.  Allocate and store data indexes.
+*/
+int MP4D__open(MP4D_demux_t * mp4, FILE * f)
+{
+    return MP4D__open_ex(mp4, f, NULL);
+}
+
+/**
+*   Parse given file as MP4 file, with extended parameters.
+*/
+int MP4D__open_ex(MP4D_demux_t * mp4, FILE * f, const MP4D_params_t * params)
+{
+    mp4d_parser_t parser;
+    mp4d_input_t input;
+    int status;
+
+    if (!f || !mp4)
+    {
+        MP4D_TRACE(("\nERROR: invlaid arguments!"));
+        return 0;
+    }
+
+    if (fseek(f, 0, SEEK_SET))  // some platforms missing rewind()
+    {
+        return 0;
+    }
+
+    mp4d_init(mp4, params);
+    mp4d_parser_init(&parser, (mp4d_size_t)mp4d_fsize(f));
+    mp4d_parser_set_params(&parser, params);
+    parser.lazy = params && params->lazy && !params->probe;
+    parser.compact = params && params->compact && !parser.lazy;
+    memset(&input, 0, sizeof(input));
+    input.f = f;
+    do
+    {
+        status = mp4d_parse_box(mp4, &parser, &input);
+    } while (status == MP4D_PARSE_CONTINUE);
+
+    if (status != MP4D_PARSE_ERROR && parser.lazy && !mp4d_lazy_init(mp4, f, params->lazy_window_count))
+    {
+        status = MP4D_PARSE_ERROR;
+    }
+    if (status != MP4D_PARSE_ERROR && parser.compact && !mp4d_pack_tables(mp4))
+    {
+        status = MP4D_PARSE_ERROR;
+    }
+    if (status == MP4D_PARSE_ERROR || !mp4->track_count)
+    {
+        MP4D_TRACE(("\nMP4 ERROR: no tracks found"));
+        fseek(f, 0, SEEK_SET);
+        MP4D__close(mp4);
+        return 0;
+    }
+    fseek(f, 0, SEEK_SET);
+    return 1;
+}
+
+/**
+*   Find chunk, containing given sample.
+*   Returns chunk number, and first sample in this chunk.
+*   Chunks of the 'stsc' entry have the same number of samples, so the
+*   entries are walked, not the chunks.
+*/
+static int mp4d_sample_to_chunk(const MP4D_track_t * tr, unsigned nsample, unsigned * nfirst_sample_in_chunk)
+{
+    unsigned chunk_group = 0, nc = 0;
+    mp4d_size_t sum = 0;
+    *nfirst_sample_in_chunk = 0;
+    if (tr->chunk_count <= 1 || !tr->sample_to_chunk_count)
+    {
+        return 0;
+    }
+    // Chunks counted starting with '1'; 1st entry is used from chunk 0 in any case
+    if (tr->sample_to_chunk_count > 1 && tr->sample_to_chunk[1].first_chunk == 1)
+    {
+        chunk_group = 1;
+    }
+    for (;;)
+    {
+        unsigned end = tr->chunk_count, spc = tr->sample_to_chunk[chunk_group].samples_per_chunk;
+        mp4d_size_t group_samples;
+        if (chunk_group + 1 < tr->sample_to_chunk_count)    // stuck at last entry till EOF
+        {
+            unsigned next = tr->sample_to_chunk[chunk_group + 1].first_chunk - 1;
+            if (next > nc && next < end)
+            {
+                end = next;
+            }
+        }
+        group_samples = (mp4d_size_t)(end - nc)*spc;
+        if (nsample < sum + group_samples)
+        {
+            unsigned k = (unsigned)((nsample - sum) / spc);
+            *nfirst_sample_in_chunk = (unsigned)(sum + (mp4d_size_t)k*spc);
+            return nc + k;
+        }
+        sum += group_samples;
+        if (end == tr->chunk_count)
+        {
+            // entry, which does not end before the last chunk: no more groups
+            *nfirst_sample_in_chunk = (unsigned)sum;
+            return -1;
+        }
+        nc = end;
+        chunk_group++;
+    }
+}
+
+/**
+*   MP4D__frame_offset() in lazy mode: read the tables through the window cache
+*/
+static mp4d_size_t mp4d_lazy_frame_offset(const MP4D_demux_t * mp4, unsigned ntrack, unsigned nsample, unsigned * frame_bytes, unsigned * timestamp, unsigned * duration)
+{
+    const MP4D_track_t * tr = mp4->track + ntrack;
+    const mp4d_lazy_track_t * lt = tr->lazy;
+    const unsigned * entry_size;
+    const mp4d_size_t * chunk_offset;
+    unsigned ns;
+    int nchunk = mp4d_sample_to_chunk(tr, nsample, &ns);
+    mp4d_size_t offset;
+
+    *frame_bytes = 0;
+    if (nchunk < 0 || !tr->chunk_count || nsample >= tr->sample_count || !lt->field_bits || !lt->chunk_offset_bytes)
+    {
+        return 0;
+    }
+    chunk_offset = (const mp4d_size_t *)mp4d_lazy_window(mp4, ntrack, MP4D_LAZY_CHUNK_OFFSET, nchunk);
+    if (!chunk_offset)
+    {
+        return 0;
+    }
+    offset = chunk_offset[nchunk % MP4D_LAZY_WINDOW_SAMPLES];
+    if (lt->constant_size)
+    {
+        offset += (mp4d_size_t)(nsample - ns)*lt->constant_size;
+    }
+    while (!lt->constant_size && ns < nsample)
+    {
+        // preceding samples of the chunk, window by window
+        unsigned end = (ns / MP4D_LAZY_WINDOW_SAMPLES + 1)*MP4D_LAZY_WINDOW_SAMPLES;
+        entry_size = (const unsigned *)mp4d_lazy_window(mp4, ntrack, MP4D_LAZY_ENTRY_SIZE, ns);
+        if (!entry_size)
+        {
+            return 0;
+        }
+        for (; ns < nsample && ns < end; ns++)
+        {
+            offset += entry_size[ns % MP4D_LAZY_WINDOW_SAMPLES];
+        }
+    }
+    if (lt->constant_size)
+    {
+        *frame_bytes = lt->constant_size;
+    }
+    else
+    {
+        entry_size = (const unsigned *)mp4d_lazy_window(mp4, ntrack, MP4D_LAZY_ENTRY_SIZE, nsample);
+        if (!entry_size)
+        {
+            return 0;
+        }
+        *frame_bytes = entry_size[nsample % MP4D_LAZY_WINDOW_SAMPLES];
+    }
+
+    if (timestamp || duration)
+    {
+        const unsigned * timing = (const unsigned *)mp4d_lazy_window(mp4, ntrack, MP4D_LAZY_TIMING, nsample);
+        unsigned i = nsample % MP4D_LAZY_WINDOW_SAMPLES;
+        if (timestamp)
+        {
+            *timestamp = timing ? timing[i] : 0;
+        }
+        if (duration)
+        {
+            *duration = timing ? timing[MP4D_LAZY_WINDOW_SAMPLES + i] : 0;
+        }
+    }
+    return offset;
+}
+
+/**
+*   MP4D__frame_offset() in compact mode
+*/
+static mp4d_size_t mp4d_packed_frame_offset(const MP4D_track_t * tr, unsigned nsample, unsigned * frame_bytes, unsigned * timestamp, unsigned * duration)
+{
+    const mp4d_packed_track_t * packed = tr->packed;
+    unsigned ns;
+    int nchunk = mp4d_sample_to_chunk(tr, nsample, &ns);
+    mp4d_size_t offset;
+
+    *frame_bytes = 0;
+    if (nchunk < 0 || !tr->chunk_count || nsample >= tr->sample_count || !packed->entry_size.block)
+    {
+        return 0;
+    }
+    offset = tr->chunk_offset ? tr->chunk_offset[nchunk] : mp4d_packed_get(&packed->chunk_offset, nchunk);
+    offset += mp4d_packed_sum(&packed->entry_size, ns, nsample - ns);
+    *frame_bytes = (unsigned)mp4d_packed_get(&packed->entry_size, nsample);
+    if (timestamp)
+    {
+        *timestamp = nsample < packed->timing_count ? (unsigned)mp4d_packed_get(&packed->timestamp, nsample) : 0;
+    }
+    if (duration)
+    {
+        *duration = nsample < packed->timing_count ? (unsigned)mp4d_packed_get(&packed->duration, nsample) : 0;
+    }
+    return offset;
+}
+
+/**
+*   Return position and size for given sample from given track.
+*/
+mp4d_size_t MP4D__frame_offset(const MP4D_demux_t * mp4, unsigned ntrack, unsigned nsample, unsigned * frame_bytes, unsigned * timestamp, unsigned * duration)
+{
+    const MP4D_track_t * tr = mp4->track + ntrack;
+    unsigned ns;
+    int nchunk;
+    mp4d_size_t offset;
+
+    if (mp4->lazy && tr->lazy)
+    {
+        return mp4d_lazy_frame_offset(mp4, ntrack, nsample, frame_bytes, timestamp, duration);
+    }
+    if (tr->packed && tr->packed->entry_size.block)
+    {
+        return mp4d_packed_frame_offset(tr, nsample, frame_bytes, timestamp, duration);
+    }
+    nchunk = mp4d_sample_to_chunk(tr, nsample, &ns);
+    if (nchunk < 0 || !tr->chunk_count || !tr->entry_size)
+    {
+        // no such sample, or tables are not read (probe)
+        *frame_bytes = 0;
+        return 0;
+    }
+
+    offset = tr->chunk_offset[nchunk];
+    for (;ns < nsample; ns++)
+    {
+        offset += tr->entry_size[ns];
+    }
+
+    *frame_bytes = tr->entry_size[ns];
+
+    if (timestamp)
+    {
+        *timestamp = tr->timestamp[ns];
+    }
+    if (duration)
+    {
+        *duration = tr->duration[ns];
+    }
+
+    return offset;
+}
+
+#if MP4D_USE_PREAD
+/**
+*   Read sample data at given position with pread(): file position is not used
+*/
+int MP4D__read_sample(const MP4D_demux_t * mp4, int fd, unsigned ntrack, unsigned nsample, void * buf, unsigned buf_bytes, unsigned * frame_bytes, unsigned * timestamp, unsigned * duration)
+{
+    unsigned char * p = (unsigned char *)buf;
+    mp4d_size_t offset;
+    unsigned bytes, done = 0;
+    if (!mp4 || !frame_bytes || ntrack >= mp4->track_count || nsample >= mp4->track[ntrack].sample_count)
+    {
+        return 0;
+    }
+    offset = MP4D__frame_offset(mp4, ntrack, nsample, &bytes, timestamp, duration);
+    *frame_bytes = bytes;
+    if (bytes > buf_bytes || (bytes && !buf))
+    {
+        return 0;
+    }
+    while (done < bytes)
+    {
+        ssize_t n = pread(fd, p + done, bytes - done, (off_t)(offset + done));
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return 0;
+        }
+        done += (unsigned)n;
+    }
+    return 1;
+}
+#endif
+
+/**
+*   De-allocated memory
+*/
+void MP4D__close(MP4D_demux_t * mp4)
+{
+#define FREE(x) if (x) {mp4->allocator.deallocate(mp4->allocator.context, x); x = NULL;}
+    while (mp4->track_count)
+    {
+        MP4D_track_t *tr = mp4->track + --mp4->track_count;
+        FREE(tr->entry_size);
+        FREE(tr->timestamp);
+        FREE(tr->duration);
         FREE(tr->sample_to_chunk);
         FREE(tr->chunk_offset);
         FREE(tr->dsi);
+        FREE(tr->random_access);
+        if (tr->lazy)
+        {
+            FREE(tr->lazy->stts_point);
+            FREE(tr->lazy);
+        }
+        if (tr->packed)
+        {
+            mp4d_packed_free(mp4, &tr->packed->entry_size);
+            mp4d_packed_free(mp4, &tr->packed->timestamp);
+            mp4d_packed_free(mp4, &tr->packed->duration);
+            mp4d_packed_free(mp4, &tr->packed->chunk_offset);
+            FREE(tr->packed);
+        }
+    }
+    if (mp4->lazy)
+    {
+        while (mp4->lazy->window && mp4->lazy->window_count)
+        {
+            mp4d_window_t * w = mp4->lazy->window + --mp4->lazy->window_count;
+            FREE(w->data);
+        }
+        FREE(mp4->lazy->window);
+        FREE(mp4->lazy);
     }
     FREE(mp4->track);
     FREE(mp4->tag.title);
@@ -813,6 +2070,554 @@ void MP4D__close(MP4D_demux_t * mp4)
     FREE(mp4->tag.genre);
 }
 
+/**
+*   Find random access point at or before given time
+*/
+int MP4D__seek_fragment(const MP4D_demux_t * mp4, unsigned ntrack, mp4d_size_t time, mp4d_size_t * moof_offset, mp4d_size_t * ra_time)
+{
+    const MP4D_track_t * tr;
+    unsigned lo = 0, hi;
+    if (!mp4 || ntrack >= mp4->track_count || !mp4->track[ntrack].random_access_count)
+    {
+        return 0;
+    }
+    tr = mp4->track + ntrack;
+    // binary search for the last point with time <= given time
+    hi = tr->random_access_count;
+    while (hi - lo > 1)
+    {
+        unsigned mid = (lo + hi) / 2;
+        if (tr->random_access[mid].time <= time)
+        {
+            lo = mid;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    *moof_offset = tr->random_access[lo].moof_offset;
+    if (ra_time)
+    {
+        *ra_time = tr->random_access[lo].time;
+    }
+    return 1;
+}
+
+/**
+*   Read big-endian value from memory
+*/
+static mp4d_size_t mp4d_get(const unsigned char * p, int nb)
+{
+    mp4d_size_t v = 0;
+    while (nb--)
+    {
+        v = (v << 8) | *p++;
+    }
+    return v;
+}
+
+/**
+*   Parse 'traf' box in memory, and append samples of given track to the fragment
+*   return 1 on success, 0 on broken box or out of memory
+*/
+static int mp4d_read_traf(MP4D_demux_t * mp4, const unsigned char * traf, mp4d_size_t traf_bytes, unsigned track_id, MP4D_fragment_t * fragment)
+{
+    mp4d_size_t pos, base_offset = fragment->moof_offset, data_offset = 0, time = 0;
+    unsigned default_duration = 0, default_size = 0, default_flags = 0;
+    int track_found = 0, data_offset_known = 0;
+
+    for (pos = 8; pos + 12 <= traf_bytes; pos += mp4d_get(traf + pos, 4))
+    {
+        const unsigned char * box = traf + pos, * p = box + 12;
+        mp4d_size_t box_bytes = mp4d_get(box, 4);
+        uint32_t box_name = (uint32_t)mp4d_get(box + 4, 4);
+        unsigned flags = (unsigned)mp4d_get(box + 8, 4) & 0xFFFFFF;
+        int version = box[8];
+        if (box_bytes < 12 || pos + box_bytes > traf_bytes)
+        {
+            return 0;
+        }
+        if (box_name == BOX_tfhd)   // ISO/IEC 14496-12 Section 8.8.7 - Track Fragment Header Box
+        {
+            unsigned need = 4 + ((flags & 0x01) ? 8 : 0) + ((flags & 0x02) ? 4 : 0) + 
+                            ((flags & 0x08) ? 4 : 0) + ((flags & 0x10) ? 4 : 0) + ((flags & 0x20) ? 4 : 0);
+            if (12 + need > box_bytes)
+            {
+                return 0;
+            }
+            if (mp4d_get(p, 4) != track_id)
+            {
+                return 1;   // other track
+            }
+            track_found = 1;
+            p += 4;
+            if (flags & 0x01)
+            {
+                base_offset = mp4d_get(p, 8);
+                p += 8;
+            }
+            if (flags & 0x02)
+            {
+                p += 4;     // sample_description_index
+            }
+            if (flags & 0x08)
+            {
+                default_duration = (unsigned)mp4d_get(p, 4);
+                p += 4;
+            }
+            if (flags & 0x10)
+            {
+                default_size = (unsigned)mp4d_get(p, 4);
+                p += 4;
+            }
+            if (flags & 0x20)
+            {
+                default_flags = (unsigned)mp4d_get(p, 4);
+            }
+        }
+        else if (box_name == BOX_tfdt && track_found)
+        {
+            if (12 + (version == 1 ? 8 : 4) > box_bytes)
+            {
+                return 0;
+            }
+            time = mp4d_get(p, version == 1 ? 8 : 4);
+        }
+        else if (box_name == BOX_trun && track_found)  // ISO/IEC 14496-12 Section 8.8.8 - Track Fragment Run Box
+        {
+            unsigned i, count, first_flags = 0, entry_bytes;
+            mp4d_size_t header_bytes = 12 + 4 + ((flags & 0x01) ? 4 : 0) + ((flags & 0x04) ? 4 : 0);
+            entry_bytes = ((flags & 0x100) ? 4 : 0) + ((flags & 0x200) ? 4 : 0) + ((flags & 0x400) ? 4 : 0) + ((flags & 0x800) ? 4 : 0);
+            if (header_bytes > box_bytes)
+            {
+                return 0;
+            }
+            count = (unsigned)mp4d_get(p, 4);
+            p += 4;
+            if ((mp4d_size_t)count*entry_bytes > box_bytes - header_bytes)
+            {
+                return 0;
+            }
+            if (flags & 0x01)
+            {
+                data_offset = base_offset + (mp4d_size_t)(int32_t)mp4d_get(p, 4);
+                data_offset_known = 1;
+                p += 4;
+            }
+            else if (!data_offset_known)
+            {
+                data_offset = base_offset;
+                data_offset_known = 1;
+            }
+            if (flags & 0x04)
+            {
+                first_flags = (unsigned)mp4d_get(p, 4);
+                p += 4;
+            }
+            if (fragment->sample_count + count > fragment->capacity)
+            {
+                unsigned capacity = fragment->sample_count + count;
+                void * r = mp4->allocator.reallocate(mp4->allocator.context, fragment->sample, capacity*sizeof(MP4D_fragment_sample_t));
+                if (!r)
+                {
+                    return 0;
+                }
+                fragment->sample = (MP4D_fragment_sample_t *)r;
+                fragment->capacity = capacity;
+            }
+            for (i = 0; i < count; i++)
+            {
+                MP4D_fragment_sample_t * sample = fragment->sample + fragment->sample_count++;
+                unsigned sample_flags = (i == 0 && (flags & 0x04)) ? first_flags : default_flags;
+                sample->duration = default_duration;
+                sample->bytes = default_size;
+                sample->composition_offset = 0;
+                if (flags & 0x100)
+                {
+                    sample->duration = (unsigned)mp4d_get(p, 4);
+                    p += 4;
+                }
+                if (flags & 0x200)
+                {
+                    sample->bytes = (unsigned)mp4d_get(p, 4);
+                    p += 4;
+                }
+                if (flags & 0x400)
+                {
+                    sample_flags = (unsigned)mp4d_get(p, 4);
+                    p += 4;
+                }
+                if (flags & 0x800)
+                {
+                    sample->composition_offset = (int32_t)mp4d_get(p, 4);
+                    p += 4;
+                }
+                sample->offset = data_offset;
+                sample->timestamp = time;
+                // sample_is_non_sync_sample flag
+                sample->random_access = !(sample_flags & 0x10000);
+                data_offset += sample->bytes;
+                time += sample->duration;
+            }
+        }
+    }
+    return 1;
+}
+
+/**
+*   Read samples of given track from the movie fragment
+*/
+int MP4D__read_fragment(MP4D_demux_t * mp4, FILE * f, mp4d_size_t offset, unsigned ntrack, MP4D_fragment_t * fragment)
+{
+    off_t file_size;
+    mp4d_size_t box_bytes, pos;
+    uint32_t box_name;
+    unsigned char * moof;
+    unsigned track_id;
+    int eof_flag = 0, ok = 1;
+
+    if (!mp4 || !f || !fragment || ntrack >= mp4->track_count)
+    {
+        return 0;
+    }
+    file_size = mp4d_fsize(f);
+    track_id = mp4->track[ntrack].track_id ? mp4->track[ntrack].track_id : ntrack + 1;
+    fragment->sample_count = 0;
+
+    // skip boxes before 'moof' box
+    for (;;)
+    {
+        if (offset + 8 > (mp4d_size_t)file_size || fseek(f, (long)offset, SEEK_SET))
+        {
+            return 0;
+        }
+        box_bytes = mp4d_read(f, 4, &eof_flag);
+        box_name = mp4d_read(f, 4, &eof_flag);
+        if (box_bytes == 1)
+        {
+            box_bytes = mp4d_read_u64(f, 1, &eof_flag);
+        }
+        if (eof_flag || box_bytes < 8)
+        {
+            return 0;
+        }
+        if (box_name == BOX_moof)
+        {
+            break;
+        }
+        offset += box_bytes;
+    }
+
+    // read whole 'moof' box: it holds sample tables only
+    if (offset + box_bytes > (mp4d_size_t)file_size || box_bytes != (size_t)box_bytes ||
+        !(moof = (unsigned char *)mp4->allocator.allocate(mp4->allocator.context, (size_t)box_bytes)))
+    {
+        return 0;
+    }
+    if (fseek(f, (long)offset, SEEK_SET) || fread(moof, 1, (size_t)box_bytes, f) != (size_t)box_bytes)
+    {
+        ok = 0;
+    }
+    fragment->moof_offset = offset;
+    for (pos = 8; ok && pos + 8 <= box_bytes; pos += mp4d_get(moof + pos, 4))
+    {
+        mp4d_size_t traf_bytes = mp4d_get(moof + pos, 4);
+        if (traf_bytes < 8 || pos + traf_bytes > box_bytes)
+        {
+            ok = 0;
+        }
+        else if (mp4d_get(moof + pos + 4, 4) == BOX_traf)
+        {
+            ok = mp4d_read_traf(mp4, moof + pos, traf_bytes, track_id, fragment);
+        }
+    }
+    mp4->allocator.deallocate(mp4->allocator.context, moof);
+
+    // next fragment follows 'mdat' box
+    fragment->next_offset = offset + box_bytes;
+    if (ok && fragment->next_offset + 8 <= (mp4d_size_t)file_size && !fseek(f, (long)fragment->next_offset, SEEK_SET))
+    {
+        box_bytes = mp4d_read(f, 4, &eof_flag);
+        box_name = mp4d_read(f, 4, &eof_flag);
+        if (box_bytes == 1)
+        {
+            box_bytes = mp4d_read_u64(f, 1, &eof_flag);
+        }
+        if (!eof_flag && box_name == BOX_mdat)
+        {
+            // 'mdat' till the end of file
+            fragment->next_offset = box_bytes ? fragment->next_offset + box_bytes : (mp4d_size_t)file_size;
+        }
+    }
+    return ok;
+}
+
+/**
+*   Release fragment memory
+*/
+void MP4D__free_fragment(MP4D_demux_t * mp4, MP4D_fragment_t * fragment)
+{
+    if (fragment->sample)
+    {
+        mp4->allocator.deallocate(mp4->allocator.context, fragment->sample);
+    }
+    memset(fragment, 0, sizeof(MP4D_fragment_t));
+}
+
+/************************************************************************/
+/*      Push parser                                                     */
+/************************************************************************/
+
+struct MP4D_feed_tag
+{
+    MP4D_demux_t * mp4;
+    mp4d_parser_t parser;
+    mp4d_size_t offset;             // stream position of the next byte to parse
+    unsigned char * buf;            // incomplete box header, or box to be read
+    size_t buf_bytes;
+    size_t buf_capacity;
+    int status;                     // MP4D_FEED_END or MP4D_FEED_ERROR, when parsing is stopped
+    int box_done;                   // flag: top-level box is parsed, and not reported yet
+};
+
+/**
+*   Return 1 if box payload is read by the parser
+*/
+static int mp4d_is_read_box(uint32_t box_name)
+{
+    unsigned i;
+    for (i = 0; i < sizeof(g_read_box)/sizeof(g_read_box[0]); i++)
+    {
+        if (box_name == g_read_box[i])
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+*   Return number of bytes, which the parser needs to parse the next box:
+*   the whole box, if its payload is read, or box header only. Return value
+*   greater than available bytes, if header is not complete.
+*/
+static size_t mp4d_feed_need(const mp4d_parser_t * parser, const unsigned char * p, size_t bytes)
+{
+    mp4d_size_t box_bytes, parent_bytes = parser->depth ? parser->stack[parser->depth].bytes : ~(mp4d_size_t)0;
+    size_t header_bytes = 8;
+    uint32_t box_name;
+    unsigned i;
+
+    if (parser->stack[parser->depth].format == BOX_OD)
+    {
+        // OD boxes are parsed with the parent box
+        return parent_bytes == (size_t)parent_bytes ? (size_t)parent_bytes : ~(size_t)0;
+    }
+    if (bytes < 8)
+    {
+        return 8;
+    }
+    box_bytes = mp4d_get(p, 4);
+    box_name = (uint32_t)mp4d_get(p + 4, 4);
+    if (box_bytes == 1)
+    {
+        header_bytes = 16;
+        if (bytes < 16)
+        {
+            return 16;
+        }
+        box_bytes = mp4d_get(p + 8, 8);
+    }
+    for (i = 0; i < sizeof(g_fullbox)/sizeof(g_fullbox[0]); i++)
+    {
+        if (box_name == g_fullbox[i].name)
+        {
+            header_bytes += 4;
+        }
+    }
+    if (box_bytes > parent_bytes)
+    {
+        box_bytes = parent_bytes;   // broken box is skipped
+    }
+    else if (mp4d_is_read_box(box_name) && box_bytes >= header_bytes && box_bytes != 0xFFFFFFFFU && 
+             box_bytes == (size_t)box_bytes)
+    {
+        return (size_t)box_bytes;
+    }
+    return header_bytes;
+}
+
+/**
+*   Grow the buffer to given size
+*   return 1 on success, 0 if out of memory
+*/
+static int mp4d_feed_reserve(MP4D_feed_t * feed, size_t bytes)
+{
+    if (bytes > feed->buf_capacity)
+    {
+        MP4D_demux_t * mp4 = feed->mp4;
+        void * p = mp4->allocator.reallocate(mp4->allocator.context, feed->buf, bytes);
+        if (!p)
+        {
+            return 0;
+        }
+        feed->buf = (unsigned char *)p;
+        feed->buf_capacity = bytes;
+    }
+    return 1;
+}
+
+/**
+*   Start push parser
+*/
+MP4D_feed_t * MP4D__feed_open(MP4D_demux_t * mp4, const MP4D_params_t * params)
+{
+    MP4D_feed_t * feed;
+    if (!mp4)
+    {
+        return NULL;
+    }
+    mp4d_init(mp4, params);
+    feed = (MP4D_feed_t *)mp4->allocator.allocate(mp4->allocator.context, sizeof(MP4D_feed_t));
+    if (feed)
+    {
+        memset(feed, 0, sizeof(MP4D_feed_t));
+        feed->mp4 = mp4;
+        mp4d_parser_init(&feed->parser, ~(mp4d_size_t)0);
+        mp4d_parser_set_params(&feed->parser, params);
+    }
+    return feed;
+}
+
+/**
+*   Pass next bytes of the stream to the push parser
+*/
+int MP4D__feed(MP4D_feed_t * feed, const void * data, size_t bytes, MP4D_feed_result_t * result)
+{
+    const unsigned char * input = (const unsigned char *)data;
+    if (!result)
+    {
+        return MP4D_FEED_ERROR;
+    }
+    memset(result, 0, sizeof(MP4D_feed_result_t));
+    if (!feed || (!data && bytes))
+    {
+        return MP4D_FEED_ERROR;
+    }
+
+    for (;;)
+    {
+        mp4d_input_t in;
+        const unsigned char * p = feed->buf_bytes ? feed->buf : input + result->consumed;
+        size_t have = feed->buf_bytes ? feed->buf_bytes : bytes - result->consumed;
+        size_t need, n;
+        int depth = feed->parser.depth, status = MP4D_PARSE_CONTINUE;
+
+        result->offset = feed->offset + feed->buf_bytes;
+        if (feed->status)
+        {
+            return feed->status;
+        }
+        if (feed->box_done)
+        {
+            feed->box_done = 0;
+            result->box_name = feed->parser.top_box_name;
+            return MP4D_FEED_BOX;
+        }
+
+        need = mp4d_feed_need(&feed->parser, p, have);
+        if (need > have)
+        {
+            // keep incomplete box in the buffer
+            n = bytes - result->consumed;
+            if (!n)
+            {
+                return MP4D_FEED_NEED_MORE;
+            }
+            if (n > need - feed->buf_bytes)
+            {
+                n = need - feed->buf_bytes;
+            }
+            if (!mp4d_feed_reserve(feed, feed->buf_bytes + n))
+            {
+                feed->status = MP4D_FEED_ERROR;
+                continue;
+            }
+            memcpy(feed->buf + feed->buf_bytes, input + result->consumed, n);
+            feed->buf_bytes += n;
+            result->consumed += n;
+            continue;
+        }
+
+        // parse the box, and boxes inside, if the whole box is available
+        memset(&in, 0, sizeof(in));
+        in.data = p;
+        in.bytes = need;
+        in.pos = feed->offset;
+        while (status == MP4D_PARSE_CONTINUE && in.bytes)
+        {
+            status = mp4d_parse_box(feed->mp4, &feed->parser, &in);
+        }
+        if (feed->buf_bytes)
+        {
+            feed->buf_bytes = 0;
+        }
+        else
+        {
+            result->consumed += need;
+        }
+        feed->offset += need + in.skip;
+        if (status != MP4D_PARSE_CONTINUE)
+        {
+            feed->status = status == MP4D_PARSE_ERROR ? MP4D_FEED_ERROR : MP4D_FEED_END;
+        }
+        else if (!feed->parser.depth && (depth || mp4d_is_read_box(feed->parser.top_box_name)))
+        {
+            feed->box_done = 1;
+        }
+
+        // skip the box payload in the input, or let the application skip it
+        n = bytes - result->consumed;
+        if (n > in.skip)
+        {
+            n = (size_t)in.skip;
+        }
+        result->consumed += n;
+        if (in.skip > n)
+        {
+            result->offset = feed->offset;
+            result->skip_bytes = in.skip - n;
+            return MP4D_FEED_SKIP;
+        }
+    }
+}
+
+/**
+*   Finish push parsing, and release the parser
+*/
+int MP4D__feed_close(MP4D_feed_t * feed)
+{
+    MP4D_demux_t * mp4;
+    int ok;
+    if (!feed)
+    {
+        return 0;
+    }
+    mp4 = feed->mp4;
+    ok = feed->status != MP4D_FEED_ERROR && mp4->track_count;
+    if (feed->buf)
+    {
+        mp4->allocator.deallocate(mp4->allocator.context, feed->buf);
+    }
+    mp4->allocator.deallocate(mp4->allocator.context, feed);
+    if (!ok)
+    {
+        MP4D__close(mp4);
+    }
+    return ok;
+}
+
 /**
 *   skip given number of SPS/PPS in the list.
 *   return number of bytes skipped
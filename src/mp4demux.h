@@ -2,9 +2,13 @@
 *   ISO MP4 file parsing
 *
 *   Portability note: this module uses:
-*   - Dynamic memory allocation (malloc(), realloc() and free()
-*   - Direct file access (fgetc(), fread() & fseek())
+*   - Dynamic memory allocation (malloc(), realloc() and free(), or
+*     application-supplied allocator, see MP4D__open_ex())
+*   - Direct file access (fgetc(), fread() & fseek()), except the push
+*     parser, see MP4D__feed_open()
 *   - File size (fstat())
+*   - POSIX pread() in MP4D__read_sample(), if MP4D_USE_PREAD is enabled
+*     (default on POSIX systems)
 *
 *   This module provide functions to decode mp4 indexes, and retrieve
 *   file position and size for each sample in given track.
@@ -33,6 +37,20 @@
 *       }
 *   }
 *
+*   Thread safety: the demultiplexer is not changed after MP4D__open(), so the
+*   query functions with const MP4D_demux_t argument (MP4D__frame_offset(),
+*   MP4D__read_sample(), MP4D__seek_fragment(), MP4D__read_sps(),
+*   MP4D__read_pps()) may be called from several threads at once. The FILE
+*   position is shared, so the threads should read sample data with
+*   MP4D__read_sample(), which does not use it. This does not apply to lazy
+*   mode (MP4D_params_t::lazy), which reads the tables on queries:
+*
+*   // worker thread, fd = fileno(file_handle)
+*   if (MP4D__read_sample(mp4, fd, i, k, buf, sizeof(buf), &frame_size, NULL, NULL))
+*   {
+*       send(buf, frame_size);
+*   }
+*
 */
 
 #ifndef mp4demux_H_INCLUDED
@@ -70,6 +88,15 @@ typedef struct
     unsigned         samples_per_chunk;
 } MP4D_sample_to_chunk_t;
 
+/*
+*   Random access point of fragmented file, from 'tfra' or 'sidx' box
+*/
+typedef struct
+{
+    mp4d_size_t      time;          // presentation time, track timescale units
+    mp4d_size_t      moof_offset;   // file position of the fragment (or segment)
+} MP4D_random_access_t;
+
 
 typedef struct
 {
@@ -174,6 +201,17 @@ typedef struct
     unsigned chunk_count;
     mp4d_size_t * chunk_offset;  // [chunk_count]
 
+    // fragmented file: track_ID from 'tkhd' box, and random access points
+    unsigned track_id;
+    unsigned random_access_count;
+    MP4D_random_access_t * random_access;   // [random_access_count], sorted by time
+
+    // lazy mode: file positions of the sample tables, see MP4D_params_t
+    struct mp4d_lazy_track_tag * lazy;
+
+    // compact mode: packed sample tables, see MP4D_params_t
+    struct mp4d_packed_track_tag * packed;
+
 } MP4D_track_t;
 
 
@@ -210,9 +248,115 @@ typedef struct MP4D_demux_tag
         unsigned char *genre;
     } tag;
 
+    /************************************************************************/
+    /*                 private data                                         */
+    /************************************************************************/
+    // memory allocator, used for all data above
+    MP4_allocator_t allocator;
+
+    // lazy mode: cache of decoded sample table windows, see MP4D_params_t
+    struct mp4d_lazy_tag * lazy;
+
 } MP4D_demux_t;
 
 
+/*
+*   Sample of the movie fragment, see MP4D__read_fragment()
+*/
+typedef struct
+{
+    mp4d_size_t offset;             // sample data file position
+    unsigned bytes;                 // sample data size
+    unsigned duration;              // track timescale units
+    mp4d_size_t timestamp;          // decoding time, track timescale units
+    int composition_offset;         // presentation time - decoding time
+    int random_access;              // 1 for sync sample
+} MP4D_fragment_sample_t;
+
+/*
+*   Samples of one track in the movie fragment
+*/
+typedef struct
+{
+    mp4d_size_t moof_offset;        // position of the 'moof' box
+    mp4d_size_t next_offset;        // position of the next box after the fragment 'mdat' box
+    unsigned sample_count;
+    MP4D_fragment_sample_t * sample;    // [sample_count]
+
+    // private: allocated samples
+    unsigned capacity;
+} MP4D_fragment_t;
+
+/*
+*   Extended demultiplexer parameters for MP4D__open_ex()
+*   Zero-initialized members select default behaviour.
+*/
+typedef struct
+{
+    // Memory allocator; NULL to use malloc()/realloc()/free()
+    // The allocator object is copied, and its context must outlive MP4D__close().
+    const MP4_allocator_t * allocator;
+
+    // Flag: probe the file metadata. Only the entry count of the sample tables is read, so
+    // sample_count is available, and no per-sample memory is allocated: entry_size,
+    // timestamp, duration, chunk_offset and sample_to_chunk are NULL, and MP4D__frame_offset()
+    // returns zero size. Parsing stops after the 'moov' box; movie fragments are not read.
+    // The push parser stores the same data, but still buffers the sample table boxes
+    int probe;
+
+    // Track filter: sample tables are read only for the tracks, which match all set members.
+    // Other tracks are kept with their metadata and sample_count, but without tables, as in
+    // probe mode, so track indexes do not depend on the filter
+    uint32_t handler_type;              // e.g. MP4_HANDLER_TYPE_SOUN; 0 - any
+    unsigned object_type_indication;    // e.g. MP4_OBJECT_TYPE_AVC; 0 - any
+    uint32_t track_mask;                // bit n selects track n (n < 32); 0 - any
+
+    // Flag: lazy sample tables. Only file positions of 'stsz', 'stts' and 'stco' boxes are
+    // stored at open, and MP4D__frame_offset() reads the entries on demand, in windows of
+    // MP4D_LAZY_WINDOW_SAMPLES, which are cached; 'stsc' is small and is read at open.
+    // entry_size, timestamp, duration and chunk_offset are NULL. The file must stay open
+    // till MP4D__close(); queries move its position, and are not thread-safe. Ignored in
+    // probe mode and by the push parser
+    int lazy;
+
+    // Lazy mode: number of cached windows of all tracks and tables; 0 - default (16)
+    unsigned lazy_window_count;
+
+    // Flag: compact sample tables, for applications, which keep many files open. After
+    // parsing, entry_size, timestamp, duration and chunk_offset are bit-packed in blocks of
+    // 128 entries, and the arrays are freed (set to NULL). MP4D__frame_offset() decodes the
+    // entries in O(1), and stays thread-safe. chunk_offset is kept, if its block can't be
+    // packed. Ignored in lazy mode and by the push parser
+    int compact;
+} MP4D_params_t;
+
+
+/*
+*   Push parser, see MP4D__feed_open()
+*/
+typedef struct MP4D_feed_tag MP4D_feed_t;
+
+/*
+*   Push parser events, returned by MP4D__feed()
+*/
+#define MP4D_FEED_NEED_MORE     0   // input is used: pass next bytes of the stream
+#define MP4D_FEED_SKIP          1   // skip result.skip_bytes of the stream after the used input
+#define MP4D_FEED_BOX           2   // top-level box result.box_name is parsed, e.g. 'moov'
+#define MP4D_FEED_END           3   // parsing is stopped at broken top-level box
+#define MP4D_FEED_ERROR        -1   // broken file or out of memory
+
+/*
+*   Result of MP4D__feed()
+*/
+typedef struct
+{
+    size_t consumed;                // input bytes, used by the parser; pass the rest again
+    mp4d_size_t skip_bytes;         // MP4D_FEED_SKIP: stream bytes, not needed by the parser
+    mp4d_size_t offset;             // stream position of the next byte, expected by the parser
+    uint32_t box_name;              // MP4D_FEED_BOX: parsed box
+} MP4D_feed_result_t;
+
+
 /**
 *   Parse given file as MP4 file.  Allocate and store data indexes.
 *   return 1 on success, 0 on failure
@@ -225,6 +369,14 @@ typedef struct MP4D_demux_tag
 int MP4D__open(MP4D_demux_t * mp4, FILE * f);
 
 
+/**
+*   Same as MP4D__open(), with extended parameters.
+*   params may be NULL.
+*   return 1 on success, 0 on failure
+*/
+int MP4D__open_ex(MP4D_demux_t * mp4, FILE * f, const MP4D_params_t * params);
+
+
 /**
 *   Return position and size for given sample from given track. The 'sample' is a
 *   MP4 term for 'frame'
@@ -238,12 +390,122 @@ int MP4D__open(MP4D_demux_t * mp4, FILE * f);
 mp4d_size_t MP4D__frame_offset(const MP4D_demux_t * mp4, unsigned int ntrack, unsigned int nsample, unsigned int * frame_bytes, unsigned * timestamp, unsigned * duration);
 
 
+/**
+*   Read given sample from given track with pread() at the sample offset. The
+*   file position is neither used nor changed, so several threads may read the
+*   samples of one demultiplexer from one file descriptor without locks.
+*   Available, if MP4D_USE_PREAD is enabled.
+*
+*   fd                  - file descriptor of the parsed file, e.g. fileno(f)
+*   buf                 - buffer for sample data, buf_bytes in size
+*   frame_bytes [OUT]   - sample size; set also if the buffer is too small
+*   timestamp [OUT]     - sample timestamp; may be NULL
+*   duration [OUT]      - sample duration; may be NULL
+*
+*   return 1 on success; 0 on invalid track or sample, small buffer or read error
+*/
+int MP4D__read_sample(const MP4D_demux_t * mp4, int fd, unsigned int ntrack, unsigned int nsample,
+                      void * buf, unsigned int buf_bytes, unsigned int * frame_bytes, unsigned * timestamp, unsigned * duration);
+
+
 /**
 *   De-allocated memory
 */
 void MP4D__close(MP4D_demux_t * mp4);
 
 
+/**
+*   Fragmented file seek: find random access point at or before given time
+*   in the track random access points, read by MP4D__open() from 'mfra' box
+*   at the end of file, or from 'sidx' boxes. When 'mfra' box is present,
+*   MP4D__open() does not scan the movie fragments.
+*
+*   time                - presentation time, track timescale units
+*   moof_offset [OUT]   - position to pass to MP4D__read_fragment()
+*   ra_time [OUT]       - random access point time; may be NULL
+*
+*   return 1 on success, 0 if track has no random access points
+*/
+int MP4D__seek_fragment(const MP4D_demux_t * mp4, unsigned int ntrack, mp4d_size_t time, 
+                        mp4d_size_t * moof_offset, mp4d_size_t * ra_time);
+
+
+/**
+*   Read samples of given track from the movie fragment: the 1st 'moof' box
+*   at or after given file position (e.g. 'styp' and 'sidx' boxes are skipped).
+*   Only the 'moof' box and 'mdat' box header are read. Fragment without the
+*   track samples returns sample_count = 0; read next one from next_offset.
+*   fragment must be zero-initialized before the 1st call, and released with
+*   MP4D__free_fragment().
+*
+*   return 1 on success, 0 on failure or end of file
+*/
+int MP4D__read_fragment(MP4D_demux_t * mp4, FILE * f, mp4d_size_t offset, unsigned int ntrack, MP4D_fragment_t * fragment);
+
+
+/**
+*   Release fragment memory
+*/
+void MP4D__free_fragment(MP4D_demux_t * mp4, MP4D_fragment_t * fragment);
+
+
+/**
+*   Start push parser: the application passes the stream bytes in pieces of
+*   any size, as they arrive, e.g. from non-blocking socket, and the parser
+*   never reads the file, nor blocks. Parser state, including the box stack,
+*   is kept in the returned object. Data indexes are stored to mp4 as by
+*   MP4D__open_ex(), and are available after the 'moov' box is parsed.
+*
+*   Example:
+*
+*       feed = MP4D__feed_open(mp4, NULL);
+*       while (!done && (bytes = receive(buf)) > 0)
+*       {
+*           p = buf;
+*           do
+*           {
+*               event = MP4D__feed(feed, p, bytes, &result);
+*               p += result.consumed;
+*               bytes -= result.consumed;
+*               if (event == MP4D_FEED_SKIP)
+*               {
+*                   // drop the bytes, or seek the source to result.offset
+*                   skip(result.skip_bytes);
+*               }
+*               done = event == MP4D_FEED_BOX && result.box_name == BOX_moov;
+*           } while (bytes && !done && event != MP4D_FEED_END && event != MP4D_FEED_ERROR);
+*       }
+*       if (MP4D__feed_close(feed))
+*       {
+*           ... use mp4 tracks, then MP4D__close(mp4)
+*       }
+*
+*   return parser object; NULL on failure
+*/
+MP4D_feed_t * MP4D__feed_open(MP4D_demux_t * mp4, const MP4D_params_t * params);
+
+
+/**
+*   Pass next bytes of the stream to the push parser. The function returns
+*   on each event; input bytes after result->consumed must be passed again.
+*   Incomplete box, which is read by the parser, is copied to internal buffer;
+*   large boxes, not needed by the parser (e.g. 'mdat'), are reported with 
+*   MP4D_FEED_SKIP: the application skips result->skip_bytes of the stream, 
+*   which follow the used input, and passes the bytes after them.
+*
+*   return event MP4D_FEED_*
+*/
+int MP4D__feed(MP4D_feed_t * feed, const void * data, size_t bytes, MP4D_feed_result_t * result);
+
+
+/**
+*   Finish push parsing, e.g. at the end of stream, and release the parser.
+*   return 1 if tracks are found, as MP4D__open(); 0 on failure, and the
+*   demultiplexer is closed
+*/
+int MP4D__feed_close(MP4D_feed_t * feed);
+
+
 /**
 *   Helper functions to parse mp4.track[ntrack].dsi for H.264 SPS/PPS
 *   Return pointer to internal mp4 memory, it must not be free()-ed
@@ -0,0 +1,473 @@
+/** 18.10.2026 @file
+*
+*   Index file layout: header, track records, and data blocks (sample tables,
+*   DSI, zero-terminated tags), each aligned to 8 bytes. Data block is referred
+*   by its offset from the file start, and size. Numbers are in native byte order,
+*   so the tables are used in place; byte order field detects foreign index.
+*
+*   Demultiplexer, opened from the index, has own allocator, which context is
+*   the mapping: deallocation of the mapped tables is ignored, so MP4D__close()
+*   releases only the track array, and MP4I__close() unmaps the index.
+**/
+
+#include "mp4index.h"
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define MP4I_VERSION        1
+#define MP4I_BYTE_ORDER     0x01020304
+
+/*
+*   Data block position in the index file
+*/
+typedef struct
+{
+    uint64_t offset;
+    uint64_t bytes;
+} mp4i_block_t;
+
+/*
+*   Index file header
+*/
+typedef struct
+{
+    char magic[4];                  // "MP4I"
+    uint32_t version;               // MP4I_VERSION
+    uint32_t byte_order;            // MP4I_BYTE_ORDER, as written
+    uint32_t track_count;
+    uint64_t file_size;             // MP4 file size and modification time
+    int64_t file_mtime_sec;
+    int64_t file_mtime_nsec;
+    uint32_t duration_hi;
+    uint32_t duration_lo;
+    uint32_t timescale;
+    uint32_t reserved;
+    mp4i_block_t tag[6];            // title, artist, album, year, comment, genre
+} mp4i_header_t;
+
+/*
+*   Track record: MP4D_track_t fields, and its tables
+*/
+typedef struct
+{
+    uint32_t sample_count;
+    uint32_t dsi_bytes;
+    uint32_t object_type_indication;
+    uint32_t handler_type;
+    uint32_t duration_hi;
+    uint32_t duration_lo;
+    uint32_t timescale;
+    uint32_t avg_bitrate_bps;
+    unsigned char language[4];
+    uint32_t stream_type;
+    uint32_t sample_description[2];
+    uint32_t sample_to_chunk_count;
+    uint32_t chunk_count;
+    uint32_t track_id;
+    uint32_t random_access_count;
+    mp4i_block_t dsi;
+    mp4i_block_t entry_size;
+    mp4i_block_t timestamp;
+    mp4i_block_t duration;
+    mp4i_block_t sample_to_chunk;
+    mp4i_block_t chunk_offset;
+    mp4i_block_t random_access;
+} mp4i_track_t;
+
+/*
+*   Index file mapping: the allocator context of the demultiplexer
+*/
+typedef struct
+{
+    const unsigned char * base;
+    size_t bytes;
+} mp4i_map_t;
+
+/*
+*   Index file output: layout pass assigns data blocks positions, write pass writes them
+*/
+typedef struct
+{
+    FILE * f;                       // NULL for layout pass
+    uint64_t pos;
+    int success;
+} mp4i_writer_t;
+
+/************************************************************************/
+/*      Mapped demultiplexer allocator                                  */
+/************************************************************************/
+
+static void * mp4i_allocate(void * context, size_t bytes)
+{
+    (void)context;
+    return malloc(bytes);
+}
+
+static void * mp4i_reallocate(void * context, void * ptr, size_t bytes)
+{
+    (void)context;
+    return realloc(ptr, bytes);
+}
+
+static void mp4i_deallocate(void * context, void * ptr)
+{
+    const mp4i_map_t * map = (const mp4i_map_t *)context;
+    const unsigned char * p = (const unsigned char *)ptr;
+    if (p < map->base || p >= map->base + map->bytes)
+    {
+        free(ptr);
+    }
+}
+
+/************************************************************************/
+/*      Index file output                                               */
+/************************************************************************/
+
+/**
+*   Get MP4 file size and modification time
+*   return 1 on success
+*/
+static int mp4i_file_stamp(FILE * mp4file, uint64_t * size, int64_t * mtime_sec, int64_t * mtime_nsec)
+{
+    struct stat st;
+    if (!mp4file || fstat(fileno(mp4file), &st))
+    {
+        return 0;
+    }
+    *size = (uint64_t)st.st_size;
+    *mtime_sec = (int64_t)st.st_mtim.tv_sec;
+    *mtime_nsec = (int64_t)st.st_mtim.tv_nsec;
+    return 1;
+}
+
+/**
+*   Layout pass: assign position to the data block.
+*   Write pass: write the data block at its position.
+*/
+static void mp4i_put_block(mp4i_writer_t * w, mp4i_block_t * block, const void * data, uint64_t bytes)
+{
+    static const unsigned char zero[8] = {0,};
+    if (!w->f)
+    {
+        block->offset = bytes ? (w->pos + 7) & ~(uint64_t)7 : 0;
+        block->bytes = bytes;
+        w->pos = bytes ? block->offset + bytes : w->pos;
+        return;
+    }
+    if (bytes && w->success)
+    {
+        w->success = fwrite(zero, 1, (size_t)(block->offset - w->pos), w->f) == block->offset - w->pos &&
+                     fwrite(data, 1, (size_t)bytes, w->f) == bytes;
+        w->pos = block->offset + bytes;
+    }
+}
+
+/**
+*   Pass all data blocks of the index to the writer, in the file order
+*/
+static void mp4i_put_blocks(mp4i_writer_t * w, const MP4D_demux_t * mp4, mp4i_header_t * header, mp4i_track_t * records)
+{
+    const unsigned char * tags[6];
+    unsigned i;
+    tags[0] = mp4->tag.title;
+    tags[1] = mp4->tag.artist;
+    tags[2] = mp4->tag.album;
+    tags[3] = mp4->tag.year;
+    tags[4] = mp4->tag.comment;
+    tags[5] = mp4->tag.genre;
+    for (i = 0; i < 6; i++)
+    {
+        mp4i_put_block(w, header->tag + i, tags[i], tags[i] ? strlen((const char *)tags[i]) + 1 : 0);
+    }
+    for (i = 0; i < mp4->track_count; i++)
+    {
+        const MP4D_track_t * tr = mp4->track + i;
+        mp4i_track_t * r = records + i;
+        mp4i_put_block(w, &r->dsi, tr->dsi, tr->dsi ? tr->dsi_bytes : 0);
+        mp4i_put_block(w, &r->entry_size, tr->entry_size, tr->entry_size ? tr->sample_count*4ull : 0);
+        mp4i_put_block(w, &r->timestamp, tr->timestamp, tr->timestamp ? tr->sample_count*4ull : 0);
+        mp4i_put_block(w, &r->duration, tr->duration, tr->duration ? tr->sample_count*4ull : 0);
+        mp4i_put_block(w, &r->sample_to_chunk, tr->sample_to_chunk,
+                       tr->sample_to_chunk_count*(uint64_t)sizeof(MP4D_sample_to_chunk_t));
+        mp4i_put_block(w, &r->chunk_offset, tr->chunk_offset, tr->chunk_count*(uint64_t)sizeof(mp4d_size_t));
+        mp4i_put_block(w, &r->random_access, tr->random_access,
+                       tr->random_access_count*(uint64_t)sizeof(MP4D_random_access_t));
+    }
+}
+
+/**
+*   Save the index of parsed MP4 file
+*/
+int MP4I__save(const MP4D_demux_t * mp4, FILE * mp4file, const char * index_file_name)
+{
+    mp4i_header_t header;
+    mp4i_track_t * records;
+    mp4i_writer_t w;
+    char * temp_name;
+    unsigned i;
+
+    if (!mp4 || mp4->lazy || !index_file_name || sizeof(unsigned) != 4)
+    {
+        return 0;
+    }
+    for (i = 0; i < mp4->track_count; i++)
+    {
+        if (mp4->track[i].packed)
+        {
+            // compact mode: the index stores plain arrays
+            return 0;
+        }
+    }
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "MP4I", 4);
+    header.version = MP4I_VERSION;
+    header.byte_order = MP4I_BYTE_ORDER;
+    header.track_count = mp4->track_count;
+    header.duration_hi = mp4->duration_hi;
+    header.duration_lo = mp4->duration_lo;
+    header.timescale = mp4->timescale;
+    if (!mp4i_file_stamp(mp4file, &header.file_size, &header.file_mtime_sec, &header.file_mtime_nsec))
+    {
+        return 0;
+    }
+    records = (mp4i_track_t *)calloc(mp4->track_count + 1, sizeof(mp4i_track_t));
+    temp_name = (char *)malloc(strlen(index_file_name) + 32);
+    if (!records || !temp_name)
+    {
+        free(records);
+        free(temp_name);
+        return 0;
+    }
+    for (i = 0; i < mp4->track_count; i++)
+    {
+        const MP4D_track_t * tr = mp4->track + i;
+        mp4i_track_t * r = records + i;
+        r->sample_count = tr->sample_count;
+        r->dsi_bytes = tr->dsi_bytes;
+        r->object_type_indication = tr->object_type_indication;
+        r->handler_type = tr->handler_type;
+        r->duration_hi = tr->duration_hi;
+        r->duration_lo = tr->duration_lo;
+        r->timescale = tr->timescale;
+        r->avg_bitrate_bps = tr->avg_bitrate_bps;
+        memcpy(r->language, tr->language, 4);
+        r->stream_type = tr->stream_type;
+        r->sample_description[0] = tr->SampleDescription.video.width;
+        r->sample_description[1] = tr->SampleDescription.video.height;
+        r->sample_to_chunk_count = tr->sample_to_chunk_count;
+        r->chunk_count = tr->chunk_count;
+        r->track_id = tr->track_id;
+        r->random_access_count = tr->random_access_count;
+    }
+
+    // layout pass
+    memset(&w, 0, sizeof(w));
+    w.pos = sizeof(header) + mp4->track_count*(uint64_t)sizeof(mp4i_track_t);
+    mp4i_put_blocks(&w, mp4, &header, records);
+
+    // write pass: temporary file is renamed, when complete
+    sprintf(temp_name, "%s.%d.tmp", index_file_name, (int)getpid());
+    w.f = fopen(temp_name, "wb");
+    w.success = w.f && fwrite(&header, sizeof(header), 1, w.f) == 1 &&
+                fwrite(records, sizeof(mp4i_track_t), mp4->track_count, w.f) == mp4->track_count;
+    w.pos = sizeof(header) + mp4->track_count*(uint64_t)sizeof(mp4i_track_t);
+    if (w.f)
+    {
+        mp4i_put_blocks(&w, mp4, &header, records);
+        w.success &= !fclose(w.f);
+    }
+    w.success = w.success && !rename(temp_name, index_file_name);
+    if (!w.success)
+    {
+        remove(temp_name);
+    }
+    free(records);
+    free(temp_name);
+    return w.success;
+}
+
+/************************************************************************/
+/*      Index file mapping                                              */
+/************************************************************************/
+
+/**
+*   Check, that data block is within the mapping, and has expected size
+*   return pointer to the data, NULL if block is empty or broken
+*/
+static void * mp4i_block_data(const mp4i_map_t * map, const mp4i_block_t * block, uint64_t bytes, int * broken)
+{
+    if (block->bytes != bytes || (block->offset & 7) || block->offset > map->bytes ||
+        block->bytes > map->bytes - block->offset)
+    {
+        *broken = 1;
+    }
+    return (*broken || !bytes) ? NULL : (void *)(map->base + block->offset);
+}
+
+/**
+*   Fill demultiplexer from the mapped index
+*   return 1 on success
+*/
+static int mp4i_load(MP4D_demux_t * mp4, const mp4i_map_t * map)
+{
+    const mp4i_header_t * header = (const mp4i_header_t *)map->base;
+    const mp4i_track_t * records = (const mp4i_track_t *)(header + 1);
+    unsigned char ** tags[6];
+    int broken = 0;
+    unsigned i;
+
+    mp4->duration_hi = header->duration_hi;
+    mp4->duration_lo = header->duration_lo;
+    mp4->timescale = header->timescale;
+    tags[0] = &mp4->tag.title;
+    tags[1] = &mp4->tag.artist;
+    tags[2] = &mp4->tag.album;
+    tags[3] = &mp4->tag.year;
+    tags[4] = &mp4->tag.comment;
+    tags[5] = &mp4->tag.genre;
+    for (i = 0; i < 6; i++)
+    {
+        const mp4i_block_t * tag = header->tag + i;
+        *tags[i] = (unsigned char *)mp4i_block_data(map, tag, tag->bytes, &broken);
+        broken |= *tags[i] && map->base[tag->offset + tag->bytes - 1];    // zero-terminated
+    }
+
+    mp4->track = (MP4D_track_t *)calloc(header->track_count ? header->track_count : 1, sizeof(MP4D_track_t));
+    if (!mp4->track)
+    {
+        return 0;
+    }
+    mp4->track_count = header->track_count;
+    for (i = 0; i < mp4->track_count && !broken; i++)
+    {
+        MP4D_track_t * tr = mp4->track + i;
+        const mp4i_track_t * r = records + i;
+        tr->sample_count = r->sample_count;
+        tr->dsi_bytes = r->dsi_bytes;
+        tr->object_type_indication = r->object_type_indication;
+        tr->handler_type = r->handler_type;
+        tr->duration_hi = r->duration_hi;
+        tr->duration_lo = r->duration_lo;
+        tr->timescale = r->timescale;
+        tr->avg_bitrate_bps = r->avg_bitrate_bps;
+        memcpy(tr->language, r->language, 4);
+        tr->stream_type = r->stream_type;
+        tr->SampleDescription.video.width = r->sample_description[0];
+        tr->SampleDescription.video.height = r->sample_description[1];
+        tr->sample_to_chunk_count = r->sample_to_chunk_count;
+        tr->chunk_count = r->chunk_count;
+        tr->track_id = r->track_id;
+        tr->random_access_count = r->random_access_count;
+
+        tr->dsi = (unsigned char *)mp4i_block_data(map, &r->dsi, r->dsi.bytes ? r->dsi_bytes : 0, &broken);
+        tr->entry_size = (unsigned *)mp4i_block_data(map, &r->entry_size, r->entry_size.bytes ? r->sample_count*4ull : 0, &broken);
+        tr->timestamp = (unsigned *)mp4i_block_data(map, &r->timestamp, r->timestamp.bytes ? r->sample_count*4ull : 0, &broken);
+        tr->duration = (unsigned *)mp4i_block_data(map, &r->duration, r->duration.bytes ? r->sample_count*4ull : 0, &broken);
+        tr->sample_to_chunk = (MP4D_sample_to_chunk_t *)mp4i_block_data(map, &r->sample_to_chunk,
+            r->sample_to_chunk_count*(uint64_t)sizeof(MP4D_sample_to_chunk_t), &broken);
+        tr->chunk_offset = (mp4d_size_t *)mp4i_block_data(map, &r->chunk_offset,
+            r->chunk_count*(uint64_t)sizeof(mp4d_size_t), &broken);
+        tr->random_access = (MP4D_random_access_t *)mp4i_block_data(map, &r->random_access,
+            r->random_access_count*(uint64_t)sizeof(MP4D_random_access_t), &broken);
+    }
+    return !broken;
+}
+
+/**
+*   Open the index file, if it matches the MP4 file
+*/
+int MP4I__open(MP4D_demux_t * mp4, FILE * mp4file, const char * index_file_name)
+{
+    const mp4i_header_t * header;
+    mp4i_map_t * map;
+    struct stat st;
+    uint64_t file_size;
+    int64_t mtime_sec, mtime_nsec;
+    int fd, success;
+    void * base;
+
+    if (!mp4 || !index_file_name || sizeof(unsigned) != 4 ||
+        !mp4i_file_stamp(mp4file, &file_size, &mtime_sec, &mtime_nsec))
+    {
+        return 0;
+    }
+    fd = open(index_file_name, O_RDONLY);
+    if (fd < 0)
+    {
+        return 0;
+    }
+    base = (!fstat(fd, &st) && (size_t)st.st_size >= sizeof(mp4i_header_t)) ?
+        mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (base == MAP_FAILED)
+    {
+        return 0;
+    }
+
+    header = (const mp4i_header_t *)base;
+    success = !memcmp(header->magic, "MP4I", 4) && header->version == MP4I_VERSION &&
+              header->byte_order == MP4I_BYTE_ORDER && header->file_size == file_size &&
+              header->file_mtime_sec == mtime_sec && header->file_mtime_nsec == mtime_nsec &&
+              header->track_count <= ((size_t)st.st_size - sizeof(mp4i_header_t))/sizeof(mp4i_track_t);
+    map = success ? (mp4i_map_t *)malloc(sizeof(mp4i_map_t)) : NULL;
+    if (!map)
+    {
+        munmap(base, (size_t)st.st_size);
+        return 0;
+    }
+    map->base = (const unsigned char *)base;
+    map->bytes = (size_t)st.st_size;
+
+    memset(mp4, 0, sizeof(MP4D_demux_t));
+    mp4->allocator.allocate = mp4i_allocate;
+    mp4->allocator.reallocate = mp4i_reallocate;
+    mp4->allocator.deallocate = mp4i_deallocate;
+    mp4->allocator.context = map;
+    if (!mp4i_load(mp4, map))
+    {
+        MP4I__close(mp4);
+        return 0;
+    }
+    return 1;
+}
+
+/**
+*   Open the index file, or parse the MP4 file, and save the index
+*/
+int MP4I__open_cached(MP4D_demux_t * mp4, FILE * mp4file, const char * index_file_name)
+{
+    if (MP4I__open(mp4, mp4file, index_file_name))
+    {
+        return 1;
+    }
+    if (!MP4D__open(mp4, mp4file))
+    {
+        return 0;
+    }
+    MP4I__save(mp4, mp4file, index_file_name);
+    return 1;
+}
+
+/**
+*   Close demultiplexer, and unmap the index
+*/
+void MP4I__close(MP4D_demux_t * mp4)
+{
+    mp4i_map_t * map;
+    if (!mp4)
+    {
+        return;
+    }
+    map = mp4->allocator.deallocate == mp4i_deallocate ? (mp4i_map_t *)mp4->allocator.context : NULL;
+    MP4D__close(mp4);
+    if (map)
+    {
+        munmap((void *)map->base, map->bytes);
+        free(map);
+        mp4->allocator.context = NULL;
+    }
+}
@@ -0,0 +1,79 @@
+/** 18.10.2026 @file
+*
+*   Persistent index cache for MP4 demultiplexer
+*
+*   Portability note: this module uses POSIX file API (fstat(), mmap(), rename()).
+*
+*   MP4D__open() parses 'moov' box into sample tables on each open, which takes
+*   tens of milliseconds for long movies. The index cache saves the parsed tables
+*   to the index file (e.g. "movie.mp4.idx") beside the MP4 file; next open maps
+*   the index file to memory, and points the sample tables to it, without parsing
+*   and copying. Index file is valid for the MP4 file of the same size and
+*   modification time; index of other version, or of other byte order is ignored.
+*   Index is saved to temporary file, and renamed, so concurrent readers never see
+*   incomplete index.
+*
+*   Example:
+*
+*       FILE * f = fopen("movie.mp4", "rb");
+*       if (MP4I__open_cached(&mp4, f, "movie.mp4.idx"))
+*       {
+*           ... use mp4 tracks, as after MP4D__open()
+*           MP4I__close(&mp4);
+*       }
+*/
+
+#ifndef mp4index_H_INCLUDED
+#define mp4index_H_INCLUDED
+
+#include "mp4demux.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif  //__cplusplus
+
+
+/**
+*   Save sample tables, track information and tags of the parsed MP4 file to
+*   the index file, with the size and modification time of mp4file. Files,
+*   opened in lazy or compact mode (MP4D_params_t::lazy, compact) have no plain
+*   tables, and are not saved.
+*
+*   return 1 on success, 0 on failure
+*/
+int MP4I__save(const MP4D_demux_t * mp4, FILE * mp4file, const char * index_file_name);
+
+
+/**
+*   Open the index file, saved by MP4I__save() for mp4file: the index file is
+*   mapped to memory, and mp4 is filled as by MP4D__open(), with sample tables
+*   and tags in the read-only mapping. The index file is not read, until the
+*   tables are used. mp4 must be closed with MP4I__close().
+*
+*   return 1 on success; 0, if the index file does not exist, is broken, or
+*   does not match mp4file
+*/
+int MP4I__open(MP4D_demux_t * mp4, FILE * mp4file, const char * index_file_name);
+
+
+/**
+*   Open the index file with MP4I__open(), if it matches mp4file; otherwise,
+*   parse mp4file with MP4D__open(), and save the index file for the next open.
+*   Failure to save the index is ignored. mp4 must be closed with MP4I__close().
+*
+*   return 1 on success, 0 on failure
+*/
+int MP4I__open_cached(MP4D_demux_t * mp4, FILE * mp4file, const char * index_file_name);
+
+
+/**
+*   De-allocate memory, and unmap the index file, if mp4 is opened from the index
+*/
+void MP4I__close(MP4D_demux_t * mp4);
+
+
+#ifdef __cplusplus
+}
+#endif //__cplusplus
+
+#endif //mp4index_H_INCLUDED
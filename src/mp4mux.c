@@ -7,6 +7,14 @@
         [MDAT]<interleaved a/v frames, in any order> [MOOV]<Stream description & data index>
 
         A/V data written in single huge MDAT box. fseek() needed to update size of the MDAT box.
+
+    Option 1 with checkpoints (MP4E_params_t::checkpoint_interval_ms):
+
+        [MDAT]<frames> [FREE]<checkpoint> [MDAT]<frames> [FREE]<checkpoint> ... [MDAT]<frames> [MOOV]
+
+        Each frame in MDAT is prefixed by record header: size, track, duration, composition offset. FREE box
+        holds track configuration and index of frames, written since the previous checkpoint. If the file is 
+        not closed, MP4E__recover() builds MOOV from checkpoints, and from record headers after the last one.
     
 
     Option 2: simple mp4 layout, when fseek() NOT available:
@@ -17,11 +25,24 @@
 
     Options 3&4: fragmented mp4 layout:
 
-        [MOOV]<Stream description> [MOOF][MDAT]<media frame>[MOOF][MDAT]<media frame> .... [MOOF][MDAT]<media frame>
+        [MOOV]<Stream description> [MOOF][MDAT]<media frame>[MOOF][MDAT]<media frame> .... [MOOF][MDAT]<media frame> [MFRA]
 
-        Each A/V frame written in it's MDAT box. Frame side info written in MOOF box before. There is no global index in this file
+        Each A/V frame written in it's MDAT box. Frame side info written in MOOF box before. There is no global index in this file,
+        but MFRA box at the end lists key frames time and MOOF positions
         If fseek() available, media duration in the stream description is updated when closing the file
 
+    Option 5: CMAF chunked layout (fragmentation with MP4E_params_t::cmaf_chunk_duration_ms):
+
+        [MOOV]<Stream description> [STYP][MOOF][MDAT]<chunk> [MOOF][MDAT]<chunk> ... [STYP][MOOF][MDAT]<chunk> ... [MFRA]
+
+        Chunk holds samples of all tracks for up to given duration. Segment ('styp' box and chunks) starts
+        at video key frame. Samples are held in memory until the chunk is complete.
+
+    Option 6: segmented layout (fragmentation with MP4E_params_t::segment_sink):
+
+        Init segment: [MOOV]<Stream description>
+        Media segments, each to its own sink: [STYP][SIDX][MOOF][MDAT]<samples of all tracks>
+
 **/      
 #include "mp4mux.h"
 #include <assert.h>
@@ -45,9 +66,25 @@
 #define FILE_HEADER_BYTES 256       // file header
 #define TRACK_HEADER_BYTES 512      // track header
 
+// Max size of 1-sample 'moof' box (108 bytes actually)
+#define FRAGMENT_HEADER_BYTES 128
+
+// Max size of 'traf' box header in CMAF chunk, without 'trun' entries
+#define CHUNK_TRAF_HEADER_BYTES 80
+
+// Size of 'trun' entry in CMAF chunk: duration, size, flags, composition offset
+#define CHUNK_SAMPLE_ENTRY_BYTES 16
+
+// Size of 'sidx' box with single reference
+#define SIDX_BYTES 52
+
 // File timescale
 #define MOOV_TIMESCALE 1000
 
+// Checkpoint mode: sample record header size, and checkpoint 'free' box signature
+#define CHECKPOINT_RECORD_BYTES 16
+#define CHECKPOINT_MAGIC FOUR_CHAR_INT('c','k','p','t')
+
 typedef unsigned int mp4e_size_t;
 
 /*
@@ -61,6 +98,7 @@ typedef struct
     mp4e_size_t offset;             // sample data offset in the mp4 file 
     unsigned duration;              // sample duration, x(1./MP4E_track_t::time_scale) seconds
     unsigned flag_random_access;    // 1 if sample intra-coded
+    int composition_offset;         // pts - dts
 } sample_t;
 
 /*
@@ -68,34 +106,146 @@ typedef struct
 */
 typedef struct 
 {
-    unsigned char * data;           // malloc()-ed memory
+    unsigned char * data;           // allocated memory
     size_t bytes;                   // used size
     size_t capacity;                // allocated size
+    const MP4_allocator_t * allocator;  // memory allocator of the multiplexer
 } asp_vector_t;
 
 /*
-*   Track descriptor
+*   Pre-built 'moof' box for 1-sample fragment.
+*   Fields, which vary from sample to sample, are patched in place before write.
+*/
+typedef struct
+{
+    unsigned char data[FRAGMENT_HEADER_BYTES];  // 'moof' box
+    unsigned char bytes;            // 'moof' box size
+    unsigned char pos_sequence;     // mfhd::sequence_number position
+    unsigned char pos_decode_time;  // tfdt::baseMediaDecodeTime position
+    unsigned char pos_duration[2];  // tfhd::default_sample_duration / trun::sample_duration positions, 0 if absent
+    unsigned char pos_size;         // trun::sample_size position
+    unsigned char pos_composition;  // trun::sample_composition_time_offset position, 0 if absent
+} fragment_template_t;
+
+/*
+*   Sample of the pending CMAF chunk
+*/
+typedef struct
+{
+    int track_num;
+    int sample_index;               // sample descriptor index in track_t::smpl
+    mp4e_time_t dts;                // decoding time
+    const void * data;              // sample data by reference, NULL if copied
+    size_t copy_offset;             // copied data position in MP4E_mux_t::chunk_data
+    MP4E_release_fn release;
+    void * release_token;
+} chunk_sample_t;
+
+/*
+*   Ownership of the pending pull output buffer (MP4E_output_t)
+*/
+typedef struct
+{
+    const void * data;              // referenced sample data, or owned copy
+    MP4E_release_fn release;        // NULL, if data is owned copy
+    void * release_token;
+} output_ref_t;
+
+/*
+*   Random access point: 1st random access sample of the sync track in the fragment
+*/
+typedef struct
+{
+    mp4e_time_t time;               // presentation time
+    mp4e_size_t moof_offset;        // 'moof' box position
+    unsigned traf_number;           // 1-based 'traf' number in 'moof'
+    unsigned sample_number;         // 1-based sample number in 'trun'
+} random_access_t;
+
+/*
+*   Track descriptor: configuration and timing
 *   Track is a sequence of samples. There are 1 or several tracks in the mp4 file
 */
 typedef struct 
 {
     MP4E_track_t info;              // Application-supplied track description
-    asp_vector_t smpl;              // samples descriptor
     asp_vector_t vsps;              // SPS for video or DSI for audio
     asp_vector_t vpps;              // PPS for video, not used for audio
+    fragment_template_t moof[2][2]; // fragment header [with composition offset][MP4E_SAMPLE_RANDOM_ACCESS]
+    mp4e_time_t last_dts;           // decoding time of the last sample
+    mp4e_time_t next_dts;           // decoding time of the next sample, if not given
+    int has_composition_offset;     // flag: some samples have pts != dts
 } track_t;
 
+/*
+*   Track samples in the output file: layout-specific part of the track state
+*/
+typedef struct
+{
+    asp_vector_t smpl;              // samples descriptor; only the last sample in fragmentation mode without chunks
+    unsigned removed_duration;      // duration of the samples, removed from smpl
+    unsigned checkpoint_samples;    // # of samples, listed in checkpoints
+    int dropping;                   // flag: samples are dropped until the next random access sample
+} track_index_t;
+
 /*
 *   MP4 file descriptor
 */
 typedef struct MP4E_mux_tag
 {
-    asp_vector_t tracks;            // mp4 file tracks
-    FILE * mp4file;                 // output file handle
+    MP4_allocator_t allocator;      // memory allocator
+    asp_vector_t tracks;            // mp4 file tracks (track_t); copy of the owner's vector, if shared
+    asp_vector_t index;             // samples of the tracks (track_index_t)
+    struct MP4E_mux_tag * track_owner;  // multiplexer, which track table is shared, NULL if own
+    FILE * mp4file;                 // output file handle, NULL if sink is used
+    MP4E_sink_t sink;               // application-supplied output, if sink.write != NULL
     mp4e_size_t write_pos;          // ## of bytes written ~ current file position (until 1st fseek)
     char * text_comment;            // application-supplied file comment
     int enable_fragmentation;         // flag, indicating streaming-friendly 'fragmentation' mode
     int fragments_count;            // # of fragments in 'fragmentation' mode
+    MP4E_flush_fn flush;            // application-supplied flush callback, may be NULL
+    void * flush_token;
+    mp4e_size_t fragment_pos;       // position of the last written fragment
+
+    // CMAF chunked and segmented modes
+    unsigned chunk_duration_ms;     // max chunk duration, 0 if not in CMAF or segmented mode
+    unsigned segment_duration_ms;   // min segment duration
+    MP4E_segment_fn segment_sink;   // media segment output, NULL if not in segmented mode
+    void * segment_token;
+    int sync_track;                 // track, which random access samples start segments
+    asp_vector_t random_access;     // sync track random access points for 'tfra' box (random_access_t)
+    asp_vector_t chunk;             // samples of the pending chunk (chunk_sample_t)
+    asp_vector_t chunk_data;        // copied data of the pending chunk samples
+    mp4e_time_t chunk_start_ms;     // time of the 1st sample in the pending chunk
+    mp4e_time_t segment_start_ms;   // time of the 1st sample in the current segment
+    int chunk_starts_segment;       // flag: pending chunk starts new segment
+    int chunks_count;               // # of written chunks
+
+    // checkpoint mode
+    unsigned checkpoint_interval_ms;    // checkpoint period, 0 if checkpoints are disabled
+    mp4e_time_t checkpoint_ms;      // media time of the last checkpoint
+    mp4e_size_t mdat_pos;           // position of the current 'mdat' box, 0 if none
+
+    // output rotation
+    MP4E_rotate_fn rotate;          // application-supplied next file output, NULL if rotation is disabled
+    void * rotate_token;
+    unsigned rotate_duration_ms;    // file duration limit, 0 if none
+    mp4e_offset_t rotate_bytes;     // file size limit, 0 if none
+    mp4e_time_t file_start_ms;      // time of the 1st sync track sample in the current file
+    int file_number;                // 1-based number of the current file
+
+    // non-blocking mode
+    mp4e_offset_t max_pending_bytes;    // max output bytes, not confirmed by the application, 0 if blocking
+    int drop_frames;                // flag: drop video samples instead of MP4E_STATUS_WOULD_BLOCK
+    mp4e_offset_t output_bytes;     // total bytes, passed to the output
+    mp4e_offset_t confirmed_bytes;  // total bytes, confirmed by the application
+
+    // pull output mode
+    int pull_output;                // flag: output is held in the buffer chain
+    asp_vector_t output;            // pending output buffers (MP4E_output_t)
+    asp_vector_t output_ref;        // ownership of the pending output buffers (output_ref_t)
+    size_t output_head;             // # of drained buffers at the start of the vectors
+    int finished;                   // flag: file index is written by MP4E__finish()
 } MP4E_mux_t;
 
 
@@ -126,6 +276,12 @@ typedef struct MP4E_mux_tag
 
 
 static int mp4e_write_index(MP4E_mux_t * mux);
+static track_t * mp4e_get_track(MP4E_mux_t * mux, int track_num);
+static track_index_t * mp4e_get_index(MP4E_mux_t * mux, int track_num);
+static int mp4e_write_chunk(MP4E_mux_t * mux);
+static int mp4e_find_sync_track(MP4E_mux_t * mux);
+static int mp4e_put_sample_header(MP4E_mux_t * mux, int track_num, const void * data, int data_bytes, int duration, int kind, 
+                                  mp4e_time_t dts, int composition_offset);
 
 /************************************************************************/
 /*      File output (non-portable) stuff                                */
@@ -137,20 +293,84 @@ static int mp4e_write_index(MP4E_mux_t * mux);
 static size_t mp4e_fwrite(MP4E_mux_t * mux, const void *buffer, size_t size)
 {
     mux->write_pos += size;
+    mux->output_bytes += size;
+    if (mux->sink.write)
+    {
+        return !mux->sink.write(mux->sink.token, mux->write_pos - size, buffer, size);
+    }
     return fwrite(buffer, size, 1, mux->mp4file);
 }
 
+/**
+*   Sample payload output function: pass payload by reference, if sink supports it.
+*   release() called exactly once, when data no longer needed
+*/
+static size_t mp4e_fwrite_ref(MP4E_mux_t * mux, const void *buffer, size_t size, MP4E_release_fn release, void * release_token)
+{
+    size_t result;
+    if (mux->sink.write_ref)
+    {
+        mux->write_pos += size;
+        mux->output_bytes += size;
+        return !mux->sink.write_ref(mux->sink.token, mux->write_pos - size, buffer, size, release, release_token);
+    }
+    result = mp4e_fwrite(mux, buffer, size);
+    if (release)
+    {
+        release(release_token, buffer);
+    }
+    return result;
+}
+
+/**
+*   Set output position
+*/
+static void mp4e_fseek(MP4E_mux_t * mux, mp4e_size_t pos)
+{
+    mux->write_pos = pos;
+    if (!mux->sink.write)
+    {
+        fseek(mux->mp4file, pos, SEEK_SET);
+    }
+}
+
+/************************************************************************/
+/*      Default memory allocator                                        */
+/************************************************************************/
+static void * mp4e_default_allocate(void * context, size_t bytes)
+{
+    (void)context;
+    return malloc(bytes);
+}
+
+static void * mp4e_default_reallocate(void * context, void * ptr, size_t bytes)
+{
+    (void)context;
+    return realloc(ptr, bytes);
+}
+
+static void mp4e_default_deallocate(void * context, void * ptr)
+{
+    (void)context;
+    free(ptr);
+}
+
+#define MP4E_ALLOC(a, bytes)        (a)->allocate((a)->context, bytes)
+#define MP4E_REALLOC(a, p, bytes)   (a)->reallocate((a)->context, p, bytes)
+#define MP4E_FREE(a, p)             (a)->deallocate((a)->context, p)
+
 /************************************************************************/
 /*      Abstract vector data structure                                  */
 /************************************************************************/
 /**
 *   Allocate vector with given size, return 1 on success, 0 on fail
 */
-static int asp_vector_init(asp_vector_t * h, int capacity)
+static int asp_vector_init(asp_vector_t * h, int capacity, const MP4_allocator_t * allocator)
 {
     h->bytes = 0;
-    h->capacity = capacity;
-    h->data = capacity ? (unsigned char *)malloc(capacity) : NULL;
+    h->allocator = allocator;
+    h->data = capacity ? (unsigned char *)MP4E_ALLOC(allocator, capacity) : NULL;
+    h->capacity = h->data ? capacity : 0;   // on failure, vector is empty, and grows on demand
     return !capacity || !!h->data;
 }
 
@@ -159,7 +379,10 @@ static int asp_vector_init(asp_vector_t * h, int capacity)
 */
 static void asp_vector_reset(asp_vector_t * h)
 {
-    free(h->data);
+    if (h->data)
+    {
+        MP4E_FREE(h->allocator, h->data);
+    }
     memset(h, 0, sizeof(asp_vector_t));
 }
 
@@ -175,7 +398,7 @@ static unsigned char * asp_vector_alloc_tail(asp_vector_t * h, size_t bytes)
     {
         size_t grow_by = (bytes > h->capacity/2 ? bytes : h->capacity/2);
         size_t new_size = (h->capacity + grow_by + 1024) & -1024; // less-realloc's variant
-        p = (unsigned char *)realloc(h->data, new_size);
+        p = (unsigned char *)MP4E_REALLOC(h->allocator, h->data, new_size);
         if (!p)
         {
             return NULL;
@@ -202,10 +425,177 @@ static unsigned char * asp_vector_put(asp_vector_t * h, const void * buf, int by
     return tail;
 }
 
+/************************************************************************/
+/*      Pull output                                                     */
+/************************************************************************/
+
+/**
+*   Append buffer to the pull output chain
+*   return 1 on success
+*/
+static int mp4e_append_output(MP4E_mux_t * mux, mp4e_offset_t offset, const void * data, size_t bytes, 
+                              const output_ref_t * ref)
+{
+    MP4E_output_t out;
+    out.offset = offset;
+    out.data = data;
+    out.bytes = bytes;
+    if (!asp_vector_put(&mux->output_ref, ref, sizeof(output_ref_t)))
+    {
+        return 0;
+    }
+    if (!asp_vector_put(&mux->output, &out, sizeof(MP4E_output_t)))
+    {
+        mux->output_ref.bytes -= sizeof(output_ref_t);
+        return 0;
+    }
+    return 1;
+}
+
+/**
+*   Sink write() of the pull output mode: copy data to the chain
+*/
+static int mp4e_pull_write(void * token, mp4e_offset_t offset, const void * data, size_t bytes)
+{
+    MP4E_mux_t * mux = (MP4E_mux_t *)token;
+    output_ref_t ref = {0,};
+    if (!bytes)
+    {
+        return 0;
+    }
+    ref.data = MP4E_ALLOC(&mux->allocator, bytes);
+    if (!ref.data)
+    {
+        return 1;
+    }
+    memcpy((void *)ref.data, data, bytes);
+    if (!mp4e_append_output(mux, offset, ref.data, bytes, &ref))
+    {
+        MP4E_FREE(&mux->allocator, (void *)ref.data);
+        return 1;
+    }
+    return 0;
+}
+
+/**
+*   Sink write_ref() of the pull output mode: reference data by the chain,
+*   or copy it, if there is no release callback
+*/
+static int mp4e_pull_write_ref(void * token, mp4e_offset_t offset, const void * data, size_t bytes,
+                               MP4E_release_fn release, void * release_token)
+{
+    MP4E_mux_t * mux = (MP4E_mux_t *)token;
+    output_ref_t ref;
+    if (!release)
+    {
+        return mp4e_pull_write(token, offset, data, bytes);
+    }
+    ref.data = data;
+    ref.release = release;
+    ref.release_token = release_token;
+    if (!mp4e_append_output(mux, offset, data, bytes, &ref))
+    {
+        release(release_token, data);
+        return 1;
+    }
+    return 0;
+}
+
+/**
+*   Drain given number of bytes from the start of the pull output chain:
+*   release drained buffers, and advance partially drained one
+*/
+static void mp4e_drain_output(MP4E_mux_t * mux, mp4e_offset_t bytes)
+{
+    MP4E_output_t * out = (MP4E_output_t *)mux->output.data;
+    output_ref_t * ref = (output_ref_t *)mux->output_ref.data;
+    size_t count = mux->output.bytes / sizeof(MP4E_output_t);
+    while (bytes && mux->output_head < count)
+    {
+        MP4E_output_t * o = out + mux->output_head;
+        output_ref_t * r = ref + mux->output_head;
+        if (bytes < o->bytes)
+        {
+            o->offset += bytes;
+            o->data = (const unsigned char *)o->data + bytes;
+            o->bytes -= (size_t)bytes;
+            break;
+        }
+        bytes -= o->bytes;
+        if (r->release)
+        {
+            r->release(r->release_token, r->data);
+        }
+        else
+        {
+            MP4E_FREE(&mux->allocator, (void *)r->data);
+        }
+        mux->output_head++;
+    }
+    if (mux->output_head && (mux->output_head == count || mux->output_head >= 256))
+    {
+        // move pending buffers to the start of the vectors
+        count -= mux->output_head;
+        memmove(out, out + mux->output_head, count*sizeof(MP4E_output_t));
+        memmove(ref, ref + mux->output_head, count*sizeof(output_ref_t));
+        mux->output.bytes = count*sizeof(MP4E_output_t);
+        mux->output_ref.bytes = count*sizeof(output_ref_t);
+        mux->output_head = 0;
+    }
+}
+
 /************************************************************************/
 /*  Index data structure managment functions                            */
 /************************************************************************/
 
+/**
+*   Release multiplexer memory, and close output file handle, but not free the object
+*/
+static void mp4e_reset(MP4E_mux_t * mux)
+{
+    unsigned long ntr, ntracks = mux->tracks.bytes / sizeof(track_t);
+    for (ntr = 0; ntr < ntracks && !mux->track_owner; ntr++)
+    {
+        track_t* tr = ((track_t*)mux->tracks.data) + ntr;
+        asp_vector_reset(&tr->vsps);
+        asp_vector_reset(&tr->vpps);
+    }
+    if (mux->track_owner)
+    {
+        memset(&mux->tracks, 0, sizeof(asp_vector_t));
+    }
+    asp_vector_reset(&mux->tracks);
+    for (ntr = 0; ntr < mux->index.bytes / sizeof(track_index_t); ntr++)
+    {
+        asp_vector_reset(&((track_index_t*)mux->index.data)[ntr].smpl);
+    }
+    asp_vector_reset(&mux->index);
+    for (ntr = 0; ntr < mux->chunk.bytes / sizeof(chunk_sample_t); ntr++)
+    {
+        chunk_sample_t * cs = ((chunk_sample_t*)mux->chunk.data) + ntr;
+        if (cs->release)
+        {
+            cs->release(cs->release_token, cs->data);
+        }
+    }
+    asp_vector_reset(&mux->chunk);
+    asp_vector_reset(&mux->chunk_data);
+    asp_vector_reset(&mux->random_access);
+    mp4e_drain_output(mux, (mp4e_offset_t)-1);
+    asp_vector_reset(&mux->output);
+    asp_vector_reset(&mux->output_ref);
+    if (mux->mp4file)
+    {
+        fclose(mux->mp4file);
+        mux->mp4file = NULL;
+    }
+    if (mux->text_comment)
+    {
+        MP4E_FREE(&mux->allocator, mux->text_comment);
+        mux->text_comment = NULL;
+    }
+}
+
 /**
 *   Destroy multiplexer object: release memory, close output file handle
 */
@@ -213,19 +603,37 @@ static void mp4e_free(MP4E_mux_t * mux)
 {
     if (mux) 
     {
-        unsigned long ntr, ntracks = mux->tracks.bytes / sizeof(track_t);
-        for (ntr = 0; ntr < ntracks; ntr++)
+        mp4e_reset(mux);
+        MP4E_FREE(&mux->allocator, mux);
+    }
+}
+
+/**
+*   Take the tracks of the owner, if the track table is shared, and add samples 
+*   list for new tracks
+*   return 1 on success
+*/
+static int mp4e_sync_tracks(MP4E_mux_t * mux)
+{
+    if (mux->track_owner)
+    {
+        mux->tracks = mux->track_owner->tracks;
+    }
+    while (mux->index.bytes / sizeof(track_index_t) < mux->tracks.bytes / sizeof(track_t))
+    {
+        track_index_t * ix = (track_index_t *)asp_vector_alloc_tail(&mux->index, sizeof(track_index_t));
+        if (!ix)
         {
-            track_t* tr = ((track_t*)mux->tracks.data) + ntr;
-            asp_vector_reset(&tr->vsps);
-            asp_vector_reset(&tr->vpps);
-            asp_vector_reset(&tr->smpl);
+            return 0;
+        }
+        memset(ix, 0, sizeof(track_index_t));
+        if (!asp_vector_init(&ix->smpl, 256, &mux->allocator))
+        {
+            mux->index.bytes -= sizeof(track_index_t);
+            return 0;
         }
-        asp_vector_reset(&mux->tracks);
-        fclose(mux->mp4file);
-        free(mux->text_comment);
-        free(mux);
     }
+    return 1;
 }
 
 /**
@@ -270,11 +678,11 @@ static int mp4e_sps_pps_items_count(asp_vector_t * v)
 /**
 *   Return sum of track samples duration.
 */
-static unsigned mp4e_get_track_duration(const track_t * tr)
+static unsigned mp4e_get_track_duration(const track_index_t * ix)
 {
-    unsigned i, sum_duration = 0;
-    const sample_t * s = (const sample_t *)tr->smpl.data;
-    for (i = 0; i < tr->smpl.bytes/sizeof(sample_t); i++)
+    unsigned i, sum_duration = ix->removed_duration;
+    const sample_t * s = (const sample_t *)ix->smpl.data;
+    for (i = 0; i < ix->smpl.bytes/sizeof(sample_t); i++)
     {
         sum_duration += s[i].duration;
     }
@@ -292,16 +700,50 @@ static int mp4e_od_size_of_size(int size)
 }
 
 /**
-*   Append sample descriptor to the samples list
+*   Append sample descriptor to the samples list, and update track timing, if 
+*   the track table is not shared. In fragmentation mode without chunks, sample 
+*   headers are already written, and only the last sample is kept, to update 
+*   its duration.
 */
-static int mp4e_add_sample_descriptor(MP4E_mux_t * mux, track_t * tr, int data_bytes, int duration, int kind)
+static int mp4e_add_sample_descriptor(MP4E_mux_t * mux, track_t * tr, track_index_t * ix, int data_bytes, int duration, 
+                                      int kind, mp4e_time_t dts, int composition_offset)
 {
     sample_t smp;
     smp.size = data_bytes;
     smp.offset = (mp4e_size_t)mux->write_pos;
     smp.duration = (duration ? duration : tr->info.default_duration);
     smp.flag_random_access = (kind == MP4E_SAMPLE_RANDOM_ACCESS);
-    return NULL != asp_vector_put(&tr->smpl, &smp, sizeof(sample_t));
+    smp.composition_offset = composition_offset;
+    if (mux->enable_fragmentation && !mux->chunk_duration_ms && ix->smpl.bytes)
+    {
+        ix->removed_duration += ((const sample_t *)ix->smpl.data)->duration;
+        ix->smpl.bytes = 0;
+    }
+    if (!asp_vector_put(&ix->smpl, &smp, sizeof(sample_t)))
+    {
+        return 0;
+    }
+    if (!mux->track_owner)
+    {
+        tr->last_dts = dts;
+        tr->next_dts = dts + smp.duration;
+        tr->has_composition_offset |= (composition_offset != 0);
+    }
+    return 1;
+}
+
+/**
+*   Append random access point to the list for 'tfra' box
+*/
+static int mp4e_add_random_access(MP4E_mux_t * mux, mp4e_time_t time, mp4e_size_t moof_offset, 
+                                  unsigned traf_number, unsigned sample_number)
+{
+    random_access_t ra;
+    ra.time = time;
+    ra.moof_offset = moof_offset;
+    ra.traf_number = traf_number;
+    ra.sample_number = sample_number;
+    return NULL != asp_vector_put(&mux->random_access, &ra, sizeof(random_access_t));
 }
 
 /************************************************************************/
@@ -328,6 +770,17 @@ static int mp4e_write_file_header(MP4E_mux_t * mux)
         'i','s','o','2','a','v','c','1', 
 #endif
     };
+    // CMAF header: 'cmfc' brand
+    static const unsigned char mp4e_box_ftyp_cmaf[] = 
+    {
+        0,0,0,0x1c,'f','t','y','p',
+        'i','s','o','6',0,0,0,0,
+        'i','s','o','6','c','m','f','c','m','p','4','2',
+    };
+    if (mux->chunk_duration_ms)
+    {
+        return mp4e_fwrite(mux, mp4e_box_ftyp_cmaf, sizeof(mp4e_box_ftyp_cmaf)) ? sizeof(mp4e_box_ftyp_cmaf) : 0;
+    }
     return mp4e_fwrite(mux, mp4e_box_ftyp, sizeof(mp4e_box_ftyp)) ? sizeof(mp4e_box_ftyp) : 0;
 }
 
@@ -343,27 +796,43 @@ static int mp4e_write_mdat_box(MP4E_mux_t * mux, unsigned data_bytes)
 }
 
 /**
-*   Write Movie Fragment: 'moof' box 
+*   Write headers at the beginning of the file
+*/
+static int mp4e_start_file(MP4E_mux_t * mux)
+{
+    int success = !!mp4e_write_file_header(mux);
+#if MP4E_CAN_USE_RANDOM_FILE_ACCESS
+    if (!mux->enable_fragmentation && !mux->checkpoint_interval_ms)
+    {
+        // in checkpoint mode, 'mdat' box follows 1st checkpoint
+        mux->mdat_pos = mux->write_pos;
+        success &= mp4e_write_mdat_box(mux, 0);    // Write stub, which would be updated later
+    }
+#endif
+    return success;
+}
+
+/**
+*   Build Movie Fragment 'moof' box template for given track and sample kind,
+*   with or without composition time offset.
+*   Variable fields are zero-filled; their positions saved in the template.
 */
-static int mp4e_write_fragment_header(MP4E_mux_t * mux, int track_num, int data_bytes, int duration, int kind)
+static void mp4e_build_fragment_template(track_t * tr, int track_num, int kind, int composition, fragment_template_t * t)
 {
-    unsigned char write_base[888], *write_ptr = write_base;     // for WRITE_4 macro
+    unsigned char *write_base = t->data, *write_ptr = write_base;     // for WRITE_4 macro
     // atoms nesting stack
     unsigned char * stack_base[20];
     unsigned char ** stack = stack_base;
     unsigned flags;
     unsigned char * pdata_offset;
-    enum 
-    {
-        default_sample_duration_present = 0x000008,
-        default_sample_flags_present = 0x000020,
-    } e;
+    const int duration = 0, data_bytes = 0;     // patched by mp4e_write_fragment_header()
 
-    track_t * tr = ((track_t*)mux->tracks.data) + track_num;
+    memset(t, 0, sizeof(fragment_template_t));
 
     MP4_ATOM(BOX_moof)
         MP4_FULL_ATOM(BOX_mfhd, 0)
-            WR4(mux->fragments_count);  // start from 1
+            t->pos_sequence = (unsigned char)(write_ptr - write_base);
+            WR4(0);                     // sequence_number, start from 1
         MP4_END_ATOM
         MP4_ATOM(BOX_traf)
             flags = 0;
@@ -381,59 +850,140 @@ static int mp4e_write_fragment_header(MP4E_mux_t * mux, int track_num, int data_
                 WR4(track_num+1);       // track_ID
                 if (tr->info.track_media_kind == e_video)
                 {
-                    flags  = 0x001;     // data-offset-present
-                    flags |= 0x100;     // sample-duration-present
                     WR4(0x1010000);     // default_sample_flags
                 }
                 else
                 {
+                    t->pos_duration[0] = (unsigned char)(write_ptr - write_base);
                     WR4(duration);
                 }
             MP4_END_ATOM
-            if (tr->info.track_media_kind == e_audio)
+            MP4_FULL_ATOM(BOX_tfdt, 0x01000000)     // version 1: 64-bit time
+                t->pos_decode_time = (unsigned char)(write_ptr - write_base);
+                WR4(0); WR4(0);         // baseMediaDecodeTime
+            MP4_END_ATOM
+            flags  = 0;
+            flags |= 0x001;             // data-offset-present
+            if (tr->info.track_media_kind != e_audio)
             {
-                flags  = 0;
-                flags |= 0x001;         // data-offset-present
-                flags |= 0x200;         // sample-size-present
-                MP4_FULL_ATOM(BOX_trun, flags)
-                    WR4(1);             // sample_count
-                    pdata_offset = write_ptr; write_ptr += 4;   // save ptr to data_offset
-                    WR4(duration);      // sample_duration
-                MP4_END_ATOM
+                if (kind == MP4E_SAMPLE_RANDOM_ACCESS)
+                {
+                    flags |= 0x004;     // first-sample-flags-present
+                }
+                flags |= 0x100;         // sample-duration-present
             }
-            else if (kind == MP4E_SAMPLE_RANDOM_ACCESS)
+            flags |= 0x200;             // sample-size-present
+            if (composition)
             {
-                flags  = 0;
-                flags |= 0x001;         // data-offset-present
-                flags |= 0x004;         // first-sample-flags-present
-                flags |= 0x100;         // sample-duration-present
-                flags |= 0x200;         // sample-size-present
-                MP4_FULL_ATOM(BOX_trun, flags)
-                    WR4(1);             // sample_count
-                    pdata_offset = write_ptr; write_ptr += 4;   // save ptr to data_offset
+                flags |= 0x800;         // sample-composition-time-offsets-present
+                flags |= 0x01000000;    // version 1: signed offset
+            }
+            MP4_FULL_ATOM(BOX_trun, flags)
+                WR4(1);                 // sample_count
+                pdata_offset = write_ptr; write_ptr += 4;   // save ptr to data_offset
+                if (flags & 0x004)
+                {
                     WR4(0x2000000);     // first_sample_flags
+                }
+                if (flags & 0x100)
+                {
+                    t->pos_duration[1] = (unsigned char)(write_ptr - write_base);
                     WR4(duration);      // sample_duration
-                    WR4(data_bytes);    // sample_size
-                MP4_END_ATOM
-            }
-            else
+                }
+                t->pos_size = (unsigned char)(write_ptr - write_base);
+                WR4(data_bytes);        // sample_size
+                if (flags & 0x800)
+                {
+                    t->pos_composition = (unsigned char)(write_ptr - write_base);
+                    WR4(0);             // sample_composition_time_offset
+                }
+            MP4_END_ATOM
+        MP4_END_ATOM
+    MP4_END_ATOM
+    MP4_WR4_PTR(pdata_offset, (write_ptr - write_base) + 8);
+
+    assert(write_ptr - write_base <= FRAGMENT_HEADER_BYTES);
+    t->bytes = (unsigned char)(write_ptr - write_base);
+}
+
+/**
+*   Write Movie Fragment: 'moof' box, patching pre-built template
+*/
+static int mp4e_write_fragment_header(MP4E_mux_t * mux, int track_num, int data_bytes, int duration, int kind, 
+                                      mp4e_time_t dts, int composition_offset)
+{
+    track_t * tr = ((track_t*)mux->tracks.data) + track_num;
+    fragment_template_t * t = &tr->moof[composition_offset != 0][kind == MP4E_SAMPLE_RANDOM_ACCESS];
+
+    MP4_WR4_PTR(t->data + t->pos_sequence, mux->fragments_count);
+    MP4_WR4_PTR(t->data + t->pos_decode_time, (mp4e_offset_t)dts >> 32);
+    MP4_WR4_PTR(t->data + t->pos_decode_time + 4, dts);
+    if (t->pos_duration[0])
+    {
+        MP4_WR4_PTR(t->data + t->pos_duration[0], duration);
+    }
+    if (t->pos_duration[1])
+    {
+        MP4_WR4_PTR(t->data + t->pos_duration[1], duration);
+    }
+    MP4_WR4_PTR(t->data + t->pos_size, data_bytes);
+    if (t->pos_composition)
+    {
+        MP4_WR4_PTR(t->data + t->pos_composition, composition_offset);
+    }
+    return mp4e_fwrite(mux, t->data, t->bytes);
+}
+
+/**
+*   Write Movie Fragment Random Access 'mfra' box: 'tfra' box with random
+*   access points of the sync track, and 'mfro' box, which gives 'mfra' size
+*   to the reader at the end of file.
+*/
+static int mp4e_write_mfra(MP4E_mux_t * mux)
+{
+    // atoms nesting stack
+    unsigned char * stack_base[20];
+    unsigned char ** stack = stack_base;
+    unsigned char * write_base, * write_ptr;
+
+    const random_access_t * ra = (const random_access_t *)mux->random_access.data;
+    unsigned i, count = (unsigned)(mux->random_access.bytes / sizeof(random_access_t));
+    unsigned mfra_bytes = 8 + 24 + count*22 + 16;
+    int error_code = MP4E_STATUS_OK;
+
+    write_base = write_ptr = (unsigned char *)MP4E_ALLOC(&mux->allocator, mfra_bytes);
+    if (!write_base)
+    {
+        return MP4E_STATUS_NO_MEMORY;
+    }
+    MP4_ATOM(BOX_mfra)
+        MP4_FULL_ATOM(BOX_tfra, 0x01000000)     // version 1: 64-bit time and offset
+            WR4(mux->sync_track + 1);           // track_ID
+            WR4(0x03);                          // 1-byte traf_number and trun_number, 4-byte sample_number
+            WR4(count);                         // number_of_entry
+            for (i = 0; i < count; i++)
             {
-                flags  = 0;
-                flags |= 0x001;         // data-offset-present
-                flags |= 0x100;         // sample-duration-present
-                flags |= 0x200;         // sample-size-present
-                MP4_FULL_ATOM(BOX_trun, flags)
-                    WR4(1);             // sample_count
-                    pdata_offset = write_ptr; write_ptr += 4;   // save ptr to data_offset
-                    WR4(duration);      // sample_duration
-                    WR4(data_bytes);    // sample_size
-                MP4_END_ATOM
+                WR4((mp4e_offset_t)ra[i].time >> 32);
+                WR4(ra[i].time);                // time
+                WR4(0);
+                WR4(ra[i].moof_offset);         // moof_offset
+                WR1(ra[i].traf_number);
+                WR1(1);                         // trun_number
+                WR4(ra[i].sample_number);
             }
         MP4_END_ATOM
+        MP4_FULL_ATOM(BOX_mfro, 0)
+            WR4(mfra_bytes);                    // size of 'mfra' box
+        MP4_END_ATOM
     MP4_END_ATOM
-    MP4_WR4_PTR(pdata_offset, (write_ptr - write_base) + 8);
 
-    return mp4e_fwrite(mux, write_base, write_ptr - write_base);
+    assert((unsigned)(write_ptr - write_base) == mfra_bytes);
+    if (!mp4e_fwrite(mux, write_base, write_ptr - write_base))
+    {
+        error_code = MP4E_STATUS_FILE_WRITE_ERROR;
+    }
+    MP4E_FREE(&mux->allocator, write_base);
+    return error_code;
 }
 
 /**
@@ -462,15 +1012,21 @@ static int mp4e_write_index(MP4E_mux_t * mux)
     for (ntr = 0; ntr < ntracks; ntr++)
     {
         track_t * tr = ((track_t*)mux->tracks.data) + ntr;
+        track_index_t * ix = ((track_index_t*)mux->index.data) + ntr;
         index_bytes += TRACK_HEADER_BYTES;          // fixed amount (implementation-dependent)
         // may need extra 4 bytes for duration field + 4 bytes for worst-case random access box
-        index_bytes += tr->smpl.bytes * (sizeof(sample_t) + 4 + 4) / sizeof(sample_t);
+        index_bytes += ix->smpl.bytes * (sizeof(sample_t) + 4 + 4) / sizeof(sample_t);
+        if (tr->has_composition_offset)
+        {
+            // worst-case composition offset box: entry per sample
+            index_bytes += ix->smpl.bytes * 8 / sizeof(sample_t);
+        }
         index_bytes += tr->vsps.bytes;
         index_bytes += tr->vpps.bytes;
     }
 
     // Allocate index memory
-    write_base = (unsigned char*)malloc(index_bytes);
+    write_base = (unsigned char*)MP4E_ALLOC(&mux->allocator, index_bytes);
     if (!write_base)
     {
         return MP4E_STATUS_NO_MEMORY;
@@ -488,7 +1044,7 @@ static int mp4e_write_index(MP4E_mux_t * mux)
         if (ntracks)
         {
             track_t * tr = ((track_t*)mux->tracks.data) + 0;    // take 1st track
-            unsigned duration = mp4e_get_track_duration(tr);
+            unsigned duration = mp4e_get_track_duration((track_index_t*)mux->index.data);
             duration = (unsigned)(duration * 1LL * MOOV_TIMESCALE / tr->info.time_scale);
             WR4(MOOV_TIMESCALE); // duration
             WR4(duration); // duration
@@ -518,9 +1074,10 @@ static int mp4e_write_index(MP4E_mux_t * mux)
     for (ntr = 0; ntr < ntracks; ntr++)
     {
         track_t * tr = ((track_t*)mux->tracks.data) + ntr;
-        unsigned duration = mp4e_get_track_duration(tr);
-        int samples_count = (int)(tr->smpl.bytes / sizeof(sample_t));
-        const sample_t * sample = (const sample_t *)tr->smpl.data;
+        track_index_t * ix = ((track_index_t*)mux->index.data) + ntr;
+        unsigned duration = mp4e_get_track_duration(ix);
+        int samples_count = (int)(ix->smpl.bytes / sizeof(sample_t));
+        const sample_t * sample = (const sample_t *)ix->smpl.data;
         unsigned handler_type;
         const char * handler_ascii = NULL;
 
@@ -789,16 +1346,42 @@ static int mp4e_write_index(MP4E_mux_t * mux)
                         }
                         MP4_END_ATOM;
 
-                        // Sample To Chunk Box 
-                        MP4_FULL_ATOM(BOX_stsc, 0);
-                        if (mux->enable_fragmentation)
-                        {
-                            WR4(0); // entry_count
-                        }
-                        else 
+                        // Composition Time to Sample Box
+                        if (tr->has_composition_offset && samples_count)
                         {
-                            WR4(1); // entry_count
-                            WR4(1); // first_chunk;
+                            unsigned char * pentry_count;
+                            int cnt = 1, entry_count = 0, negative = 0;
+                            for (i = 0; i < samples_count; i++)
+                            {
+                                negative |= (sample[i].composition_offset < 0);
+                            }
+                            MP4_FULL_ATOM(BOX_ctts, negative ? 0x01000000 : 0);    // version 1: signed offsets
+                            pentry_count = write_ptr;
+                            WR4(0);
+                            for (i = 0; i < samples_count; i++, cnt++)
+                            {
+                                if (i == samples_count-1 || sample[i].composition_offset != sample[i+1].composition_offset)
+                                {
+                                    WR4(cnt);
+                                    WR4(sample[i].composition_offset);
+                                    cnt = 0;
+                                    entry_count++;
+                                }
+                            }
+                            MP4_WR4_PTR(pentry_count, entry_count);
+                            MP4_END_ATOM;
+                        }
+
+                        // Sample To Chunk Box 
+                        MP4_FULL_ATOM(BOX_stsc, 0);
+                        if (mux->enable_fragmentation)
+                        {
+                            WR4(0); // entry_count
+                        }
+                        else 
+                        {
+                            WR4(1); // entry_count
+                            WR4(1); // first_chunk;
                             WR4(1); // samples_per_chunk;
                             WR4(1); // sample_description_index;
                         }
@@ -877,8 +1460,7 @@ static int mp4e_write_index(MP4E_mux_t * mux)
 
     if (mux->enable_fragmentation) 
     {
-        track_t * tr = ((track_t*)mux->tracks.data) + 0;
-        unsigned movie_duration = mp4e_get_track_duration(tr);
+        unsigned movie_duration = ntracks ? mp4e_get_track_duration((track_index_t*)mux->index.data) : 0;
 
         MP4_ATOM(BOX_mvex);
             MP4_FULL_ATOM(BOX_mehd, 0);
@@ -909,21 +1491,328 @@ static int mp4e_write_index(MP4E_mux_t * mux)
     {
         error_code = MP4E_STATUS_OK;
     }
-    free(write_base);
+    MP4E_FREE(&mux->allocator, write_base);
 
 
 #if MP4E_CAN_USE_RANDOM_FILE_ACCESS
-    if (!mux->enable_fragmentation) 
+    if (!mux->enable_fragmentation && mux->mdat_pos) 
     {
         // update size of mdat box.
-        fseek(mux->mp4file, 0, SEEK_SET);
-        mp4e_write_mdat_box(mux, mdat_end - mp4e_write_file_header(mux));
+        mp4e_fseek(mux, mux->mdat_pos);
+        mp4e_write_mdat_box(mux, mdat_end - mux->mdat_pos);
     }
 #endif
 
     return error_code;
 }
 
+/************************************************************************/
+/*      Checkpoints and recovery                                        */
+/************************************************************************/
+
+/**
+*   Read big-endian 32-bit value from memory
+*/
+static unsigned mp4e_get4(const unsigned char * p)
+{
+    return ((unsigned)p[0] << 24) | ((unsigned)p[1] << 16) | ((unsigned)p[2] << 8) | p[3];
+}
+
+/**
+*   Write sample record header in checkpoint mode: sample data size, track 
+*   number with random access flag, duration and composition offset
+*/
+static int mp4e_write_sample_record(MP4E_mux_t * mux, int track_num, int data_bytes, int duration, int kind, 
+                                    int composition_offset)
+{
+    unsigned char write_base[CHECKPOINT_RECORD_BYTES], *write_ptr = write_base;     // for WR4 macro
+    WR4(data_bytes);
+    WR4(track_num | (kind == MP4E_SAMPLE_RANDOM_ACCESS ? 0x80000000u : 0));
+    WR4(duration);
+    WR4(composition_offset);
+    return mp4e_fwrite(mux, write_base, CHECKPOINT_RECORD_BYTES) ? MP4E_STATUS_OK : MP4E_STATUS_FILE_WRITE_ERROR;
+}
+
+/**
+*   Write index checkpoint: close current 'mdat' box, write 'free' box with
+*   track configuration and descriptors of samples, written since previous
+*   checkpoint, and open new 'mdat' box.
+*   Last sample of the previous checkpoint is repeated, since its duration
+*   is updated by MP4E__put_sample_ts(), when next sample arrives.
+*/
+static int mp4e_write_checkpoint(MP4E_mux_t * mux)
+{
+    unsigned char * write_base, * write_ptr;
+    unsigned ntr, ntracks = (unsigned)(mux->tracks.bytes / sizeof(track_t));
+    unsigned checkpoint_bytes = 8 + 8;
+    mp4e_size_t pos = mux->write_pos;
+    int error_code = MP4E_STATUS_OK;
+
+    for (ntr = 0; ntr < ntracks; ntr++)
+    {
+        track_t * tr = ((track_t*)mux->tracks.data) + ntr;
+        track_index_t * ix = ((track_index_t*)mux->index.data) + ntr;
+        unsigned first = ix->checkpoint_samples ? ix->checkpoint_samples - 1 : 0;
+        checkpoint_bytes += 7*4 + 4 + (unsigned)tr->vsps.bytes + 4 + (unsigned)tr->vpps.bytes + 8;
+        checkpoint_bytes += (unsigned)(ix->smpl.bytes/sizeof(sample_t) - first)*16;
+    }
+    write_base = write_ptr = (unsigned char *)MP4E_ALLOC(&mux->allocator, checkpoint_bytes);
+    if (!write_base)
+    {
+        return MP4E_STATUS_NO_MEMORY;
+    }
+
+    WR4(checkpoint_bytes);
+    WR4(BOX_free);
+    WR4(CHECKPOINT_MAGIC);
+    WR4(ntracks);
+    for (ntr = 0; ntr < ntracks; ntr++)
+    {
+        track_t * tr = ((track_t*)mux->tracks.data) + ntr;
+        track_index_t * ix = ((track_index_t*)mux->index.data) + ntr;
+        const sample_t * smpl = (const sample_t *)ix->smpl.data;
+        unsigned i, count = (unsigned)(ix->smpl.bytes/sizeof(sample_t));
+        unsigned first = ix->checkpoint_samples ? ix->checkpoint_samples - 1 : 0;
+
+        // track configuration
+        WR4(tr->info.object_type_indication);
+        memcpy(write_ptr, tr->info.language, 4);
+        write_ptr += 4;
+        WR4(tr->info.track_media_kind);
+        WR4(tr->info.time_scale);
+        WR4(tr->info.default_duration);
+        WR4(tr->info.u.v.width);            // or u.a.channelcount
+        WR4(tr->info.u.v.height);
+        WR4(tr->vsps.bytes);
+        if (tr->vsps.bytes)
+        {
+            memcpy(write_ptr, tr->vsps.data, tr->vsps.bytes);
+            write_ptr += tr->vsps.bytes;
+        }
+        WR4(tr->vpps.bytes);
+        if (tr->vpps.bytes)
+        {
+            memcpy(write_ptr, tr->vpps.data, tr->vpps.bytes);
+            write_ptr += tr->vpps.bytes;
+        }
+
+        // new samples
+        WR4(first);
+        WR4(count - first);
+        for (i = first; i < count; i++)
+        {
+            WR4(smpl[i].offset);
+            WR4(smpl[i].size | (smpl[i].flag_random_access ? 0x80000000u : 0));
+            WR4(smpl[i].duration);
+            WR4(smpl[i].composition_offset);
+        }
+        ix->checkpoint_samples = count;
+    }
+    assert((unsigned)(write_ptr - write_base) == checkpoint_bytes);
+
+    if (mux->mdat_pos)
+    {
+        // close current 'mdat' box
+        mp4e_fseek(mux, mux->mdat_pos);
+        mp4e_write_mdat_box(mux, pos - mux->mdat_pos);
+        mp4e_fseek(mux, pos);
+    }
+    if (!mp4e_fwrite(mux, write_base, checkpoint_bytes))
+    {
+        error_code = MP4E_STATUS_FILE_WRITE_ERROR;
+    }
+    else
+    {
+        mux->mdat_pos = mux->write_pos;
+        if (!mp4e_write_mdat_box(mux, 0))
+        {
+            error_code = MP4E_STATUS_FILE_WRITE_ERROR;
+        }
+    }
+    MP4E_FREE(&mux->allocator, write_base);
+
+    if (error_code == MP4E_STATUS_OK)
+    {
+        if (mux->mp4file)
+        {
+            fflush(mux->mp4file);
+        }
+        if (mux->flush)
+        {
+            mux->flush(mux->flush_token, 0, mux->write_pos, MP4E_FLUSH_CHECKPOINT);
+        }
+    }
+    return error_code;
+}
+
+/**
+*   Create multiplexer object, which appends index to existing file
+*   return multiplexer handle on success; NULL on failure
+*/
+static MP4E_mux_t * mp4e_open_recovery(FILE * mp4file)
+{
+    static const MP4_allocator_t default_allocator = 
+    {
+        mp4e_default_allocate, mp4e_default_reallocate, mp4e_default_deallocate, NULL
+    };
+    MP4E_mux_t * mux = (MP4E_mux_t *)MP4E_ALLOC(&default_allocator, sizeof(MP4E_mux_t));
+    if (mux)
+    {
+        memset(mux, 0, sizeof(MP4E_mux_t));
+        mux->allocator = default_allocator;
+        mux->mp4file = mp4file;
+        asp_vector_init(&mux->index, 0, &mux->allocator);
+        if (!asp_vector_init(&mux->tracks, 2*sizeof(track_t), &mux->allocator))
+        {
+            mux->mp4file = NULL;
+            mp4e_free(mux);
+            mux = NULL;
+        }
+    }
+    return mux;
+}
+
+/**
+*   Write 'moov' box at given position, if no error occurred; destroy the 
+*   multiplexer object, but not close the file
+*   return error code MP4E_STATUS_*
+*/
+static int mp4e_close_recovery(MP4E_mux_t * mux, int error_code, mp4e_size_t pos)
+{
+    if (error_code == MP4E_STATUS_OK)
+    {
+        mp4e_fseek(mux, pos);
+        error_code = mp4e_write_index(mux);
+        fflush(mux->mp4file);
+    }
+    mux->mp4file = NULL;    // not owned
+    mp4e_free(mux);
+    return error_code;
+}
+
+/**
+*   Check, if sample data at given file position is H.264 access unit: chain
+*   of NAL units with 4-byte size prefix, which exactly fills the sample.
+*   return 0 if not, 1 for non-IDR access unit, 2 for IDR access unit
+*/
+static int mp4e_scan_avc_sample(FILE * f, mp4e_size_t pos, mp4e_size_t bytes)
+{
+    unsigned char nal[5];
+    mp4e_size_t end = pos + bytes;
+    int result = 1;
+    while (pos < end)
+    {
+        unsigned nal_bytes, nal_type;
+        if (end - pos < 5 || fseek(f, (long)pos, SEEK_SET) || fread(nal, 1, 5, f) != 5)
+        {
+            return 0;
+        }
+        nal_bytes = mp4e_get4(nal);
+        nal_type = nal[4] & 0x1F;
+        if (!nal_bytes || nal_bytes > end - pos - 4 || (nal[4] & 0x80) || !nal_type || nal_type > 23)
+        {
+            return 0;   // forbidden_zero_bit, or reserved NAL unit type
+        }
+        if (nal_type == 5)
+        {
+            result = 2; // IDR slice
+        }
+        pos += 4 + nal_bytes;
+    }
+    return bytes ? result : 0;
+}
+
+/**
+*   Read checkpoint 'free' box payload to the multiplexer tracks
+*   return 1 on success, 0 if this is not a valid checkpoint
+*/
+static int mp4e_read_checkpoint(MP4E_mux_t * mux, const unsigned char * p, const unsigned char * end)
+{
+    unsigned ntr, ntracks;
+    if (end - p < 8 || mp4e_get4(p) != CHECKPOINT_MAGIC)
+    {
+        return 0;
+    }
+    ntracks = mp4e_get4(p + 4);
+    p += 8;
+    for (ntr = 0; ntr < ntracks; ntr++)
+    {
+        MP4E_track_t info;
+        track_t * tr;
+        track_index_t * ix;
+        unsigned i, first, count;
+
+        if (end - p < 7*4)
+        {
+            return 0;
+        }
+        memset(&info, 0, sizeof(info));
+        info.object_type_indication = mp4e_get4(p);
+        memcpy(info.language, p + 4, 4);
+        info.track_media_kind = (int)mp4e_get4(p + 8);
+        info.time_scale = mp4e_get4(p + 12);
+        info.default_duration = mp4e_get4(p + 16);
+        info.u.v.width = (int)mp4e_get4(p + 20);
+        info.u.v.height = (int)mp4e_get4(p + 24);
+        p += 7*4;
+        if (ntr*sizeof(track_t) >= mux->tracks.bytes && MP4E__add_track(mux, &info) < 0)
+        {
+            return 0;
+        }
+        tr = ((track_t*)mux->tracks.data) + ntr;
+        ix = ((track_index_t*)mux->index.data) + ntr;
+        tr->info = info;
+
+        // SPS (or DSI) and PPS lists
+        for (i = 0; i < 2; i++)
+        {
+            asp_vector_t * v = i ? &tr->vpps : &tr->vsps;
+            unsigned bytes;
+            if (end - p < 4 || (bytes = mp4e_get4(p)) > (unsigned)(end - p - 4))
+            {
+                return 0;
+            }
+            v->bytes = 0;
+            if (bytes && !asp_vector_put(v, p + 4, bytes))
+            {
+                return 0;
+            }
+            p += 4 + bytes;
+        }
+
+        // samples, which replace samples from given one
+        if (end - p < 8)
+        {
+            return 0;
+        }
+        first = mp4e_get4(p);
+        count = mp4e_get4(p + 4);
+        p += 8;
+        if (first > ix->smpl.bytes/sizeof(sample_t) || count > (unsigned)(end - p)/16)
+        {
+            return 0;
+        }
+        ix->smpl.bytes = first*sizeof(sample_t);
+        for (i = 0; i < count; i++, p += 16)
+        {
+            sample_t smp;
+            smp.offset = mp4e_get4(p);
+            smp.size = mp4e_get4(p + 4) & 0x7FFFFFFF;
+            smp.flag_random_access = mp4e_get4(p + 4) >> 31;
+            smp.duration = mp4e_get4(p + 8);
+            smp.composition_offset = (int)mp4e_get4(p + 12);
+            if (!asp_vector_put(&ix->smpl, &smp, sizeof(sample_t)))
+            {
+                return 0;
+            }
+            tr->has_composition_offset |= (smp.composition_offset != 0);
+        }
+        tr->next_dts = mp4e_get_track_duration(ix);
+    }
+    return 1;
+}
+
+
 /************************************************************************/
 /*      Exported API functions                                          */
 /************************************************************************/
@@ -934,27 +1823,95 @@ static int mp4e_write_index(MP4E_mux_t * mux)
 */
 MP4E_mux_t * MP4E__open(FILE * mp4file, int enable_fragmentation)
 {
+    MP4E_params_t params = {0,};
+    params.mp4file = mp4file;
+    params.enable_fragmentation = enable_fragmentation;
+    return MP4E__open_ex(&params);
+}
+
+/**
+*   Allocates and initialize mp4 multiplexer with extended parameters
+*   return multiplexer handle on success; NULL on failure
+*/
+MP4E_mux_t * MP4E__open_ex(const MP4E_params_t * params)
+{
+    static const MP4_allocator_t default_allocator = 
+    {
+        mp4e_default_allocate, mp4e_default_reallocate, mp4e_default_deallocate, NULL
+    };
+    const MP4_allocator_t * allocator;
     MP4E_mux_t * mux;
-    if (!mp4file)
+    if (!params || (!params->mp4file && !(params->sink && params->sink->write) && !params->pull_output) ||
+        (params->pull_output && (params->mp4file || params->sink || params->rotate)))
     {
         return NULL;
     }
+    if (params->track_owner && (params->rotate || params->max_pending_bytes || params->track_owner->track_owner ||
+        params->track_owner->rotate || params->track_owner->max_pending_bytes))
+    {
+        return NULL;    // track timing must be the same for both
+    }
 
-    mux = (MP4E_mux_t *)calloc(sizeof(MP4E_mux_t), 1);
+    allocator = params->allocator ? params->allocator : &default_allocator;
+    mux = (MP4E_mux_t *)MP4E_ALLOC(allocator, sizeof(MP4E_mux_t));
     if (mux)
     {
         int success;
-        mux->mp4file = mp4file;
-        mux->enable_fragmentation = enable_fragmentation;
-        asp_vector_init(&mux->tracks, 2*sizeof(track_t));
-
-        success = !!mp4e_write_file_header(mux);
+        memset(mux, 0, sizeof(MP4E_mux_t));
+        mux->allocator = *allocator;
+        if (params->pull_output)
+        {
+            mux->pull_output = 1;
+            mux->sink.write = mp4e_pull_write;
+            mux->sink.write_ref = mp4e_pull_write_ref;
+            mux->sink.token = mux;
+        }
+        else if (params->sink && params->sink->write)
+        {
+            mux->sink = *params->sink;
+        }
+        else
+        {
+            mux->mp4file = params->mp4file;
+        }
+        mux->enable_fragmentation = params->enable_fragmentation;
+        mux->chunk_duration_ms = params->enable_fragmentation ? params->cmaf_chunk_duration_ms : 0;
+        if (params->enable_fragmentation && params->segment_sink)
+        {
+            // segment is single chunk
+            mux->chunk_duration_ms = (unsigned)-1;
+            mux->segment_sink = params->segment_sink;
+            mux->segment_token = params->segment_token;
+        }
+        mux->segment_duration_ms = params->segment_duration_ms;
+        mux->flush = params->flush;
+        mux->flush_token = params->flush_token;
+        mux->track_owner = params->track_owner;
+        if (!mux->track_owner)
+        {
+            asp_vector_init(&mux->tracks, 2*sizeof(track_t), &mux->allocator);
+        }
+        asp_vector_init(&mux->index, 0, &mux->allocator);
+        asp_vector_init(&mux->chunk, 0, &mux->allocator);
+        asp_vector_init(&mux->chunk_data, 0, &mux->allocator);
+        asp_vector_init(&mux->random_access, 0, &mux->allocator);
+        asp_vector_init(&mux->output, 0, &mux->allocator);
+        asp_vector_init(&mux->output_ref, 0, &mux->allocator);
+
+        mux->rotate = params->rotate;
+        mux->rotate_token = params->rotate_token;
+        mux->rotate_duration_ms = params->rotate_duration_ms;
+        mux->rotate_bytes = params->rotate_bytes;
+        mux->file_number = 1;
+        mux->max_pending_bytes = params->max_pending_bytes;
+        mux->drop_frames = params->drop_frames;
 #if MP4E_CAN_USE_RANDOM_FILE_ACCESS
         if (!mux->enable_fragmentation)
         {
-            success &= mp4e_write_mdat_box(mux, 0);    // Write stub, which would be updated later
+            mux->checkpoint_interval_ms = params->checkpoint_interval_ms;
         }
 #endif
+        success = mp4e_start_file(mux);
         if (!success) 
         {
             mp4e_free(mux);
@@ -966,33 +1923,97 @@ MP4E_mux_t * MP4E__open(FILE * mp4file, int enable_fragmentation)
 }
 
 /**
-*   Closes MP4 multiplexer
+*   Write pending samples, and the file index
 */
-int MP4E__close(MP4E_mux_t * mux)
+static int mp4e_finish(MP4E_mux_t * mux)
 {
     int error_code = MP4E_STATUS_OK;
-    if (!mux) 
+    if (!mp4e_sync_tracks(mux))
     {
-        return MP4E_STATUS_BAD_ARGUMENTS;
+        return MP4E_STATUS_NO_MEMORY;
     }
-
     if (mux->enable_fragmentation)
     {
+        error_code = mp4e_write_chunk(mux);
+        if (error_code == MP4E_STATUS_OK && mux->fragments_count && !mux->segment_sink)
+        {
+            error_code = mp4e_write_mfra(mux);
+        }
 #if MP4E_CAN_USE_RANDOM_FILE_ACCESS
-        rewind(mux->mp4file);
+        mp4e_fseek(mux, 0);
         mp4e_write_file_header(mux);
-        error_code = mp4e_write_index(mux);
+        if (error_code == MP4E_STATUS_OK)
+        {
+            error_code = mp4e_write_index(mux);
+        }
 #endif
     }
     else
     {
         error_code = mp4e_write_index(mux);
     }
+    return error_code;
+}
+
+/**
+*   Write the file index, keeping the multiplexer
+*/
+int MP4E__finish(MP4E_mux_t * mux)
+{
+    if (!mux || mux->finished) 
+    {
+        return MP4E_STATUS_BAD_ARGUMENTS;
+    }
+    mux->finished = 1;
+    return mp4e_finish(mux);
+}
+
+/**
+*   Closes MP4 multiplexer
+*/
+int MP4E__close(MP4E_mux_t * mux)
+{
+    int error_code;
+    if (!mux) 
+    {
+        return MP4E_STATUS_BAD_ARGUMENTS;
+    }
+
+    error_code = mux->finished ? MP4E_STATUS_OK : mp4e_finish(mux);
     mp4e_free(mux);
 
     return error_code;
 }
 
+/**
+*   Report output bytes, written to the destination
+*/
+void MP4E__confirm_output(MP4E_mux_t * mux, mp4e_offset_t bytes)
+{
+    if (mux)
+    {
+        mux->confirmed_bytes += bytes;
+        if (mux->pull_output)
+        {
+            mp4e_drain_output(mux, bytes);
+        }
+    }
+}
+
+/**
+*   Get pending output buffers in pull output mode
+*/
+int MP4E__get_output(MP4E_mux_t * mux, const MP4E_output_t ** output, int * count)
+{
+    if (!mux || !mux->pull_output || !output || !count)
+    {
+        return MP4E_STATUS_BAD_ARGUMENTS;
+    }
+    *output = (const MP4E_output_t *)mux->output.data + mux->output_head;
+    *count = (int)(mux->output.bytes / sizeof(MP4E_output_t) - mux->output_head);
+    return MP4E_STATUS_OK;
+}
+
 /**
 *   Add new track, return track ID
 */
@@ -1000,7 +2021,7 @@ int MP4E__add_track(MP4E_mux_t * mux, const MP4E_track_t * track_data)
 {
     track_t *tr;
 
-    if (!mux || !track_data)
+    if (!mux || !track_data || mux->track_owner)
     {
         return MP4E_STATUS_BAD_ARGUMENTS;
     }
@@ -1016,12 +2037,25 @@ int MP4E__add_track(MP4E_mux_t * mux, const MP4E_track_t * track_data)
     }
     memset(tr, 0, sizeof(track_t));
     memcpy(&tr->info, track_data, sizeof(*track_data));
-    if (!asp_vector_init(&tr->smpl, 256))
+    asp_vector_init(&tr->vsps, 0, &mux->allocator);
+    asp_vector_init(&tr->vpps, 0, &mux->allocator);
+    if (!mp4e_sync_tracks(mux))
     {
+        mux->tracks.bytes -= sizeof(track_t);
         return MP4E_STATUS_NO_MEMORY;
     }
-    asp_vector_init(&tr->vsps, 0);
-    asp_vector_init(&tr->vpps, 0);
+    {
+        // fragment templates are built for any mode: the track table may be shared by fragmented output
+        int track_num = (int)(mux->tracks.bytes / sizeof(track_t)) - 1;
+        int composition, kind;
+        for (composition = 0; composition < 2; composition++)
+        {
+            for (kind = MP4E_SAMPLE_DEFAULT; kind <= MP4E_SAMPLE_RANDOM_ACCESS; kind++)
+            {
+                mp4e_build_fragment_template(tr, track_num, kind, composition, &tr->moof[composition][kind]);
+            }
+        }
+    }
     return (int)(mux->tracks.bytes / sizeof(track_t)) - 1;
 }
 
@@ -1030,7 +2064,12 @@ int MP4E__add_track(MP4E_mux_t * mux, const MP4E_track_t * track_data)
 */
 int MP4E__set_dsi(MP4E_mux_t * mux, int track_id, const void * dsi, int bytes)
 {
-    track_t* tr = ((track_t*)mux->tracks.data) + track_id;
+    track_t* tr;
+    if (mux->track_owner)
+    {
+        return MP4E_STATUS_BAD_ARGUMENTS;   // track table is set with the owner
+    }
+    tr = ((track_t*)mux->tracks.data) + track_id;
     assert(tr->info.track_media_kind == e_audio ||
            tr->info.track_media_kind == e_private);
     if (tr->vsps.bytes)
@@ -1049,7 +2088,12 @@ int MP4E__set_dsi(MP4E_mux_t * mux, int track_id, const void * dsi, int bytes)
 */
 int MP4E__set_sps(MP4E_mux_t * mux, int track_id, const void * sps, int bytes)
 {
-    track_t* tr = ((track_t*)mux->tracks.data) + track_id;
+    track_t* tr;
+    if (mux->track_owner)
+    {
+        return MP4E_STATUS_BAD_ARGUMENTS;   // track table is set with the owner
+    }
+    tr = ((track_t*)mux->tracks.data) + track_id;
     assert(tr->info.track_media_kind == e_video);
     if (mux->fragments_count)
     {
@@ -1063,7 +2107,12 @@ int MP4E__set_sps(MP4E_mux_t * mux, int track_id, const void * sps, int bytes)
 */
 int MP4E__set_pps(MP4E_mux_t * mux, int track_id, const void * pps, int bytes)
 {
-    track_t* tr = ((track_t*)mux->tracks.data) + track_id;
+    track_t* tr;
+    if (mux->track_owner)
+    {
+        return MP4E_STATUS_BAD_ARGUMENTS;   // track table is set with the owner
+    }
+    tr = ((track_t*)mux->tracks.data) + track_id;
     assert(tr->info.track_media_kind == e_video);
     if (mux->fragments_count)
     {
@@ -1090,11 +2139,14 @@ int MP4E__set_text_comment(MP4E_mux_t * mux, const char * comment)
     }
 
     // replace comment
-    free(mux->text_comment);
+    if (mux->text_comment)
+    {
+        MP4E_FREE(&mux->allocator, mux->text_comment);
+    }
     mux->text_comment = NULL;
     if (comment)
     {
-        mux->text_comment = (char*)malloc(strlen(comment) + 1);
+        mux->text_comment = (char*)MP4E_ALLOC(&mux->allocator, strlen(comment) + 1);
         if (mux->text_comment)
         {
             strcpy(mux->text_comment, comment);
@@ -1104,21 +2156,1129 @@ int MP4E__set_text_comment(MP4E_mux_t * mux, const char * comment)
 }
 
 /**
-*   Add new sample to specified track
+*   Restore index of the file, written in checkpoint mode, and append 'moov' box
 */
-int MP4E__put_sample(MP4E_mux_t * mux, int track_num, const void * data, int data_bytes, int duration, int kind)
+int MP4E__recover(FILE * mp4file)
 {
-    if (!mux || !data || track_num*sizeof(track_t) >= mux->tracks.bytes)
+    unsigned char header[CHECKPOINT_RECORD_BYTES];
+    mp4e_size_t file_size, pos = 0, mdat_pos = 0, mdat_end = 0;
+    int checkpoints = 0, error_code = MP4E_STATUS_OK;
+    MP4E_mux_t * mux;
+    long size;
+
+    if (!mp4file || fseek(mp4file, 0, SEEK_END) || (size = ftell(mp4file)) < 0)
     {
         return MP4E_STATUS_BAD_ARGUMENTS;
     }
+    file_size = (mp4e_size_t)size;
+    mux = mp4e_open_recovery(mp4file);
+    if (!mux)
+    {
+        return MP4E_STATUS_NO_MEMORY;
+    }
 
-    if (mux->enable_fragmentation)
+    // walk top-level boxes: read checkpoints, and find 'mdat' box after the last one
+    while (pos + 8 <= file_size)
+    {
+        mp4e_size_t box_bytes;
+        uint32_t box_name;
+        if (fseek(mp4file, (long)pos, SEEK_SET) || fread(header, 1, 8, mp4file) != 8)
+        {
+            break;
+        }
+        box_bytes = mp4e_get4(header);
+        box_name = mp4e_get4(header + 4);
+        if (box_name == BOX_mdat)
+        {
+            if (box_bytes < 8 || box_bytes > file_size - pos)
+            {
+                box_bytes = file_size - pos;    // open 'mdat' box
+            }
+            if (!mdat_pos)
+            {
+                mdat_pos = pos;
+                mdat_end = pos + box_bytes;
+            }
+        }
+        else if (box_bytes < 8 || box_bytes > file_size - pos)
+        {
+            break;  // incomplete box
+        }
+        else if (box_name == BOX_free && box_bytes > 8 + 8)
+        {
+            unsigned char * box = (unsigned char *)MP4E_ALLOC(&mux->allocator, box_bytes - 8);
+            if (!box)
+            {
+                error_code = MP4E_STATUS_NO_MEMORY;
+                break;
+            }
+            if (fread(box, 1, box_bytes - 8, mp4file) == box_bytes - 8 && mp4e_read_checkpoint(mux, box, box + box_bytes - 8))
+            {
+                checkpoints++;
+                mdat_pos = 0;
+            }
+            MP4E_FREE(&mux->allocator, box);
+        }
+        pos += box_bytes;
+    }
+
+    if (error_code == MP4E_STATUS_OK && !checkpoints)
+    {
+        error_code = MP4E_STATUS_NOT_RECOVERABLE;
+    }
+    if (error_code == MP4E_STATUS_OK && mdat_pos)
+    {
+        // samples after the last checkpoint: complete records of 'mdat' box
+        mp4e_size_t record_pos;
+        for (record_pos = mdat_pos + 8; record_pos + CHECKPOINT_RECORD_BYTES <= mdat_end; 
+             record_pos += CHECKPOINT_RECORD_BYTES + mp4e_get4(header))
+        {
+            unsigned info;
+            track_t * tr;
+            if (fseek(mp4file, (long)record_pos, SEEK_SET) || 
+                fread(header, 1, CHECKPOINT_RECORD_BYTES, mp4file) != CHECKPOINT_RECORD_BYTES)
+            {
+                break;
+            }
+            info = mp4e_get4(header + 4);
+            tr = mp4e_get_track(mux, info & 0x7FFFFFFF);
+            if (!tr || mp4e_get4(header) > mdat_end - record_pos - CHECKPOINT_RECORD_BYTES)
+            {
+                break;
+            }
+            mux->write_pos = record_pos + CHECKPOINT_RECORD_BYTES;
+            if (!mp4e_add_sample_descriptor(mux, tr, mp4e_get_index(mux, info & 0x7FFFFFFF), mp4e_get4(header), 
+                    mp4e_get4(header + 8), (info >> 31) ? MP4E_SAMPLE_RANDOM_ACCESS : MP4E_SAMPLE_DEFAULT, 
+                    tr->next_dts, (int)mp4e_get4(header + 12)))
+            {
+                error_code = MP4E_STATUS_NO_MEMORY;
+                break;
+            }
+        }
+
+        // 'mdat' box covers the rest of file, incl. incomplete sample or checkpoint
+        mp4e_fseek(mux, mdat_pos);
+        if (!mp4e_write_mdat_box(mux, file_size - mdat_pos))
+        {
+            error_code = MP4E_STATUS_FILE_WRITE_ERROR;
+        }
+        pos = file_size;
+    }
+    // 'moov' box follows the last box; it overwrites incomplete 'mdat' box header, if any
+    return mp4e_close_recovery(mux, error_code, pos);
+}
+
+/**
+*   Restore index of the file, written in streaming mode, and append 'moov' box
+*/
+int MP4E__recover_stream(FILE * mp4file, const MP4E_recover_track_t * tracks, int track_count)
+{
+    unsigned char header[8];
+    mp4e_size_t file_size, pos = 0;
+    int ntr, avc_track = -1, other_track = -1, samples = 0, error_code = MP4E_STATUS_OK;
+    MP4E_mux_t * mux;
+    long size;
+
+    if (!mp4file || !tracks || track_count <= 0)
+    {
+        return MP4E_STATUS_BAD_ARGUMENTS;
+    }
+    for (ntr = 0; ntr < track_count; ntr++)
+    {
+        // samples are assigned by content: one AVC track, and one other track
+        if (tracks[ntr].info.object_type_indication == MP4_OBJECT_TYPE_AVC ? avc_track >= 0 : other_track >= 0)
+        {
+            return MP4E_STATUS_BAD_ARGUMENTS;
+        }
+        if (tracks[ntr].info.object_type_indication == MP4_OBJECT_TYPE_AVC)
+        {
+            avc_track = ntr;
+        }
+        else
+        {
+            other_track = ntr;
+        }
+    }
+    if (fseek(mp4file, 0, SEEK_END) || (size = ftell(mp4file)) < 0)
+    {
+        return MP4E_STATUS_BAD_ARGUMENTS;
+    }
+    file_size = (mp4e_size_t)size;
+    mux = mp4e_open_recovery(mp4file);
+    if (!mux)
+    {
+        return MP4E_STATUS_NO_MEMORY;
+    }
+    for (ntr = 0; ntr < track_count && error_code == MP4E_STATUS_OK; ntr++)
+    {
+        const MP4E_recover_track_t * t = tracks + ntr;
+        if (MP4E__add_track(mux, &t->info) < 0)
+        {
+            error_code = MP4E_STATUS_NO_MEMORY;
+        }
+        else if (t->info.object_type_indication == MP4_OBJECT_TYPE_AVC)
+        {
+            if (t->sps)
+            {
+                error_code = MP4E__set_sps(mux, ntr, t->sps, t->sps_bytes);
+            }
+            if (t->pps && error_code == MP4E_STATUS_OK)
+            {
+                error_code = MP4E__set_pps(mux, ntr, t->pps, t->pps_bytes);
+            }
+        }
+        else
+        {
+            if (t->dsi)
+            {
+                error_code = MP4E__set_dsi(mux, ntr, t->dsi, t->dsi_bytes);
+            }
+        }
+    }
+
+    // walk 'mdat' box chain: 1 sample per box
+    while (error_code == MP4E_STATUS_OK && pos + 8 <= file_size)
+    {
+        mp4e_size_t box_bytes;
+        uint32_t box_name;
+        if (fseek(mp4file, (long)pos, SEEK_SET) || fread(header, 1, 8, mp4file) != 8)
+        {
+            break;
+        }
+        box_bytes = mp4e_get4(header);
+        box_name = mp4e_get4(header + 4);
+        if (box_name == BOX_moov)
+        {
+            // file is complete: nothing to do
+            mux->mp4file = NULL;
+            mp4e_free(mux);
+            return MP4E_STATUS_OK;
+        }
+        if (box_bytes < 8 || box_bytes > file_size - pos)
+        {
+            break;  // incomplete box
+        }
+        if (box_name == BOX_mdat && box_bytes > 8)
+        {
+            // H.264 access unit goes to AVC track; other samples to the other track
+            int avc = avc_track >= 0 ? mp4e_scan_avc_sample(mp4file, pos + 8, box_bytes - 8) : 0;
+            int track_num = (avc || other_track < 0) ? avc_track : other_track;
+            int kind = (track_num != avc_track || avc == 2) ? MP4E_SAMPLE_RANDOM_ACCESS : MP4E_SAMPLE_DEFAULT;
+            track_t * tr = mp4e_get_track(mux, track_num);
+            mux->write_pos = pos + 8;
+            if (!mp4e_add_sample_descriptor(mux, tr, mp4e_get_index(mux, track_num), box_bytes - 8, 0, kind, tr->next_dts, 0))
+            {
+                error_code = MP4E_STATUS_NO_MEMORY;
+            }
+            samples++;
+        }
+        pos += box_bytes;
+    }
+
+    if (error_code == MP4E_STATUS_OK && !samples)
+    {
+        error_code = MP4E_STATUS_NOT_RECOVERABLE;
+    }
+    if (error_code == MP4E_STATUS_OK && file_size - pos >= 8)
+    {
+        // incomplete sample becomes 'free' box
+        unsigned char * write_ptr = header;     // for WR4 macro
+        WR4(file_size - pos);
+        WR4(BOX_free);
+        mp4e_fseek(mux, pos);
+        if (!mp4e_fwrite(mux, header, 8))
+        {
+            error_code = MP4E_STATUS_FILE_WRITE_ERROR;
+        }
+        pos = file_size;
+    }
+    // 'moov' box follows the last box; it overwrites incomplete box header, if any
+    return mp4e_close_recovery(mux, error_code, pos);
+}
+
+/**
+*   Return track, which random access samples start CMAF segments, and are
+*   listed in 'tfra' box: 1st video track, or 1st track, if there is no video
+*/
+static int mp4e_find_sync_track(MP4E_mux_t * mux)
+{
+    int ntr, ntracks = (int)(mux->tracks.bytes / sizeof(track_t));
+    for (ntr = 0; ntr < ntracks; ntr++)
+    {
+        if (((track_t*)mux->tracks.data)[ntr].info.track_media_kind == e_video)
+        {
+            return ntr;
+        }
+    }
+    return 0;
+}
+
+/**
+*   Write file headers before 1st sample in fragmentation mode
+*/
+static int mp4e_write_fragmented_header(MP4E_mux_t * mux)
+{
+    int error_code;
+    mux->sync_track = mp4e_find_sync_track(mux);
+    error_code = mp4e_write_index(mux);
+    if (error_code == MP4E_STATUS_OK && mux->flush)
+    {
+        mux->flush(mux->flush_token, 0, mux->write_pos, MP4E_FLUSH_HEADER);
+    }
+    return error_code;
+}
+
+/**
+*   Write Segment Index 'sidx' box with single reference to the following
+*   'moof' + 'mdat' boxes
+*/
+static int mp4e_write_sidx(MP4E_mux_t * mux, int track_num, mp4e_time_t earliest_time, unsigned duration, 
+                           mp4e_size_t referenced_size)
+{
+    unsigned char write_base[SIDX_BYTES], *write_ptr = write_base;     // for WR4 macro
+    track_t * tr = ((track_t*)mux->tracks.data) + track_num;
+    WR4(SIDX_BYTES);
+    WR4(BOX_sidx);
+    WR4(0x01000000);                // version 1: 64-bit time and offset
+    WR4(track_num + 1);             // reference_ID
+    WR4(tr->info.time_scale);       // timescale
+    WR4((mp4e_offset_t)earliest_time >> 32);
+    WR4(earliest_time);             // earliest_presentation_time
+    WR4(0); WR4(0);                 // first_offset
+    WR2(0);                         // reserved
+    WR2(1);                         // reference_count
+    WR4(referenced_size);           // reference_type = 0 (media), referenced_size
+    WR4(duration);                  // subsegment_duration
+    WR4(0x90000000);                // starts_with_SAP = 1, SAP_type = 1, SAP_delta_time = 0
+    assert(write_ptr - write_base == SIDX_BYTES);
+    return mp4e_fwrite(mux, write_base, SIDX_BYTES);
+}
+
+/**
+*   Write pending CMAF chunk: 'styp' box, if chunk starts new segment; 'sidx'
+*   box in segmented mode; 'moof' box with 'traf' for every track, which has
+*   samples in the chunk; and single 'mdat' box with samples data, grouped by
+*   track. In segmented mode, chunk is written to the new segment sink.
+*/
+static int mp4e_write_chunk(MP4E_mux_t * mux)
+{
+    static const unsigned char mp4e_box_styp[] = 
+    {
+        0,0,0,0x18,'s','t','y','p',
+        'c','m','f','s',0,0,0,0,
+        'c','m','f','s','c','m','f','c',
+    };
+    // atoms nesting stack
+    unsigned char * stack_base[20];
+    unsigned char ** stack = stack_base;
+    unsigned char * write_base, * write_ptr, ** pdata_offset;
+
+    chunk_sample_t * cs = (chunk_sample_t *)mux->chunk.data;
+    unsigned i, count = (unsigned)(mux->chunk.bytes / sizeof(chunk_sample_t));
+    unsigned ntr, ntracks = (unsigned)(mux->tracks.bytes / sizeof(track_t)), traf_number = 0;
+    mp4e_size_t start = mux->write_pos, mdat_bytes = 8;
+    mp4e_size_t moof_pos = start + (mux->chunk_starts_segment ? sizeof(mp4e_box_styp) : 0);
+    int error_code = MP4E_STATUS_OK;
+
+    // 'sidx' reference: sync track, or 1st track in the chunk
+    int sidx_track = -1;
+    mp4e_time_t sidx_time = 0;
+    unsigned sidx_duration = 0;
+
+    // output of the init segment, while writing the media segment
+    MP4E_sink_t init_sink = mux->sink;
+    FILE * init_file = mux->mp4file;
+    mp4e_size_t init_pos = mux->write_pos;
+
+    if (!count)
+    {
+        return MP4E_STATUS_OK;
+    }
+    pdata_offset = (unsigned char **)MP4E_ALLOC(&mux->allocator, ntracks*sizeof(unsigned char *) + 
+        8 + 16 + ntracks*CHUNK_TRAF_HEADER_BYTES + count*CHUNK_SAMPLE_ENTRY_BYTES);
+    if (!pdata_offset)
+    {
+        return MP4E_STATUS_NO_MEMORY;
+    }
+    write_base = write_ptr = (unsigned char *)(pdata_offset + ntracks);
+
+    mux->chunks_count++;
+    MP4_ATOM(BOX_moof)
+        MP4_FULL_ATOM(BOX_mfhd, 0)
+            WR4(mux->chunks_count);     // sequence_number, start from 1
+        MP4_END_ATOM
+        for (ntr = 0; ntr < ntracks; ntr++)
+        {
+            const track_t * tr = ((track_t*)mux->tracks.data) + ntr;
+            const sample_t * smpl = (const sample_t *)(((track_index_t*)mux->index.data) + ntr)->smpl.data;
+            unsigned first = count, sample_count = 0, flags, n;
+            int composition = 0, has_random_access = 0;
+
+            pdata_offset[ntr] = NULL;
+            for (i = 0; i < count; i++)
+            {
+                if (cs[i].track_num == (int)ntr)
+                {
+                    first = sample_count++ ? first : i;
+                    composition |= (smpl[cs[i].sample_index].composition_offset != 0);
+                }
+            }
+            if (!sample_count)
+            {
+                continue;
+            }
+            traf_number++;
+            MP4_ATOM(BOX_traf)
+                MP4_FULL_ATOM(BOX_tfhd, 0x20000)    // default-base-is-moof
+                    WR4(ntr+1);                     // track_ID
+                MP4_END_ATOM
+                MP4_FULL_ATOM(BOX_tfdt, 0x01000000) // version 1: 64-bit time
+                    WR4((mp4e_offset_t)cs[first].dts >> 32);
+                    WR4(cs[first].dts);             // baseMediaDecodeTime
+                MP4_END_ATOM
+                flags  = 0;
+                flags |= 0x001;                     // data-offset-present
+                flags |= 0x100;                     // sample-duration-present
+                flags |= 0x200;                     // sample-size-present
+                flags |= 0x400;                     // sample-flags-present
+                if (composition)
+                {
+                    flags |= 0x800;                 // sample-composition-time-offsets-present
+                    flags |= 0x01000000;            // version 1: signed offset
+                }
+                MP4_FULL_ATOM(BOX_trun, flags)
+                    WR4(sample_count);
+                    pdata_offset[ntr] = write_ptr;
+                    WR4(mdat_bytes);                // data_offset, 'moof' size added below
+                    if (sidx_track < 0 || (int)ntr == mux->sync_track)
+                    {
+                        sidx_track = ntr;
+                        sidx_time = cs[first].dts + smpl[cs[first].sample_index].composition_offset;
+                        sidx_duration = 0;
+                    }
+                    for (i = first, n = 0; i < count; i++)
+                    {
+                        const sample_t * s = smpl + cs[i].sample_index;
+                        if (cs[i].track_num != (int)ntr)
+                        {
+                            continue;
+                        }
+                        n++;
+                        if ((int)ntr == mux->sync_track && s->flag_random_access && !has_random_access && !mux->segment_sink)
+                        {
+                            // 1st random access sample in the chunk: random access point for 'tfra'
+                            has_random_access = 1;
+                            if (!mp4e_add_random_access(mux, cs[i].dts + s->composition_offset, moof_pos, traf_number, n))
+                            {
+                                error_code = MP4E_STATUS_NO_MEMORY;
+                            }
+                        }
+                        if (sidx_track == (int)ntr)
+                        {
+                            // earliest presentation time, and duration
+                            if (cs[i].dts + s->composition_offset < sidx_time)
+                            {
+                                sidx_time = cs[i].dts + s->composition_offset;
+                            }
+                            sidx_duration += s->duration;
+                        }
+                        WR4(s->duration);           // sample_duration
+                        WR4(s->size);               // sample_size
+                        if (s->flag_random_access || tr->info.track_media_kind == e_audio)
+                        {
+                            WR4(0x2000000);         // sample_flags: sample_depends_on = 2
+                        }
+                        else
+                        {
+                            WR4(0x1010000);         // sample_flags: sample_depends_on = 1, non-sync
+                        }
+                        if (composition)
+                        {
+                            WR4(s->composition_offset);
+                        }
+                        mdat_bytes += s->size;
+                    }
+                MP4_END_ATOM
+            MP4_END_ATOM
+        }
+    MP4_END_ATOM
+
+    assert((unsigned)(write_ptr - write_base) <= 8 + 16 + ntracks*CHUNK_TRAF_HEADER_BYTES + count*CHUNK_SAMPLE_ENTRY_BYTES);
+    for (ntr = 0; ntr < ntracks; ntr++)
+    {
+        unsigned char * p = pdata_offset[ntr];
+        if (p)
+        {
+            unsigned data_offset = ((unsigned)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+            data_offset += (unsigned)(write_ptr - write_base);
+            MP4_WR4_PTR(p, data_offset);
+        }
+    }
+
+    if (mux->segment_sink)
+    {
+        MP4E_sink_t sink;
+        memset(&sink, 0, sizeof(sink));
+        if (mux->segment_sink(mux->segment_token, mux->chunks_count, &sink) || !sink.write)
+        {
+            error_code = MP4E_STATUS_FILE_WRITE_ERROR;
+        }
+        mux->sink = sink;
+        mux->mp4file = NULL;
+        mux->write_pos = start = 0;
+    }
+
+    if (error_code == MP4E_STATUS_OK && (
+        (mux->chunk_starts_segment && !mp4e_fwrite(mux, mp4e_box_styp, sizeof(mp4e_box_styp))) ||
+        (mux->segment_sink && !mp4e_write_sidx(mux, sidx_track, sidx_time, sidx_duration, 
+                                               (mp4e_size_t)(write_ptr - write_base) + mdat_bytes)) ||
+        !mp4e_fwrite(mux, write_base, write_ptr - write_base) ||
+        !mp4e_write_mdat_box(mux, mdat_bytes)))
+    {
+        error_code = MP4E_STATUS_FILE_WRITE_ERROR;
+    }
+    MP4E_FREE(&mux->allocator, pdata_offset);
+
+    // samples data, in the same order as 'trun' entries
+    for (ntr = 0; ntr < ntracks; ntr++)
+    {
+        const sample_t * smpl = (const sample_t *)(((track_index_t*)mux->index.data) + ntr)->smpl.data;
+        for (i = 0; i < count; i++)
+        {
+            MP4E_release_fn release = cs[i].release;
+            if (cs[i].track_num != (int)ntr)
+            {
+                continue;
+            }
+            cs[i].release = NULL;
+            if (error_code)
+            {
+                if (release)
+                {
+                    release(cs[i].release_token, cs[i].data);
+                }
+            }
+            else if (cs[i].data)
+            {
+                if (!mp4e_fwrite_ref(mux, cs[i].data, smpl[cs[i].sample_index].size, release, cs[i].release_token))
+                {
+                    error_code = MP4E_STATUS_FILE_WRITE_ERROR;
+                }
+            }
+            else if (!mp4e_fwrite(mux, mux->chunk_data.data + cs[i].copy_offset, smpl[cs[i].sample_index].size))
+            {
+                error_code = MP4E_STATUS_FILE_WRITE_ERROR;
+            }
+        }
+    }
+    mux->chunk.bytes = 0;
+    mux->chunk_data.bytes = 0;
+
+    if (error_code == MP4E_STATUS_OK && mux->flush)
+    {
+        mux->flush(mux->flush_token, start, mux->write_pos - start, 
+            mux->chunk_starts_segment ? MP4E_FLUSH_SEGMENT_START : 0);
+    }
+    mux->chunk_starts_segment = 0;
+    if (mux->segment_sink)
+    {
+        // back to the init segment; its size is not changed
+        mux->sink = init_sink;
+        mux->mp4file = init_file;
+        mux->write_pos = init_pos;
+    }
+    return error_code;
+}
+
+/**
+*   Append sample to the pending CMAF chunk; write the chunk first, if the
+*   sample starts new segment, or chunk duration is reached
+*/
+static int mp4e_put_chunk_sample(MP4E_mux_t * mux, int track_num, const void * data, int data_bytes, int duration, int kind, 
+                                 mp4e_time_t dts, int composition_offset, MP4E_release_fn release, void * release_token)
+{
+    track_t * tr = mp4e_get_track(mux, track_num);
+    track_index_t * ix = mp4e_get_index(mux, track_num);
+    chunk_sample_t * cs;
+    mp4e_time_t sample_ms;
+    int error_code = MP4E_STATUS_OK, starts_segment;
+
+    if (!tr || !ix || !data || data_bytes < 0 || !tr->info.time_scale)
+    {
+        error_code = MP4E_STATUS_BAD_ARGUMENTS;
+    }
+    else if (!mux->fragments_count++)
+    {
+        // write file headers before 1st sample
+        error_code = mp4e_write_fragmented_header(mux);
+    }
+
+    if (error_code == MP4E_STATUS_OK)
+    {
+        sample_ms = dts * 1000 / tr->info.time_scale;
+        starts_segment = (track_num == mux->sync_track && kind == MP4E_SAMPLE_RANDOM_ACCESS && 
+                          sample_ms - mux->segment_start_ms >= (mp4e_time_t)mux->segment_duration_ms);
+        if (mux->chunk.bytes && (starts_segment || sample_ms - mux->chunk_start_ms >= (mp4e_time_t)mux->chunk_duration_ms))
+        {
+            error_code = mp4e_write_chunk(mux);
+        }
+        if (!mux->chunk.bytes)
+        {
+            mux->chunk_start_ms = sample_ms;
+            mux->chunk_starts_segment = starts_segment || !mux->chunks_count;
+            if (mux->chunk_starts_segment)
+            {
+                mux->segment_start_ms = sample_ms;
+            }
+        }
+    }
+
+    cs = error_code ? NULL : (chunk_sample_t *)asp_vector_alloc_tail(&mux->chunk, sizeof(chunk_sample_t));
+    if (cs)
+    {
+        size_t copy_offset = mux->chunk_data.bytes;
+        cs->track_num = track_num;
+        cs->sample_index = (int)(ix->smpl.bytes / sizeof(sample_t));
+        cs->dts = dts;
+        cs->data = release ? data : NULL;   // caller's buffer is valid during this call only, if not released
+        cs->copy_offset = copy_offset;
+        cs->release = release;
+        cs->release_token = release_token;
+        if ((!release && !asp_vector_put(&mux->chunk_data, data, data_bytes)) ||
+            !mp4e_add_sample_descriptor(mux, tr, ix, data_bytes, duration, kind, dts, composition_offset))
+        {
+            mux->chunk.bytes -= sizeof(chunk_sample_t);
+            mux->chunk_data.bytes = copy_offset;
+            cs = NULL;
+            error_code = MP4E_STATUS_NO_MEMORY;
+        }
+    }
+    else if (error_code == MP4E_STATUS_OK)
+    {
+        error_code = MP4E_STATUS_NO_MEMORY;
+    }
+
+    if (!cs && release && data)
+    {
+        release(release_token, data);
+    }
+    return error_code;
+}
+
+/************************************************************************/
+/*      Non-blocking mode                                               */
+/************************************************************************/
+
+/**
+*   Check, if the sample fits to the pending output bytes limit; drop video sample, 
+*   which does not fit, if frame dropping is enabled. Called before the sample 
+*   timestamp is derived from the track state.
+*   has_timestamps: flag, sample timestamp is given by the application
+*   return 0, if the sample should be written; 1, if it is dropped (and released);
+*   MP4E_STATUS_WOULD_BLOCK, if it should be passed later; MP4E_STATUS_BAD_ARGUMENTS 
+*   (sample is released), if the file is finished
+*/
+static int mp4e_check_pending_output(MP4E_mux_t * mux, int track_num, int data_bytes, int duration, int kind, 
+                                     int has_timestamps, const void * data, MP4E_release_fn release, void * release_token)
+{
+    track_t * tr = mp4e_get_track(mux, track_num);
+    track_index_t * ix = mp4e_get_index(mux, track_num);
+    mp4e_offset_t pending;
+    if (tr && mux->finished)
+    {
+        // file index is written
+        if (release && data)
+        {
+            release(release_token, data);
+        }
+        return MP4E_STATUS_BAD_ARGUMENTS;
+    }
+    if (!tr || !ix || !mux->max_pending_bytes || !data)
+    {
+        return 0;
+    }
+    if (kind == MP4E_SAMPLE_RANDOM_ACCESS)
+    {
+        ix->dropping = 0;
+    }
+    if (!ix->dropping)
+    {
+        pending = mux->output_bytes - mux->confirmed_bytes;
+        if (!pending || pending + data_bytes + FRAGMENT_HEADER_BYTES <= mux->max_pending_bytes)
+        {
+            return 0;
+        }
+        if (!mux->drop_frames || kind == MP4E_SAMPLE_RANDOM_ACCESS || tr->info.track_media_kind != e_video)
+        {
+            return MP4E_STATUS_WOULD_BLOCK;
+        }
+        ix->dropping = 1;
+    }
+
+    // drop the sample: previous sample lasts till the next one. In fragmented output, trun of 
+    // the previous sample is written already, unless it waits in CMAF chunk: then the next 
+    // fragment tfdt carries the gap
+    if (!has_timestamps)
+    {
+        duration = duration ? duration : (int)tr->info.default_duration;
+        tr->next_dts += duration;
+        if (ix->smpl.bytes)
+        {
+            ((sample_t *)(ix->smpl.data + ix->smpl.bytes))[-1].duration += duration;
+        }
+    }
+    if (release)
+    {
+        release(release_token, data);
+    }
+    return 1;
+}
+
+/************************************************************************/
+/*      Output rotation                                                 */
+/************************************************************************/
+
+/**
+*   Point vectors of the multiplexer object to its own allocator,
+*   after the object is copied
+*/
+static void mp4e_set_vectors_allocator(MP4E_mux_t * mux)
+{
+    unsigned long ntr, ntracks = mux->tracks.bytes / sizeof(track_t);
+    for (ntr = 0; ntr < ntracks; ntr++)
+    {
+        track_t* tr = ((track_t*)mux->tracks.data) + ntr;
+        track_index_t * ix = ((track_index_t*)mux->index.data) + ntr;
+        ix->smpl.allocator = &mux->allocator;
+        tr->vsps.allocator = &mux->allocator;
+        tr->vpps.allocator = &mux->allocator;
+    }
+    mux->tracks.allocator = &mux->allocator;
+    mux->index.allocator = &mux->allocator;
+    mux->chunk.allocator = &mux->allocator;
+    mux->chunk_data.allocator = &mux->allocator;
+    mux->random_access.allocator = &mux->allocator;
+    mux->output.allocator = &mux->allocator;
+    mux->output_ref.allocator = &mux->allocator;
+}
+
+/**
+*   Initialize empty state of the next file in 'next' object: track configuration 
+*   and file comment are copied from 'mux'. Vectors of 'next' use allocator of 'mux'.
+*   return 1 on success
+*/
+static int mp4e_init_next_file(MP4E_mux_t * mux, MP4E_mux_t * next)
+{
+    unsigned long ntr, ntracks = mux->tracks.bytes / sizeof(track_t);
+    int success;
+    *next = *mux;
+    next->mp4file = NULL;
+    memset(&next->sink, 0, sizeof(next->sink));
+    next->write_pos = 0;
+    next->text_comment = NULL;
+    next->fragments_count = 0;
+    next->fragment_pos = 0;
+    next->chunk_start_ms = next->segment_start_ms = 0;
+    next->chunk_starts_segment = 0;
+    next->chunks_count = 0;
+    next->checkpoint_ms = 0;
+    next->mdat_pos = 0;
+    asp_vector_init(&next->chunk, 0, &mux->allocator);
+    asp_vector_init(&next->chunk_data, 0, &mux->allocator);
+    asp_vector_init(&next->random_access, 0, &mux->allocator);
+    asp_vector_init(&next->index, 0, &mux->allocator);
+    success = asp_vector_init(&next->tracks, (int)mux->tracks.capacity, &mux->allocator);
+    for (ntr = 0; success && ntr < ntracks; ntr++)
+    {
+        const track_t * src = ((track_t*)mux->tracks.data) + ntr;
+        track_t * tr = (track_t*)asp_vector_put(&next->tracks, src, sizeof(track_t));
+        track_index_t * ix = (track_index_t*)asp_vector_alloc_tail(&next->index, sizeof(track_index_t));
+        asp_vector_init(&tr->vsps, 0, &mux->allocator);
+        asp_vector_init(&tr->vpps, 0, &mux->allocator);
+        tr->last_dts = tr->next_dts = 0;
+        tr->has_composition_offset = 0;
+        if (ix)
+        {
+            memset(ix, 0, sizeof(track_index_t));
+            ix->dropping = ((track_index_t*)mux->index.data)[ntr].dropping;
+        }
+        success = ix && asp_vector_init(&ix->smpl, 256, &mux->allocator) &&
+                  (!src->vsps.bytes || asp_vector_put(&tr->vsps, src->vsps.data, (int)src->vsps.bytes)) &&
+                  (!src->vpps.bytes || asp_vector_put(&tr->vpps, src->vpps.data, (int)src->vpps.bytes));
+    }
+    if (success && mux->text_comment)
+    {
+        size_t len = strlen(mux->text_comment) + 1;
+        next->text_comment = (char *)MP4E_ALLOC(&mux->allocator, len);
+        success = next->text_comment != NULL;
+        if (success)
+        {
+            memcpy(next->text_comment, mux->text_comment, len);
+        }
+    }
+    if (!success)
+    {
+        mp4e_reset(next);
+    }
+    return success;
+}
+
+/**
+*   Start next file: move current file state to new multiplexer object, pass it to 
+*   the application, and start next file with the same tracks
+*   return error code MP4E_STATUS_*
+*/
+static int mp4e_rotate(MP4E_mux_t * mux)
+{
+    MP4E_mux_t next, * finished;
+    FILE * mp4file = NULL;
+    MP4E_sink_t sink;
+
+    finished = (MP4E_mux_t *)MP4E_ALLOC(&mux->allocator, sizeof(MP4E_mux_t));
+    if (!finished)
+    {
+        return MP4E_STATUS_NO_MEMORY;
+    }
+    if (!mp4e_init_next_file(mux, &next))
+    {
+        MP4E_FREE(&mux->allocator, finished);
+        return MP4E_STATUS_NO_MEMORY;
+    }
+    *finished = *mux;
+    finished->rotate = NULL;
+    mp4e_set_vectors_allocator(finished);
+    *mux = next;
+    mp4e_set_vectors_allocator(mux);
+    mux->file_number++;
+
+    memset(&sink, 0, sizeof(sink));
+    if (mux->rotate(mux->rotate_token, mux->file_number, finished, &mp4file, &sink) || (!mp4file && !sink.write))
+    {
+        // rotation is cancelled: continue current file
+        mp4e_reset(mux);
+        *mux = *finished;
+        mux->rotate = next.rotate;
+        mp4e_set_vectors_allocator(mux);
+        MP4E_FREE(&mux->allocator, finished);
+        return MP4E_STATUS_OK;
+    }
+    if (sink.write)
+    {
+        mux->sink = sink;
+    }
+    else
+    {
+        mux->mp4file = mp4file;
+    }
+    return mp4e_start_file(mux) ? MP4E_STATUS_OK : MP4E_STATUS_FILE_WRITE_ERROR;
+}
+
+/**
+*   Start next file at random access sample of the sync track, if current file 
+*   duration or size reached the limit. Called before the sample timestamp is 
+*   derived from the track state, which is reset for the next file.
+*   dts: sample timestamp in the current file
+*   has_timestamps: flag, dts is given by the application, and is not reset in the next file
+*   return error code MP4E_STATUS_*; release sample data on error
+*/
+static int mp4e_check_rotation(MP4E_mux_t * mux, int track_num, int kind, mp4e_time_t dts, int has_timestamps,
+                               const void * data, MP4E_release_fn release, void * release_token)
+{
+    track_t * tr = mp4e_get_track(mux, track_num);
+    mp4e_time_t sample_ms;
+    if (!tr || !mux->rotate || kind != MP4E_SAMPLE_RANDOM_ACCESS || !tr->info.time_scale ||
+        track_num != mp4e_find_sync_track(mux))
+    {
+        return MP4E_STATUS_OK;
+    }
+    sample_ms = dts * 1000 / tr->info.time_scale;
+    if (mp4e_get_index(mux, track_num)->smpl.bytes && 
+        ((mux->rotate_duration_ms && sample_ms - mux->file_start_ms >= (mp4e_time_t)mux->rotate_duration_ms) ||
+         (mux->rotate_bytes && mux->write_pos >= mux->rotate_bytes)))
+    {
+        int file_number = mux->file_number;
+        int error_code = mp4e_rotate(mux);
+        if (error_code)
+        {
+            if (release && data)
+            {
+                release(release_token, data);
+            }
+            return error_code;
+        }
+        if (mux->file_number != file_number && !has_timestamps)
+        {
+            sample_ms = 0;  // next file starts at time 0
+        }
+    }
+    if (!mp4e_get_index(mux, track_num)->smpl.bytes)
+    {
+        mux->file_start_ms = sample_ms;
+    }
+    return MP4E_STATUS_OK;
+}
+
+/**
+*   Write sample headers and sample data, and update file index
+*/
+static int mp4e_put_sample(MP4E_mux_t * mux, int track_num, const void * data, int data_bytes, int duration, int kind, 
+                           mp4e_time_t dts, int composition_offset, MP4E_release_fn release, void * release_token)
+{
+    int error_code;
+    if (mux && mux->chunk_duration_ms)
+    {
+        return mp4e_put_chunk_sample(mux, track_num, data, data_bytes, duration, kind, dts, composition_offset, 
+                                     release, release_token);
+    }
+    error_code = mp4e_put_sample_header(mux, track_num, data, data_bytes, duration, kind, dts, composition_offset);
+    if (error_code)
+    {
+        if (release && data)
+        {
+            release(release_token, data);
+        }
+        return error_code;
+    }
+
+    // write sample data
+    if (!mp4e_fwrite_ref(mux, data, data_bytes, release, release_token))
+    {
+        return MP4E_STATUS_FILE_WRITE_ERROR;
+    }
+
+    if (mux->enable_fragmentation && mux->flush)
+    {
+        mux->flush(mux->flush_token, mux->fragment_pos, mux->write_pos - mux->fragment_pos, 0);
+    }
+    return MP4E_STATUS_OK;
+}
+
+/**
+*   Return track descriptor, or NULL if track ID is not valid
+*/
+static track_t * mp4e_get_track(MP4E_mux_t * mux, int track_num)
+{
+    if (!mux || track_num < 0 || track_num*sizeof(track_t) >= mux->tracks.bytes)
+    {
+        return NULL;
+    }
+    return ((track_t*)mux->tracks.data) + track_num;
+}
+
+/**
+*   Return samples of the track in the output file, or NULL if track ID is not valid
+*/
+static track_index_t * mp4e_get_index(MP4E_mux_t * mux, int track_num)
+{
+    if (!mux || track_num < 0 || track_num*sizeof(track_index_t) >= mux->index.bytes)
+    {
+        return NULL;
+    }
+    return ((track_index_t*)mux->index.data) + track_num;
+}
+
+/**
+*   Set duration of the last sample, which is known, when next sample with given 
+*   decoding time arrives
+*   return duration of the last sample, to guess duration of the next one; 0 if no samples
+*/
+static int mp4e_update_last_duration(const track_t * tr, track_index_t * ix, mp4e_time_t dts)
+{
+    sample_t * last;
+    if (!tr || !ix || !ix->smpl.bytes)
+    {
+        return 0;
+    }
+    last = (sample_t *)(ix->smpl.data + ix->smpl.bytes) - 1;
+    if (dts > tr->last_dts)
+    {
+        last->duration = (unsigned)(dts - tr->last_dts);
+    }
+    return last->duration;
+}
+
+/**
+*   Reject the sample, passed directly to the multiplexer, which shares the track table
+*   return error code MP4E_STATUS_*; release sample data on error
+*/
+static int mp4e_check_shared(MP4E_mux_t * mux, const void * data, MP4E_release_fn release, void * release_token)
+{
+    if (mux && mux->track_owner)
+    {
+        if (release && data)
+        {
+            release(release_token, data);
+        }
+        return MP4E_STATUS_BAD_ARGUMENTS;
+    }
+    return MP4E_STATUS_OK;
+}
+
+/**
+*   Add new sample to specified track
+*/
+int MP4E__put_sample(MP4E_mux_t * mux, int track_num, const void * data, int data_bytes, int duration, int kind)
+{
+    return MP4E__put_sample_ref(mux, track_num, data, data_bytes, duration, kind, NULL, NULL);
+}
+
+/**
+*   Add new sample to specified track, passing sample data by reference
+*/
+int MP4E__put_sample_ref(MP4E_mux_t * mux, int track_num, const void * data, int data_bytes, int duration, int kind, 
+                         MP4E_release_fn release, void * release_token)
+{
+    // sample follows previous sample without gap
+    track_t * tr = mp4e_get_track(mux, track_num);
+    mp4e_time_t dts;
+    int error_code = mp4e_check_shared(mux, data, release, release_token);
+    if (error_code)
+    {
+        return error_code;
+    }
+    error_code = mp4e_check_pending_output(mux, track_num, data_bytes, duration, kind, 0, data, release, release_token);
+    if (error_code)
+    {
+        return error_code > 0 ? MP4E_STATUS_OK : error_code;
+    }
+    error_code = mp4e_check_rotation(mux, track_num, kind, tr ? tr->next_dts : 0, 0, data, release, release_token);
+    if (error_code)
+    {
+        return error_code;
+    }
+    tr = mp4e_get_track(mux, track_num);
+    dts = tr ? tr->next_dts : 0;
+    return mp4e_put_sample(mux, track_num, data, data_bytes, duration, kind, dts, 0, release, release_token);
+}
+
+/**
+*   Add new sample to specified track, with decoding and presentation timestamps
+*/
+int MP4E__put_sample_ts(MP4E_mux_t * mux, int track_num, const void * data, int data_bytes, 
+                        mp4e_time_t dts, mp4e_time_t pts, int kind)
+{
+    return MP4E__put_sample_ts_ref(mux, track_num, data, data_bytes, dts, pts, kind, NULL, NULL);
+}
+
+/**
+*   Add new sample to specified track, with timestamps, passing sample data by reference
+*/
+int MP4E__put_sample_ts_ref(MP4E_mux_t * mux, int track_num, const void * data, int data_bytes, 
+                            mp4e_time_t dts, mp4e_time_t pts, int kind, 
+                            MP4E_release_fn release, void * release_token)
+{
+    int duration;
+    int error_code = mp4e_check_shared(mux, data, release, release_token);
+    if (error_code)
+    {
+        return error_code;
+    }
+    error_code = mp4e_check_pending_output(mux, track_num, data_bytes, 0, kind, 1, data, release, release_token);
+    if (error_code)
+    {
+        return error_code > 0 ? MP4E_STATUS_OK : error_code;
+    }
+    error_code = mp4e_check_rotation(mux, track_num, kind, dts, 1, data, release, release_token);
+    if (error_code)
+    {
+        return error_code;
+    }
+    // guess this sample duration, until next sample arrives
+    duration = mp4e_update_last_duration(mp4e_get_track(mux, track_num), mp4e_get_index(mux, track_num), dts);
+    return mp4e_put_sample(mux, track_num, data, data_bytes, duration, kind, dts, (int)(pts - dts), release, release_token);
+}
+
+/**
+*   Add new sample to the multiplexers, which share the track table of the 1st one
+*/
+int MP4E__put_shared_sample(MP4E_mux_t * const * mux, int mux_count, int track_num, const void * data, int data_bytes, 
+                            int duration, mp4e_time_t dts, mp4e_time_t pts, int has_timestamps, int kind, 
+                            MP4E_release_fn release, void * release_token)
+{
+    track_t * tr = (mux && mux_count > 0) ? mp4e_get_track(mux[0], track_num) : NULL;
+    int n, error_code = MP4E_STATUS_OK;
+    if (!tr || !data || data_bytes < 0 || mux[0]->track_owner || mux[0]->rotate || mux[0]->max_pending_bytes)
+    {
+        error_code = MP4E_STATUS_BAD_ARGUMENTS;
+    }
+    for (n = 0; n < mux_count && !error_code; n++)
+    {
+        if (!mux[n] || (n && mux[n]->track_owner != mux[0]))
+        {
+            error_code = MP4E_STATUS_BAD_ARGUMENTS;
+        }
+        else if (!mp4e_sync_tracks(mux[n]))
+        {
+            error_code = MP4E_STATUS_NO_MEMORY;
+        }
+    }
+    if (error_code)
+    {
+        for (n = 0; release && data && n < mux_count; n++)
+        {
+            release(release_token, data);
+        }
+        return error_code;
+    }
+
+    // sample timing is resolved once, from the shared track table
+    if (has_timestamps)
+    {
+        for (n = 0; n < mux_count; n++)
+        {
+            int last_duration = mp4e_update_last_duration(tr, mp4e_get_index(mux[n], track_num), dts);
+            if (!n)
+            {
+                duration = last_duration;
+            }
+        }
+    }
+    else
+    {
+        dts = pts = tr->next_dts;
+    }
+
+    // each output updates its layout; track timing is updated by the owner
+    for (n = 0; n < mux_count; n++)
+    {
+        int output_error = mp4e_check_pending_output(mux[n], track_num, data_bytes, duration, kind, has_timestamps, 
+                                                     data, release, release_token);
+        if (!output_error)
+        {
+            output_error = mp4e_put_sample(mux[n], track_num, data, data_bytes, duration, kind, dts, (int)(pts - dts), 
+                                           release, release_token);
+        }
+        if (!error_code && output_error < 0)
+        {
+            error_code = output_error;
+        }
+    }
+    return error_code;
+}
+
+/**
+*   Write sample headers and update file index for the new sample
+*/
+static int mp4e_put_sample_header(MP4E_mux_t * mux, int track_num, const void * data, int data_bytes, int duration, int kind, 
+                                  mp4e_time_t dts, int composition_offset)
+{
+    track_t * tr = mp4e_get_track(mux, track_num);
+    track_index_t * ix = mp4e_get_index(mux, track_num);
+    if (!tr || !ix || !data)
+    {
+        return MP4E_STATUS_BAD_ARGUMENTS;
+    }
+    if (!duration)
+    {
+        duration = tr->info.default_duration;
+    }
+
+    if (mux->enable_fragmentation)
     {
         if (!mux->fragments_count++)
         {
             // write file headers before 1st sample
-            int error_code = mp4e_write_index(mux);
+            int error_code = mp4e_write_fragmented_header(mux);
             if (error_code)
             {
                 return error_code;
@@ -1126,7 +3286,13 @@ int MP4E__put_sample(MP4E_mux_t * mux, int track_num, const void * data, int dat
         }
 
         // write MOOF + MDAT + sample data
-        if (!mp4e_write_fragment_header(mux, track_num, data_bytes, duration, kind))
+        mux->fragment_pos = mux->write_pos;
+        if (track_num == mux->sync_track && kind == MP4E_SAMPLE_RANDOM_ACCESS &&
+            !mp4e_add_random_access(mux, dts + composition_offset, mux->fragment_pos, 1, 1))
+        {
+            return MP4E_STATUS_NO_MEMORY;
+        }
+        if (!mp4e_write_fragment_header(mux, track_num, data_bytes, duration, kind, dts, composition_offset))
         {
             return MP4E_STATUS_FILE_WRITE_ERROR;
         }
@@ -1137,6 +3303,26 @@ int MP4E__put_sample(MP4E_mux_t * mux, int track_num, const void * data, int dat
             return MP4E_STATUS_FILE_WRITE_ERROR;
         }
     }
+    else if (mux->checkpoint_interval_ms)
+    {
+        // write checkpoint before 1st sample, and then periodically
+        mp4e_time_t time_ms = dts*1000/tr->info.time_scale;
+        int error_code;
+        if (!mux->mdat_pos || time_ms >= mux->checkpoint_ms + mux->checkpoint_interval_ms)
+        {
+            mux->checkpoint_ms = time_ms;
+            error_code = mp4e_write_checkpoint(mux);
+            if (error_code)
+            {
+                return error_code;
+            }
+        }
+        error_code = mp4e_write_sample_record(mux, track_num, data_bytes, duration, kind, composition_offset);
+        if (error_code)
+        {
+            return error_code;
+        }
+    }
     else
     {
 #if !MP4E_CAN_USE_RANDOM_FILE_ACCESS
@@ -1150,17 +3336,11 @@ int MP4E__put_sample(MP4E_mux_t * mux, int track_num, const void * data, int dat
 
     // update file index (after optional MDAT)
     // fragmented mode also may use optional index at the end of file (not yet implemented)
-    if (!mp4e_add_sample_descriptor(mux, ((track_t*)mux->tracks.data) + track_num, data_bytes, duration, kind))
+    if (!mp4e_add_sample_descriptor(mux, tr, ix, data_bytes, duration, kind, dts, composition_offset))
     {
         return MP4E_STATUS_NO_MEMORY;
     }
 
-    // write sample data
-    if (!mp4e_fwrite(mux, data, data_bytes))
-    {
-        return MP4E_STATUS_FILE_WRITE_ERROR;
-    }
-
     return MP4E_STATUS_OK;
 }
 
@@ -15,6 +15,23 @@ extern "C" {
 #include "mp4defs.h"
 
 
+/************************************************************************/
+/*                  Portable 64-bit type definition                     */
+/************************************************************************/
+
+#if (defined(__GNUC__) && __GNUC__ >= 4) || (defined __STDC_VERSION__ && __STDC_VERSION__ >= 199901)
+#   include <stdint.h>
+    typedef uint64_t mp4e_offset_t;
+    typedef int64_t mp4e_time_t;
+#elif defined (_MSC_VER)
+    typedef unsigned __int64 mp4e_offset_t;
+    typedef __int64 mp4e_time_t;
+#else
+    typedef unsigned long long mp4e_offset_t;
+    typedef long long mp4e_time_t;
+#endif
+
+
 /************************************************************************/
 /*          API error codes                                             */
 /************************************************************************/
@@ -24,6 +41,9 @@ extern "C" {
 #define MP4E_STATUS_FILE_WRITE_ERROR        -3
 #define MP4E_STATUS_ONLY_ONE_DSI_ALLOWED    -4
 #define MP4E_STATUS_ENCODE_IN_PROGRESS      -5
+#define MP4E_STATUS_QUEUE_FULL              -6
+#define MP4E_STATUS_NOT_RECOVERABLE         -7
+#define MP4E_STATUS_WOULD_BLOCK             -8
 
 
 /************************************************************************/
@@ -79,6 +99,183 @@ typedef struct
 } MP4E_track_t;
 
 
+/*
+*   Callback, which releases sample data, passed with MP4E__put_sample_ref()
+*/
+typedef void (*MP4E_release_fn)(void * release_token, const void * data);
+
+/*
+*   Application-supplied output, used instead of FILE.
+*
+*   write() stores given data at given file offset, and return 0 on success.
+*   Data written sequentially, except file header update, when closing the file.
+*
+*   write_ref() is optional, and used for sample data: instead of copying, 
+*   the sink may keep reference to the data, and must call release(release_token, data)
+*   exactly once, when data is written. Return 0 on success.
+*/
+typedef struct
+{
+    int (*write)(void * token, mp4e_offset_t offset, const void * data, size_t bytes);
+    int (*write_ref)(void * token, mp4e_offset_t offset, const void * data, size_t bytes, MP4E_release_fn release, void * release_token);
+    void * token;
+} MP4E_sink_t;
+
+/*
+*   Pending output buffer in pull output mode (see MP4E__get_output())
+*/
+typedef struct
+{
+    mp4e_offset_t offset;           // file offset of the data
+    const void * data;
+    size_t bytes;
+} MP4E_output_t;
+
+/*
+*   Callback, which is called in fragmentation mode, when file header, or
+*   fragment (CMAF chunk) is completely passed to the output; and in checkpoint
+*   mode, when checkpoint is written (offset 0, bytes: recoverable file size).
+*   offset, bytes: file position and size of the data
+*   flags: combination of MP4E_FLUSH_* bits
+*/
+typedef void (*MP4E_flush_fn)(void * flush_token, mp4e_offset_t offset, mp4e_offset_t bytes, int flags);
+
+#define MP4E_FLUSH_HEADER           1   // the data is file header ('ftyp' + 'moov')
+#define MP4E_FLUSH_SEGMENT_START    2   // the data starts new segment ('styp' box)
+#define MP4E_FLUSH_CHECKPOINT       4   // the data ends with index checkpoint
+
+/*
+*   Callback, which supplies output for the media segment in segmented mode.
+*   segment_number starts from 1. The callback fills the sink, which receives
+*   data at offsets from the segment start; the sink is not used after the 
+*   flush callback for the segment. Return 0 on success.
+*/
+typedef int (*MP4E_segment_fn)(void * segment_token, int segment_number, MP4E_sink_t * sink);
+
+/*
+*   Callback, which supplies output for the next file in rotation mode.
+*   file_number starts from 2. The callback sets either *mp4file (owned by the
+*   multiplexer, as in MP4E__open()), or the sink (copied). Return 0 on success.
+*   'finished' multiplexer holds the previous file, with all its samples; the
+*   application must finalize it with MP4E__close(). It is independent of the
+*   multiplexer, which continues with the next file, so MP4E__close() may be 
+*   called later, or from another thread (e.g. to write the index in the background), 
+*   if the allocator is thread-safe.
+*   If the callback returns non-zero, it must not use 'finished': rotation is cancelled,
+*   the current file continues, and rotation is retried at the next random access sample.
+*/
+typedef int (*MP4E_rotate_fn)(void * rotate_token, int file_number, MP4E_mux_t * finished, 
+                              FILE ** mp4file, MP4E_sink_t * sink);
+
+/*
+*   Track configuration for MP4E__recover_stream()
+*/
+typedef struct
+{
+    MP4E_track_t info;
+
+    // DSI for audio or private track; SPS and PPS for AVC video track. May be NULL.
+    const void * dsi;
+    int dsi_bytes;
+    const void * sps;
+    int sps_bytes;
+    const void * pps;
+    int pps_bytes;
+} MP4E_recover_track_t;
+
+/*
+*   Extended multiplexer parameters for MP4E__open_ex()
+*   Zero-initialized members select default behaviour.
+*/
+typedef struct
+{
+    // Output file handle, owned by the multiplexer (see MP4E__open())
+    FILE * mp4file;
+
+    // Output sink, used instead of mp4file, if not NULL. 
+    // The sink object is copied; it is not owned by the multiplexer.
+    const MP4E_sink_t * sink;
+
+    // Flag, indicating streaming-friendly 'fragmentation' mode
+    int enable_fragmentation;
+
+    // Memory allocator; NULL to use malloc()/realloc()/free()
+    // The allocator object is copied, and its context must outlive the multiplexer.
+    const MP4_allocator_t * allocator;
+
+    // CMAF chunked output, if non-zero (fragmentation mode only): max chunk duration, milliseconds.
+    // Chunk is 'moof' + 'mdat' with several samples of all tracks; segment is 'styp' box
+    // and chunks, starting at MP4E_SAMPLE_RANDOM_ACCESS sample of the 1st video track
+    // (or the 1st track, if there is no video). Sample data are held until chunk is complete.
+    unsigned cmaf_chunk_duration_ms;
+
+    // Called, when file header, fragment (chunk), or checkpoint is written; may be NULL
+    MP4E_flush_fn flush;
+    void * flush_token;
+
+    // Target segment duration, milliseconds, for CMAF or segmented output: segment starts at 
+    // the 1st random access sample after it. Default (0): every random access sample.
+    unsigned segment_duration_ms;
+
+    // Segmented output, if not NULL (fragmentation mode only): 'ftyp' + 'moov' init segment
+    // is written to mp4file or sink, and each media segment ('styp', 'sidx', 'moof', 'mdat')
+    // to the sink, supplied by this callback. Segment is a single fragment; sample data
+    // are held until segment is complete.
+    MP4E_segment_fn segment_sink;
+    void * segment_token;
+
+    // Crash-safe recording, if non-zero (non-fragmented mode, MP4E_CAN_USE_RANDOM_FILE_ACCESS=1 only):
+    // index checkpoint period of media time, milliseconds. Checkpoint holds the track configuration,
+    // and index of the samples, written since the previous checkpoint, in a 'free' box between 'mdat'
+    // boxes; each sample in 'mdat' box is prefixed by 16-byte header. Closed file is a valid MP4 file;
+    // file, which is not closed, is made playable by MP4E__recover().
+    unsigned checkpoint_interval_ms;
+
+    // Output rotation, if not NULL: when the file duration reaches rotate_duration_ms of media 
+    // time, or the file size reaches rotate_bytes, the next MP4E_SAMPLE_RANDOM_ACCESS sample of 
+    // the 1st video track (or the 1st track, if there is no video) starts the next file, with 
+    // the same tracks, SPS/PPS/DSI and comment. Each file starts at time 0, if samples are passed
+    // with durations; timestamps, passed to MP4E__put_sample_ts(), are not changed.
+    MP4E_rotate_fn rotate;
+    void * rotate_token;
+    unsigned rotate_duration_ms;
+    mp4e_offset_t rotate_bytes;
+
+    // Shared track table, if not NULL (used by the tee multiplexer, see mp4tee.h): tracks, 
+    // SPS/PPS/DSI and sample timing of this multiplexer are those of track_owner, and only the 
+    // file layout (sample index, fragments and random access points) is its own. Tracks are added
+    // to the owner, and samples are passed with MP4E__put_shared_sample(). The owner must be closed 
+    // after this multiplexer. Rotation and non-blocking mode are not supported for both.
+    MP4E_mux_t * track_owner;
+
+    // Non-blocking mode, if non-zero: max output bytes, which are passed to the output, but 
+    // not yet reported by MP4E__confirm_output(). If the sample does not fit, MP4E__put_sample*()
+    // does not write it, and returns MP4E_STATUS_WOULD_BLOCK; release() is not called, and the
+    // sample may be passed again later. Sample is written anyway, if there are no pending bytes.
+    mp4e_offset_t max_pending_bytes;
+
+    // Frame dropping policy for non-blocking mode: if non-zero, video sample, which is not 
+    // MP4E_SAMPLE_RANDOM_ACCESS, and does not fit, is dropped instead of MP4E_STATUS_WOULD_BLOCK; 
+    // following samples of the track are dropped until the next random access sample, since they 
+    // depend on the dropped one. Audio and random access samples are not dropped. Dropped sample 
+    // duration is added to the previous sample, so the track timeline is not changed. In fragmented 
+    // output the previous sample may be already written: then its 'trun' duration is not extended, 
+    // and the gap is carried by 'tfdt' of the next fragment, i.e. the next kept sample has its 
+    // original decode time. MP4E__put_sample*() returns MP4E_STATUS_OK for the dropped sample, 
+    // and releases it.
+    int drop_frames;
+
+    // Pull output mode, if non-zero: mp4file and sink must be NULL. Output is appended to the 
+    // internal chain of buffers, which the application drains with MP4E__get_output() and 
+    // MP4E__confirm_output(), e.g. from the event loop of asynchronous network stack. Sample 
+    // data, passed with release callback, is referenced by the chain, not copied; other data 
+    // is copied. Rotation is not supported. The file index is passed to the chain by MP4E__finish().
+    // File header is updated at close (non-fragmented mode, and MP4E_CAN_USE_RANDOM_FILE_ACCESS=1),
+    // so buffers are sequential in fragmentation mode only: offset of the buffer must be checked.
+    int pull_output;
+} MP4E_params_t;
+
+
 /************************************************************************/
 /*          API                                                         */
 /************************************************************************/
@@ -97,6 +294,24 @@ typedef struct
 MP4E_mux_t * MP4E__open(FILE * mp4file, int enable_fragmentation);
 
 
+/**
+*   Same as MP4E__open(), with extended parameters.
+*
+*   return multiplexor handle on success; NULL on failure
+*
+*   Example: multiplexer without heap usage:
+*
+*       static unsigned char memory[256*1024];
+*       MP4_arena_t arena;
+*       MP4E_params_t params = {0,};
+*       MP4__arena_init(&arena, memory, sizeof(memory));
+*       params.mp4file = fopen(input_file_name, "wb");
+*       params.allocator = &arena.allocator;
+*       mux = MP4E__open_ex(&params);
+*/
+MP4E_mux_t * MP4E__open_ex(const MP4E_params_t * params);
+
+
 /**
 *   Add new track 
 *   The track_data parameter does not referred by the multiplexer after function 
@@ -149,6 +364,110 @@ int MP4E__add_track(MP4E_mux_t * mux, const MP4E_track_t * track_data);
 int MP4E__put_sample(MP4E_mux_t * mux, int track_id, const void * data, int data_bytes, int duration, int kind);
 
 
+/**
+*   Same as MP4E__put_sample(), but sample data passed by reference: if output
+*   sink supports write_ref(), the data is not copied, and must stay valid until 
+*   release(release_token, data) call. The release() is called exactly once, 
+*   also in case of error, except MP4E_STATUS_WOULD_BLOCK. release may be NULL.
+*
+*   return error code MP4E_STATUS_*
+*/
+int MP4E__put_sample_ref(MP4E_mux_t * mux, int track_id, const void * data, int data_bytes, int duration, int kind, 
+                         MP4E_release_fn release, void * release_token);
+
+
+/**
+*   Add new sample to specified track, with decoding and presentation
+*   timestamps (dts, pts) in the track time_scale units, instead of duration.
+*   Sample duration is the difference of the next sample dts and this sample dts;
+*   it is updated in the index when the next sample arrives. Until then (and for
+*   the last sample), duration of the previous sample (or default_duration) is used.
+*   In fragmented mode, the sample is written immediately, and its dts is stored
+*   in the fragment 'tfdt' box, so the timeline does not depend on durations.
+*   The pts - dts difference is stored as composition offset (for B-frames).
+*
+*   return error code MP4E_STATUS_*
+*
+*   Example: put video frame from the encoder:
+*
+*       MP4E__put_sample_ts(mux, video_track_id, data, data_bytes, frame.dts, frame.pts, MP4E_SAMPLE_DEFAULT);
+*/
+int MP4E__put_sample_ts(MP4E_mux_t * mux, int track_id, const void * data, int data_bytes, 
+                        mp4e_time_t dts, mp4e_time_t pts, int kind);
+
+
+/**
+*   Same as MP4E__put_sample_ts(), but sample data passed by reference,
+*   as for MP4E__put_sample_ref()
+*
+*   return error code MP4E_STATUS_*
+*/
+int MP4E__put_sample_ts_ref(MP4E_mux_t * mux, int track_id, const void * data, int data_bytes, 
+                            mp4e_time_t dts, mp4e_time_t pts, int kind, 
+                            MP4E_release_fn release, void * release_token);
+
+
+/**
+*   Add new sample to mux[0], and to the multiplexers, which share its track table 
+*   (see MP4E_params_t::track_owner). Sample timing is resolved once, as by 
+*   MP4E__put_sample_ref(), or by MP4E__put_sample_ts_ref() if has_timestamps is set,
+*   and each multiplexer writes the sample in its own layout. The data is passed by 
+*   reference to each multiplexer, and release(release_token, data) is called once 
+*   for each of them, also in case of error.
+*
+*   return error code MP4E_STATUS_* of the 1st failed multiplexer; the sample is passed
+*   to other multiplexers anyway
+*/
+int MP4E__put_shared_sample(MP4E_mux_t * const * mux, int mux_count, int track_id, const void * data, int data_bytes, 
+                            int duration, mp4e_time_t dts, mp4e_time_t pts, int has_timestamps, int kind, 
+                            MP4E_release_fn release, void * release_token);
+
+
+/**
+*   Report output bytes, which are written to the destination (e.g. sent to the
+*   network), in non-blocking mode (see MP4E_params_t::max_pending_bytes).
+*   Bytes are counted in the order, they are passed to the output.
+*   In pull output mode, the bytes are drained from the start of the buffer chain:
+*   fully drained buffers are released, partially drained buffer is advanced.
+*/
+void MP4E__confirm_output(MP4E_mux_t * mux, mp4e_offset_t bytes);
+
+
+/**
+*   Get pending output buffers in pull output mode (see MP4E_params_t::pull_output), 
+*   in the output order. The buffers stay pending, until drained with MP4E__confirm_output(); 
+*   the array is valid until the next call to the multiplexer.
+*
+*   return error code MP4E_STATUS_*
+*
+*   Example:
+*
+*       const MP4E_output_t * output;
+*       int count;
+*       MP4E__get_output(mux, &output, &count);
+*       if (count)
+*       {
+*           int sent = send(socket, output[0].data, output[0].bytes, MSG_DONTWAIT);
+*           if (sent > 0)
+*           {
+*               MP4E__confirm_output(mux, sent);
+*           }
+*       }
+*/
+int MP4E__get_output(MP4E_mux_t * mux, const MP4E_output_t ** output, int * count);
+
+
+/**
+*   Write the file index, as MP4E__close(), but do not de-allocate the multiplexer:
+*   in pull output mode, the rest of output is drained before MP4E__close().
+*   Samples can not be added after this call; MP4E__close() only de-allocates
+*   the multiplexer, and returns MP4E_STATUS_OK.
+*
+*   return error code MP4E_STATUS_*
+*/
+int MP4E__finish(MP4E_mux_t * mux);
+
+
 /**
 *   Finalize MP4 file, de-allocated memory, and closes MP4 multiplexer. 
 *   The close operation takes a time and disk space, since it writes MP4 file 
@@ -160,6 +479,47 @@ int MP4E__put_sample(MP4E_mux_t * mux, int track_id, const void * data, int data
 int MP4E__close(MP4E_mux_t * mux);
 
 
+/**
+*   Make the file, written in checkpoint mode (see MP4E_params_t::checkpoint_interval_ms),
+*   but not closed (e.g. after crash or power loss), playable: index is restored from the 
+*   checkpoints and samples headers after the last checkpoint; incomplete sample is dropped. 
+*   'moov' box is appended to the file.
+*   mp4file must be opened for update ("r+b"); it is not closed.
+*
+*   return error code MP4E_STATUS_*:
+*       MP4E_STATUS_NOT_RECOVERABLE: there is no complete checkpoint in the file
+*
+*   Example:
+*
+*       FILE * f = fopen(file_name, "r+b");
+*       MP4E__recover(f);
+*       fclose(f);
+*/
+int MP4E__recover(FILE * mp4file);
+
+
+/**
+*   Make the file, written in streaming mode (MP4E_CAN_USE_RANDOM_FILE_ACCESS=0),
+*   but not closed, playable. Each sample of such file is in its own 'mdat' box;
+*   the box chain is scanned, and 'moov' box is appended to the file. Incomplete
+*   sample is dropped. Track configuration is not stored in the file, and must
+*   be the same as for the multiplexer, in the same order.
+*   Sample, which is H.264 access unit (chain of NAL units with 4-byte size prefix),
+*   goes to the MP4_OBJECT_TYPE_AVC track, and it is random access point, if it has
+*   IDR slice. Other samples go to the other track, so tracks may have at most one
+*   AVC track, and at most one other (e.g. audio) track. Sample duration is
+*   default_duration.
+*   File with 'moov' box is not changed.
+*   mp4file must be opened for update ("r+b"); it is not closed.
+*
+*   return error code MP4E_STATUS_*:
+*       MP4E_STATUS_BAD_ARGUMENTS: more than one AVC track, or more than one other
+*           track; the file is not changed
+*       MP4E_STATUS_NOT_RECOVERABLE: there are no samples in the file
+*/
+int MP4E__recover_stream(FILE * mp4file, const MP4E_recover_track_t * tracks, int track_count);
+
+
 /**
 *   Set Decoder Specific Info (DSI)
 *   Can be used for audio and private tracks.
@@ -0,0 +1,407 @@
+/** 18.10.2026 @file
+*
+*   Producers append samples to the bounded lock-free queue: a ring of cells,
+*   each with a sequence number, which tells if the cell is free for the
+*   position, or holds the sample for the position (D. Vyukov's algorithm).
+*   Producers reserve the position with compare-and-swap; the single consumer
+*   needs no atomic read-modify-write.
+*
+*   The consumer moves samples from the ring to per-track lists of pending
+*   samples (allocated from the pool of 'capacity' nodes), and passes the
+*   earliest pending sample to the multiplexer, when all active tracks have a
+*   pending sample, or when the pool is exhausted.
+**/
+
+#include "mp4queue.h"
+#include <stdlib.h>
+#include <string.h>
+
+/************************************************************************/
+/*      Build config                                                    */
+/************************************************************************/
+// Default queue capacity
+#ifndef MP4Q_DEFAULT_CAPACITY
+#define MP4Q_DEFAULT_CAPACITY   256
+#endif
+
+// Cache line size, to keep producer and consumer positions apart
+#ifndef MP4Q_CACHE_LINE
+#define MP4Q_CACHE_LINE         64
+#endif
+
+typedef struct
+{
+    int track_id;
+    const void * data;
+    int data_bytes;
+    int duration;
+    int kind;
+    double timestamp;
+    MP4E_release_fn release;
+    void * release_token;
+} mp4q_sample_t;
+
+typedef struct
+{
+    size_t sequence;
+    mp4q_sample_t sample;
+} mp4q_cell_t;
+
+/*
+*   Pending sample in the consumer's pool
+*/
+typedef struct
+{
+    mp4q_sample_t sample;
+    int next;                       // next node in the list, -1 if none
+} mp4q_node_t;
+
+/*
+*   Consumer's list of pending samples for the track
+*/
+typedef struct
+{
+    int head;                       // first node, -1 if none
+    int tail;                       // last node
+    int active;                     // flag: track is interleaved
+} mp4q_track_t;
+
+struct MP4Q_queue_tag
+{
+    MP4E_mux_t * mux;
+    mp4q_cell_t * cells;
+    size_t mask;                    // capacity - 1
+
+    // Producers state
+    char pad0[MP4Q_CACHE_LINE];
+    size_t enqueue_pos;
+    char pad1[MP4Q_CACHE_LINE];
+
+    // Consumer state
+    size_t dequeue_pos;
+    mp4q_node_t * nodes;
+    int free_node;                  // head of free nodes list, -1 if none
+    mp4q_track_t * tracks;
+    int track_count;
+};
+
+/************************************************************************/
+/*      Producer side                                                   */
+/************************************************************************/
+
+/**
+*   Release callback for the data, copied by the queue
+*/
+static void mp4q_free_copy(void * release_token, const void * data)
+{
+    (void)release_token;
+    free((void *)data);
+}
+
+/**
+*   Append sample to the ring
+*   return 1 on success, 0 if the ring is full
+*/
+static int mp4q_enqueue(MP4Q_queue_t * q, const mp4q_sample_t * sample)
+{
+    size_t pos = __atomic_load_n(&q->enqueue_pos, __ATOMIC_RELAXED);
+    mp4q_cell_t * cell;
+    for (;;)
+    {
+        size_t seq;
+        cell = q->cells + (pos & q->mask);
+        seq = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+        if (seq == pos)
+        {
+            // cell is free: reserve the position
+            if (__atomic_compare_exchange_n(&q->enqueue_pos, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            {
+                break;
+            }
+        }
+        else if ((ptrdiff_t)(seq - pos) < 0)
+        {
+            // cell still holds the sample, queued one lap ago
+            return 0;
+        }
+        else
+        {
+            pos = __atomic_load_n(&q->enqueue_pos, __ATOMIC_RELAXED);
+        }
+    }
+    cell->sample = *sample;
+    __atomic_store_n(&cell->sequence, pos + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+/************************************************************************/
+/*      Consumer side                                                   */
+/************************************************************************/
+
+/**
+*   Take next sample from the ring
+*   return 1 on success, 0 if the ring is empty
+*/
+static int mp4q_dequeue(MP4Q_queue_t * q, mp4q_sample_t * sample)
+{
+    mp4q_cell_t * cell = q->cells + (q->dequeue_pos & q->mask);
+    if (__atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE) != q->dequeue_pos + 1)
+    {
+        return 0;
+    }
+    *sample = cell->sample;
+    __atomic_store_n(&cell->sequence, q->dequeue_pos + q->mask + 1, __ATOMIC_RELEASE);
+    q->dequeue_pos++;
+    return 1;
+}
+
+/**
+*   Grow pending lists array to given number of tracks
+*   return 1 on success, 0 on fail
+*/
+static int mp4q_add_tracks(MP4Q_queue_t * q, int count, int active)
+{
+    int n;
+    mp4q_track_t * tracks = (mp4q_track_t *)realloc(q->tracks, count * sizeof(mp4q_track_t));
+    if (!tracks)
+    {
+        return 0;
+    }
+    for (n = q->track_count; n < count; n++)
+    {
+        tracks[n].head = -1;
+        tracks[n].tail = -1;
+        tracks[n].active = active;
+    }
+    q->tracks = tracks;
+    q->track_count = count;
+    return 1;
+}
+
+/**
+*   Move samples from the ring to pending lists, while pool has free nodes
+*   return error code MP4E_STATUS_*
+*/
+static int mp4q_fetch(MP4Q_queue_t * q)
+{
+    int error = MP4E_STATUS_OK;
+    while (q->free_node >= 0)
+    {
+        mp4q_sample_t sample;
+        mp4q_track_t * tr;
+        int n;
+        if (!mp4q_dequeue(q, &sample))
+        {
+            break;
+        }
+        if (sample.track_id >= q->track_count && !mp4q_add_tracks(q, sample.track_id + 1, 0))
+        {
+            sample.release(sample.release_token, sample.data);
+            error = MP4E_STATUS_NO_MEMORY;
+            continue;
+        }
+
+        n = q->free_node;
+        q->free_node = q->nodes[n].next;
+        q->nodes[n].sample = sample;
+        q->nodes[n].next = -1;
+        tr = q->tracks + sample.track_id;
+        if (tr->head < 0)
+        {
+            tr->head = n;
+        }
+        else
+        {
+            q->nodes[tr->tail].next = n;
+        }
+        tr->tail = n;
+        tr->active = 1;
+    }
+    return error;
+}
+
+/**
+*   Return track with the earliest pending sample, which may be passed to
+*   the multiplexer now; -1 if none
+*/
+static int mp4q_next_track(const MP4Q_queue_t * q, int flush)
+{
+    int i, best = -1, all_ready = 1;
+    for (i = 0; i < q->track_count; i++)
+    {
+        const mp4q_track_t * tr = q->tracks + i;
+        if (!tr->active)
+        {
+            continue;
+        }
+        if (tr->head < 0)
+        {
+            all_ready = 0;
+        }
+        else if (best < 0 || q->nodes[tr->head].sample.timestamp < q->nodes[q->tracks[best].head].sample.timestamp)
+        {
+            best = i;
+        }
+    }
+    // pool exhausted: don't wait for missing tracks
+    if (!all_ready && !flush && q->free_node >= 0)
+    {
+        return -1;
+    }
+    return best;
+}
+
+/************************************************************************/
+/*      Exported API functions                                          */
+/************************************************************************/
+
+/**
+*   Create the queue for given multiplexer.
+*/
+MP4Q_queue_t * MP4Q__open(MP4E_mux_t * mux, const MP4Q_params_t * params)
+{
+    unsigned requested = (params && params->capacity) ? params->capacity : MP4Q_DEFAULT_CAPACITY;
+    size_t i, capacity = 2;
+    MP4Q_queue_t * q;
+
+    if (!mux)
+    {
+        return NULL;
+    }
+    while (capacity < requested)
+    {
+        capacity *= 2;
+    }
+    q = (MP4Q_queue_t *)calloc(1, sizeof(MP4Q_queue_t));
+    if (!q)
+    {
+        return NULL;
+    }
+    q->mux = mux;
+    q->mask = capacity - 1;
+    q->cells = (mp4q_cell_t *)malloc(capacity * sizeof(mp4q_cell_t));
+    q->nodes = (mp4q_node_t *)malloc(capacity * sizeof(mp4q_node_t));
+    if (!q->cells || !q->nodes ||
+        (params && params->track_count > 0 && !mp4q_add_tracks(q, params->track_count, 1)))
+    {
+        free(q->cells);
+        free(q->nodes);
+        free(q->tracks);
+        free(q);
+        return NULL;
+    }
+    for (i = 0; i < capacity; i++)
+    {
+        q->cells[i].sequence = i;
+        q->nodes[i].next = (i + 1 < capacity) ? (int)(i + 1) : -1;
+    }
+    q->free_node = 0;
+    return q;
+}
+
+/**
+*   Queue the sample; may be called by any thread.
+*/
+int MP4Q__put_sample(MP4Q_queue_t * q, int track_id, const void * data, int data_bytes, double timestamp,
+                     int duration, int kind, MP4E_release_fn release, void * release_token)
+{
+    mp4q_sample_t sample;
+    if (!q || track_id < 0 || !data || data_bytes < 0)
+    {
+        if (release)
+        {
+            release(release_token, data);
+        }
+        return MP4E_STATUS_BAD_ARGUMENTS;
+    }
+    if (!release)
+    {
+        void * copy = malloc(data_bytes ? data_bytes : 1);
+        if (!copy)
+        {
+            return MP4E_STATUS_NO_MEMORY;
+        }
+        memcpy(copy, data, data_bytes);
+        data = copy;
+        release = mp4q_free_copy;
+    }
+    sample.track_id = track_id;
+    sample.data = data;
+    sample.data_bytes = data_bytes;
+    sample.duration = duration;
+    sample.kind = kind;
+    sample.timestamp = timestamp;
+    sample.release = release;
+    sample.release_token = release_token;
+    if (!mp4q_enqueue(q, &sample))
+    {
+        if (release == mp4q_free_copy)
+        {
+            free((void *)data);
+        }
+        return MP4E_STATUS_QUEUE_FULL;
+    }
+    return MP4E_STATUS_OK;
+}
+
+/**
+*   Pass queued samples to the multiplexer in timestamp order; must be called
+*   by a single thread.
+*/
+int MP4Q__drain(MP4Q_queue_t * q, int flush)
+{
+    int count = 0, error = MP4E_STATUS_OK;
+    if (!q)
+    {
+        return MP4E_STATUS_BAD_ARGUMENTS;
+    }
+    for (;;)
+    {
+        mp4q_track_t * tr;
+        mp4q_sample_t * s;
+        int n, t, result;
+
+        result = mp4q_fetch(q);
+        if (result != MP4E_STATUS_OK && error == MP4E_STATUS_OK)
+        {
+            error = result;
+        }
+        t = mp4q_next_track(q, flush);
+        if (t < 0)
+        {
+            break;
+        }
+        tr = q->tracks + t;
+        n = tr->head;
+        tr->head = q->nodes[n].next;
+        s = &q->nodes[n].sample;
+        result = MP4E__put_sample_ref(q->mux, s->track_id, s->data, s->data_bytes, s->duration, s->kind,
+                                      s->release, s->release_token);
+        if (result != MP4E_STATUS_OK && error == MP4E_STATUS_OK)
+        {
+            error = result;
+        }
+        q->nodes[n].next = q->free_node;
+        q->free_node = n;
+        count++;
+    }
+    return error != MP4E_STATUS_OK ? error : count;
+}
+
+/**
+*   Pass all queued samples to the multiplexer, and de-allocate the queue.
+*/
+int MP4Q__close(MP4Q_queue_t * q)
+{
+    int result;
+    if (!q)
+    {
+        return MP4E_STATUS_BAD_ARGUMENTS;
+    }
+    result = MP4Q__drain(q, 1);
+    free(q->cells);
+    free(q->nodes);
+    free(q->tracks);
+    free(q);
+    return result < 0 ? result : MP4E_STATUS_OK;
+}
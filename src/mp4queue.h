@@ -0,0 +1,109 @@
+/** 18.10.2026 @file
+*
+*   Thread-safe sample queue for MP4 multiplexer
+*
+*   Portability note: this module uses GCC/Clang __atomic built-ins.
+*
+*   MP4E_mux_t is not thread-safe. This queue lets several threads (e.g. audio
+*   and video encoders) submit samples without locking: MP4Q__put_sample() only
+*   appends the sample to a bounded lock-free queue, and a single 'mux thread'
+*   passes queued samples to the multiplexer with MP4Q__drain(), interleaving
+*   tracks by sample timestamp. When the queue is full, MP4Q__put_sample() does
+*   not wait, but returns MP4E_STATUS_QUEUE_FULL, so the producer can retry
+*   later, or drop the sample.
+*
+*   Single-threaded applications should call MP4E__put_sample() directly.
+*
+*   Example:
+*
+*       // setup: add tracks to the multiplexer, then
+*       MP4Q_queue_t * q = MP4Q__open(mux, NULL);
+*
+*       // encoder threads
+*       MP4Q__put_sample(q, audio_track_id, data, bytes, timestamp, duration, kind, release, token);
+*
+*       // mux thread
+*       while (running)
+*       {
+*           MP4Q__drain(q, 0);
+*           ... wait for more samples
+*       }
+*       MP4Q__close(q);     // mux the rest, after encoder threads are stopped
+*       MP4E__close(mux);
+*/
+
+#ifndef mp4queue_H_INCLUDED
+#define mp4queue_H_INCLUDED
+
+#include "mp4mux.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif  //__cplusplus
+
+typedef struct MP4Q_queue_tag MP4Q_queue_t;
+
+/*
+*   Queue parameters; zero-initialized members select defaults
+*/
+typedef struct
+{
+    // Max number of queued samples, rounded up to power of 2. Default is 256
+    // The mux thread holds up to the same number of samples for interleaving.
+    unsigned capacity;
+
+    // Number of tracks to interleave (track IDs 0..track_count-1): samples are
+    // held until all of them have samples. Default (0): tracks, which had samples
+    int track_count;
+} MP4Q_params_t;
+
+
+/**
+*   Create the queue for given multiplexer.
+*   params may be NULL.
+*
+*   return queue handle on success; NULL on failure
+*/
+MP4Q_queue_t * MP4Q__open(MP4E_mux_t * mux, const MP4Q_params_t * params);
+
+
+/**
+*   Queue the sample; may be called by any thread. Arguments are the same as for
+*   MP4E__put_sample_ref(), plus timestamp: sample time in any units, common
+*   for all tracks (e.g. seconds).
+*   If release is NULL, the data is copied; otherwise it must stay valid until
+*   release(release_token, data) call. The release() is called exactly once,
+*   unless MP4E_STATUS_QUEUE_FULL is returned.
+*
+*   return error code MP4E_STATUS_*:
+*       MP4E_STATUS_QUEUE_FULL: the sample is not queued (back-pressure)
+*/
+int MP4Q__put_sample(MP4Q_queue_t * q, int track_id, const void * data, int data_bytes, double timestamp,
+                     int duration, int kind, MP4E_release_fn release, void * release_token);
+
+
+/**
+*   Pass queued samples to the multiplexer in timestamp order; must be called
+*   by a single thread. Sample is passed when next sample is queued for every
+*   interleaved track (see MP4Q_params_t), or when interleaving buffer is full.
+*   If flush is non-zero, all queued samples are passed.
+*
+*   return number of passed samples, or error code MP4E_STATUS_* from the multiplexer
+*/
+int MP4Q__drain(MP4Q_queue_t * q, int flush);
+
+
+/**
+*   Pass all queued samples to the multiplexer, and de-allocate the queue.
+*   The multiplexer is not closed.
+*
+*   return error code MP4E_STATUS_*
+*/
+int MP4Q__close(MP4Q_queue_t * q);
+
+
+#ifdef __cplusplus
+}
+#endif //__cplusplus
+
+#endif //mp4queue_H_INCLUDED
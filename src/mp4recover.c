@@ -0,0 +1,137 @@
+/** 18.10.2026 @file
+*
+*   Recovery tool for files, which were not closed by the multiplexer.
+*
+*   mp4recover file.mp4
+*       file written in checkpoint mode: index is restored from the last
+*       checkpoint, and the following sample records (MP4E__recover)
+*
+*   mp4recover file.mp4 init.mp4
+*       file written in streaming mode (MP4E_CAN_USE_RANDOM_FILE_ACCESS=0):
+*       track configuration is read from init.mp4 (init segment, or any file
+*       from the same recorder), and 'mdat' box chain is scanned
+*       (MP4E__recover_stream). Samples are assigned to the tracks by
+*       content, so init.mp4 may have at most one H.264 track, and at most one
+*       other track. Files with more tracks can't be recovered: e.g. the
+*       mp4mux_stream layout (audio + H.264 + private data track) is rejected
+*
+*   The file is updated in place.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "mp4demux.h"
+#include "mp4mux.h"
+
+#define MAX_TRACKS 8
+
+/**
+*   Read track configuration from init file; return number of tracks, or 0 on failure
+*/
+static int read_tracks(MP4D_demux_t * mp4, FILE * f, MP4E_recover_track_t * tracks)
+{
+    unsigned i;
+    if (!MP4D__open(mp4, f) || !mp4->track_count || mp4->track_count > MAX_TRACKS)
+    {
+        return 0;
+    }
+    memset(tracks, 0, mp4->track_count*sizeof(MP4E_recover_track_t));
+    for (i = 0; i < mp4->track_count; i++)
+    {
+        const MP4D_track_t * tr = mp4->track + i;
+        MP4E_track_t * info = &tracks[i].info;
+        info->object_type_indication = tr->object_type_indication;
+        memcpy(info->language, tr->language, 4);
+        info->time_scale = tr->timescale;
+        if (tr->handler_type == MP4_HANDLER_TYPE_SOUN)
+        {
+            info->track_media_kind = e_audio;
+            info->u.a.channelcount = tr->SampleDescription.audio.channelcount;
+            info->default_duration = 1024;
+        }
+        else if (tr->handler_type == MP4_HANDLER_TYPE_VIDE)
+        {
+            info->track_media_kind = e_video;
+            info->u.v.width = tr->SampleDescription.video.width;
+            info->u.v.height = tr->SampleDescription.video.height;
+            info->default_duration = tr->timescale / 30;
+        }
+        else
+        {
+            info->track_media_kind = e_private;
+        }
+        if (tr->sample_count)
+        {
+            info->default_duration = tr->duration[0];
+        }
+        if (tr->object_type_indication == MP4_OBJECT_TYPE_AVC)
+        {
+            tracks[i].sps = MP4D__read_sps(mp4, i, 0, &tracks[i].sps_bytes);
+            tracks[i].pps = MP4D__read_pps(mp4, i, 0, &tracks[i].pps_bytes);
+        }
+        else
+        {
+            tracks[i].dsi = tr->dsi;
+            tracks[i].dsi_bytes = tr->dsi_bytes;
+        }
+    }
+    return mp4->track_count;
+}
+
+int main(int argc, char* argv[])
+{
+    MP4E_recover_track_t tracks[MAX_TRACKS];
+    MP4D_demux_t mp4 = {0,};
+    FILE * mp4_file, * init_file = NULL;
+    int track_count = 0, error_code;
+
+    if (argc < 2)
+    {
+        printf("Usage: mp4recover file.mp4 [init.mp4]\n"
+               "  init.mp4: track configuration of streaming mode file, at most one H.264 track and one other track;\n"
+               "  files with more tracks (e.g. audio + H.264 + private data of mp4mux_stream) can't be recovered\n");
+        return 1;
+    }
+    mp4_file = fopen(argv[1], "r+b");
+    if (!mp4_file)
+    {
+        printf("\nERROR: can't open file %s for update\n", argv[1]);
+        return 1;
+    }
+    if (argc > 2)
+    {
+        init_file = fopen(argv[2], "rb");
+        track_count = init_file ? read_tracks(&mp4, init_file, tracks) : 0;
+        if (!track_count)
+        {
+            printf("\nERROR: can't read track configuration from %s\n", argv[2]);
+            MP4D__close(&mp4);
+            if (init_file)
+            {
+                fclose(init_file);
+            }
+            fclose(mp4_file);
+            return 1;
+        }
+        error_code = MP4E__recover_stream(mp4_file, tracks, track_count);
+        MP4D__close(&mp4);
+        fclose(init_file);
+    }
+    else
+    {
+        error_code = MP4E__recover(mp4_file);
+    }
+    fclose(mp4_file);
+
+    if (error_code == MP4E_STATUS_BAD_ARGUMENTS && init_file)
+    {
+        printf("\nERROR: can't recover %s: %s must have at most one H.264 track, and at most one other track\n", argv[1], argv[2]);
+        return 1;
+    }
+    if (error_code != MP4E_STATUS_OK)
+    {
+        printf("\nERROR: can't recover %s: error %d\n", argv[1], error_code);
+        return 1;
+    }
+    return 0;
+}
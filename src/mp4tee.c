@@ -0,0 +1,251 @@
+/** 18.10.2026 @file
+*
+*   The 1st output multiplexer owns the track table: tracks, SPS/PPS/DSI and
+*   sample timing. Other outputs share it (MP4E_params_t::track_owner), and keep
+*   only their layout state, so the sample is validated and timed once, by
+*   MP4E__put_shared_sample().
+*
+*   Sample data is passed to each output multiplexer by reference, with
+*   reference-counted release: the shared reference holds the application's
+*   release callback, and the number of outputs, which did not release the
+*   data yet.
+*
+*   Data, passed without release callback, is copied once, to the memory block
+*   of the shared reference.
+**/
+
+#include "mp4tee.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*
+*   Shared reference to the sample data
+*/
+typedef struct
+{
+    int count;                      // # of holders
+    MP4E_release_fn release;        // application-supplied release, NULL if data is copied
+    void * release_token;
+} mp4t_ref_t;
+
+struct MP4T_tee_tag
+{
+    MP4E_mux_t ** mux;              // [output_count], mux[0] owns the track table
+    int output_count;
+    int fragmented;                 // flag: some output is fragmented, so tracks are fixed after the 1st sample
+    int started;                    // flag: samples are passed
+};
+
+/************************************************************************/
+/*      Shared reference                                                */
+/************************************************************************/
+
+/**
+*   Create shared reference with given number of holders; copy data, if release is NULL
+*   return reference, or NULL on failure
+*/
+static mp4t_ref_t * mp4t_ref_create(const void ** data, int data_bytes, int count, MP4E_release_fn release, void * release_token)
+{
+    mp4t_ref_t * ref = (mp4t_ref_t *)malloc(sizeof(mp4t_ref_t) + (release ? 0 : data_bytes));
+    if (ref)
+    {
+        ref->count = count;
+        ref->release = release;
+        ref->release_token = release_token;
+        if (!release)
+        {
+            memcpy(ref + 1, *data, data_bytes);
+            *data = ref + 1;
+        }
+    }
+    return ref;
+}
+
+/**
+*   Release callback for the outputs: drop the holder, and release the data
+*   after the last one
+*/
+static void mp4t_ref_release(void * release_token, const void * data)
+{
+    mp4t_ref_t * ref = (mp4t_ref_t *)release_token;
+    if (__atomic_sub_fetch(&ref->count, 1, __ATOMIC_ACQ_REL) == 0)
+    {
+        if (ref->release)
+        {
+            ref->release(ref->release_token, data);
+        }
+        free(ref);
+    }
+}
+
+/************************************************************************/
+/*      API                                                             */
+/************************************************************************/
+
+/**
+*   Open multiplexer for each output; outputs share the track table of the 1st one
+*/
+MP4T_tee_t * MP4T__open(const MP4E_params_t * outputs, int output_count)
+{
+    MP4T_tee_t * tee;
+    int n, success;
+    if (!outputs || output_count <= 0)
+    {
+        return NULL;
+    }
+    tee = (MP4T_tee_t *)calloc(1, sizeof(MP4T_tee_t));
+    success = tee && (tee->mux = (MP4E_mux_t **)calloc(output_count, sizeof(MP4E_mux_t *))) != NULL;
+    for (n = 0; n < output_count; n++)
+    {
+        // track timing is shared: outputs with rotation or non-blocking mode are not supported
+        success = success && !outputs[n].track_owner && !outputs[n].rotate && !outputs[n].max_pending_bytes;
+    }
+    for (n = 0; n < output_count; n++)
+    {
+        // open all outputs, to take ownership of the files
+        if (success)
+        {
+            MP4E_params_t params = outputs[n];
+            params.track_owner = n ? tee->mux[0] : NULL;
+            tee->mux[n] = MP4E__open_ex(&params);
+            tee->output_count = n + 1;
+            tee->fragmented |= params.enable_fragmentation;
+            success = tee->mux[n] != NULL;
+        }
+        else if (outputs[n].mp4file && !(outputs[n].sink && outputs[n].sink->write))
+        {
+            fclose(outputs[n].mp4file);
+        }
+    }
+    if (!success)
+    {
+        MP4T__close(tee);
+        tee = NULL;
+    }
+    return tee;
+}
+
+/**
+*   Return multiplexer of given output
+*/
+MP4E_mux_t * MP4T__get_mux(MP4T_tee_t * tee, int output)
+{
+    return (tee && output >= 0 && output < tee->output_count) ? tee->mux[output] : NULL;
+}
+
+/**
+*   Return error code MP4E_STATUS_*, if the track table can not be changed
+*/
+static int mp4t_check_tracks(MP4T_tee_t * tee)
+{
+    if (!tee)
+    {
+        return MP4E_STATUS_BAD_ARGUMENTS;
+    }
+    return (tee->fragmented && tee->started) ? MP4E_STATUS_ENCODE_IN_PROGRESS : MP4E_STATUS_OK;
+}
+
+/**
+*   Add new track to the shared track table, return track ID
+*/
+int MP4T__add_track(MP4T_tee_t * tee, const MP4E_track_t * track_data)
+{
+    int error_code = mp4t_check_tracks(tee);
+    return error_code ? error_code : MP4E__add_track(tee->mux[0], track_data);
+}
+
+/**
+*   Set track DSI in the shared track table
+*/
+int MP4T__set_dsi(MP4T_tee_t * tee, int track_id, const void * dsi, int bytes)
+{
+    int error_code = mp4t_check_tracks(tee);
+    return error_code ? error_code : MP4E__set_dsi(tee->mux[0], track_id, dsi, bytes);
+}
+
+/**
+*   Set track SPS in the shared track table
+*/
+int MP4T__set_sps(MP4T_tee_t * tee, int track_id, const void * sps, int bytes)
+{
+    int error_code = mp4t_check_tracks(tee);
+    return error_code ? error_code : MP4E__set_sps(tee->mux[0], track_id, sps, bytes);
+}
+
+/**
+*   Set track PPS in the shared track table
+*/
+int MP4T__set_pps(MP4T_tee_t * tee, int track_id, const void * pps, int bytes)
+{
+    int error_code = mp4t_check_tracks(tee);
+    return error_code ? error_code : MP4E__set_pps(tee->mux[0], track_id, pps, bytes);
+}
+
+/**
+*   Pass the sample to all outputs
+*   has_timestamps: flag, use dts and pts instead of duration
+*   return error code MP4E_STATUS_* of the 1st failed output
+*/
+static int mp4t_put_sample(MP4T_tee_t * tee, int track_id, const void * data, int data_bytes, int duration,
+                           mp4e_time_t dts, mp4e_time_t pts, int has_timestamps, int kind,
+                           MP4E_release_fn release, void * release_token)
+{
+    mp4t_ref_t * ref = NULL;
+    if (tee && data && data_bytes >= 0)
+    {
+        ref = mp4t_ref_create(&data, data_bytes, tee->output_count, release, release_token);
+    }
+    if (!ref)
+    {
+        if (release && data)
+        {
+            release(release_token, data);
+        }
+        return (tee && data && data_bytes >= 0) ? MP4E_STATUS_NO_MEMORY : MP4E_STATUS_BAD_ARGUMENTS;
+    }
+    tee->started = 1;
+    return MP4E__put_shared_sample(tee->mux, tee->output_count, track_id, data, data_bytes, duration, dts, pts,
+                                   has_timestamps, kind, mp4t_ref_release, ref);
+}
+
+/**
+*   Add new sample to all outputs
+*/
+int MP4T__put_sample(MP4T_tee_t * tee, int track_id, const void * data, int data_bytes, int duration, int kind,
+                     MP4E_release_fn release, void * release_token)
+{
+    return mp4t_put_sample(tee, track_id, data, data_bytes, duration, 0, 0, 0, kind, release, release_token);
+}
+
+/**
+*   Add new sample with timestamps to all outputs
+*/
+int MP4T__put_sample_ts(MP4T_tee_t * tee, int track_id, const void * data, int data_bytes,
+                        mp4e_time_t dts, mp4e_time_t pts, int kind, MP4E_release_fn release, void * release_token)
+{
+    return mp4t_put_sample(tee, track_id, data, data_bytes, 0, dts, pts, 1, kind, release, release_token);
+}
+
+/**
+*   Close all multiplexers, and de-allocate the tee. The owner of the track table
+*   is closed last.
+*/
+int MP4T__close(MP4T_tee_t * tee)
+{
+    int n, error_code = MP4E_STATUS_OK;
+    if (!tee)
+    {
+        return MP4E_STATUS_BAD_ARGUMENTS;
+    }
+    for (n = tee->output_count - 1; n >= 0; n--)
+    {
+        int output_error = tee->mux[n] ? MP4E__close(tee->mux[n]) : MP4E_STATUS_OK;
+        if (output_error)
+        {
+            error_code = output_error;
+        }
+    }
+    free(tee->mux);
+    free(tee);
+    return error_code;
+}
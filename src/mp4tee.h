@@ -0,0 +1,109 @@
+/** 18.10.2026 @file
+*
+*   Multi-output ('tee') MP4 multiplexer
+*
+*   Portability note: this module uses GCC/Clang __atomic built-ins.
+*
+*   Each sample is submitted once, and written to several outputs with
+*   different layouts, e.g. fragmented live feed and progressive archive file.
+*   Outputs share one track table (tracks, SPS/PPS/DSI and sample timing), and
+*   each output keeps only its layout state: sample index of progressive file,
+*   fragment sequence number and random access points of fragmented file.
+*   Sample data is shared by reference: outputs, which keep the sample (CMAF
+*   chunk, or sink with write_ref()), do not copy it, and the data is released
+*   once, when the last output releases it.
+*   Rotation and non-blocking mode are not supported for the outputs.
+*
+*   Example:
+*
+*       MP4E_params_t outputs[2] = {{0,}};
+*       outputs[0].mp4file = fopen("archive.mp4", "wb");
+*       outputs[1].sink = &live_sink;
+*       outputs[1].enable_fragmentation = 1;
+*       outputs[1].cmaf_chunk_duration_ms = 200;
+*       tee = MP4T__open(outputs, 2);
+*       video_track_id = MP4T__add_track(tee, &track);
+*       MP4T__set_sps(tee, video_track_id, sps, sps_bytes);
+*       ...
+*       MP4T__put_sample(tee, video_track_id, data, bytes, 0, kind, release, token);
+*       ...
+*       MP4T__close(tee);
+*/
+
+#ifndef mp4tee_H_INCLUDED
+#define mp4tee_H_INCLUDED
+
+#include "mp4mux.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif  //__cplusplus
+
+typedef struct MP4T_tee_tag MP4T_tee_t;
+
+
+/**
+*   Open multiplexer for each output, see MP4E__open_ex(). Output files are
+*   owned by the tee, as by MP4E__open_ex(), also on failure. Outputs with 
+*   rotate, max_pending_bytes or track_owner parameters are not accepted.
+*
+*   return tee handle on success; NULL on failure
+*/
+MP4T_tee_t * MP4T__open(const MP4E_params_t * outputs, int output_count);
+
+
+/**
+*   Return multiplexer of given output, e.g. to set output-specific comment;
+*   NULL if output number is not valid. Samples must be passed to the tee.
+*/
+MP4E_mux_t * MP4T__get_mux(MP4T_tee_t * tee, int output);
+
+
+/**
+*   Same as MP4E__add_track(), MP4E__set_dsi(), MP4E__set_sps(), MP4E__set_pps(),
+*   for the shared track table of the outputs. If some output is fragmented,
+*   tracks can not be changed after the 1st sample (MP4E_STATUS_ENCODE_IN_PROGRESS).
+*
+*   return error code MP4E_STATUS_*, or track ID for MP4T__add_track()
+*/
+int MP4T__add_track(MP4T_tee_t * tee, const MP4E_track_t * track_data);
+int MP4T__set_dsi(MP4T_tee_t * tee, int track_id, const void * dsi, int bytes);
+int MP4T__set_sps(MP4T_tee_t * tee, int track_id, const void * sps, int bytes);
+int MP4T__set_pps(MP4T_tee_t * tee, int track_id, const void * pps, int bytes);
+
+
+/**
+*   Same as MP4E__put_sample_ref(), for all outputs; see MP4E__put_shared_sample().
+*   If release is NULL, the data is copied once, and the copy is shared by outputs;
+*   otherwise, release(release_token, data) is called exactly once, when the data is
+*   written to all outputs, possibly from the thread of the output sink.
+*
+*   return error code MP4E_STATUS_* of the 1st failed output; the sample is passed
+*   to other outputs anyway
+*/
+int MP4T__put_sample(MP4T_tee_t * tee, int track_id, const void * data, int data_bytes, int duration, int kind,
+                     MP4E_release_fn release, void * release_token);
+
+
+/**
+*   Same as MP4E__put_sample_ts_ref(), for all outputs; data is shared as for MP4T__put_sample()
+*
+*   return error code MP4E_STATUS_* of the 1st failed output
+*/
+int MP4T__put_sample_ts(MP4T_tee_t * tee, int track_id, const void * data, int data_bytes,
+                        mp4e_time_t dts, mp4e_time_t pts, int kind, MP4E_release_fn release, void * release_token);
+
+
+/**
+*   Close all multiplexers, see MP4E__close(), and de-allocate the tee
+*
+*   return error code MP4E_STATUS_* of the 1st failed output
+*/
+int MP4T__close(MP4T_tee_t * tee);
+
+
+#ifdef __cplusplus
+}
+#endif //__cplusplus
+
+#endif //mp4tee_H_INCLUDED
@@ -0,0 +1,640 @@
+/** 18.10.2026 @file
+*
+*   Each write request is a 'chunk': a copy of multiplexer output, or a
+*   reference to sample data. Sequential writes of a file are appended to its
+*   fill chunk; the chunk is queued when full, or when the write can't be
+*   appended. Queued chunks become submission queue entries, which are passed
+*   to the kernel when the submission queue is full, or on MP4U__ring_submit().
+*   The chunk is released when its completion is reaped.
+*
+*   Writes to the same file may complete in any order, so an out-of-order
+*   write (file header update on close) waits for all writes of the file.
+*
+*   The ring is set up with raw system calls, liburing is not needed.
+**/
+
+#include "mp4uring.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/************************************************************************/
+/*      Build config                                                    */
+/************************************************************************/
+// Use io_uring, if available at run time
+#ifndef MP4U_USE_IO_URING
+#   ifdef __linux__
+#       define MP4U_USE_IO_URING 1
+#   else
+#       define MP4U_USE_IO_URING 0
+#   endif
+#endif
+
+// Older kernel headers (or cross toolchain sysroots) may not have io_uring
+#if MP4U_USE_IO_URING && defined(__has_include)
+#   if !__has_include(<linux/io_uring.h>)
+#       undef MP4U_USE_IO_URING
+#       define MP4U_USE_IO_URING 0
+#   endif
+#endif
+
+#if MP4U_USE_IO_URING
+#   include <stdint.h>
+#   include <sys/mman.h>
+#   include <sys/syscall.h>
+#   include <linux/io_uring.h>
+#   if !defined(__NR_io_uring_setup) || !defined(__NR_io_uring_enter)
+#       undef MP4U_USE_IO_URING
+#       define MP4U_USE_IO_URING 0
+#   endif
+#endif
+
+// Default submission queue size and chunk size
+#ifndef MP4U_DEFAULT_ENTRIES
+#define MP4U_DEFAULT_ENTRIES        256
+#endif
+#ifndef MP4U_DEFAULT_CHUNK_BYTES
+#define MP4U_DEFAULT_CHUNK_BYTES    (256*1024)
+#endif
+
+// Sample data smaller than this is copied, even if passed by reference
+#ifndef MP4U_MIN_REF_BYTES
+#define MP4U_MIN_REF_BYTES          (16*1024)
+#endif
+
+/*
+*   Write request
+*/
+typedef struct
+{
+    MP4U_file_t * file;
+    const unsigned char * data;     // data to write: copy buffer, or sample data
+    size_t bytes;                   // data size
+    size_t capacity;                // copy buffer size; 0 for sample data reference
+    mp4e_offset_t offset;           // file offset
+    MP4E_release_fn release;        // sample data release callback
+    void * release_token;
+} mp4u_chunk_t;
+
+struct MP4U_ring_tag
+{
+    int fd;                         // io_uring descriptor; -1 for blocking writes
+    size_t chunk_bytes;             // default copy chunk size
+    unsigned inflight;              // queued and not completed requests
+    unsigned max_inflight;          // limit, to avoid completion queue overflow
+    unsigned to_submit;             // queued and not submitted requests
+
+#if MP4U_USE_IO_URING
+    // Submission queue
+    unsigned sq_entries;
+    unsigned * sq_head;
+    unsigned * sq_tail;
+    unsigned * sq_mask;
+    unsigned * sq_array;
+    struct io_uring_sqe * sqes;
+
+    // Completion queue
+    unsigned * cq_head;
+    unsigned * cq_tail;
+    unsigned * cq_mask;
+    struct io_uring_cqe * cqes;
+
+    // Mappings
+    void * sq_ring;
+    size_t sq_ring_bytes;
+    void * cq_ring;
+    size_t cq_ring_bytes;
+    size_t sqes_bytes;
+#endif
+};
+
+struct MP4U_file_tag
+{
+    MP4U_ring_t * ring;
+    int fd;                         // output file
+    mp4u_chunk_t * fill;            // copy chunk being filled, or NULL
+    mp4e_offset_t next_offset;      // file offset of next sequential write
+    unsigned inflight;              // queued and not completed requests
+    int error;                      // flag: write error occurred
+};
+
+/************************************************************************/
+/*      Chunks                                                          */
+/************************************************************************/
+
+/**
+*   Write all given data at given offset, return 1 on success, 0 on fail
+*/
+static int mp4u_pwrite(int fd, const unsigned char * data, size_t bytes, mp4e_offset_t offset)
+{
+    while (bytes)
+    {
+        ssize_t n = pwrite(fd, data, bytes, (off_t)offset);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return 0;
+        }
+        data += n;
+        bytes -= n;
+        offset += n;
+    }
+    return 1;
+}
+
+/**
+*   Allocate copy chunk with given capacity, and copy data to it
+*/
+static mp4u_chunk_t * mp4u_chunk_copy(MP4U_file_t * f, mp4e_offset_t offset, const void * data, size_t bytes)
+{
+    size_t capacity = bytes > f->ring->chunk_bytes ? bytes : f->ring->chunk_bytes;
+    mp4u_chunk_t * c = (mp4u_chunk_t *)malloc(sizeof(mp4u_chunk_t) + capacity);
+    if (c)
+    {
+        memset(c, 0, sizeof(mp4u_chunk_t));
+        c->file = f;
+        c->data = (unsigned char *)(c + 1);
+        c->capacity = capacity;
+        c->offset = offset;
+        c->bytes = bytes;
+        memcpy(c + 1, data, bytes);
+    }
+    return c;
+}
+
+/**
+*   Release chunk memory and sample data
+*/
+static void mp4u_chunk_free(mp4u_chunk_t * c)
+{
+    if (c->release)
+    {
+        c->release(c->release_token, c->data);
+    }
+    free(c);
+}
+
+/************************************************************************/
+/*      io_uring                                                        */
+/************************************************************************/
+#if MP4U_USE_IO_URING
+
+/**
+*   Create io_uring instance and map its queues
+*   return 1 on success, 0 on fail
+*/
+static int mp4u_uring_setup(MP4U_ring_t * ring, unsigned entries)
+{
+    struct io_uring_params p;
+    unsigned char * sq;
+    unsigned char * cq;
+
+    memset(&p, 0, sizeof(p));
+    ring->fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+    if (ring->fd < 0)
+    {
+        ring->fd = -1;
+        return 0;
+    }
+
+    ring->sq_ring_bytes = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    ring->cq_ring_bytes = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if (ring->cq_ring_bytes > ring->sq_ring_bytes)
+        {
+            ring->sq_ring_bytes = ring->cq_ring_bytes;
+        }
+        ring->cq_ring_bytes = 0;
+    }
+    ring->sqes_bytes = p.sq_entries * sizeof(struct io_uring_sqe);
+
+    ring->sq_ring = mmap(NULL, ring->sq_ring_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    ring->cq_ring = ring->cq_ring_bytes ? mmap(NULL, ring->cq_ring_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING) : ring->sq_ring;
+    ring->sqes = (struct io_uring_sqe *)mmap(NULL, ring->sqes_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sq_ring == MAP_FAILED || ring->cq_ring == MAP_FAILED || (void *)ring->sqes == MAP_FAILED)
+    {
+        return 0;
+    }
+
+    sq = (unsigned char *)ring->sq_ring;
+    cq = (unsigned char *)ring->cq_ring;
+    ring->sq_entries = p.sq_entries;
+    ring->sq_head  = (unsigned *)(sq + p.sq_off.head);
+    ring->sq_tail  = (unsigned *)(sq + p.sq_off.tail);
+    ring->sq_mask  = (unsigned *)(sq + p.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(sq + p.sq_off.array);
+    ring->cq_head  = (unsigned *)(cq + p.cq_off.head);
+    ring->cq_tail  = (unsigned *)(cq + p.cq_off.tail);
+    ring->cq_mask  = (unsigned *)(cq + p.cq_off.ring_mask);
+    ring->cqes     = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    ring->max_inflight = p.cq_entries;
+    return 1;
+}
+
+/**
+*   Unmap queues and close io_uring instance
+*/
+static void mp4u_uring_free(MP4U_ring_t * ring)
+{
+    if (ring->sqes && (void *)ring->sqes != MAP_FAILED)
+    {
+        munmap(ring->sqes, ring->sqes_bytes);
+    }
+    if (ring->cq_ring_bytes && ring->cq_ring && ring->cq_ring != MAP_FAILED)
+    {
+        munmap(ring->cq_ring, ring->cq_ring_bytes);
+    }
+    if (ring->sq_ring && ring->sq_ring != MAP_FAILED)
+    {
+        munmap(ring->sq_ring, ring->sq_ring_bytes);
+    }
+    if (ring->fd >= 0)
+    {
+        close(ring->fd);
+    }
+    ring->fd = -1;
+}
+
+/**
+*   Process all available completions
+*/
+static void mp4u_uring_reap(MP4U_ring_t * ring)
+{
+    unsigned head = *ring->cq_head;
+    while (head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE))
+    {
+        const struct io_uring_cqe * cqe = ring->cqes + (head & *ring->cq_mask);
+        mp4u_chunk_t * c = (mp4u_chunk_t *)(uintptr_t)cqe->user_data;
+        int res = cqe->res;
+        int success = 1;
+        if (res < 0 || (size_t)res < c->bytes)
+        {
+            // short write, or IORING_OP_WRITE not supported by the kernel: write the rest synchronously
+            size_t done = res > 0 ? (size_t)res : 0;
+            success = (res >= 0 || res == -EINVAL || res == -EOPNOTSUPP || res == -EAGAIN || res == -EINTR) &&
+                mp4u_pwrite(c->file->fd, c->data + done, c->bytes - done, c->offset + done);
+        }
+        c->file->error |= !success;
+        c->file->inflight--;
+        ring->inflight--;
+        mp4u_chunk_free(c);
+        head++;
+    }
+    __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+}
+
+/**
+*   Submit queued entries, and optionally wait for at least one completion
+*   return 1 on success, 0 on fail
+*/
+static int mp4u_uring_enter(MP4U_ring_t * ring, int wait)
+{
+    for (;;)
+    {
+        unsigned min_complete = wait ? 1 : 0;
+        long n = syscall(__NR_io_uring_enter, ring->fd, ring->to_submit, min_complete,
+            min_complete ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+        if (n >= 0)
+        {
+            ring->to_submit -= (unsigned)n;
+            if (!ring->to_submit || !wait)
+            {
+                break;
+            }
+        }
+        else if (errno == EBUSY || errno == EAGAIN)
+        {
+            // completion queue is full, or kernel is out of resources: reap and retry
+            mp4u_uring_reap(ring);
+            if (!wait)
+            {
+                break;
+            }
+        }
+        else if (errno != EINTR)
+        {
+            return 0;
+        }
+    }
+    mp4u_uring_reap(ring);
+    return 1;
+}
+
+/**
+*   Put write request to the submission queue; the chunk is released on completion
+*   return 1 on success, 0 on fail
+*/
+static int mp4u_uring_queue(MP4U_ring_t * ring, mp4u_chunk_t * c)
+{
+    struct io_uring_sqe * sqe;
+    unsigned tail, index;
+
+    while (ring->inflight >= ring->max_inflight ||
+           *ring->sq_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) >= ring->sq_entries)
+    {
+        if (!mp4u_uring_enter(ring, 1))
+        {
+            return 0;
+        }
+    }
+
+    tail = *ring->sq_tail;
+    index = tail & *ring->sq_mask;
+    sqe = ring->sqes + index;
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = c->file->fd;
+    sqe->addr = (uintptr_t)c->data;
+    sqe->len = (unsigned)c->bytes;
+    sqe->off = c->offset;
+    sqe->user_data = (uintptr_t)c;
+    ring->sq_array[index] = index;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ring->to_submit++;
+    ring->inflight++;
+    c->file->inflight++;
+
+    // submission queue is full: pass the batch to the kernel
+    // (on failure, the request stays queued, and the error is reported when waiting for it)
+    if (ring->to_submit == ring->sq_entries)
+    {
+        (void)mp4u_uring_enter(ring, 0);
+    }
+    return 1;
+}
+
+#endif  // MP4U_USE_IO_URING
+
+/************************************************************************/
+/*      File output                                                     */
+/************************************************************************/
+
+/**
+*   Queue write request, or write it synchronously in blocking mode.
+*   The chunk is released in any case.
+*   return 1 on success, 0 on fail
+*/
+static int mp4u_queue(mp4u_chunk_t * c)
+{
+    MP4U_file_t * f = c->file;
+    int success;
+#if MP4U_USE_IO_URING
+    if (f->ring->fd >= 0 && mp4u_uring_queue(f->ring, c))
+    {
+        return 1;
+    }
+    success = f->ring->fd < 0 && mp4u_pwrite(f->fd, c->data, c->bytes, c->offset);
+#else
+    success = mp4u_pwrite(f->fd, c->data, c->bytes, c->offset);
+#endif
+    f->error |= !success;
+    mp4u_chunk_free(c);
+    return success;
+}
+
+/**
+*   Queue the fill chunk, if any
+*   return 1 on success, 0 on fail
+*/
+static int mp4u_queue_fill(MP4U_file_t * f)
+{
+    mp4u_chunk_t * c = f->fill;
+    f->fill = NULL;
+    return c ? mp4u_queue(c) : 1;
+}
+
+/**
+*   Wait until all queued writes of the file are completed
+*   return 1 on success, 0 on fail
+*/
+static int mp4u_wait_file(MP4U_file_t * f)
+{
+#if MP4U_USE_IO_URING
+    while (f->inflight)
+    {
+        if (!mp4u_uring_enter(f->ring, 1))
+        {
+            return 0;
+        }
+    }
+#endif
+    return !f->error;
+}
+
+/**
+*   MP4E_sink_t::write() implementation: append data to the fill chunk
+*/
+static int mp4u_sink_write(void * token, mp4e_offset_t offset, const void * data, size_t bytes)
+{
+    MP4U_file_t * f = (MP4U_file_t *)token;
+    mp4u_chunk_t * c = f->fill;
+
+    if (f->error)
+    {
+        return -1;
+    }
+    if (c && offset == f->next_offset && c->bytes + bytes <= c->capacity)
+    {
+        memcpy((unsigned char *)c->data + c->bytes, data, bytes);
+        c->bytes += bytes;
+        f->next_offset += bytes;
+        return 0;
+    }
+    if (!mp4u_queue_fill(f))
+    {
+        return -1;
+    }
+    // out-of-order write may overlap queued ones
+    if (offset != f->next_offset && !mp4u_wait_file(f))
+    {
+        return -1;
+    }
+    f->fill = mp4u_chunk_copy(f, offset, data, bytes);
+    if (!f->fill)
+    {
+        f->error = 1;
+        return -1;
+    }
+    f->next_offset = offset + bytes;
+    return 0;
+}
+
+/**
+*   MP4E_sink_t::write_ref() implementation: queue large sample data by reference
+*/
+static int mp4u_sink_write_ref(void * token, mp4e_offset_t offset, const void * data, size_t bytes, MP4E_release_fn release, void * release_token)
+{
+    MP4U_file_t * f = (MP4U_file_t *)token;
+    mp4u_chunk_t * c;
+
+    // copy data, if its lifetime is unknown, or copy is cheap
+    if (!release || bytes < MP4U_MIN_REF_BYTES || offset != f->next_offset)
+    {
+        int result = mp4u_sink_write(token, offset, data, bytes);
+        if (release)
+        {
+            release(release_token, data);
+        }
+        return result;
+    }
+
+    c = (mp4u_chunk_t *)malloc(sizeof(mp4u_chunk_t));
+    if (!c || f->error || !mp4u_queue_fill(f))
+    {
+        free(c);
+        f->error = 1;
+        release(release_token, data);
+        return -1;
+    }
+    memset(c, 0, sizeof(mp4u_chunk_t));
+    c->file = f;
+    c->data = (const unsigned char *)data;
+    c->bytes = bytes;
+    c->offset = offset;
+    c->release = release;
+    c->release_token = release_token;
+    f->next_offset = offset + bytes;
+    return mp4u_queue(c) ? 0 : -1;
+}
+
+/************************************************************************/
+/*      Exported API functions                                          */
+/************************************************************************/
+
+/**
+*   Create the ring.
+*/
+MP4U_ring_t * MP4U__ring_open(const MP4U_params_t * params)
+{
+    MP4U_ring_t * ring = (MP4U_ring_t *)calloc(1, sizeof(MP4U_ring_t));
+    if (!ring)
+    {
+        return NULL;
+    }
+    ring->fd = -1;
+    ring->chunk_bytes = (params && params->chunk_bytes) ? params->chunk_bytes : MP4U_DEFAULT_CHUNK_BYTES;
+#if MP4U_USE_IO_URING
+    if (!(params && params->disable_io_uring) &&
+        !mp4u_uring_setup(ring, (params && params->entries) ? params->entries : MP4U_DEFAULT_ENTRIES))
+    {
+        // io_uring is not available: fall back to blocking writes
+        mp4u_uring_free(ring);
+    }
+#endif
+    return ring;
+}
+
+/**
+*   return 1 if the ring uses io_uring, 0 if it falls back to blocking writes
+*/
+int MP4U__ring_is_async(const MP4U_ring_t * ring)
+{
+    return ring && ring->fd >= 0;
+}
+
+/**
+*   Submit queued write requests to the kernel, and process completed ones.
+*/
+int MP4U__ring_submit(MP4U_ring_t * ring)
+{
+    if (!ring)
+    {
+        return MP4E_STATUS_BAD_ARGUMENTS;
+    }
+#if MP4U_USE_IO_URING
+    if (ring->fd >= 0 && !mp4u_uring_enter(ring, 0))
+    {
+        return MP4E_STATUS_FILE_WRITE_ERROR;
+    }
+#endif
+    return MP4E_STATUS_OK;
+}
+
+/**
+*   Destroy the ring.
+*/
+void MP4U__ring_close(MP4U_ring_t * ring)
+{
+    if (ring)
+    {
+#if MP4U_USE_IO_URING
+        mp4u_uring_free(ring);
+#endif
+        free(ring);
+    }
+}
+
+/**
+*   Create output file, served by the ring.
+*/
+MP4U_file_t * MP4U__file_open(MP4U_ring_t * ring, const char * file_name)
+{
+    MP4U_file_t * f;
+    if (!ring || !file_name)
+    {
+        return NULL;
+    }
+    f = (MP4U_file_t *)calloc(1, sizeof(MP4U_file_t));
+    if (!f)
+    {
+        return NULL;
+    }
+    f->ring = ring;
+    f->fd = open(file_name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (f->fd < 0)
+    {
+        free(f);
+        return NULL;
+    }
+    return f;
+}
+
+/**
+*   Fill output sink, which passes multiplexer output to the file
+*/
+void MP4U__get_sink(MP4U_file_t * file, MP4E_sink_t * sink)
+{
+    sink->write = mp4u_sink_write;
+    sink->write_ref = mp4u_sink_write_ref;
+    sink->token = file;
+}
+
+/**
+*   Queue partially filled chunk, and wait until all data is written to the file.
+*/
+int MP4U__file_flush(MP4U_file_t * f)
+{
+    if (!f)
+    {
+        return MP4E_STATUS_BAD_ARGUMENTS;
+    }
+    if (!mp4u_queue_fill(f) || !mp4u_wait_file(f))
+    {
+        return MP4E_STATUS_FILE_WRITE_ERROR;
+    }
+    return MP4E_STATUS_OK;
+}
+
+/**
+*   Write remaining data, close the file and de-allocate memory.
+*/
+int MP4U__file_close(MP4U_file_t * f)
+{
+    int success;
+    if (!f)
+    {
+        return MP4E_STATUS_BAD_ARGUMENTS;
+    }
+    success = mp4u_queue_fill(f);
+    // requests must not refer to the file after it is freed
+    success &= mp4u_wait_file(f);
+    success &= !close(f->fd);
+    free(f);
+    return success ? MP4E_STATUS_OK : MP4E_STATUS_FILE_WRITE_ERROR;
+}
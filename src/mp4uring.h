@@ -0,0 +1,132 @@
+/** 18.10.2026 @file
+*
+*   Asynchronous io_uring output for many MP4 multiplexers
+*
+*   Portability note: this module uses POSIX file API (open(), pwrite()), and
+*   Linux io_uring, if available. When io_uring can't be used (old kernel,
+*   seccomp policy, non-Linux build), writes are done with blocking pwrite().
+*
+*   Many output files share one ring. Multiplexer output is copied into
+*   per-file chunks; full chunks, and sample data passed with
+*   MP4E__put_sample_ref(), are queued to the ring, and submitted to the kernel
+*   in batches, with a single system call for all files. The ring is not
+*   thread-safe: all multiplexers using the ring must be driven from one thread.
+*
+*   Example:
+*
+*       MP4U_ring_t * ring = MP4U__ring_open(NULL);
+*       for (i = 0; i < camera_count; i++)
+*       {
+*           MP4E_params_t params = {0,};
+*           MP4E_sink_t sink;
+*           file[i] = MP4U__file_open(ring, name[i]);
+*           MP4U__get_sink(file[i], &sink);
+*           params.sink = &sink;
+*           mux[i] = MP4E__open_ex(&params);
+*       }
+*       for (;;)
+*       {
+*           ... MP4E__put_sample(mux[i], ...) for all ready cameras
+*           MP4U__ring_submit(ring);
+*       }
+*       ...
+*       MP4E__close(mux[i]);
+*       MP4U__file_close(file[i]);
+*       ...
+*       MP4U__ring_close(ring);
+*/
+
+#ifndef mp4uring_H_INCLUDED
+#define mp4uring_H_INCLUDED
+
+#include "mp4mux.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif  //__cplusplus
+
+typedef struct MP4U_ring_tag MP4U_ring_t;
+typedef struct MP4U_file_tag MP4U_file_t;
+
+/*
+*   Ring parameters; zero-initialized members select defaults
+*/
+typedef struct
+{
+    // Submission queue size. Default is 256
+    unsigned entries;
+
+    // Size of per-file copy chunk; one write request per chunk. Default is 256 KB
+    size_t chunk_bytes;
+
+    // Non-zero to use blocking pwrite() even if io_uring is available
+    int disable_io_uring;
+} MP4U_params_t;
+
+
+/**
+*   Create the ring.
+*   params may be NULL.
+*
+*   return ring handle on success; NULL on failure
+*/
+MP4U_ring_t * MP4U__ring_open(const MP4U_params_t * params);
+
+
+/**
+*   return 1 if the ring uses io_uring, 0 if it falls back to blocking writes
+*/
+int MP4U__ring_is_async(const MP4U_ring_t * ring);
+
+
+/**
+*   Submit queued write requests to the kernel, and process completed ones.
+*   Does not wait for the writes.
+*
+*   return error code MP4E_STATUS_*
+*/
+int MP4U__ring_submit(MP4U_ring_t * ring);
+
+
+/**
+*   Destroy the ring. All files must be closed.
+*/
+void MP4U__ring_close(MP4U_ring_t * ring);
+
+
+/**
+*   Create output file, served by the ring.
+*
+*   return file handle on success; NULL on failure
+*/
+MP4U_file_t * MP4U__file_open(MP4U_ring_t * ring, const char * file_name);
+
+
+/**
+*   Fill output sink, which passes multiplexer output to the file
+*/
+void MP4U__get_sink(MP4U_file_t * file, MP4E_sink_t * sink);
+
+
+/**
+*   Queue partially filled chunk, and wait until all data is written to the file.
+*
+*   return error code MP4E_STATUS_*
+*/
+int MP4U__file_flush(MP4U_file_t * file);
+
+
+/**
+*   Write remaining data, close the file and de-allocate memory.
+*   Must be called after MP4E__close().
+*
+*   return error code MP4E_STATUS_*
+*/
+int MP4U__file_close(MP4U_file_t * file);
+
+
+#ifdef __cplusplus
+}
+#endif //__cplusplus
+
+#endif //mp4uring_H_INCLUDED
@@ -0,0 +1,571 @@
+/** 18.10.2026 @file
+*
+*   Multiplexer output is collected in the 'fill' buffer. Full buffers, and
+*   sample data passed by reference, are queued to the writer thread, which
+*   writes them with pwrite() in the queue order. Buffers are acquired and
+*   released in the ring order.
+*
+*   Out-of-order writes (file header update on close) are written synchronously,
+*   after the queue is drained.
+*
+*   With O_DIRECT, all buffer writes are aligned: buffers are written at aligned
+*   offsets, the last buffer is padded, and the file is truncated on close.
+**/
+
+#define _GNU_SOURCE     // O_DIRECT, fallocate()
+#include "mp4writer.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+
+/************************************************************************/
+/*      Build config                                                    */
+/************************************************************************/
+// Default buffer size and count
+#ifndef MP4W_DEFAULT_BUFFER_BYTES
+#define MP4W_DEFAULT_BUFFER_BYTES   (4*1024*1024)
+#endif
+#ifndef MP4W_DEFAULT_BUFFER_COUNT
+#define MP4W_DEFAULT_BUFFER_COUNT   4
+#endif
+
+// Buffers memory, size and file offset alignment (as required by O_DIRECT)
+#define MP4W_ALIGN                  4096
+
+// Max number of sample references in the queue
+#ifndef MP4W_MAX_REFS
+#define MP4W_MAX_REFS               256
+#endif
+
+// Sample data smaller than this is copied, even if passed by reference
+#ifndef MP4W_MIN_REF_BYTES
+#define MP4W_MIN_REF_BYTES          (16*1024)
+#endif
+
+#define MP4W_ROUND(x) (((x) + (MP4W_ALIGN - 1)) & ~(size_t)(MP4W_ALIGN - 1))
+
+/*
+*   Write request: buffer (release == NULL) or sample data reference
+*/
+typedef struct
+{
+    const unsigned char * data;
+    size_t bytes;
+    mp4e_offset_t offset;
+    MP4E_release_fn release;
+    void * release_token;
+} mp4w_item_t;
+
+struct MP4W_writer_tag
+{
+    int fd;                         // output file
+    int fd_patch;                   // output file without O_DIRECT, for out-of-order writes
+    int direct_io;                  // O_DIRECT flag
+    size_t buffer_bytes;            // size of each buffer
+    unsigned buffer_count;          // number of buffers
+    unsigned char * memory;         // buffers memory
+
+    // Producer state, used by the multiplexer thread only
+    unsigned fill_buffer;           // buffer being filled
+    unsigned next_buffer;           // buffer to be filled next
+    int fill_active;                // flag: fill_buffer acquired
+    size_t fill_bytes;              // data size in the fill_buffer
+    mp4e_offset_t fill_offset;      // file offset of fill_buffer data
+    mp4e_offset_t next_offset;      // file offset of next sequential write
+    mp4e_offset_t file_size;        // max written offset
+
+    // Shared state, protected by lock
+    pthread_mutex_t lock;
+    pthread_cond_t cond_queued;     // item queued or stop requested
+    pthread_cond_t cond_written;    // item written
+    mp4w_item_t * queue;            // ring of write requests
+    unsigned queue_size;
+    unsigned queue_head;
+    unsigned queue_count;
+    unsigned free_buffers;          // buffers available to producer
+    size_t ref_bytes;               // sample data size, queued by reference
+    int stop;                       // flag: writer thread should exit when queue is empty
+    int error;                      // flag: write error occurred
+
+    pthread_t thread;
+};
+
+/************************************************************************/
+/*      File output                                                     */
+/************************************************************************/
+
+/**
+*   Write all given data at given offset, return 1 on success, 0 on fail
+*/
+static int mp4w_pwrite(int fd, const unsigned char * data, size_t bytes, mp4e_offset_t offset)
+{
+    while (bytes)
+    {
+        ssize_t n = pwrite(fd, data, bytes, (off_t)offset);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return 0;
+        }
+        data += n;
+        bytes -= n;
+        offset += n;
+    }
+    return 1;
+}
+
+/**
+*   Writer thread: write queued requests in order
+*/
+static void * mp4w_thread(void * arg)
+{
+    MP4W_writer_t * w = (MP4W_writer_t *)arg;
+    pthread_mutex_lock(&w->lock);
+    for (;;)
+    {
+        mp4w_item_t item;
+        int success;
+        while (!w->queue_count && !w->stop)
+        {
+            pthread_cond_wait(&w->cond_queued, &w->lock);
+        }
+        if (!w->queue_count)
+        {
+            break;
+        }
+        item = w->queue[w->queue_head];
+        pthread_mutex_unlock(&w->lock);
+
+        success = mp4w_pwrite(w->fd, item.data, item.bytes, item.offset);
+        if (item.release)
+        {
+            item.release(item.release_token, item.data);
+        }
+
+        pthread_mutex_lock(&w->lock);
+        w->error |= !success;
+        w->queue_head = (w->queue_head + 1) % w->queue_size;
+        w->queue_count--;
+        if (item.release)
+        {
+            w->ref_bytes -= item.bytes;
+        }
+        else
+        {
+            w->free_buffers++;
+        }
+        pthread_cond_broadcast(&w->cond_written);
+    }
+    pthread_mutex_unlock(&w->lock);
+    return NULL;
+}
+
+/************************************************************************/
+/*      Producer side                                                   */
+/************************************************************************/
+
+/**
+*   Append write request to the queue, waiting for free space
+*   return 1 on success, 0 on fail
+*/
+static int mp4w_enqueue(MP4W_writer_t * w, const mp4w_item_t * item)
+{
+    int success;
+    pthread_mutex_lock(&w->lock);
+    while (w->queue_count == w->queue_size && !w->error)
+    {
+        pthread_cond_wait(&w->cond_written, &w->lock);
+    }
+    success = !w->error;
+    if (success)
+    {
+        w->queue[(w->queue_head + w->queue_count) % w->queue_size] = *item;
+        w->queue_count++;
+        pthread_cond_signal(&w->cond_queued);
+    }
+    pthread_mutex_unlock(&w->lock);
+    return success;
+}
+
+/**
+*   Wait until all queued requests are written
+*   return 1 on success, 0 on fail
+*/
+static int mp4w_drain(MP4W_writer_t * w)
+{
+    int success;
+    pthread_mutex_lock(&w->lock);
+    while (w->queue_count && !w->error)
+    {
+        pthread_cond_wait(&w->cond_written, &w->lock);
+    }
+    success = !w->error;
+    pthread_mutex_unlock(&w->lock);
+    return success;
+}
+
+/**
+*   Take next buffer of the ring for filling, waiting if all buffers are queued
+*   return 1 on success, 0 on fail
+*/
+static int mp4w_acquire_buffer(MP4W_writer_t * w)
+{
+    int success;
+    pthread_mutex_lock(&w->lock);
+    while (!w->free_buffers && !w->error)
+    {
+        pthread_cond_wait(&w->cond_written, &w->lock);
+    }
+    success = !w->error;
+    if (success)
+    {
+        w->free_buffers--;
+    }
+    pthread_mutex_unlock(&w->lock);
+    if (success)
+    {
+        w->fill_buffer = w->next_buffer;
+        w->next_buffer = (w->next_buffer + 1) % w->buffer_count;
+        w->fill_bytes = 0;
+        w->fill_active = 1;
+    }
+    return success;
+}
+
+/**
+*   Return address of the fill buffer
+*/
+static unsigned char * mp4w_fill_data(MP4W_writer_t * w)
+{
+    return w->memory + (size_t)w->fill_buffer * w->buffer_bytes;
+}
+
+/**
+*   Return fill buffer write size: padded to alignment with zeroes for O_DIRECT
+*/
+static size_t mp4w_fill_write_bytes(MP4W_writer_t * w)
+{
+    if (w->direct_io)
+    {
+        size_t bytes = MP4W_ROUND(w->fill_bytes);
+        memset(mp4w_fill_data(w) + w->fill_bytes, 0, bytes - w->fill_bytes);
+        return bytes;
+    }
+    return w->fill_bytes;
+}
+
+/**
+*   Queue the fill buffer to the writer thread
+*   return 1 on success, 0 on fail
+*/
+static int mp4w_queue_fill(MP4W_writer_t * w)
+{
+    mp4w_item_t item;
+    item.data = mp4w_fill_data(w);
+    item.bytes = mp4w_fill_write_bytes(w);
+    item.offset = w->fill_offset;
+    item.release = NULL;
+    item.release_token = NULL;
+    w->fill_active = 0;
+    return mp4w_enqueue(w, &item);
+}
+
+/**
+*   Out-of-order write: write synchronously, and update fill buffer, if overlapped
+*/
+static int mp4w_write_patch(MP4W_writer_t * w, mp4e_offset_t offset, const unsigned char * data, size_t bytes)
+{
+    if (w->fill_active)
+    {
+        mp4e_offset_t lo = offset > w->fill_offset ? offset : w->fill_offset;
+        mp4e_offset_t hi = offset + bytes < w->fill_offset + w->fill_bytes ? offset + bytes : w->fill_offset + w->fill_bytes;
+        if (lo < hi)
+        {
+            memcpy(mp4w_fill_data(w) + (lo - w->fill_offset), data + (lo - offset), (size_t)(hi - lo));
+        }
+    }
+    if (!mp4w_drain(w) || !mp4w_pwrite(w->fd_patch, data, bytes, offset))
+    {
+        return -1;
+    }
+    return 0;
+}
+
+/**
+*   MP4E_sink_t::write() implementation: copy data to the fill buffer
+*/
+static int mp4w_sink_write(void * token, mp4e_offset_t offset, const void * data, size_t bytes)
+{
+    MP4W_writer_t * w = (MP4W_writer_t *)token;
+    const unsigned char * p = (const unsigned char *)data;
+
+    if (offset + bytes > w->file_size)
+    {
+        w->file_size = offset + bytes;
+    }
+    if (offset != w->next_offset)
+    {
+        return mp4w_write_patch(w, offset, p, bytes);
+    }
+    while (bytes)
+    {
+        size_t n;
+        if (!w->fill_active && !mp4w_acquire_buffer(w))
+        {
+            return -1;
+        }
+        if (!w->fill_bytes)
+        {
+            w->fill_offset = offset;
+        }
+        n = w->buffer_bytes - w->fill_bytes;
+        n = n < bytes ? n : bytes;
+        memcpy(mp4w_fill_data(w) + w->fill_bytes, p, n);
+        w->fill_bytes += n;
+        offset += n;
+        p += n;
+        bytes -= n;
+        if (w->fill_bytes == w->buffer_bytes && !mp4w_queue_fill(w))
+        {
+            return -1;
+        }
+    }
+    w->next_offset = offset;
+    return 0;
+}
+
+/**
+*   MP4E_sink_t::write_ref() implementation: queue large sample data by reference
+*/
+static int mp4w_sink_write_ref(void * token, mp4e_offset_t offset, const void * data, size_t bytes, MP4E_release_fn release, void * release_token)
+{
+    MP4W_writer_t * w = (MP4W_writer_t *)token;
+    size_t budget = w->buffer_bytes * w->buffer_count;
+    mp4w_item_t item;
+    int success;
+
+    // copy data, if its lifetime is unknown, or copy is cheap
+    if (!release || w->direct_io || bytes < MP4W_MIN_REF_BYTES || offset != w->next_offset)
+    {
+        int result = mp4w_sink_write(token, offset, data, bytes);
+        if (release)
+        {
+            release(release_token, data);
+        }
+        return result;
+    }
+
+    // fill buffer can't be continued after the reference: queue it now
+    if (w->fill_active && w->fill_bytes && !mp4w_queue_fill(w))
+    {
+        success = 0;
+    }
+    else
+    {
+        pthread_mutex_lock(&w->lock);
+        while (w->ref_bytes && w->ref_bytes + bytes > budget && !w->error)
+        {
+            pthread_cond_wait(&w->cond_written, &w->lock);
+        }
+        success = !w->error;
+        if (success)
+        {
+            w->ref_bytes += bytes;
+        }
+        pthread_mutex_unlock(&w->lock);
+    }
+    if (!success)
+    {
+        release(release_token, data);
+        return -1;
+    }
+
+    item.data = (const unsigned char *)data;
+    item.bytes = bytes;
+    item.offset = offset;
+    item.release = release;
+    item.release_token = release_token;
+    if (!mp4w_enqueue(w, &item))
+    {
+        pthread_mutex_lock(&w->lock);
+        w->ref_bytes -= bytes;
+        pthread_mutex_unlock(&w->lock);
+        release(release_token, data);
+        return -1;
+    }
+    w->next_offset = offset + bytes;
+    if (w->next_offset > w->file_size)
+    {
+        w->file_size = w->next_offset;
+    }
+    return 0;
+}
+
+/************************************************************************/
+/*      Exported API functions                                          */
+/************************************************************************/
+
+/**
+*   Release writer resources
+*/
+static void mp4w_free(MP4W_writer_t * w)
+{
+    if (w->fd_patch >= 0 && w->fd_patch != w->fd)
+    {
+        close(w->fd_patch);
+    }
+    if (w->fd >= 0)
+    {
+        close(w->fd);
+    }
+    free(w->memory);
+    free(w->queue);
+    free(w);
+}
+
+/**
+*   Create the file and start writer thread.
+*/
+MP4W_writer_t * MP4W__open(const char * file_name, const MP4W_params_t * params)
+{
+    const int flags = O_WRONLY | O_CREAT | O_TRUNC;
+    void * memory = NULL;
+    MP4W_writer_t * w;
+
+    if (!file_name)
+    {
+        return NULL;
+    }
+    w = (MP4W_writer_t *)calloc(1, sizeof(MP4W_writer_t));
+    if (!w)
+    {
+        return NULL;
+    }
+    w->fd = w->fd_patch = -1;
+    w->buffer_bytes = MP4W_ROUND((params && params->buffer_bytes) ? params->buffer_bytes : MP4W_DEFAULT_BUFFER_BYTES);
+    w->buffer_count = (params && params->buffer_count) ? params->buffer_count : MP4W_DEFAULT_BUFFER_COUNT;
+    w->free_buffers = w->buffer_count;
+    w->queue_size = w->buffer_count + MP4W_MAX_REFS;
+
+#ifdef O_DIRECT
+    if (params && params->direct_io)
+    {
+        w->fd = open(file_name, flags | O_DIRECT, 0644);
+        w->direct_io = (w->fd >= 0);
+    }
+#endif
+    if (w->fd < 0)
+    {
+        w->fd = open(file_name, flags, 0644);
+    }
+    w->fd_patch = w->direct_io ? open(file_name, O_WRONLY) : w->fd;
+    if (w->fd < 0 || w->fd_patch < 0)
+    {
+        mp4w_free(w);
+        return NULL;
+    }
+
+#if defined(__linux__) && defined(FALLOC_FL_KEEP_SIZE)
+    if (params && params->preallocate_bytes)
+    {
+        // not an error, if not supported by file system
+        (void)fallocate(w->fd, FALLOC_FL_KEEP_SIZE, 0, (off_t)params->preallocate_bytes);
+    }
+#endif
+
+    if (posix_memalign(&memory, MP4W_ALIGN, w->buffer_bytes * w->buffer_count))
+    {
+        memory = NULL;
+    }
+    w->memory = (unsigned char *)memory;
+    w->queue = (mp4w_item_t *)malloc(w->queue_size * sizeof(mp4w_item_t));
+    if (!w->memory || !w->queue)
+    {
+        mp4w_free(w);
+        return NULL;
+    }
+
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->cond_queued, NULL);
+    pthread_cond_init(&w->cond_written, NULL);
+    if (pthread_create(&w->thread, NULL, mp4w_thread, w))
+    {
+        pthread_cond_destroy(&w->cond_written);
+        pthread_cond_destroy(&w->cond_queued);
+        pthread_mutex_destroy(&w->lock);
+        mp4w_free(w);
+        return NULL;
+    }
+    return w;
+}
+
+/**
+*   Fill output sink, which passes multiplexer output to the writer
+*/
+void MP4W__get_sink(MP4W_writer_t * writer, MP4E_sink_t * sink)
+{
+    sink->write = mp4w_sink_write;
+    sink->write_ref = mp4w_sink_write_ref;
+    sink->token = writer;
+}
+
+/**
+*   Wait until all data is written to the file.
+*/
+int MP4W__flush(MP4W_writer_t * w)
+{
+    if (!w)
+    {
+        return MP4E_STATUS_BAD_ARGUMENTS;
+    }
+    if (!mp4w_drain(w))
+    {
+        return MP4E_STATUS_FILE_WRITE_ERROR;
+    }
+    // writer thread is idle: write partially filled buffer synchronously, and keep filling it
+    if (w->fill_active && w->fill_bytes &&
+        !mp4w_pwrite(w->fd, mp4w_fill_data(w), mp4w_fill_write_bytes(w), w->fill_offset))
+    {
+        return MP4E_STATUS_FILE_WRITE_ERROR;
+    }
+    return MP4E_STATUS_OK;
+}
+
+/**
+*   Write remaining data, stop writer thread, close the file and de-allocate memory.
+*/
+int MP4W__close(MP4W_writer_t * w)
+{
+    int error;
+    if (!w)
+    {
+        return MP4E_STATUS_BAD_ARGUMENTS;
+    }
+    if (w->fill_active && w->fill_bytes)
+    {
+        mp4w_queue_fill(w);
+    }
+
+    pthread_mutex_lock(&w->lock);
+    w->stop = 1;
+    pthread_cond_signal(&w->cond_queued);
+    pthread_mutex_unlock(&w->lock);
+    pthread_join(w->thread, NULL);
+
+    error = w->error;
+    if (w->direct_io && ftruncate(w->fd, (off_t)w->file_size))
+    {
+        error = 1;
+    }
+    pthread_cond_destroy(&w->cond_written);
+    pthread_cond_destroy(&w->cond_queued);
+    pthread_mutex_destroy(&w->lock);
+    mp4w_free(w);
+    return error ? MP4E_STATUS_FILE_WRITE_ERROR : MP4E_STATUS_OK;
+}
@@ -0,0 +1,96 @@
+/** 18.10.2026 @file
+*
+*   Write-behind output engine for MP4 multiplexer
+*
+*   Portability note: this module uses POSIX threads and file API
+*   (open(), pwrite()), and optionally Linux O_DIRECT and fallocate().
+*
+*   Multiplexer output is copied into large aligned buffers, which are written
+*   to the file by the dedicated thread, so the thread calling MP4E__put_sample()
+*   does not wait for the disk, until all buffers are in use. Sample data,
+*   passed with MP4E__put_sample_ref(), may be queued by reference instead of
+*   copying.
+*
+*   Example:
+*
+*       MP4W_params_t wparams = {0,};
+*       MP4E_params_t params = {0,};
+*       MP4E_sink_t sink;
+*       MP4W_writer_t * writer = MP4W__open("out.mp4", &wparams);
+*       MP4W__get_sink(writer, &sink);
+*       params.sink = &sink;
+*       mux = MP4E__open_ex(&params);
+*       ...
+*       MP4E__close(mux);
+*       MP4W__close(writer);
+*/
+
+#ifndef mp4writer_H_INCLUDED
+#define mp4writer_H_INCLUDED
+
+#include "mp4mux.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif  //__cplusplus
+
+typedef struct MP4W_writer_tag MP4W_writer_t;
+
+/*
+*   Writer parameters; zero-initialized members select defaults
+*/
+typedef struct
+{
+    // Size of each buffer, rounded up to 4096 bytes. Default is 4 MB
+    size_t buffer_bytes;
+
+    // Number of buffers. Default is 4
+    // Total buffers size is the memory budget: the writer blocks when it is exhausted.
+    unsigned buffer_count;
+
+    // Non-zero to bypass OS page cache with O_DIRECT (ignored, if not available)
+    // Sample data is always copied in this mode.
+    int direct_io;
+
+    // Disk space to reserve with fallocate() on open (ignored, if not available)
+    mp4e_offset_t preallocate_bytes;
+} MP4W_params_t;
+
+
+/**
+*   Create the file and start writer thread.
+*   params may be NULL.
+*
+*   return writer handle on success; NULL on failure
+*/
+MP4W_writer_t * MP4W__open(const char * file_name, const MP4W_params_t * params);
+
+
+/**
+*   Fill output sink, which passes multiplexer output to the writer
+*/
+void MP4W__get_sink(MP4W_writer_t * writer, MP4E_sink_t * sink);
+
+
+/**
+*   Wait until all data is written to the file.
+*
+*   return error code MP4E_STATUS_*
+*/
+int MP4W__flush(MP4W_writer_t * writer);
+
+
+/**
+*   Write remaining data, stop writer thread, close the file and de-allocate memory.
+*   Must be called after MP4E__close().
+*
+*   return error code MP4E_STATUS_*
+*/
+int MP4W__close(MP4W_writer_t * writer);
+
+
+#ifdef __cplusplus
+}
+#endif //__cplusplus
+
+#endif //mp4writer_H_INCLUDED
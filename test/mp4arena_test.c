@@ -0,0 +1,157 @@
+/** 18.10.2026 @file
+*
+*   Multiplex and demultiplex audio and video on fixed memory arenas. Check,
+*   that both succeed on an arena of sufficient size, that exhausted arena
+*   returns failure, and that MP4__arena_reset() releases all memory, so the
+*   arena can be used again.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mp4demux.h"
+#include "mp4mux.h"
+#include "mp4arena.h"
+#include "mp4test_util.h"
+
+#define VIDEO_FRAMES    300         // 10 seconds, 30 fps
+#define GOP             30
+#define AUDIO_FRAMES    431         // 10 seconds, 44100 Hz
+
+static unsigned char g_memory[1024*1024];
+
+/**
+*   Record test sequence on the arena: video track 0, audio track 1
+*   return error code MP4E_STATUS_* of the 1st failed call
+*/
+static int record(const char * file_name, MP4_arena_t * arena)
+{
+    static unsigned char frame[200];
+    MP4E_params_t params = {0,};
+    MP4E_mux_t * mux;
+    MP4E_track_t track;
+    int a = 0, v = 0, error, close_error;
+
+    params.mp4file = fopen(file_name, "wb");
+    params.allocator = &arena->allocator;
+    mux = params.mp4file ? MP4E__open_ex(&params) : NULL;
+    if (!mux)
+    {
+        return MP4E_STATUS_NO_MEMORY;
+    }
+
+    memset(&track, 0, sizeof(track));
+    strcpy((char*)track.language, "und");
+    track.object_type_indication = MP4_OBJECT_TYPE_AVC;
+    track.track_media_kind = e_video;
+    track.u.v.width = 320;
+    track.u.v.height = 240;
+    track.time_scale = 90000;
+    track.default_duration = 3000;
+    error = MP4E__add_track(mux, &track);
+    error = error < 0 ? error : MP4E__set_sps(mux, 0, g_sps, sizeof(g_sps));
+    error = error ? error : MP4E__set_pps(mux, 0, g_pps, sizeof(g_pps));
+
+    track.object_type_indication = MP4_OBJECT_TYPE_AUDIO_ISO_IEC_14496_3;
+    track.track_media_kind = e_audio;
+    track.u.a.channelcount = 2;
+    track.time_scale = 44100;
+    track.default_duration = 1024;
+    error = error ? error : MP4E__add_track(mux, &track);
+    error = error < 0 ? error : MP4E__set_dsi(mux, 1, g_dsi, sizeof(g_dsi));
+
+    while (!error && (a < AUDIO_FRAMES || v < VIDEO_FRAMES))
+    {
+        if (v >= VIDEO_FRAMES || (a < AUDIO_FRAMES && (double)a*1024/44100 < (double)v/30))
+        {
+            error = MP4E__put_sample(mux, 1, frame, 50 + a % 100, 0, MP4E_SAMPLE_RANDOM_ACCESS);
+            a++;
+        }
+        else
+        {
+            error = MP4E__put_sample(mux, 0, frame, 100 + v % 100, 0, (v % GOP) ? MP4E_SAMPLE_DEFAULT : MP4E_SAMPLE_RANDOM_ACCESS);
+            v++;
+        }
+    }
+    if (!error && !arena->used)
+    {
+        error = MP4E_STATUS_BAD_ARGUMENTS;  // memory is not allocated on the arena
+    }
+    close_error = MP4E__close(mux);
+    return error ? error : close_error;
+}
+
+/**
+*   Open the file on the arena, and check the tracks
+*   return 1 on success
+*/
+static int check_file(const char * file_name, MP4_arena_t * arena)
+{
+    MP4D_demux_t mp4 = {0,};
+    MP4D_params_t params = {0,};
+    FILE * f = fopen(file_name, "rb");
+    int ok;
+    params.allocator = &arena->allocator;
+    ok = f && MP4D__open_ex(&mp4, f, &params);
+    if (ok)
+    {
+        ok = arena->used && mp4.track_count == 2 && mp4.track[0].sample_count == VIDEO_FRAMES && mp4.track[1].sample_count == AUDIO_FRAMES;
+        MP4D__close(&mp4);
+    }
+    if (f)
+    {
+        fclose(f);
+    }
+    return ok;
+}
+
+int main(int argc, char* argv[])
+{
+    const char * file_name = argc > 1 ? argv[1] : "arena_test.mp4";
+    MP4_arena_t arena;
+    int fail = 0;
+
+    // sufficient arena, reused after reset
+    MP4__arena_init(&arena, g_memory, sizeof(g_memory));
+    if (record(file_name, &arena) != MP4E_STATUS_OK)
+    {
+        printf("arena test failed: multiplexer\n");
+        fail = 1;
+    }
+    MP4__arena_reset(&arena);
+    if (arena.used)
+    {
+        printf("arena test failed: multiplexer memory is not released\n");
+        fail = 1;
+    }
+    if (!check_file(file_name, &arena))
+    {
+        printf("arena test failed: demultiplexer\n");
+        fail = 1;
+    }
+    MP4__arena_reset(&arena);
+    if (arena.used)
+    {
+        printf("arena test failed: demultiplexer memory is not released\n");
+        fail = 1;
+    }
+
+    // exhausted arena: sample tables do not fit
+    MP4__arena_init(&arena, g_memory, 4096);
+    if (check_file(file_name, &arena))
+    {
+        printf("arena test failed: demultiplexer on exhausted arena\n");
+        fail = 1;
+    }
+    MP4__arena_reset(&arena);
+    if (record("arena_exhausted.mp4", &arena) != MP4E_STATUS_NO_MEMORY)
+    {
+        printf("arena test failed: multiplexer on exhausted arena\n");
+        fail = 1;
+    }
+    MP4__arena_reset(&arena);
+
+    remove(file_name);
+    remove("arena_exhausted.mp4");
+    return fail;
+}
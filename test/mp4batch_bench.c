@@ -0,0 +1,178 @@
+/** 18.10.2026 @file
+*
+*   Throughput of batch open versus number of threads.
+*
+*   Usage: mp4batch_bench [dir] [file count] [seconds per file] [thread count]...
+*   Default: current directory, 64 files, 600 seconds, 1 2 4 8 threads
+*
+*   Files with audio and video tracks are written, and opened with MP4B__open().
+*   Before each run, the files are dropped from the page cache, if the system
+*   allows it, so file reads are measured too. Results are checked against
+*   sequential MP4D__open(), with missing and broken file in the batch;
+*   return 1 on mismatch.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "mp4batch.h"
+#include "mp4test_util.h"
+
+static mp4d_size_t * g_checksum;    // [file] reference
+static mp4d_size_t * g_result;      // [file] computed in the callback
+
+/**
+*   Sum of the sample tables
+*/
+static mp4d_size_t checksum(const MP4D_demux_t * mp4)
+{
+    mp4d_size_t sum = 1;
+    unsigned ntrack, i;
+    for (ntrack = 0; ntrack < mp4->track_count; ntrack++)
+    {
+        const MP4D_track_t * tr = mp4->track + ntrack;
+        for (i = 0; i < tr->sample_count; i++)
+        {
+            sum = sum*31 + tr->entry_size[i] + tr->timestamp[i]*7;
+        }
+        for (i = 0; i < tr->chunk_count; i++)
+        {
+            sum = sum*31 + tr->chunk_offset[i];
+        }
+        for (i = 0; i < tr->sample_to_chunk_count; i++)
+        {
+            sum = sum*31 + tr->sample_to_chunk[i].first_chunk + tr->sample_to_chunk[i].samples_per_chunk*7;
+        }
+    }
+    return sum;
+}
+
+static void on_file(void * token, MP4B_file_t * file)
+{
+    MP4B_file_t * files = (MP4B_file_t *)token;
+    g_result[file - files] = file->status == MP4B_STATUS_OK ? checksum(&file->mp4) : 0;
+}
+
+/**
+*   Drop the file from the page cache
+*/
+static void drop_cache(const char * file_name)
+{
+#ifdef POSIX_FADV_DONTNEED
+    int fd = open(file_name, O_RDONLY);
+    if (fd >= 0)
+    {
+        fdatasync(fd);
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+#else
+    (void)file_name;
+#endif
+}
+
+int main(int argc, char* argv[])
+{
+    static const unsigned default_threads[] = { 1, 2, 4, 8 };
+    const char * dir = argc > 1 ? argv[1] : ".";
+    unsigned file_count = argc > 2 ? (unsigned)atoi(argv[2]) : 64;
+    int seconds = argc > 3 ? atoi(argv[3]) : 600;
+    int thread_num = argc > 4 ? argc - 4 : 4;
+    unsigned count = file_count + 2, i;   // + missing and broken file
+    MP4B_file_t * files = (MP4B_file_t *)calloc(count, sizeof(MP4B_file_t));
+    char (* names)[1024] = (char (*)[1024])calloc(count, 1024);
+    double base_rate = 0;
+    int t, fail = 0;
+    FILE * f;
+
+    g_checksum = (mp4d_size_t *)calloc(count, sizeof(mp4d_size_t));
+    g_result = (mp4d_size_t *)calloc(count, sizeof(mp4d_size_t));
+    if (!files || !names || !g_checksum || !g_result || !file_count)
+    {
+        return 1;
+    }
+    for (i = 0; i < count; i++)
+    {
+        sprintf(names[i], "%s/batch_%u.mp4", dir, i);
+        files[i].path = names[i];
+    }
+    for (i = 0; i < file_count; i++)
+    {
+        MP4D_demux_t mp4;
+        if (!write_movie(names[i], seconds, 1, 0, (int)i) || (f = fopen(names[i], "rb")) == NULL)
+        {
+            printf("can't write %s\n", names[i]);
+            return 1;
+        }
+        if (MP4D__open(&mp4, f))
+        {
+            g_checksum[i] = checksum(&mp4);
+            MP4D__close(&mp4);
+        }
+        fclose(f);
+        drop_cache(names[i]);
+    }
+    // broken file; the last file is missing
+    f = fopen(names[file_count], "wb");
+    if (f)
+    {
+        fwrite("\0\0\0\1broken", 1, 10, f);
+        fclose(f);
+    }
+    remove(names[file_count + 1]);
+
+    printf("%u files of %d seconds\n", file_count, seconds);
+    printf("%8s %12s %10s\n", "threads", "files/s", "speedup");
+    for (t = 0; t < thread_num; t++)
+    {
+        MP4B_params_t params;
+        unsigned parsed;
+        double wall;
+        int ok;
+        memset(&params, 0, sizeof(params));
+        params.thread_count = argc > 4 ? (unsigned)atoi(argv[4 + t]) : default_threads[t];
+        params.callback = on_file;
+        params.token = files;
+        memset(g_result, 0, count*sizeof(mp4d_size_t));
+        for (i = 0; i < count; i++)
+        {
+            drop_cache(names[i]);
+        }
+
+        wall = now_us();
+        parsed = MP4B__open(files, count, &params);
+        wall = (now_us() - wall)*1e-6;
+
+        ok = parsed == file_count && files[file_count].status == MP4B_STATUS_PARSE_FAILED &&
+             files[file_count + 1].status == MP4B_STATUS_OPEN_FAILED && files[file_count + 1].sys_errno == ENOENT;
+        for (i = 0; i < file_count; i++)
+        {
+            ok &= files[i].status == MP4B_STATUS_OK && g_result[i] == g_checksum[i] && checksum(&files[i].mp4) == g_checksum[i];
+        }
+        MP4B__close(files, count);
+        if (!ok)
+        {
+            printf("%8u failed\n", params.thread_count);
+            fail = 1;
+            continue;
+        }
+        if (!base_rate)
+        {
+            base_rate = count/wall;
+        }
+        printf("%8u %12.1f %10.2f\n", params.thread_count, count/wall, count/wall/base_rate);
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        remove(names[i]);
+    }
+    free(files);
+    free(names);
+    free(g_checksum);
+    free(g_result);
+    return fail;
+}
@@ -0,0 +1,246 @@
+/** 18.10.2026 @file
+*
+*   Check demultiplexer cache: repeated open is a hit, with the same handle;
+*   changed file is parsed again, while the old handle stays valid; unused
+*   entries are evicted in LRU order to fit the memory budget, and entries in
+*   use are not evicted. Several threads get the handles, and read sample
+*   offsets concurrently, with evictions.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "mp4cache.h"
+
+#define FILE_COUNT      3
+#define THREAD_COUNT    8
+#define ITERATIONS      2000
+
+static const char * g_sources[FILE_COUNT] =
+{
+    "vectors/ref/mp4mux_file.mp4", "vectors/ref/mp4mux_stream.mp4", "vectors/ref/transcoded.mp4"
+};
+static char g_names[FILE_COUNT][64];
+static mp4d_size_t g_checksum[FILE_COUNT];
+static MP4C_cache_t * g_cache;
+
+static int copy_file(const char * from, const char * to)
+{
+    static unsigned char buf[65536];
+    FILE * src = fopen(from, "rb"), * dst = fopen(to, "wb");
+    size_t n;
+    int ok = src && dst;
+    while (ok && (n = fread(buf, 1, sizeof(buf), src)) > 0)
+    {
+        ok = fwrite(buf, 1, n, dst) == n;
+    }
+    if (src)
+    {
+        fclose(src);
+    }
+    if (dst)
+    {
+        fclose(dst);
+    }
+    return ok;
+}
+
+/**
+*   Sum of offsets and sizes of all samples
+*/
+static mp4d_size_t checksum(const MP4D_demux_t * mp4)
+{
+    mp4d_size_t sum = 0;
+    unsigned ntrack, i;
+    for (ntrack = 0; ntrack < mp4->track_count; ntrack++)
+    {
+        for (i = 0; i < mp4->track[ntrack].sample_count; i++)
+        {
+            unsigned bytes;
+            sum += MP4D__frame_offset(mp4, ntrack, i, &bytes, NULL, NULL)*31 + bytes;
+        }
+    }
+    return sum;
+}
+
+/**
+*   Check counters
+*/
+static int check_stats(MP4C_cache_t * cache, unsigned hits, unsigned misses, unsigned evictions, unsigned entries)
+{
+    MP4C_stats_t stats;
+    MP4C__get_stats(cache, &stats);
+    return stats.hits == hits && stats.misses == misses && stats.evictions == evictions && stats.entries == entries;
+}
+
+/**
+*   Hit and miss; changed file
+*   return 1 on success
+*/
+static int test_basic(void)
+{
+    MP4C_cache_t * cache = MP4C__open(NULL);
+    const MP4D_demux_t * a, * b, * c;
+    int ok;
+
+    a = MP4C__get(cache, g_names[0]);
+    b = MP4C__get(cache, g_names[0]);
+    ok = a && a == b && checksum(a) == g_checksum[0] && check_stats(cache, 1, 1, 0, 1) &&
+         !MP4C__get(cache, "no_such_file.mp4");
+    MP4C__release(cache, b);
+
+    // replace the file: old handle is valid
+    ok = ok && copy_file(g_sources[1], g_names[0]);
+    c = MP4C__get(cache, g_names[0]);
+    ok = ok && c && c != a && checksum(c) == g_checksum[1] && checksum(a) == g_checksum[0] &&
+         check_stats(cache, 1, 2, 0, 1);
+    MP4C__release(cache, a);
+    MP4C__release(cache, c);
+    ok = ok && check_stats(cache, 1, 2, 0, 1) && copy_file(g_sources[0], g_names[0]);
+    MP4C__close(cache);
+    return ok;
+}
+
+/**
+*   LRU eviction with memory budget for two files
+*   return 1 on success
+*/
+static int test_eviction(void)
+{
+    MP4C_params_t params = {0,};
+    MP4C_stats_t stats;
+    MP4C_cache_t * cache = MP4C__open(NULL);
+    const MP4D_demux_t * h[FILE_COUNT];
+    size_t bytes[FILE_COUNT], total = 0;
+    int i, ok;
+
+    // measure the files: budget fits 0 and 1, or 0 and 2
+    for (i = 0; i < FILE_COUNT; i++)
+    {
+        MP4C__release(cache, MP4C__get(cache, g_names[i]));
+        MP4C__get_stats(cache, &stats);
+        bytes[i] = stats.bytes - total;
+        total = stats.bytes;
+    }
+    MP4C__close(cache);
+    params.memory_budget_bytes = bytes[0] + (bytes[1] > bytes[2] ? bytes[1] : bytes[2]);
+    cache = MP4C__open(&params);
+
+    // 0 is used after 1, so 1 is evicted by 2
+    MP4C__release(cache, MP4C__get(cache, g_names[0]));
+    MP4C__release(cache, MP4C__get(cache, g_names[1]));
+    MP4C__release(cache, MP4C__get(cache, g_names[0]));
+    MP4C__release(cache, MP4C__get(cache, g_names[2]));
+    ok = check_stats(cache, 1, 3, 1, 2);
+    MP4C__release(cache, MP4C__get(cache, g_names[0]));
+    MP4C__release(cache, MP4C__get(cache, g_names[2]));
+    ok &= check_stats(cache, 3, 3, 1, 2);
+
+    // entries in use are not evicted: 1 evicts unused 2, and 2 is parsed again
+    for (i = 0; i < FILE_COUNT; i++)
+    {
+        h[i] = MP4C__get(cache, g_names[i]);
+    }
+    ok &= check_stats(cache, 4, 5, 2, 3);
+    for (i = 0; i < FILE_COUNT; i++)
+    {
+        ok &= h[i] && checksum(h[i]) == g_checksum[i];
+        MP4C__release(cache, h[i]);
+    }
+    MP4C__get_stats(cache, &stats);
+    ok &= stats.entries == 2 && stats.bytes <= params.memory_budget_bytes;
+    MP4C__close(cache);
+    return ok;
+}
+
+static void * reader_thread(void * arg)
+{
+    unsigned seed = (unsigned)(size_t)arg, i;
+    size_t errors = 0;
+    for (i = 0; i < ITERATIONS; i++)
+    {
+        int n;
+        const MP4D_demux_t * mp4;
+        seed = seed*1103515245 + 12345;
+        n = (seed >> 16) % FILE_COUNT;
+        mp4 = MP4C__get(g_cache, g_names[n]);
+        errors += !mp4 || checksum(mp4) != g_checksum[n];
+        MP4C__release(g_cache, mp4);
+    }
+    return (void *)errors;
+}
+
+/**
+*   Concurrent readers, with evictions
+*   return 1 on success
+*/
+static int test_threads(void)
+{
+    MP4C_params_t params = {0,};
+    MP4C_stats_t stats;
+    pthread_t threads[THREAD_COUNT];
+    size_t i, errors = 0;
+
+    params.memory_budget_bytes = 1;
+    g_cache = MP4C__open(&params);
+    for (i = 0; i < THREAD_COUNT; i++)
+    {
+        if (pthread_create(threads + i, NULL, reader_thread, (void *)(i + 1)))
+        {
+            return 0;
+        }
+    }
+    for (i = 0; i < THREAD_COUNT; i++)
+    {
+        void * result;
+        pthread_join(threads[i], &result);
+        errors += (size_t)result;
+    }
+    MP4C__get_stats(g_cache, &stats);
+    MP4C__close(g_cache);
+    return !errors && stats.hits + stats.misses == THREAD_COUNT*ITERATIONS && stats.evictions && !stats.entries;
+}
+
+int main(int argc, char* argv[])
+{
+    int i, fail = 0;
+    (void)argc;
+    (void)argv;
+
+    for (i = 0; i < FILE_COUNT; i++)
+    {
+        MP4D_demux_t mp4;
+        FILE * f;
+        sprintf(g_names[i], "cache_test_%d.mp4", i);
+        f = copy_file(g_sources[i], g_names[i]) ? fopen(g_names[i], "rb") : NULL;
+        if (!f || !MP4D__open(&mp4, f))
+        {
+            printf("cache test failed: %s\n", g_sources[i]);
+            return 1;
+        }
+        g_checksum[i] = checksum(&mp4);
+        MP4D__close(&mp4);
+        fclose(f);
+    }
+    if (!test_basic())
+    {
+        printf("cache test failed: hit and miss\n");
+        fail = 1;
+    }
+    if (!test_eviction())
+    {
+        printf("cache test failed: eviction\n");
+        fail = 1;
+    }
+    if (!test_threads())
+    {
+        printf("cache test failed: threads\n");
+        fail = 1;
+    }
+    for (i = 0; i < FILE_COUNT; i++)
+    {
+        remove(g_names[i]);
+    }
+    return fail;
+}
@@ -0,0 +1,243 @@
+/** 18.10.2026 @file
+*
+*   Record audio and video in checkpoint mode, and simulate crash: take the
+*   output, written so far, optionally cut in the middle of sample or
+*   checkpoint. Check, that MP4E__recover() makes the file readable, with all
+*   complete samples; and that file, closed normally, has all samples.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mp4demux.h"
+#include "mp4mux.h"
+#include "mp4test_util.h"
+
+#define VIDEO_FRAMES    150         // 5 seconds, 30 fps
+#define GOP             30
+#define AUDIO_FRAMES    215         // 5 seconds, 44100 Hz
+#define CHECKPOINT_MS   1000
+#define CRASH_SAMPLES   300         // samples written before crash
+
+/*
+*   In-memory output
+*/
+static buffer_t g_file;             // output
+static buffer_t g_crash;            // output copy at crash time
+static int g_checkpoints;
+static unsigned g_samples;                  // samples, passed to the multiplexer
+static unsigned g_checkpoint_samples;       // samples before the last checkpoint
+
+static void on_flush(void * flush_token, mp4e_offset_t offset, mp4e_offset_t bytes, int flags)
+{
+    (void)flush_token;
+    if (flags == MP4E_FLUSH_CHECKPOINT && offset == 0 && bytes == g_file.bytes)
+    {
+        g_checkpoints++;
+        g_checkpoint_samples = g_samples;
+    }
+}
+
+static int sample_bytes(int track, int i)
+{
+    return track ? 100 + i : 30 + i % 20;
+}
+
+/**
+*   Record test sequence: audio track 0, video track 1; copy output after
+*   CRASH_SAMPLES samples. Sample data starts with track number and sample number.
+*   g_checkpoint_samples is set to the number of samples before the last 
+*   checkpoint at crash time.
+*   return 0 on success
+*/
+static int record(void)
+{
+    static unsigned char frame[300];
+    MP4E_params_t params = {0,};
+    MP4E_sink_t sink = {0,};
+    MP4E_mux_t * mux;
+    MP4E_track_t track;
+    unsigned crash_checkpoint_samples = 0;
+    int a = 0, v = 0, error = 0;
+
+    sink.write = buffer_write;
+    sink.token = &g_file;
+    params.sink = &sink;
+    params.checkpoint_interval_ms = CHECKPOINT_MS;
+    params.flush = on_flush;
+    mux = MP4E__open_ex(&params);
+    if (!mux)
+    {
+        return 1;
+    }
+
+    memset(&track, 0, sizeof(track));
+    strcpy((char*)track.language, "und");
+    track.object_type_indication = MP4_OBJECT_TYPE_AUDIO_ISO_IEC_14496_3;
+    track.track_media_kind = e_audio;
+    track.u.a.channelcount = 2;
+    track.time_scale = 44100;
+    track.default_duration = 1024;
+    MP4E__add_track(mux, &track);
+    MP4E__set_dsi(mux, 0, g_dsi, sizeof(g_dsi));
+    track.object_type_indication = MP4_OBJECT_TYPE_AVC;
+    track.track_media_kind = e_video;
+    track.u.v.width = 320;
+    track.u.v.height = 240;
+    track.time_scale = 90000;
+    track.default_duration = 3000;
+    MP4E__add_track(mux, &track);
+    MP4E__set_sps(mux, 1, g_sps, sizeof(g_sps));
+    MP4E__set_pps(mux, 1, g_pps, sizeof(g_pps));
+
+    while (a < AUDIO_FRAMES || v < VIDEO_FRAMES)
+    {
+        if (a + v == CRASH_SAMPLES)
+        {
+            g_crash.bytes = 0;
+            error |= buffer_write(&g_crash, 0, g_file.data, g_file.bytes);
+            crash_checkpoint_samples = g_checkpoint_samples;
+        }
+        g_samples = a + v;
+        if (v >= VIDEO_FRAMES || (a < AUDIO_FRAMES && (double)a*1024/44100 < (double)v/30))
+        {
+            frame[0] = 0;
+            frame[1] = (unsigned char)a;
+            error |= MP4E__put_sample(mux, 0, frame, sample_bytes(0, a), 0, MP4E_SAMPLE_RANDOM_ACCESS);
+            a++;
+        }
+        else
+        {
+            frame[0] = 1;
+            frame[1] = (unsigned char)v;
+            error |= MP4E__put_sample(mux, 1, frame, sample_bytes(1, v), 0,
+                (v % GOP) ? MP4E_SAMPLE_DEFAULT : MP4E_SAMPLE_RANDOM_ACCESS);
+            v++;
+        }
+    }
+    error |= MP4E__close(mux);
+    g_checkpoint_samples = crash_checkpoint_samples;
+    return error;
+}
+
+/**
+*   Read file with demultiplexer: check number of samples, and sample data
+*   return 1 on success
+*/
+static int check_file(const char * file_name, unsigned samples)
+{
+    FILE * f = fopen(file_name, "rb");
+    MP4D_demux_t mp4 = {0,};
+    unsigned ntrack, i, ok;
+    if (!f || !MP4D__open(&mp4, f))
+    {
+        if (f)
+        {
+            fclose(f);
+        }
+        return 0;
+    }
+    ok = mp4.track_count == 2 && mp4.track[0].sample_count + mp4.track[1].sample_count == samples &&
+         mp4.track[1].dsi_bytes > 0 && mp4.track[1].SampleDescription.video.width == 320;
+    for (ntrack = 0; ok && ntrack < 2; ntrack++)
+    {
+        for (i = 0; ok && i < mp4.track[ntrack].sample_count; i++)
+        {
+            unsigned frame_bytes, timestamp, duration;
+            unsigned char head[2];
+            mp4d_size_t ofs = MP4D__frame_offset(&mp4, ntrack, i, &frame_bytes, &timestamp, &duration);
+            fseek(f, (long)ofs, SEEK_SET);
+            ok = frame_bytes == (unsigned)sample_bytes(ntrack, i) && 2 == fread(head, 1, 2, f) &&
+                 head[0] == ntrack && head[1] == (unsigned char)i &&
+                 timestamp == i*(ntrack ? 3000u : 1024u) && duration == (ntrack ? 3000u : 1024u);
+        }
+    }
+    MP4D__close(&mp4);
+    fclose(f);
+    return ok;
+}
+
+/**
+*   Write first given bytes of crash-time output, recover it, and check
+*   return 1 on success
+*/
+static int check_recovery(const char * file_name, size_t bytes, unsigned samples)
+{
+    FILE * f = fopen(file_name, "wb");
+    int ok = f && bytes == fwrite(g_crash.data, 1, bytes, f);
+    if (f)
+    {
+        fclose(f);
+    }
+    f = fopen(file_name, "r+b");
+    ok &= f && MP4E__recover(f) == MP4E_STATUS_OK;
+    if (f)
+    {
+        fclose(f);
+    }
+    return ok && check_file(file_name, samples);
+}
+
+/**
+*   Return position of the last top-level box with given type in crash-time output
+*/
+static size_t find_last_box(uint32_t box_name)
+{
+    size_t pos, last = 0;
+    for (pos = 0; pos + 8 <= g_crash.bytes; pos += (size_t)(g_crash.data[pos] << 24 | g_crash.data[pos + 1] << 16 |
+                                                            g_crash.data[pos + 2] << 8 | g_crash.data[pos + 3]))
+    {
+        const unsigned char * p = g_crash.data + pos + 4;
+        if ((uint32_t)(p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3]) == box_name)
+        {
+            last = pos;
+        }
+        if (!p[-1] && !p[-2] && !p[-3] && !p[-4])
+        {
+            break;  // open 'mdat' box
+        }
+    }
+    return last;
+}
+
+int main(int argc, char* argv[])
+{
+    const char * file_name = (argc > 1) ? argv[1] : "checkpoint_test.mp4";
+    FILE * f;
+    int fail = 0, ok;
+    size_t checkpoint_pos;
+
+    if (record() || g_checkpoints < 5)
+    {
+        printf("checkpoint test failed: record\n");
+        fail = 1;
+    }
+
+    // normally closed file
+    f = fopen(file_name, "wb");
+    ok = f && g_file.bytes == fwrite(g_file.data, 1, g_file.bytes, f);
+    if (f)
+    {
+        fclose(f);
+    }
+    if (!ok || !check_file(file_name, AUDIO_FRAMES + VIDEO_FRAMES))
+    {
+        printf("checkpoint test failed: closed file\n");
+        fail = 1;
+    }
+
+    // crash after sample; in the middle of sample; in the middle of checkpoint
+    checkpoint_pos = find_last_box(BOX_free);
+    if (!check_recovery(file_name, g_crash.bytes, CRASH_SAMPLES) ||
+        !check_recovery(file_name, g_crash.bytes - 5, CRASH_SAMPLES - 1) ||
+        !check_recovery(file_name, g_crash.bytes - sample_bytes(0, 0), CRASH_SAMPLES - 1) ||
+        !checkpoint_pos || !check_recovery(file_name, checkpoint_pos + 20, g_checkpoint_samples))
+    {
+        printf("checkpoint test failed: recovery\n");
+        fail = 1;
+    }
+    remove(file_name);
+    free(g_file.data);
+    free(g_crash.data);
+    return fail;
+}
@@ -0,0 +1,250 @@
+/** 18.10.2026 @file
+*
+*   Multiplex audio and video in CMAF chunked mode. Check, that flush callback
+*   reports file header and every chunk in file order, that segments start with
+*   'styp' box at video key frames, and that each chunk 'moof' box describes
+*   samples of both tracks in the following 'mdat' box.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mp4mux.h"
+#include "mp4test_util.h"
+
+#define VIDEO_FRAMES    90          // 3 seconds, 30 fps
+#define GOP             30
+#define AUDIO_FRAMES    129         // ~3 seconds, 44100 Hz
+#define CHUNK_MS        200
+#define MAX_FLUSH       256
+
+typedef struct
+{
+    mp4e_offset_t offset;
+    mp4e_offset_t bytes;
+    int flags;
+} flush_t;
+
+static flush_t g_flush[MAX_FLUSH];
+static int g_flush_count;
+
+static void on_flush(void * flush_token, mp4e_offset_t offset, mp4e_offset_t bytes, int flags)
+{
+    (void)flush_token;
+    if (g_flush_count < MAX_FLUSH)
+    {
+        g_flush[g_flush_count].offset = offset;
+        g_flush[g_flush_count].bytes = bytes;
+        g_flush[g_flush_count].flags = flags;
+    }
+    g_flush_count++;
+}
+
+static void release_sample(void * release_token, const void * data)
+{
+    (void)release_token;
+    free((void*)data);
+}
+
+static unsigned read_u32(const unsigned char * p)
+{
+    return ((unsigned)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static int sample_bytes(int track, int i)
+{
+    return track ? 100 + (i*13 % 200) : 20 + (i*7 % 50);
+}
+
+/**
+*   Multiplex test sequence: audio track 0, video track 1; return 0 on success
+*/
+static int write_file(const char * file_name)
+{
+    MP4E_params_t params = {0,};
+    MP4E_mux_t * mux;
+    MP4E_track_t track;
+    unsigned char frame[512];
+    int a = 0, v = 0, error = 0;
+
+    params.mp4file = fopen(file_name, "wb");
+    params.enable_fragmentation = 1;
+    params.cmaf_chunk_duration_ms = CHUNK_MS;
+    params.flush = on_flush;
+    mux = MP4E__open_ex(&params);
+    if (!mux)
+    {
+        return 1;
+    }
+
+    memset(&track, 0, sizeof(track));
+    strcpy((char*)track.language, "und");
+    track.object_type_indication = MP4_OBJECT_TYPE_AUDIO_ISO_IEC_14496_3;
+    track.track_media_kind = e_audio;
+    track.u.a.channelcount = 2;
+    track.time_scale = 44100;
+    track.default_duration = 1024;
+    MP4E__add_track(mux, &track);
+    MP4E__set_dsi(mux, 0, g_dsi, sizeof(g_dsi));
+    track.object_type_indication = MP4_OBJECT_TYPE_AVC;
+    track.track_media_kind = e_video;
+    track.u.v.width = 320;
+    track.u.v.height = 240;
+    track.time_scale = 90000;
+    track.default_duration = 3000;
+    MP4E__add_track(mux, &track);
+    MP4E__set_sps(mux, 1, g_sps, sizeof(g_sps));
+    MP4E__set_pps(mux, 1, g_pps, sizeof(g_pps));
+
+    // interleave by time; audio data is copied, video passed by reference
+    while (a < AUDIO_FRAMES || v < VIDEO_FRAMES)
+    {
+        if (v >= VIDEO_FRAMES || (a < AUDIO_FRAMES && (double)a*1024/44100 < (double)v/30))
+        {
+            memset(frame, a, sizeof(frame));
+            frame[0] = 0;
+            error |= MP4E__put_sample(mux, 0, frame, sample_bytes(0, a), 0, MP4E_SAMPLE_RANDOM_ACCESS);
+            a++;
+        }
+        else
+        {
+            unsigned char * data = (unsigned char *)malloc(sample_bytes(1, v));
+            memset(data, v, sample_bytes(1, v));
+            data[0] = 1;
+            error |= MP4E__put_sample_ref(mux, 1, data, sample_bytes(1, v), 0,
+                (v % GOP) ? MP4E_SAMPLE_DEFAULT : MP4E_SAMPLE_RANDOM_ACCESS, release_sample, NULL);
+            v++;
+        }
+    }
+    error |= MP4E__close(mux);
+    return error;
+}
+
+/**
+*   Check one chunk: [styp] moof mdat; return 1 on success
+*/
+static int check_chunk(const unsigned char * chunk, unsigned bytes, int sequence, int segment_start, int next_sample[2])
+{
+    const unsigned char * moof = chunk, * traf;
+    unsigned moof_bytes, pos;
+    int ok = 1;
+
+    if (segment_start)
+    {
+        ok = read_u32(moof + 4) == BOX_styp && read_u32(moof + 8) == FOUR_CHAR_INT('c','m','f','s');
+        moof += read_u32(moof);
+    }
+    moof_bytes = read_u32(moof);
+    ok &= read_u32(moof + 4) == BOX_moof && read_u32(moof + moof_bytes + 4) == BOX_mdat &&
+          (moof - chunk) + moof_bytes + read_u32(moof + moof_bytes) == bytes &&
+          read_u32(moof + 12) == BOX_mfhd && read_u32(moof + 20) == (unsigned)sequence;
+
+    // mfhd, then traf for each track
+    for (pos = 8 + read_u32(moof + 8); ok && pos < moof_bytes; pos += read_u32(traf))
+    {
+        const unsigned char * tfhd, * tfdt, * trun, * entry;
+        unsigned track, n, count, data_offset;
+        traf = moof + pos;
+        tfhd = traf + 8;
+        tfdt = tfhd + read_u32(tfhd);
+        trun = tfdt + read_u32(tfdt);
+        track = read_u32(tfhd + 12) - 1;
+        ok = read_u32(traf + 4) == BOX_traf && read_u32(tfhd + 4) == BOX_tfhd && read_u32(tfdt + 4) == BOX_tfdt &&
+             read_u32(trun + 4) == BOX_trun && track < 2 &&
+             read_u32(tfdt + 16) == (unsigned)next_sample[track] * (track ? 3000 : 1024);
+        count = read_u32(trun + 12);
+        data_offset = read_u32(trun + 16);
+        // video chunk does not exceed chunk duration
+        ok &= count > 0 && (!track || count <= CHUNK_MS*30/1000);
+        for (n = 0, entry = trun + 20; ok && n < count; n++, entry += 12)
+        {
+            int i = next_sample[track]++;
+            const unsigned char * data = moof + data_offset;
+            unsigned key = !track || !(i % GOP);
+            ok = read_u32(entry) == (track ? 3000u : 1024u) && read_u32(entry + 4) == (unsigned)sample_bytes(track, i) &&
+                 (read_u32(entry + 8) == 0x2000000) == key && data[0] == track && data[1] == (unsigned char)i;
+            // segment starts with video key frame
+            ok &= !track || !segment_start || n || key;
+            data_offset += read_u32(entry + 4);
+        }
+    }
+    return ok;
+}
+
+/**
+*   Check 'mfra' box after the last chunk: 'tfra' lists video key frames, and
+*   their 'moof' positions; 'mfro' at the end of file gives 'mfra' size.
+*   return 1 on success
+*/
+static int check_mfra(const unsigned char * mfra, const unsigned char * data, long bytes, int segments)
+{
+    const unsigned char * tfra = mfra + 8, * entry;
+    int i, ok;
+    ok = read_u32(mfra + 4) == BOX_mfra && mfra + read_u32(mfra) == data + bytes &&
+         read_u32(data + bytes - 16 + 4) == BOX_mfro && read_u32(data + bytes - 4) == read_u32(mfra) &&
+         read_u32(tfra + 4) == BOX_tfra && read_u32(tfra + 12) == 2 && read_u32(tfra + 20) == (unsigned)segments;
+    for (i = 0, entry = tfra + 24; ok && i < segments; i++, entry += 22)
+    {
+        unsigned moof_offset = read_u32(entry + 12);
+        ok = read_u32(entry + 4) == (unsigned)i*GOP*3000 && moof_offset < bytes && 
+             read_u32(data + moof_offset + 4) == BOX_moof && read_u32(data + moof_offset - 24 + 4) == BOX_styp &&
+             entry[17] == 1 && read_u32(entry + 18) == 1;
+    }
+    return ok;
+}
+
+/**
+*   Check output file against flush callback reports; return 1 on success
+*/
+static int check_file(const char * file_name)
+{
+    FILE * f = fopen(file_name, "rb");
+    unsigned char * data;
+    long bytes;
+    int i, segments = 0, next_sample[2] = { 0, 0 }, ok;
+    if (!f)
+    {
+        return 0;
+    }
+    fseek(f, 0, SEEK_END);
+    bytes = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    data = (unsigned char *)malloc(bytes);
+    ok = data && bytes == (long)fread(data, 1, bytes, f);
+    fclose(f);
+
+    ok &= g_flush_count > 2 && g_flush_count <= MAX_FLUSH &&
+          g_flush[0].offset == 0 && g_flush[0].flags == MP4E_FLUSH_HEADER &&
+          read_u32(data + 4) == BOX_ftyp && read_u32(data + read_u32(data) + 4) == BOX_moov;
+    for (i = 1; ok && i < g_flush_count; i++)
+    {
+        int segment_start = !!(g_flush[i].flags & MP4E_FLUSH_SEGMENT_START);
+        ok = g_flush[i].offset == g_flush[i - 1].offset + g_flush[i - 1].bytes &&
+             g_flush[i].offset + g_flush[i].bytes <= (mp4e_offset_t)bytes &&
+             check_chunk(data + g_flush[i].offset, (unsigned)g_flush[i].bytes, i, segment_start, next_sample);
+        segments += segment_start;
+    }
+    ok &= segments == VIDEO_FRAMES / GOP && g_flush_count - 1 > segments;
+    ok &= next_sample[0] == AUDIO_FRAMES && next_sample[1] == VIDEO_FRAMES;
+    if (ok)
+    {
+        ok = check_mfra(data + g_flush[g_flush_count - 1].offset + g_flush[g_flush_count - 1].bytes, 
+                        data, bytes, segments);
+    }
+    free(data);
+    return ok;
+}
+
+int main(int argc, char* argv[])
+{
+    const char * file_name = (argc > 1) ? argv[1] : "cmaf_test.mp4";
+    int fail = 0;
+
+    if (write_file(file_name) || !check_file(file_name))
+    {
+        printf("CMAF test failed\n");
+        fail = 1;
+    }
+    remove(file_name);
+    return fail;
+}
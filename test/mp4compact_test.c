@@ -0,0 +1,148 @@
+/** 18.10.2026 @file
+*
+*   Check compact sample tables: MP4D__frame_offset() returns the same size,
+*   position, timestamp and duration as with plain arrays for all samples.
+*   Compare allocated memory, and time of sequential and random queries with
+*   plain arrays for 3-hour movie.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "mp4demux.h"
+#include "mp4test_util.h"
+
+/**
+*   Open the file in given mode
+*   return 1 on success; memory size, peak memory size at open, and time
+*/
+static int open_file(FILE * f, MP4D_demux_t * mp4, int compact, size_t * used, size_t * peak, double * us)
+{
+    MP4D_params_t params;
+    int ok;
+    memset(&params, 0, sizeof(params));
+    params.allocator = &g_count_allocator;
+    params.compact = compact;
+    *used = g_used;
+    g_peak = g_used;
+    *us = now_us();
+    ok = MP4D__open_ex(mp4, f, &params);
+    *us = now_us() - *us;
+    *peak = g_peak - *used;
+    *used = g_used - *used;
+    return ok;
+}
+
+/**
+*   Compare all samples of plain and compact demultiplexer
+*   return 1 if equal
+*/
+static int compare(const MP4D_demux_t * plain, const MP4D_demux_t * compact)
+{
+    unsigned ntrack, i;
+    int ok = plain->track_count == compact->track_count;
+    for (ntrack = 0; ok && ntrack < plain->track_count; ntrack++)
+    {
+        const MP4D_track_t * tr = compact->track + ntrack;
+        ok = tr->sample_count == plain->track[ntrack].sample_count && !tr->entry_size && !tr->timestamp && !tr->duration;
+        for (i = 0; ok && i < tr->sample_count; i++)
+        {
+            unsigned x_bytes, y_bytes, x_ts, y_ts, x_dur, y_dur;
+            mp4d_size_t x = MP4D__frame_offset(plain, ntrack, i, &x_bytes, &x_ts, &x_dur);
+            mp4d_size_t y = MP4D__frame_offset(compact, ntrack, i, &y_bytes, &y_ts, &y_dur);
+            ok = x == y && x_bytes == y_bytes && x_ts == y_ts && x_dur == y_dur;
+        }
+    }
+    return ok;
+}
+
+/**
+*   Return time of sequential or random queries of all samples, us
+*/
+static double query_time(const MP4D_demux_t * mp4, int random, mp4d_size_t * sum)
+{
+    unsigned ntrack, i, bytes, ts, duration, seed = 7;
+    double us = now_us();
+    *sum = 0;
+    for (ntrack = 0; ntrack < mp4->track_count; ntrack++)
+    {
+        unsigned count = mp4->track[ntrack].sample_count;
+        for (i = 0; i < count; i++)
+        {
+            seed = seed*1103515245 + 12345;
+            *sum += MP4D__frame_offset(mp4, ntrack, random ? (seed >> 8) % count : i, &bytes, &ts, &duration) + bytes + ts + duration;
+        }
+    }
+    return now_us() - us;
+}
+
+/**
+*   Parse the file with plain and compact tables, and compare. If large is
+*   set, compact tables must take 4 times less memory.
+*   return 1 on success
+*/
+static int test_file(const char * file_name, int large)
+{
+    MP4D_demux_t plain, compact;
+    FILE * f = fopen(file_name, "rb");
+    size_t plain_used, plain_peak, compact_used, compact_peak;
+    double plain_us, compact_us;
+    int ok = f && open_file(f, &plain, 0, &plain_used, &plain_peak, &plain_us);
+    if (ok)
+    {
+        ok = open_file(f, &compact, 1, &compact_used, &compact_peak, &compact_us);
+        if (ok)
+        {
+            ok = compare(&plain, &compact);
+            if (large)
+            {
+                mp4d_size_t plain_sum, compact_sum;
+                double plain_seq_us = query_time(&plain, 0, &plain_sum), compact_seq_us = query_time(&compact, 0, &compact_sum);
+                double plain_rnd_us, compact_rnd_us;
+                ok = ok && plain_sum == compact_sum;
+                plain_rnd_us = query_time(&plain, 1, &plain_sum);
+                compact_rnd_us = query_time(&compact, 1, &compact_sum);
+                ok = ok && plain_sum == compact_sum;
+                printf("%s: plain tables %.0f KB, open %.0f us, sequential %.0f us, random %.0f us\n",
+                    file_name, plain_used/1024., plain_us, plain_seq_us, plain_rnd_us);
+                printf("%s: compact tables %.0f KB (%.0f KB peak), open %.0f us, sequential %.0f us, random %.0f us\n",
+                    file_name, compact_used/1024., compact_peak/1024., compact_us, compact_seq_us, compact_rnd_us);
+                ok = ok && compact_used*4 < plain_used;
+            }
+            MP4D__close(&compact);
+        }
+        MP4D__close(&plain);
+    }
+    if (f)
+    {
+        fclose(f);
+    }
+    return ok;
+}
+
+int main(int argc, char* argv[])
+{
+    static const char * files[] =
+    {
+        "vectors/ref/mp4mux_file.mp4", "vectors/ref/mp4mux_stream.mp4", "vectors/ref/transcoded.mp4"
+    };
+    const char * movie_name = "compact_test.mp4";
+    int i, fail = 0;
+    (void)argc;
+    (void)argv;
+
+    for (i = 0; i < 3; i++)
+    {
+        if (!test_file(files[i], 0))
+        {
+            printf("compact test failed: %s\n", files[i]);
+            fail = 1;
+        }
+    }
+    if (!write_movie(movie_name, 3*3600, 1, 0, 0) || !test_file(movie_name, 1))
+    {
+        printf("compact test failed: 3-hour movie\n");
+        fail = 1;
+    }
+    remove(movie_name);
+    return fail;
+}
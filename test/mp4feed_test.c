@@ -0,0 +1,255 @@
+/** 18.10.2026 @file
+*
+*   Parse MP4 files with the push parser, passing the file in pieces of
+*   random size, as from network, and check, that the result is the same as
+*   of MP4D__open(). The application either drops skipped bytes from the
+*   stream, or seeks to the next position. Files with 'moov' box at the end
+*   and at the start (the 1st file, re-arranged) are tested.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mp4demux.h"
+
+static unsigned g_rand = 1;
+
+static unsigned random_bytes(unsigned max_bytes)
+{
+    g_rand = g_rand*1103515245 + 12345;
+    return 1 + (g_rand >> 16) % max_bytes;
+}
+
+/**
+*   Load file to memory; return NULL on failure
+*/
+static unsigned char * load_file(const char * file_name, size_t * bytes)
+{
+    FILE * f = fopen(file_name, "rb");
+    unsigned char * data = NULL;
+    long size;
+    if (f && !fseek(f, 0, SEEK_END) && (size = ftell(f)) > 0 && !fseek(f, 0, SEEK_SET) &&
+        (data = (unsigned char *)malloc(size)) != NULL && fread(data, 1, size, f) != (size_t)size)
+    {
+        free(data);
+        data = NULL;
+    }
+    *bytes = data ? (size_t)size : 0;
+    if (f)
+    {
+        fclose(f);
+    }
+    return data;
+}
+
+static unsigned get32(const unsigned char * p)
+{
+    return ((unsigned)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+/**
+*   Move 'moov' box before 'mdat' box: chunk offsets are not updated, which
+*   does not matter for the parser comparison
+*/
+static void move_moov_first(unsigned char * data, size_t bytes)
+{
+    size_t pos, mdat_pos = 0;
+    for (pos = 0; pos + 8 <= bytes && get32(data + pos) >= 8; pos += get32(data + pos))
+    {
+        unsigned box_bytes = get32(data + pos);
+        if (!memcmp(data + pos + 4, "mdat", 4) && !mdat_pos)
+        {
+            mdat_pos = pos;
+        }
+        if (!memcmp(data + pos + 4, "moov", 4) && mdat_pos && pos + box_bytes <= bytes)
+        {
+            unsigned char * moov = (unsigned char *)malloc(box_bytes);
+            memcpy(moov, data + pos, box_bytes);
+            memmove(data + mdat_pos + box_bytes, data + mdat_pos, pos - mdat_pos);
+            memcpy(data + mdat_pos, moov, box_bytes);
+            free(moov);
+            return;
+        }
+    }
+}
+
+/**
+*   Compare AVC SPS or PPS of the track
+*/
+static int compare_spspps(const MP4D_demux_t * a, const MP4D_demux_t * b, unsigned ntrack, int pps_flag)
+{
+    int n, ok = 1;
+    for (n = 0; ok; n++)
+    {
+        int x_bytes, y_bytes;
+        const unsigned char * x = pps_flag ? MP4D__read_pps(a, ntrack, n, &x_bytes) : MP4D__read_sps(a, ntrack, n, &x_bytes);
+        const unsigned char * y = pps_flag ? MP4D__read_pps(b, ntrack, n, &y_bytes) : MP4D__read_sps(b, ntrack, n, &y_bytes);
+        if (!x || !y)
+        {
+            return !x == !y;
+        }
+        ok = x_bytes == y_bytes && !memcmp(x, y, x_bytes);
+    }
+    return ok;
+}
+
+/**
+*   Compare demultiplexer data
+*   return 1 if equal
+*/
+static int compare(const MP4D_demux_t * a, const MP4D_demux_t * b)
+{
+    unsigned i;
+    int ok = a->track_count == b->track_count && a->timescale == b->timescale &&
+             a->duration_lo == b->duration_lo && a->duration_hi == b->duration_hi &&
+             !a->tag.comment == !b->tag.comment && (!a->tag.comment || !strcmp((char*)a->tag.comment, (char*)b->tag.comment));
+    for (i = 0; ok && i < a->track_count; i++)
+    {
+        const MP4D_track_t * x = a->track + i, * y = b->track + i;
+        ok = x->sample_count == y->sample_count && x->object_type_indication == y->object_type_indication &&
+             x->handler_type == y->handler_type && x->timescale == y->timescale && x->track_id == y->track_id &&
+             x->chunk_count == y->chunk_count && x->sample_to_chunk_count == y->sample_to_chunk_count &&
+             x->dsi_bytes == y->dsi_bytes && !memcmp(x->language, y->language, 4) &&
+             !memcmp(&x->SampleDescription, &y->SampleDescription, sizeof(x->SampleDescription)) &&
+             (x->object_type_indication == MP4_OBJECT_TYPE_AVC ? 
+                compare_spspps(a, b, i, 0) && compare_spspps(a, b, i, 1) : !memcmp(x->dsi, y->dsi, x->dsi_bytes)) &&
+             !memcmp(x->entry_size, y->entry_size, x->sample_count*sizeof(unsigned)) &&
+             !memcmp(x->timestamp, y->timestamp, x->sample_count*sizeof(unsigned)) &&
+             !memcmp(x->duration, y->duration, x->sample_count*sizeof(unsigned)) &&
+             !memcmp(x->chunk_offset, y->chunk_offset, x->chunk_count*sizeof(mp4d_size_t)) &&
+             !memcmp(x->sample_to_chunk, y->sample_to_chunk, x->sample_to_chunk_count*sizeof(MP4D_sample_to_chunk_t));
+    }
+    return ok;
+}
+
+/**
+*   Pass the stream to the push parser in pieces of random size, up to given
+*   max_bytes. Skipped bytes are dropped from the stream, or sought, if seek
+*   flag is set.
+*   skips [OUT]: number of MP4D_FEED_SKIP events
+*   return 1 on success
+*/
+static int feed(MP4D_demux_t * mp4, const unsigned char * data, size_t bytes, unsigned max_bytes, int seek, int * skips)
+{
+    MP4D_feed_t * feed = MP4D__feed_open(mp4, NULL);
+    MP4D_feed_result_t result;
+    size_t pos = 0;
+    int event = MP4D_FEED_NEED_MORE, moov_found = 0;
+    mp4d_size_t skip = 0;
+
+    *skips = 0;
+    while (feed && pos < bytes && event != MP4D_FEED_END && event != MP4D_FEED_ERROR)
+    {
+        // receive next piece
+        size_t n = random_bytes(max_bytes), used = 0;
+        if (n > bytes - pos)
+        {
+            n = bytes - pos;
+        }
+        if (skip)
+        {
+            // drop bytes of the skipped box
+            size_t k = skip < n ? (size_t)skip : n;
+            skip -= k;
+            pos += k;
+            continue;
+        }
+        do
+        {
+            event = MP4D__feed(feed, data + pos + used, n - used, &result);
+            used += result.consumed;
+            if (event == MP4D_FEED_SKIP)
+            {
+                (*skips)++;
+                if (seek)
+                {
+                    used = n;
+                    pos = (size_t)result.offset;
+                    break;
+                }
+                skip = result.skip_bytes;
+            }
+            moov_found |= event == MP4D_FEED_BOX && result.box_name == BOX_moov;
+        } while (used < n && event != MP4D_FEED_END && event != MP4D_FEED_ERROR);
+        if (!seek || event != MP4D_FEED_SKIP)
+        {
+            pos += used;
+        }
+        if (!seek && event == MP4D_FEED_SKIP && used < n)
+        {
+            MP4D__feed_close(feed);
+            return 0;   // skip follows the used input
+        }
+    }
+    return MP4D__feed_close(feed) && moov_found;
+}
+
+/**
+*   Test one file; return 1 on success
+*   expect_skip: flag, file has large 'mdat' box
+*/
+static int test_file(const char * file_name, int moov_first, int expect_skip)
+{
+    MP4D_demux_t reference, mp4;
+    size_t bytes;
+    unsigned char * data = load_file(file_name, &bytes);
+    char temp_name[256];
+    FILE * f;
+    int ok, skips, seek_skips, n;
+
+    if (!data)
+    {
+        return 0;
+    }
+    if (moov_first)
+    {
+        move_moov_first(data, bytes);
+    }
+    sprintf(temp_name, "feed_test_%d.mp4", moov_first);
+    f = fopen(temp_name, "wb");
+    ok = f && fwrite(data, 1, bytes, f) == bytes;
+    if (f)
+    {
+        fclose(f);
+    }
+    f = fopen(temp_name, "rb");
+    ok = ok && f && MP4D__open(&reference, f);
+    for (n = 0; ok && n < 20; n++)
+    {
+        // 1-byte pieces, small and large pieces
+        unsigned max_bytes = n == 0 ? 1 : n < 10 ? 64 : 4096;
+        ok = feed(&mp4, data, bytes, max_bytes, 0, &skips) && compare(&reference, &mp4);
+        MP4D__close(&mp4);
+        ok = ok && feed(&mp4, data, bytes, max_bytes, 1, &seek_skips) && compare(&reference, &mp4);
+        MP4D__close(&mp4);
+        // large 'mdat' box is not passed to the parser
+        ok &= !expect_skip || (skips > 0 && seek_skips > 0);
+    }
+    if (f)
+    {
+        MP4D__close(&reference);
+        fclose(f);
+    }
+    remove(temp_name);
+    free(data);
+    return ok;
+}
+
+int main(int argc, char* argv[])
+{
+    static const char * default_files[] =
+    {
+        "vectors/ref/mp4mux_file.mp4", "vectors/ref/mp4mux_stream.mp4", "vectors/ref/transcoded.mp4"
+    };
+    const char ** files = argc > 1 ? (const char **)argv + 1 : default_files;
+    int i, file_count = argc > 1 ? argc - 1 : 3, fail = 0;
+    for (i = 0; i < file_count; i++)
+    {
+        if (!test_file(files[i], 0, !i) || (!i && !test_file(files[i], 1, !i)))
+        {
+            printf("feed test failed: %s\n", files[i]);
+            fail = 1;
+        }
+    }
+    return fail;
+}
@@ -0,0 +1,138 @@
+/** 18.10.2026 @file
+*
+*   Check track filter: selected tracks have the same sample tables as with
+*   full parsing; other tracks have metadata and sample count, and no tables.
+*   Compare allocated memory and time with full parsing for a movie with video
+*   and several audio tracks.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "mp4demux.h"
+#include "mp4test_util.h"
+
+#define AUDIO_TRACKS    6
+
+/**
+*   Compare the track with fully parsed one
+*   return 1 if equal
+*/
+static int compare_track(const MP4D_track_t * x, const MP4D_track_t * y, int selected)
+{
+    int ok = x->sample_count == y->sample_count && x->object_type_indication == y->object_type_indication &&
+             x->handler_type == y->handler_type && x->timescale == y->timescale && x->track_id == y->track_id &&
+             x->duration_lo == y->duration_lo && x->duration_hi == y->duration_hi &&
+             x->dsi_bytes == y->dsi_bytes && !memcmp(x->language, y->language, 4) &&
+             !memcmp(&x->SampleDescription, &y->SampleDescription, sizeof(x->SampleDescription));
+    if (selected)
+    {
+        return ok && x->chunk_count == y->chunk_count && x->sample_to_chunk_count == y->sample_to_chunk_count &&
+             equal(x->entry_size, y->entry_size, x->sample_count*sizeof(unsigned)) &&
+             equal(x->timestamp, y->timestamp, x->sample_count*sizeof(unsigned)) &&
+             equal(x->duration, y->duration, x->sample_count*sizeof(unsigned)) &&
+             equal(x->chunk_offset, y->chunk_offset, x->chunk_count*sizeof(mp4d_size_t)) &&
+             equal(x->sample_to_chunk, y->sample_to_chunk, x->sample_to_chunk_count*sizeof(MP4D_sample_to_chunk_t));
+    }
+    return ok && !y->entry_size && !y->timestamp && !y->duration && !y->chunk_offset && !y->sample_to_chunk &&
+           !y->chunk_count && !y->sample_to_chunk_count;
+}
+
+/**
+*   Open the file with the filter, and compare with full parsing
+*   return 1 on success; allocated bytes and time
+*/
+static int test_filter(FILE * f, const MP4D_demux_t * full, uint32_t handler_type, unsigned object_type_indication,
+                       uint32_t track_mask, size_t * allocated, double * us)
+{
+    MP4D_params_t params;
+    MP4D_demux_t mp4;
+    unsigned i, selected_count = 0;
+    int opened, ok;
+    memset(&params, 0, sizeof(params));
+    params.allocator = &g_count_allocator;
+    params.handler_type = handler_type;
+    params.object_type_indication = object_type_indication;
+    params.track_mask = track_mask;
+    g_allocated = 0;
+    *us = now_us();
+    opened = MP4D__open_ex(&mp4, f, &params);
+    *us = now_us() - *us;
+    *allocated = g_allocated;
+    ok = opened && mp4.track_count == full->track_count;
+    for (i = 0; ok && i < full->track_count; i++)
+    {
+        const MP4D_track_t * tr = full->track + i;
+        int selected = (!handler_type || tr->handler_type == handler_type) &&
+                       (!object_type_indication || tr->object_type_indication == object_type_indication) &&
+                       (!track_mask || (i < 32 && ((track_mask >> i) & 1)));
+        selected_count += selected;
+        ok = compare_track(tr, mp4.track + i, selected);
+    }
+    if (opened)
+    {
+        MP4D__close(&mp4);
+    }
+    return ok && selected_count;
+}
+
+/**
+*   Check filters for the file
+*   return 1 on success
+*/
+static int test_file(const char * file_name, int verbose)
+{
+    MP4D_demux_t full;
+    FILE * f = fopen(file_name, "rb");
+    size_t full_allocated, allocated;
+    double full_us, us;
+    int ok = f && MP4D__open(&full, f);
+    if (ok)
+    {
+        ok = test_filter(f, &full, 0, 0, 0, &full_allocated, &full_us) &&
+             test_filter(f, &full, MP4_HANDLER_TYPE_SOUN, 0, 0, &allocated, &us) &&
+             test_filter(f, &full, MP4_HANDLER_TYPE_VIDE, 0, 0, &allocated, &us) &&
+             test_filter(f, &full, 0, MP4_OBJECT_TYPE_AUDIO_ISO_IEC_14496_3, 3, &allocated, &us) &&
+             test_filter(f, &full, 0, 0, 3, &allocated, &us);
+        if (ok && verbose)
+        {
+            ok = test_filter(f, &full, 0, MP4_OBJECT_TYPE_AVC, 0, &allocated, &us);
+            printf("%s: all tracks %.0f KB allocated, %.0f us; video track only %.0f KB allocated, %.0f us\n",
+                file_name, full_allocated/1024., full_us, allocated/1024., us);
+            ok = ok && allocated*3 < full_allocated;
+        }
+        MP4D__close(&full);
+    }
+    if (f)
+    {
+        fclose(f);
+    }
+    return ok;
+}
+
+int main(int argc, char* argv[])
+{
+    static const char * files[] =
+    {
+        "vectors/ref/mp4mux_file.mp4", "vectors/ref/mp4mux_stream.mp4", "vectors/ref/transcoded.mp4"
+    };
+    const char * movie_name = "filter_test.mp4";
+    int i, fail = 0;
+    (void)argc;
+    (void)argv;
+
+    for (i = 0; i < 3; i++)
+    {
+        if (!test_file(files[i], 0))
+        {
+            printf("filter test failed: %s\n", files[i]);
+            fail = 1;
+        }
+    }
+    if (!write_movie(movie_name, 3600, AUDIO_TRACKS, 0, 0) || !test_file(movie_name, 1))
+    {
+        printf("filter test failed: multi-language movie\n");
+        fail = 1;
+    }
+    remove(movie_name);
+    return fail;
+}
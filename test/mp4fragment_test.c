@@ -0,0 +1,233 @@
+/** 18.10.2026 @file
+*
+*   Seek in fragmented files with demultiplexer random access index: 'mfra'
+*   box at the end of file, or 'sidx' boxes of concatenated media segments.
+*   Check, that seek finds the fragment with the key frame at or before given
+*   time, and that fragments, read from there, give the rest of the samples.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mp4demux.h"
+#include "mp4mux.h"
+#include "mp4test_util.h"
+
+#define VIDEO_FRAMES    150         // 5 seconds, 30 fps
+#define GOP             30
+#define AUDIO_FRAMES    215         // 5 seconds, 44100 Hz
+#define MAX_SEGMENTS    16
+
+/*
+*   In-memory output for segmented mode
+*/
+static buffer_t g_init;
+static buffer_t g_segment[MAX_SEGMENTS];
+static int g_segment_count;
+
+static int open_segment(void * segment_token, int segment_number, MP4E_sink_t * sink)
+{
+    (void)segment_token;
+    (void)segment_number;
+    if (g_segment_count >= MAX_SEGMENTS)
+    {
+        return 1;
+    }
+    sink->write = buffer_write;
+    sink->token = &g_segment[g_segment_count++];
+    return 0;
+}
+
+/**
+*   Multiplex test sequence: audio track 0, video track 1; return 0 on success
+*   Sample data starts with track number and sample number.
+*/
+static int write_samples(MP4E_mux_t * mux)
+{
+    static unsigned char frame[300];
+    MP4E_track_t track;
+    int a = 0, v = 0, error = 0;
+
+    if (!mux)
+    {
+        return 1;
+    }
+    memset(&track, 0, sizeof(track));
+    strcpy((char*)track.language, "und");
+    track.object_type_indication = MP4_OBJECT_TYPE_AUDIO_ISO_IEC_14496_3;
+    track.track_media_kind = e_audio;
+    track.u.a.channelcount = 2;
+    track.time_scale = 44100;
+    track.default_duration = 1024;
+    MP4E__add_track(mux, &track);
+    MP4E__set_dsi(mux, 0, g_dsi, sizeof(g_dsi));
+    track.object_type_indication = MP4_OBJECT_TYPE_AVC;
+    track.track_media_kind = e_video;
+    track.u.v.width = 320;
+    track.u.v.height = 240;
+    track.time_scale = 90000;
+    track.default_duration = 3000;
+    MP4E__add_track(mux, &track);
+    MP4E__set_sps(mux, 1, g_sps, sizeof(g_sps));
+    MP4E__set_pps(mux, 1, g_pps, sizeof(g_pps));
+
+    while (a < AUDIO_FRAMES || v < VIDEO_FRAMES)
+    {
+        if (v >= VIDEO_FRAMES || (a < AUDIO_FRAMES && (double)a*1024/44100 < (double)v/30))
+        {
+            frame[0] = 0;
+            frame[1] = (unsigned char)a++;
+            error |= MP4E__put_sample(mux, 0, frame, 50, 0, MP4E_SAMPLE_RANDOM_ACCESS);
+        }
+        else
+        {
+            frame[0] = 1;
+            frame[1] = (unsigned char)v;
+            error |= MP4E__put_sample(mux, 1, frame, 100 + v, 0,
+                (v % GOP) ? MP4E_SAMPLE_DEFAULT : MP4E_SAMPLE_RANDOM_ACCESS);
+            v++;
+        }
+    }
+    error |= MP4E__close(mux);
+    return error;
+}
+
+/**
+*   Write init segment and media segments to one file
+*/
+static int write_segments(const char * file_name)
+{
+    MP4E_params_t params = {0,};
+    MP4E_sink_t sink = {0,};
+    FILE * f;
+    int i, error;
+
+    sink.write = buffer_write;
+    sink.token = &g_init;
+    params.sink = &sink;
+    params.enable_fragmentation = 1;
+    params.segment_duration_ms = 1500;
+    params.segment_sink = open_segment;
+    error = write_samples(MP4E__open_ex(&params));
+
+    f = fopen(file_name, "wb");
+    error |= !f || fwrite(g_init.data, 1, g_init.bytes, f) != g_init.bytes;
+    free(g_init.data);
+    for (i = 0; i < g_segment_count; i++)
+    {
+        error |= !f || fwrite(g_segment[i].data, 1, g_segment[i].bytes, f) != g_segment[i].bytes;
+        free(g_segment[i].data);
+    }
+    if (f)
+    {
+        fclose(f);
+    }
+    return error;
+}
+
+/**
+*   Read sample header from the file
+*/
+static int check_sample_data(FILE * f, const MP4D_fragment_sample_t * sample, int track, int n)
+{
+    unsigned char head[2];
+    return !fseek(f, (long)sample->offset, SEEK_SET) && 2 == fread(head, 1, 2, f) &&
+           head[0] == track && head[1] == (unsigned char)n &&
+           sample->bytes == (unsigned)(track ? 100 + n : 50);
+}
+
+/**
+*   Seek to given video frame, and read fragments till the end of file.
+*   Random access points of video track are random_access_frames apart.
+*   Check, that reading starts at key frame, and gives all the following
+*   samples of given track; return 1 on success
+*/
+static int check_seek(MP4D_demux_t * mp4, FILE * f, int frame, int track, int random_access_frames)
+{
+    MP4D_fragment_t fragment = {0,};
+    mp4d_size_t offset, ra_time;
+    unsigned duration = track ? 3000 : 1024;
+    int n = -1, ok;
+
+    ok = mp4->track[1].random_access_count == (unsigned)(VIDEO_FRAMES + random_access_frames - 1)/random_access_frames &&
+         MP4D__seek_fragment(mp4, 1, (mp4d_size_t)frame*3000, &offset, &ra_time) &&
+         ra_time == (mp4d_size_t)(frame/random_access_frames*random_access_frames)*3000;
+    while (ok && MP4D__read_fragment(mp4, f, offset, track, &fragment))
+    {
+        unsigned i;
+        for (i = 0; ok && i < fragment.sample_count; i++)
+        {
+            const MP4D_fragment_sample_t * sample = fragment.sample + i;
+            if (n < 0)
+            {
+                // 1st sample at random access point
+                n = (int)(sample->timestamp / duration);
+                ok = sample->random_access && (!track || (mp4d_size_t)n*3000 == ra_time);
+            }
+            ok &= sample->timestamp == (mp4d_size_t)n*duration && sample->duration == duration &&
+                  sample->random_access == (!track || !(n % GOP)) && check_sample_data(f, sample, track, n);
+            n++;
+        }
+        ok &= fragment.next_offset > offset;
+        offset = fragment.next_offset;
+    }
+    MP4D__free_fragment(mp4, &fragment);
+    return ok && n == (track ? VIDEO_FRAMES : AUDIO_FRAMES);
+}
+
+/**
+*   Open the file, and check seek for both tracks; return 1 on success
+*/
+static int check_file(const char * file_name, int random_access_frames)
+{
+    FILE * f = fopen(file_name, "rb");
+    MP4D_demux_t mp4 = {0,};
+    mp4d_size_t offset;
+    int ok;
+    if (!f || !MP4D__open(&mp4, f))
+    {
+        return 0;
+    }
+    ok = mp4.track_count == 2 && mp4.track[0].track_id == 1 && mp4.track[1].track_id == 2 &&
+         check_seek(&mp4, f, 100, 1, random_access_frames) &&
+         check_seek(&mp4, f, 0, 1, random_access_frames) &&
+         check_seek(&mp4, f, VIDEO_FRAMES - 1, 0, random_access_frames);
+    // track without random access points
+    ok &= !MP4D__seek_fragment(&mp4, 0, 0, &offset, NULL);
+    MP4D__close(&mp4);
+    fclose(f);
+    return ok;
+}
+
+int main(int argc, char* argv[])
+{
+    const char * file_name = (argc > 1) ? argv[1] : "fragment_test.mp4";
+    MP4E_params_t params = {0,};
+    int fail = 0;
+
+    // 'mfra' index: key frame every second
+    if (write_samples(MP4E__open(fopen(file_name, "wb"), 1)) || !check_file(file_name, GOP))
+    {
+        printf("fragment test failed: mfra\n");
+        fail = 1;
+    }
+
+    // 'mfra' index of CMAF chunks: several tracks and samples per fragment
+    params.mp4file = fopen(file_name, "wb");
+    params.enable_fragmentation = 1;
+    params.cmaf_chunk_duration_ms = 200;
+    if (write_samples(MP4E__open_ex(&params)) || !check_file(file_name, GOP))
+    {
+        printf("fragment test failed: CMAF\n");
+        fail = 1;
+    }
+
+    // 'sidx' index: segments at 0, 2, 4 s
+    if (write_segments(file_name) || !check_file(file_name, 2*GOP))
+    {
+        printf("fragment test failed: sidx\n");
+        fail = 1;
+    }
+    remove(file_name);
+    return fail;
+}
@@ -0,0 +1,249 @@
+/** 18.10.2026 @file
+*
+*   Save the index of MP4 files, open it, and check, that the demultiplexer
+*   data is the same as of MP4D__open(). Check, that the index is not used,
+*   when the MP4 file is changed, or the index is broken; and that cached open
+*   re-creates it. Compare open time with parsing and with the index for
+*   3-hour movie.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include "mp4index.h"
+#include "mp4test_util.h"
+
+/**
+*   Compare AVC SPS or PPS of the track
+*/
+static int compare_spspps(const MP4D_demux_t * a, const MP4D_demux_t * b, unsigned ntrack, int pps_flag)
+{
+    int n, ok = 1;
+    for (n = 0; ok; n++)
+    {
+        int x_bytes, y_bytes;
+        const unsigned char * x = pps_flag ? MP4D__read_pps(a, ntrack, n, &x_bytes) : MP4D__read_sps(a, ntrack, n, &x_bytes);
+        const unsigned char * y = pps_flag ? MP4D__read_pps(b, ntrack, n, &y_bytes) : MP4D__read_sps(b, ntrack, n, &y_bytes);
+        if (!x || !y)
+        {
+            return !x == !y;
+        }
+        ok = x_bytes == y_bytes && !memcmp(x, y, x_bytes);
+    }
+    return ok;
+}
+
+static int compare_tag(const unsigned char * x, const unsigned char * y)
+{
+    return !x == !y && (!x || !strcmp((const char *)x, (const char *)y));
+}
+
+/**
+*   Compare demultiplexer data
+*   return 1 if equal
+*/
+static int compare(const MP4D_demux_t * a, const MP4D_demux_t * b)
+{
+    unsigned i;
+    int ok = a->track_count == b->track_count && a->timescale == b->timescale &&
+             a->duration_lo == b->duration_lo && a->duration_hi == b->duration_hi &&
+             compare_tag(a->tag.title, b->tag.title) && compare_tag(a->tag.artist, b->tag.artist) &&
+             compare_tag(a->tag.album, b->tag.album) && compare_tag(a->tag.year, b->tag.year) &&
+             compare_tag(a->tag.comment, b->tag.comment) && compare_tag(a->tag.genre, b->tag.genre);
+    for (i = 0; ok && i < a->track_count; i++)
+    {
+        const MP4D_track_t * x = a->track + i, * y = b->track + i;
+        ok = x->sample_count == y->sample_count && x->object_type_indication == y->object_type_indication &&
+             x->handler_type == y->handler_type && x->timescale == y->timescale && x->track_id == y->track_id &&
+             x->duration_lo == y->duration_lo && x->duration_hi == y->duration_hi &&
+             x->avg_bitrate_bps == y->avg_bitrate_bps && x->stream_type == y->stream_type &&
+             x->chunk_count == y->chunk_count && x->sample_to_chunk_count == y->sample_to_chunk_count &&
+             x->random_access_count == y->random_access_count &&
+             x->dsi_bytes == y->dsi_bytes && !memcmp(x->language, y->language, 4) &&
+             !memcmp(&x->SampleDescription, &y->SampleDescription, sizeof(x->SampleDescription)) &&
+             (x->object_type_indication == MP4_OBJECT_TYPE_AVC ?
+                compare_spspps(a, b, i, 0) && compare_spspps(a, b, i, 1) : equal(x->dsi, y->dsi, x->dsi_bytes)) &&
+             equal(x->entry_size, y->entry_size, x->sample_count*sizeof(unsigned)) &&
+             equal(x->timestamp, y->timestamp, x->sample_count*sizeof(unsigned)) &&
+             equal(x->duration, y->duration, x->sample_count*sizeof(unsigned)) &&
+             equal(x->chunk_offset, y->chunk_offset, x->chunk_count*sizeof(mp4d_size_t)) &&
+             equal(x->sample_to_chunk, y->sample_to_chunk, x->sample_to_chunk_count*sizeof(MP4D_sample_to_chunk_t)) &&
+             equal(x->random_access, y->random_access, x->random_access_count*sizeof(MP4D_random_access_t));
+    }
+    return ok;
+}
+
+/**
+*   Save and open the index of the file, and compare with parsed file
+*   return 1 on success
+*/
+static int test_file(const char * file_name, const char * index_name)
+{
+    MP4D_demux_t reference, mp4;
+    FILE * f = fopen(file_name, "rb");
+    int ok = f && MP4D__open(&reference, f);
+    if (ok)
+    {
+        remove(index_name);
+        ok = !MP4I__open(&mp4, f, index_name) && MP4I__save(&reference, f, index_name) &&
+             MP4I__open(&mp4, f, index_name);
+        if (ok)
+        {
+            ok = compare(&reference, &mp4);
+            MP4I__close(&mp4);
+        }
+        MP4D__close(&reference);
+    }
+    if (f)
+    {
+        fclose(f);
+    }
+    remove(index_name);
+    return ok;
+}
+
+/**
+*   Patch the file at given offset
+*/
+static void patch_file(const char * file_name, long offset, unsigned char value)
+{
+    FILE * f = fopen(file_name, "r+b");
+    if (f)
+    {
+        fseek(f, offset, SEEK_SET);
+        fwrite(&value, 1, 1, f);
+        fclose(f);
+    }
+}
+
+/**
+*   Check, that index is not used for changed file, and broken index;
+*   and that cached open re-creates it
+*   return 1 on success
+*/
+static int test_validation(const char * file_name, const char * index_name)
+{
+    MP4D_demux_t mp4;
+    struct timeval times[2] = {{1000000000, 0}, {1000000000, 0}};
+    FILE * f = fopen(file_name, "rb");
+    int ok;
+
+    remove(index_name);
+    // 1st open parses the file, and saves the index; 2nd open maps it
+    ok = f && MP4I__open_cached(&mp4, f, index_name) && !mp4.allocator.context;
+    MP4I__close(&mp4);
+    ok = ok && MP4I__open_cached(&mp4, f, index_name) && mp4.allocator.context;
+    MP4I__close(&mp4);
+
+    // broken index
+    patch_file(index_name, 4, 0x55);
+    ok = ok && !MP4I__open(&mp4, f, index_name) && MP4I__open_cached(&mp4, f, index_name) && !mp4.allocator.context;
+    MP4I__close(&mp4);
+    ok = ok && truncate(index_name, 300) == 0 && !MP4I__open(&mp4, f, index_name);
+
+    // changed modification time
+    ok = ok && MP4I__open_cached(&mp4, f, index_name);
+    MP4I__close(&mp4);
+    ok = ok && MP4I__open(&mp4, f, index_name);
+    MP4I__close(&mp4);
+    ok = ok && !utimes(file_name, times) && !MP4I__open(&mp4, f, index_name);
+    if (f)
+    {
+        fclose(f);
+    }
+    remove(index_name);
+    return ok;
+}
+
+/**
+*   Measure average open time, microseconds
+*/
+static double open_time(const char * file_name, const char * index_name, int use_index, int count)
+{
+    MP4D_demux_t mp4;
+    FILE * f = fopen(file_name, "rb");
+    double t = now_us();
+    int i, ok = !!f;
+    for (i = 0; ok && i < count; i++)
+    {
+        ok = use_index ? MP4I__open(&mp4, f, index_name) : MP4D__open(&mp4, f);
+        if (ok)
+        {
+            // use the tables
+            unsigned bytes;
+            MP4D__frame_offset(&mp4, 1, 0, &bytes, NULL, NULL);
+            use_index ? MP4I__close(&mp4) : MP4D__close(&mp4);
+        }
+    }
+    t = (now_us() - t)/count;
+    if (f)
+    {
+        fclose(f);
+    }
+    return ok ? t : -1;
+}
+
+int main(int argc, char* argv[])
+{
+    static const char * files[] =
+    {
+        "vectors/ref/mp4mux_file.mp4", "vectors/ref/mp4mux_stream.mp4", "vectors/ref/transcoded.mp4"
+    };
+    const char * movie_name = "index_test.mp4", * index_name = "index_test.mp4.idx";
+    double parse_us, index_us;
+    int i, fail = 0;
+    (void)argc;
+    (void)argv;
+
+    for (i = 0; i < 3; i++)
+    {
+        if (!test_file(files[i], index_name))
+        {
+            printf("index test failed: %s\n", files[i]);
+            fail = 1;
+        }
+    }
+
+    // fragmented file: random access points
+    if (!write_movie(movie_name, 10, 1, 1, 0) || !test_file(movie_name, index_name))
+    {
+        printf("index test failed: fragmented\n");
+        fail = 1;
+    }
+
+    if (!write_movie(movie_name, 3*3600, 1, 0, 0) || !test_file(movie_name, index_name) ||
+        !test_validation(movie_name, index_name))
+    {
+        printf("index test failed: 3-hour movie\n");
+        fail = 1;
+    }
+
+    // open time of 3-hour movie
+    if (!fail)
+    {
+        MP4D_demux_t mp4;
+        FILE * f = fopen(movie_name, "rb");
+        int ok = f && MP4I__open_cached(&mp4, f, index_name);
+        if (ok)
+        {
+            MP4I__close(&mp4);
+        }
+        if (f)
+        {
+            fclose(f);
+        }
+        parse_us = open_time(movie_name, index_name, 0, 5);
+        index_us = open_time(movie_name, index_name, 1, 100);
+        printf("3-hour movie open: parse %.0f us, index %.1f us\n", parse_us, index_us);
+        if (!ok || parse_us < 0 || index_us < 0)
+        {
+            printf("index test failed: open time\n");
+            fail = 1;
+        }
+    }
+    remove(movie_name);
+    remove(index_name);
+    return fail;
+}
@@ -0,0 +1,172 @@
+/** 18.10.2026 @file
+*
+*   Check lazy sample tables: MP4D__frame_offset() returns the same size,
+*   position, timestamp and duration as with full parsing, for sequential
+*   and random access, and with single cached window. Compare allocated
+*   memory and time with full parsing for 3-hour movie.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "mp4demux.h"
+#include "mp4test_util.h"
+
+/**
+*   Open the file in given mode
+*   return 1 on success; allocated bytes and time
+*/
+static int open_file(FILE * f, MP4D_demux_t * mp4, int lazy, unsigned window_count, size_t * allocated, double * us)
+{
+    MP4D_params_t params;
+    int ok;
+    memset(&params, 0, sizeof(params));
+    params.allocator = &g_count_allocator;
+    params.lazy = lazy;
+    params.lazy_window_count = window_count;
+    g_allocated = 0;
+    *us = now_us();
+    ok = MP4D__open_ex(mp4, f, &params);
+    *us = now_us() - *us;
+    *allocated = g_allocated;
+    return ok;
+}
+
+/**
+*   Compare one sample of lazy and fully parsed demultiplexer
+*/
+static int compare_sample(const MP4D_demux_t * full, const MP4D_demux_t * lazy, unsigned ntrack, unsigned nsample)
+{
+    unsigned x_bytes, y_bytes, x_ts, y_ts, x_dur, y_dur;
+    mp4d_size_t x = MP4D__frame_offset(full, ntrack, nsample, &x_bytes, &x_ts, &x_dur);
+    mp4d_size_t y = MP4D__frame_offset(lazy, ntrack, nsample, &y_bytes, &y_ts, &y_dur);
+    return x == y && x_bytes == y_bytes && x_ts == y_ts && x_dur == y_dur;
+}
+
+/**
+*   Compare samples: sequential samples of the tracks, then random ones.
+*   First sequential_count samples of each track are compared; 0 - all
+*   return 1 if equal
+*/
+static int compare(const MP4D_demux_t * full, const MP4D_demux_t * lazy, unsigned sequential_count, unsigned random_count)
+{
+    unsigned ntrack, i, seed = 1;
+    int ok = full->track_count == lazy->track_count;
+    for (ntrack = 0; ok && ntrack < full->track_count; ntrack++)
+    {
+        const MP4D_track_t * tr = lazy->track + ntrack;
+        unsigned bytes, count = sequential_count && sequential_count < tr->sample_count ? sequential_count : tr->sample_count;
+        ok = tr->sample_count == full->track[ntrack].sample_count &&
+             !tr->entry_size && !tr->timestamp && !tr->duration && !tr->chunk_offset;
+        for (i = 0; ok && i < count; i++)
+        {
+            ok = compare_sample(full, lazy, ntrack, i);
+        }
+        // out of range sample
+        ok = ok && !MP4D__frame_offset(lazy, ntrack, tr->sample_count, &bytes, NULL, NULL) && !bytes;
+    }
+    for (i = 0; ok && i < random_count; i++)
+    {
+        seed = seed*1103515245 + 12345;
+        ntrack = (seed >> 16) % full->track_count;
+        seed = seed*1103515245 + 12345;
+        if (full->track[ntrack].sample_count)
+        {
+            ok = compare_sample(full, lazy, ntrack, (seed >> 8) % full->track[ntrack].sample_count);
+        }
+    }
+    return ok;
+}
+
+/**
+*   Return time of random queries, us
+*/
+static double query_time(const MP4D_demux_t * mp4, unsigned count)
+{
+    unsigned ntrack, i, bytes, ts, duration, seed = 7;
+    mp4d_size_t sum = 0;
+    double us = now_us();
+    for (i = 0; i < count; i++)
+    {
+        seed = seed*1103515245 + 12345;
+        ntrack = (seed >> 16) % mp4->track_count;
+        seed = seed*1103515245 + 12345;
+        sum += MP4D__frame_offset(mp4, ntrack, (seed >> 8) % mp4->track[ntrack].sample_count, &bytes, &ts, &duration);
+    }
+    us = now_us() - us;
+    return sum ? us : -1;
+}
+
+/**
+*   Parse the file fully and in lazy mode, and compare. If large is set,
+*   lazy mode must allocate 20 times less.
+*   return 1 on success
+*/
+static int test_file(const char * file_name, int large)
+{
+    MP4D_demux_t full, lazy;
+    FILE * f = fopen(file_name, "rb");
+    size_t full_allocated, lazy_allocated;
+    double full_us, lazy_us, full_query_us, lazy_query_us;
+    unsigned sequential_count = large ? 60*44100/1024 : 0, random_count = large ? 2000 : 500;
+    int ok = f && open_file(f, &full, 0, 0, &full_allocated, &full_us);
+    if (ok)
+    {
+        // single window: each query reads the file
+        ok = open_file(f, &lazy, 1, 1, &lazy_allocated, &lazy_us);
+        if (ok)
+        {
+            ok = compare(&full, &lazy, sequential_count, random_count);
+            MP4D__close(&lazy);
+        }
+        ok = ok && open_file(f, &lazy, 1, 0, &lazy_allocated, &lazy_us);
+        if (ok)
+        {
+            g_allocated = 0;
+            ok = compare(&full, &lazy, sequential_count, random_count);
+            lazy_allocated += g_allocated;
+            if (large)
+            {
+                full_query_us = query_time(&full, random_count);
+                lazy_query_us = query_time(&lazy, random_count);
+                printf("%s: parse %.0f KB allocated, %.0f us, %u random queries %.0f us; lazy %.1f KB allocated, %.0f us, queries %.0f us\n",
+                    file_name, full_allocated/1024., full_us, random_count, full_query_us, lazy_allocated/1024., lazy_us, lazy_query_us);
+                ok = ok && lazy_allocated*20 < full_allocated && lazy_query_us >= 0;
+            }
+            MP4D__close(&lazy);
+        }
+        MP4D__close(&full);
+    }
+    if (f)
+    {
+        fclose(f);
+    }
+    return ok;
+}
+
+int main(int argc, char* argv[])
+{
+    static const char * files[] =
+    {
+        "vectors/ref/mp4mux_file.mp4", "vectors/ref/mp4mux_stream.mp4", "vectors/ref/transcoded.mp4"
+    };
+    const char * movie_name = "lazy_test.mp4";
+    int i, fail = 0;
+    (void)argc;
+    (void)argv;
+
+    for (i = 0; i < 3; i++)
+    {
+        if (!test_file(files[i], 0))
+        {
+            printf("lazy test failed: %s\n", files[i]);
+            fail = 1;
+        }
+    }
+    if (!write_movie(movie_name, 3*3600, 1, 0, 0) || !test_file(movie_name, 1))
+    {
+        printf("lazy test failed: 3-hour movie\n");
+        fail = 1;
+    }
+    remove(movie_name);
+    return fail;
+}
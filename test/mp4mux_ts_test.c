@@ -0,0 +1,152 @@
+/** 18.10.2026 @file
+*
+*   Multiplex variable frame rate video with B-frames using timestamps.
+*   Check, that sample durations in the index follow decoding timestamps, and
+*   that each fragment 'tfdt' box holds the sample decoding time.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mp4demux.h"
+#include "mp4mux.h"
+#include "mp4test_util.h"
+
+#define FRAMES 12
+
+// decoding timestamps of variable frame rate video, 90 kHz
+static const int g_dts[FRAMES] = { 0, 3000, 6000, 9500, 12500, 16000, 19000, 22000, 26000, 29000, 32000, 35000 };
+// I P B B ... order: presentation delayed by one frame for reordered frames
+static const int g_cts[FRAMES] = { 3000, 9500, 0, 0, 6500, 0, 3000, 7000, 0, 3000, 3000, 3000 };
+
+static unsigned read_u32(const unsigned char * p)
+{
+    return ((unsigned)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+/**
+*   Multiplex test sequence to given file
+*/
+static int write_file(const char * file_name, int fragmentation_mode)
+{
+    static unsigned char frame[100];
+    MP4E_mux_t * mux = MP4E__open(fopen(file_name, "wb"), fragmentation_mode);
+    MP4E_track_t track;
+    int i, error = 0;
+
+    memset(&track, 0, sizeof(track));
+    strcpy((char*)track.language, "und");
+    track.object_type_indication = MP4_OBJECT_TYPE_AVC;
+    track.track_media_kind = e_video;
+    track.time_scale = 90000;
+    track.default_duration = 3000;
+    track.u.v.width = 320;
+    track.u.v.height = 240;
+    MP4E__add_track(mux, &track);
+    MP4E__set_sps(mux, 0, g_sps, sizeof(g_sps));
+    MP4E__set_pps(mux, 0, g_pps, sizeof(g_pps));
+    for (i = 0; i < FRAMES; i++)
+    {
+        frame[0] = (unsigned char)i;
+        error |= MP4E__put_sample_ts(mux, 0, frame, sizeof(frame), g_dts[i], g_dts[i] + g_cts[i],
+            i ? MP4E_SAMPLE_DEFAULT : MP4E_SAMPLE_RANDOM_ACCESS);
+    }
+    error |= MP4E__close(mux);
+    return error;
+}
+
+/**
+*   Check non-fragmented file index; return 1 on success
+*/
+static int check_index(const char * file_name)
+{
+    FILE * f = fopen(file_name, "rb");
+    MP4D_demux_t mp4 = {0,};
+    unsigned i, ok;
+    if (!f || !MP4D__open(&mp4, f))
+    {
+        return 0;
+    }
+    ok = mp4.track_count == 1 && mp4.track[0].sample_count == FRAMES;
+    for (i = 0; ok && i < FRAMES; i++)
+    {
+        unsigned frame_bytes, timestamp, duration;
+        MP4D__frame_offset(&mp4, 0, i, &frame_bytes, &timestamp, &duration);
+        // last sample keeps duration of the previous one
+        ok = timestamp == (unsigned)g_dts[i] &&
+             duration == (unsigned)(i < FRAMES - 1 ? g_dts[i + 1] - g_dts[i] : g_dts[i] - g_dts[i - 1]);
+    }
+    MP4D__close(&mp4);
+    fclose(f);
+    return ok;
+}
+
+/**
+*   Check 'tfdt' and 'trun' boxes of fragmented file; return 1 on success
+*/
+static int check_fragments(const char * file_name)
+{
+    FILE * f = fopen(file_name, "rb");
+    unsigned char * data;
+    long bytes, pos;
+    int n = 0, ok = 1;
+    if (!f)
+    {
+        return 0;
+    }
+    fseek(f, 0, SEEK_END);
+    bytes = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    data = (unsigned char *)malloc(bytes);
+    ok = data && bytes == (long)fread(data, 1, bytes, f);
+    fclose(f);
+
+    // moof: mfhd, traf: tfhd, tfdt, trun
+    for (pos = 0; ok && pos + 8 <= bytes; pos += read_u32(data + pos))
+    {
+        const unsigned char * moof = data + pos;
+        const unsigned char * traf, * tfhd, * tfdt, * trun;
+        if (read_u32(moof + 4) != BOX_moof)
+        {
+            ok = read_u32(moof) >= 8;
+            continue;
+        }
+        traf = moof + 8 + read_u32(moof + 8);
+        tfhd = traf + 8;
+        tfdt = tfhd + read_u32(tfhd);
+        trun = tfdt + read_u32(tfdt);
+        ok = n < FRAMES && read_u32(tfdt + 4) == BOX_tfdt && read_u32(trun + 4) == BOX_trun &&
+             read_u32(tfdt + 12) == 0 && read_u32(tfdt + 16) == (unsigned)g_dts[n];
+        // composition offset is the last trun field, if present
+        if (ok && (read_u32(trun + 8) & 0x800))
+        {
+            ok = (int)read_u32(trun + read_u32(trun) - 4) == g_cts[n];
+        }
+        else
+        {
+            ok &= !g_cts[n];
+        }
+        n++;
+    }
+    free(data);
+    return ok && n == FRAMES;
+}
+
+int main(int argc, char* argv[])
+{
+    const char * file_name = (argc > 1) ? argv[1] : "ts_test.mp4";
+    int fail = 0;
+
+    if (write_file(file_name, 0) || !check_index(file_name))
+    {
+        printf("timestamp test failed: index\n");
+        fail = 1;
+    }
+    if (write_file(file_name, 1) || !check_fragments(file_name))
+    {
+        printf("timestamp test failed: fragments\n");
+        fail = 1;
+    }
+    remove(file_name);
+    return fail;
+}
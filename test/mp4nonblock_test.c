@@ -0,0 +1,271 @@
+/** 18.10.2026 @file
+*
+*   Multiplex audio and video in non-blocking mode to in-memory output, which
+*   is drained at limited rate, as slow network. Check, that pending output
+*   never exceeds the limit, that blocked samples are written, when passed
+*   again; and with frame dropping, that audio and key frames are kept, that
+*   video is dropped till the next key frame, and that timestamps of the kept
+*   samples are not changed, also in fragmented output.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mp4demux.h"
+#include "mp4mux.h"
+#include "mp4test_util.h"
+
+#define VIDEO_FRAMES    150         // 5 seconds, 30 fps
+#define GOP             30
+#define AUDIO_FRAMES    215         // 5 seconds, 44100 Hz
+#define MAX_PENDING     4000
+
+/*
+*   In-memory output; counts bytes, written and not yet sent
+*/
+typedef struct
+{
+    buffer_t buffer;
+    mp4e_offset_t written;
+    mp4e_offset_t sent;
+    mp4e_offset_t max_pending;      // while samples are written: 'moov' at close is not limited
+    int closing;
+} output_t;
+
+static output_t g_file;
+
+static int output_write(void * token, mp4e_offset_t offset, const void * data, size_t bytes)
+{
+    output_t * b = (output_t *)token;
+    if (buffer_write(&b->buffer, offset, data, bytes))
+    {
+        return 1;
+    }
+    b->written += bytes;
+    if (!b->closing && b->written - b->sent > b->max_pending)
+    {
+        b->max_pending = b->written - b->sent;
+    }
+    return 0;
+}
+
+/**
+*   Send up to given number of pending bytes, and report them to the multiplexer
+*/
+static void send(MP4E_mux_t * mux, mp4e_offset_t bytes)
+{
+    if (bytes > g_file.written - g_file.sent)
+    {
+        bytes = g_file.written - g_file.sent;
+    }
+    g_file.sent += bytes;
+    MP4E__confirm_output(mux, bytes);
+}
+
+static int sample_bytes(int track, int i)
+{
+    return track ? ((i % GOP) ? 400 : 2000) : 100;
+}
+
+/**
+*   Multiplex test sequence: audio track 0, video track 1. Sample data starts
+*   with track number and 16-bit sample number. The output sends given number
+*   of bytes per sample; when the sample would block, it waits (sends more),
+*   and passes the sample again.
+*   video_frames [OUT]: video frames, which are not dropped
+*   would_block [OUT]: number of MP4E_STATUS_WOULD_BLOCK results
+*   return 0 on success
+*/
+static int record(int fragmented, int drop_frames, int send_bytes, int * video_frames, int * would_block)
+{
+    static unsigned char frame[2000];
+    MP4E_params_t params = {0,};
+    MP4E_sink_t sink = {0,};
+    MP4E_mux_t * mux;
+    MP4E_track_t track;
+    int a = 0, v = 0, error = 0;
+
+    memset(&g_file, 0, sizeof(g_file));
+    sink.write = output_write;
+    sink.token = &g_file;
+    params.sink = &sink;
+    params.enable_fragmentation = fragmented;
+    params.max_pending_bytes = MAX_PENDING;
+    params.drop_frames = drop_frames;
+    mux = MP4E__open_ex(&params);
+    if (!mux)
+    {
+        return 1;
+    }
+
+    memset(&track, 0, sizeof(track));
+    strcpy((char*)track.language, "und");
+    track.object_type_indication = MP4_OBJECT_TYPE_AUDIO_ISO_IEC_14496_3;
+    track.track_media_kind = e_audio;
+    track.u.a.channelcount = 2;
+    track.time_scale = 44100;
+    track.default_duration = 1024;
+    MP4E__add_track(mux, &track);
+    MP4E__set_dsi(mux, 0, g_dsi, sizeof(g_dsi));
+    track.object_type_indication = MP4_OBJECT_TYPE_AVC;
+    track.track_media_kind = e_video;
+    track.u.v.width = 320;
+    track.u.v.height = 240;
+    track.time_scale = 90000;
+    track.default_duration = 3000;
+    MP4E__add_track(mux, &track);
+    MP4E__set_sps(mux, 1, g_sps, sizeof(g_sps));
+    MP4E__set_pps(mux, 1, g_pps, sizeof(g_pps));
+
+    *video_frames = *would_block = 0;
+    while (a < AUDIO_FRAMES || v < VIDEO_FRAMES)
+    {
+        int audio = v >= VIDEO_FRAMES || (a < AUDIO_FRAMES && (double)a*1024/44100 < (double)v/30);
+        int n = audio ? a : v, result;
+        mp4e_offset_t written = g_file.written;
+        frame[0] = (unsigned char)!audio;
+        frame[1] = (unsigned char)(n >> 8);
+        frame[2] = (unsigned char)n;
+        send(mux, send_bytes);
+        result = MP4E__put_sample(mux, !audio, frame, sample_bytes(!audio, n), 0,
+            (audio || !(n % GOP)) ? MP4E_SAMPLE_RANDOM_ACCESS : MP4E_SAMPLE_DEFAULT);
+        if (result == MP4E_STATUS_WOULD_BLOCK)
+        {
+            // wait, and pass the sample again
+            (*would_block)++;
+            error |= g_file.written != written;
+            continue;
+        }
+        error |= result;
+        *video_frames += !audio && g_file.written != written;
+        audio ? a++ : v++;
+    }
+    g_file.closing = 1;
+    error |= MP4E__close(mux);
+    return error;
+}
+
+/**
+*   Check sample data and timestamp: key frames are kept, and P-frame follows
+*   previous frame of the GOP
+*   prev [IN/OUT]: number of the previous video sample, -1 if none
+*   return 1 on success
+*/
+static int check_sample(FILE * f, unsigned ntrack, mp4d_size_t offset, unsigned bytes, mp4d_size_t timestamp, int * prev)
+{
+    unsigned char head[3];
+    int n, ok;
+    fseek(f, (long)offset, SEEK_SET);
+    ok = 3 == fread(head, 1, 3, f) && head[0] == ntrack;
+    n = head[1]*256 + head[2];
+    ok &= bytes == (unsigned)sample_bytes(ntrack, n) && timestamp == (mp4d_size_t)n*(ntrack ? 3000u : 1024u);
+    if (ntrack)
+    {
+        ok &= n == *prev + 1 || !(n % GOP);
+        ok &= *prev < 0 || *prev/GOP != n/GOP || n == *prev + 1;
+        *prev = n;
+    }
+    return ok;
+}
+
+/**
+*   Read output with demultiplexer: check, that audio is complete, and that
+*   video has key frames, and GOP prefixes, with original timestamps. Samples
+*   of fragmented output are read with MP4D__read_fragment(), so their
+*   timestamps come from 'tfdt' and 'trun' boxes.
+*   return 1 on success
+*/
+static int check_file(const char * file_name, int fragmented, int video_frames)
+{
+    FILE * f = fopen(file_name, "wb");
+    MP4D_demux_t mp4 = {0,};
+    unsigned ntrack, i, count, ok;
+    mp4d_size_t end_time = 0;
+    ok = f && g_file.buffer.bytes == fwrite(g_file.buffer.data, 1, g_file.buffer.bytes, f);
+    if (f)
+    {
+        fclose(f);
+    }
+    f = fopen(file_name, "rb");
+    if (!ok || !f || !MP4D__open(&mp4, f))
+    {
+        if (f)
+        {
+            fclose(f);
+        }
+        return 0;
+    }
+    ok = mp4.track_count == 2;
+    for (ntrack = 0; ok && ntrack < 2; ntrack++)
+    {
+        int prev = -1;
+        count = 0;
+        if (fragmented)
+        {
+            MP4D_fragment_t fragment = {0,};
+            mp4d_size_t offset;
+            for (ok = MP4D__seek_fragment(&mp4, 1, 0, &offset, NULL);
+                 ok && MP4D__read_fragment(&mp4, f, offset, ntrack, &fragment); offset = fragment.next_offset)
+            {
+                for (i = 0; ok && i < fragment.sample_count; i++, count++)
+                {
+                    const MP4D_fragment_sample_t * sample = fragment.sample + i;
+                    ok = check_sample(f, ntrack, sample->offset, sample->bytes, sample->timestamp, &prev);
+                    end_time = ntrack ? sample->timestamp + sample->duration : end_time;
+                }
+            }
+            MP4D__free_fragment(&mp4, &fragment);
+        }
+        else
+        {
+            for (i = 0; ok && i < mp4.track[ntrack].sample_count; i++, count++)
+            {
+                unsigned frame_bytes, timestamp, duration;
+                mp4d_size_t ofs = MP4D__frame_offset(&mp4, ntrack, i, &frame_bytes, &timestamp, &duration);
+                ok = check_sample(f, ntrack, ofs, frame_bytes, timestamp, &prev);
+                end_time = ntrack ? timestamp + duration : end_time;
+            }
+        }
+        ok &= count == (ntrack ? (unsigned)video_frames : AUDIO_FRAMES);
+    }
+    // dropped samples do not change video duration, except the trailing ones
+    ok &= end_time <= VIDEO_FRAMES*3000u && end_time > (VIDEO_FRAMES - GOP)*3000u;
+    MP4D__close(&mp4);
+    fclose(f);
+    remove(file_name);
+    return ok;
+}
+
+int main(int argc, char* argv[])
+{
+    const char * file_name = (argc > 1) ? argv[1] : "nonblock_test.mp4";
+    int video_frames, would_block, fail = 0;
+
+    // output is slower than the stream: producer waits
+    if (record(0, 0, 150, &video_frames, &would_block) || !would_block || video_frames != VIDEO_FRAMES ||
+        g_file.max_pending > MAX_PENDING || !check_file(file_name, 0, VIDEO_FRAMES))
+    {
+        printf("non-blocking test failed: would block\n");
+        fail = 1;
+    }
+    free(g_file.buffer.data);
+
+    // frame dropping: producer waits for key frames and audio only
+    if (record(0, 1, 150, &video_frames, &would_block) || video_frames >= VIDEO_FRAMES || video_frames < VIDEO_FRAMES/GOP ||
+        g_file.max_pending > MAX_PENDING || !check_file(file_name, 0, video_frames))
+    {
+        printf("non-blocking test failed: frame dropping\n");
+        fail = 1;
+    }
+    free(g_file.buffer.data);
+
+    // frame dropping in fragmented output, as for live ingest: 'tfdt' keeps the timeline
+    if (record(1, 1, 150, &video_frames, &would_block) || video_frames >= VIDEO_FRAMES || video_frames < VIDEO_FRAMES/GOP ||
+        g_file.max_pending > MAX_PENDING || !check_file(file_name, 1, video_frames))
+    {
+        printf("non-blocking test failed: frame dropping in fragmented output\n");
+        fail = 1;
+    }
+    free(g_file.buffer.data);
+    return fail;
+}
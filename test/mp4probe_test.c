@@ -0,0 +1,183 @@
+/** 18.10.2026 @file
+*
+*   Check probe mode: track metadata and sample count are the same as of full
+*   parsing, sample tables are not allocated, and the file is not read after
+*   the 'moov' box. Compare allocated memory, read bytes and time with full
+*   parsing for 3-hour movie, and for fragmented movie.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mp4demux.h"
+#include "mp4test_util.h"
+
+/**
+*   Return bytes, read by the process, or -1 if not known
+*/
+static double read_bytes(void)
+{
+    char line[256];
+    double rchar = -1;
+    FILE * f = fopen("/proc/self/io", "r");
+    while (f && fgets(line, sizeof(line), f))
+    {
+        if (!strncmp(line, "rchar:", 6))
+        {
+            rchar = atof(line + 6);
+        }
+    }
+    if (f)
+    {
+        fclose(f);
+    }
+    return rchar;
+}
+
+/**
+*   Compare AVC SPS or PPS of the track
+*/
+static int compare_spspps(const MP4D_demux_t * a, const MP4D_demux_t * b, unsigned ntrack, int pps_flag)
+{
+    int n, ok = 1;
+    for (n = 0; ok; n++)
+    {
+        int x_bytes, y_bytes;
+        const unsigned char * x = pps_flag ? MP4D__read_pps(a, ntrack, n, &x_bytes) : MP4D__read_sps(a, ntrack, n, &x_bytes);
+        const unsigned char * y = pps_flag ? MP4D__read_pps(b, ntrack, n, &y_bytes) : MP4D__read_sps(b, ntrack, n, &y_bytes);
+        if (!x || !y)
+        {
+            return !x == !y;
+        }
+        ok = x_bytes == y_bytes && !memcmp(x, y, x_bytes);
+    }
+    return ok;
+}
+
+static int compare_tag(const unsigned char * x, const unsigned char * y)
+{
+    return !x == !y && (!x || !strcmp((const char *)x, (const char *)y));
+}
+
+/**
+*   Compare probed metadata with fully parsed file
+*   return 1 if equal
+*/
+static int compare(const MP4D_demux_t * full, const MP4D_demux_t * probe)
+{
+    unsigned i, bytes;
+    int ok = full->track_count == probe->track_count && full->timescale == probe->timescale &&
+             full->duration_lo == probe->duration_lo && full->duration_hi == probe->duration_hi &&
+             compare_tag(full->tag.title, probe->tag.title) && compare_tag(full->tag.artist, probe->tag.artist) &&
+             compare_tag(full->tag.album, probe->tag.album) && compare_tag(full->tag.year, probe->tag.year) &&
+             compare_tag(full->tag.comment, probe->tag.comment) && compare_tag(full->tag.genre, probe->tag.genre);
+    for (i = 0; ok && i < full->track_count; i++)
+    {
+        const MP4D_track_t * x = full->track + i, * y = probe->track + i;
+        ok = x->sample_count == y->sample_count && x->object_type_indication == y->object_type_indication &&
+             x->handler_type == y->handler_type && x->timescale == y->timescale && x->track_id == y->track_id &&
+             x->duration_lo == y->duration_lo && x->duration_hi == y->duration_hi &&
+             x->avg_bitrate_bps == y->avg_bitrate_bps && x->stream_type == y->stream_type &&
+             x->dsi_bytes == y->dsi_bytes && !memcmp(x->language, y->language, 4) &&
+             !memcmp(&x->SampleDescription, &y->SampleDescription, sizeof(x->SampleDescription)) &&
+             (x->object_type_indication == MP4_OBJECT_TYPE_AVC ?
+                compare_spspps(full, probe, i, 0) && compare_spspps(full, probe, i, 1) :
+                (!x->dsi_bytes || !memcmp(x->dsi, y->dsi, x->dsi_bytes))) &&
+             !y->entry_size && !y->timestamp && !y->duration && !y->chunk_offset && !y->sample_to_chunk &&
+             !y->chunk_count && !y->sample_to_chunk_count && !y->random_access_count;
+        ok = ok && !MP4D__frame_offset(probe, i, 0, &bytes, NULL, NULL) && !bytes;
+    }
+    return ok;
+}
+
+/**
+*   Parse the file with given mode
+*   return 1 on success; allocated and read bytes, and time
+*/
+static int open_file(FILE * f, MP4D_demux_t * mp4, int probe, size_t * allocated, double * read, double * us)
+{
+    MP4D_params_t params;
+    double rchar;
+    int ok;
+    memset(&params, 0, sizeof(params));
+    params.allocator = &g_count_allocator;
+    params.probe = probe;
+    // drop stdio buffer
+    fseek(f, 0, SEEK_END);
+    g_allocated = 0;
+    rchar = read_bytes();
+    *us = now_us();
+    ok = MP4D__open_ex(mp4, f, &params);
+    *us = now_us() - *us;
+    *read = read_bytes() - rchar;
+    *allocated = g_allocated;
+    return ok;
+}
+
+/**
+*   Probe and parse the file, and compare. If read_ratio is set, probe must
+*   read that many times less than parsing, and allocate 20 times less
+*   return 1 on success
+*/
+static int test_file(const char * file_name, int read_ratio)
+{
+    MP4D_demux_t full, probe;
+    FILE * f = fopen(file_name, "rb");
+    size_t full_allocated, probe_allocated;
+    double full_read, probe_read, full_us, probe_us;
+    int ok = f && open_file(f, &full, 0, &full_allocated, &full_read, &full_us);
+    if (ok)
+    {
+        ok = open_file(f, &probe, 1, &probe_allocated, &probe_read, &probe_us);
+        if (ok)
+        {
+            ok = compare(&full, &probe) && probe_allocated < 4096 && probe_allocated <= full_allocated;
+            if (read_ratio)
+            {
+                printf("%s: parse %.0f KB read, %.0f KB allocated, %.0f us; probe %.1f KB read, %.1f KB allocated, %.0f us\n",
+                    file_name, full_read/1024, full_allocated/1024., full_us, probe_read/1024, probe_allocated/1024., probe_us);
+                ok = ok && probe_allocated*20 < full_allocated && (probe_read < 0 || probe_read*read_ratio < full_read);
+            }
+            MP4D__close(&probe);
+        }
+        MP4D__close(&full);
+    }
+    if (f)
+    {
+        fclose(f);
+    }
+    return ok;
+}
+
+int main(int argc, char* argv[])
+{
+    static const char * files[] =
+    {
+        "vectors/ref/mp4mux_file.mp4", "vectors/ref/mp4mux_stream.mp4", "vectors/ref/transcoded.mp4"
+    };
+    const char * movie_name = "probe_test.mp4";
+    int i, fail = 0;
+    (void)argc;
+    (void)argv;
+
+    for (i = 0; i < 3; i++)
+    {
+        if (!test_file(files[i], 0))
+        {
+            printf("probe test failed: %s\n", files[i]);
+            fail = 1;
+        }
+    }
+    if (!write_movie(movie_name, 3*3600, 1, 0, 0) || !test_file(movie_name, 10))
+    {
+        printf("probe test failed: 3-hour movie\n");
+        fail = 1;
+    }
+    if (!write_movie(movie_name, 600, 1, 1, 0) || !test_file(movie_name, 2))
+    {
+        printf("probe test failed: fragmented movie\n");
+        fail = 1;
+    }
+    remove(movie_name);
+    return fail;
+}
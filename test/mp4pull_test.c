@@ -0,0 +1,253 @@
+/** 18.10.2026 @file
+*
+*   Multiplex audio and video in pull output mode, progressive and fragmented:
+*   output is drained in pieces of random size, as by asynchronous network stack,
+*   and assembled by buffer offsets. Check, that the file has all samples, that
+*   video sample data, passed with release callback, is referenced by the output
+*   chain, not copied, and that each sample is released once.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mp4demux.h"
+#include "mp4mux.h"
+#include "mp4test_util.h"
+
+#define VIDEO_FRAMES    90          // 3 seconds, 30 fps
+#define GOP             30
+#define AUDIO_FRAMES    129         // ~3 seconds, 44100 Hz
+
+/*
+*   Assembled output file
+*/
+static buffer_t g_file;
+static int g_released[VIDEO_FRAMES];
+static int g_release_errors;
+static unsigned g_rand = 1;
+
+static unsigned random_bytes(unsigned max_bytes)
+{
+    g_rand = g_rand*1103515245 + 12345;
+    return 1 + (g_rand >> 16) % max_bytes;
+}
+
+/**
+*   Application release: data must be released once
+*/
+static void release_sample(void * release_token, const void * data)
+{
+    const unsigned char * p = (const unsigned char *)data;
+    int n = p[1]*256 + p[2];
+    g_release_errors += (release_token != (void *)g_released) || p[0] != 1 || g_released[n]++;
+    free((void *)data);
+}
+
+static int sample_bytes(int track, int i)
+{
+    return track ? 100 + (i*13 % 200) : 20 + (i*7 % 50);
+}
+
+/**
+*   Drain up to given number of bytes from the output chain to the file
+*   return 0 on success
+*/
+static int drain(MP4E_mux_t * mux, size_t max_bytes)
+{
+    const MP4E_output_t * output;
+    int count;
+    while (max_bytes && !MP4E__get_output(mux, &output, &count) && count)
+    {
+        size_t n = output->bytes < max_bytes ? output->bytes : max_bytes;
+        if (buffer_write(&g_file, output->offset, output->data, n))
+        {
+            return 1;
+        }
+        max_bytes -= n;
+        MP4E__confirm_output(mux, n);
+    }
+    return 0;
+}
+
+/**
+*   Multiplex test sequence: audio track 0 (copied), video track 1 (by reference).
+*   Sample data starts with track number and 16-bit sample number. Part of
+*   the output is drained after each sample.
+*   return 0 on success
+*/
+static int record(int fragmented)
+{
+    MP4E_params_t params = {0,};
+    const MP4E_output_t * output;
+    MP4E_mux_t * mux;
+    MP4E_track_t track;
+    int a = 0, v = 0, count, error = 0;
+    unsigned char * data;
+
+    memset(&g_file, 0, sizeof(g_file));
+    memset(g_released, 0, sizeof(g_released));
+    params.pull_output = 1;
+    params.enable_fragmentation = fragmented;
+    mux = MP4E__open_ex(&params);
+    if (!mux)
+    {
+        return 1;
+    }
+
+    memset(&track, 0, sizeof(track));
+    strcpy((char*)track.language, "und");
+    track.object_type_indication = MP4_OBJECT_TYPE_AUDIO_ISO_IEC_14496_3;
+    track.track_media_kind = e_audio;
+    track.u.a.channelcount = 2;
+    track.time_scale = 44100;
+    track.default_duration = 1024;
+    error |= MP4E__add_track(mux, &track) != 0;
+    error |= MP4E__set_dsi(mux, 0, g_dsi, sizeof(g_dsi));
+    track.object_type_indication = MP4_OBJECT_TYPE_AVC;
+    track.track_media_kind = e_video;
+    track.u.v.width = 320;
+    track.u.v.height = 240;
+    track.time_scale = 90000;
+    track.default_duration = 3000;
+    error |= MP4E__add_track(mux, &track) != 1;
+    error |= MP4E__set_sps(mux, 1, g_sps, sizeof(g_sps));
+    error |= MP4E__set_pps(mux, 1, g_pps, sizeof(g_pps));
+
+    while (a < AUDIO_FRAMES || v < VIDEO_FRAMES)
+    {
+        int audio = v >= VIDEO_FRAMES || (a < AUDIO_FRAMES && (double)a*1024/44100 < (double)v/30);
+        int n = audio ? a++ : v++;
+        data = (unsigned char *)malloc(sample_bytes(!audio, n));
+        memset(data, 0, sample_bytes(!audio, n));
+        data[0] = (unsigned char)!audio;
+        data[1] = (unsigned char)(n >> 8);
+        data[2] = (unsigned char)n;
+        if (audio)
+        {
+            error |= MP4E__put_sample(mux, 0, data, sample_bytes(0, n), 0, MP4E_SAMPLE_RANDOM_ACCESS);
+            free(data);
+        }
+        else
+        {
+            error |= MP4E__put_sample_ref(mux, 1, data, sample_bytes(1, n), 0,
+                (n % GOP) ? MP4E_SAMPLE_DEFAULT : MP4E_SAMPLE_RANDOM_ACCESS, release_sample, g_released);
+            // the last buffer references the sample
+            error |= MP4E__get_output(mux, &output, &count) || !count || output[count - 1].data != data;
+        }
+        error |= drain(mux, random_bytes(600));
+    }
+
+    // file index is added to the chain; samples are not accepted
+    error |= MP4E__finish(mux);
+    data = (unsigned char *)malloc(sample_bytes(1, 0));
+    data[0] = 1;
+    data[1] = data[2] = 0;
+    g_released[0]--;       // released by the multiplexer
+    error |= MP4E__put_sample_ref(mux, 1, data, sample_bytes(1, 0), 0, MP4E_SAMPLE_RANDOM_ACCESS,
+        release_sample, g_released) != MP4E_STATUS_BAD_ARGUMENTS;
+    while (!MP4E__get_output(mux, &output, &count) && count)
+    {
+        error |= drain(mux, random_bytes(4000));
+    }
+    error |= MP4E__close(mux);
+    return error;
+}
+
+/**
+*   Check, that each video sample is released once
+*/
+static int check_released(void)
+{
+    int i, ok = !g_release_errors;
+    for (i = 0; i < VIDEO_FRAMES; i++)
+    {
+        ok &= g_released[i] == 1;
+    }
+    return ok;
+}
+
+/**
+*   Read sample header from the file
+*/
+static int check_sample_data(FILE * f, mp4d_size_t offset, unsigned bytes, int track, int n)
+{
+    unsigned char head[3];
+    return !fseek(f, (long)offset, SEEK_SET) && 3 == fread(head, 1, 3, f) &&
+           head[0] == track && head[1]*256 + head[2] == n && bytes == (unsigned)sample_bytes(track, n);
+}
+
+/**
+*   Save assembled output, and check all samples, indexed in 'moov' or in fragments
+*   return 1 on success
+*/
+static int check_file(const char * file_name, int fragmented)
+{
+    FILE * f = fopen(file_name, "wb");
+    MP4D_demux_t mp4 = {0,};
+    unsigned ntrack, i, ok;
+    ok = f && g_file.bytes == fwrite(g_file.data, 1, g_file.bytes, f);
+    if (f)
+    {
+        fclose(f);
+    }
+    f = fopen(file_name, "rb");
+    if (!ok || !f || !MP4D__open(&mp4, f))
+    {
+        if (f)
+        {
+            fclose(f);
+        }
+        return 0;
+    }
+    ok = mp4.track_count == 2 && mp4.track[0].dsi_bytes == sizeof(g_dsi);
+    for (ntrack = 0; ok && ntrack < 2; ntrack++)
+    {
+        i = 0;
+        if (fragmented)
+        {
+            MP4D_fragment_t fragment = {0,};
+            mp4d_size_t offset;
+            for (ok = MP4D__seek_fragment(&mp4, 1, 0, &offset, NULL);
+                 ok && MP4D__read_fragment(&mp4, f, offset, ntrack, &fragment); offset = fragment.next_offset)
+            {
+                unsigned n;
+                for (n = 0; ok && n < fragment.sample_count; n++, i++)
+                {
+                    ok = check_sample_data(f, fragment.sample[n].offset, fragment.sample[n].bytes, ntrack, i);
+                }
+            }
+            MP4D__free_fragment(&mp4, &fragment);
+        }
+        else
+        {
+            for (i = 0; ok && i < mp4.track[ntrack].sample_count; i++)
+            {
+                unsigned frame_bytes, timestamp, duration;
+                mp4d_size_t ofs = MP4D__frame_offset(&mp4, ntrack, i, &frame_bytes, &timestamp, &duration);
+                ok = check_sample_data(f, ofs, frame_bytes, ntrack, i);
+            }
+        }
+        ok &= i == (ntrack ? VIDEO_FRAMES : AUDIO_FRAMES);
+    }
+    MP4D__close(&mp4);
+    fclose(f);
+    remove(file_name);
+    return ok;
+}
+
+int main(int argc, char* argv[])
+{
+    const char * file_name = (argc > 1) ? argv[1] : "pull_test.mp4";
+    int fragmented, fail = 0;
+
+    for (fragmented = 0; fragmented < 2; fragmented++)
+    {
+        if (record(fragmented) || !check_released() || !check_file(file_name, fragmented))
+        {
+            printf("pull test failed: %s\n", fragmented ? "fragmented" : "progressive");
+            fail = 1;
+        }
+        free(g_file.data);
+    }
+    return fail;
+}
@@ -0,0 +1,200 @@
+/** 18.10.2026 @file
+*
+*   Audio and video threads feed one multiplexer through the sample queue.
+*   Check with demultiplexer, that all samples are stored, and, when the queue
+*   is large enough, that tracks are interleaved by timestamp.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <pthread.h>
+#include "mp4demux.h"
+#include "mp4mux.h"
+#include "mp4queue.h"
+#include "mp4test_util.h"
+
+#define AUDIO_FRAMES    200
+#define VIDEO_FRAMES    140
+
+typedef struct
+{
+    MP4Q_queue_t * q;
+    int track_id;
+    int frames;
+    int time_scale;
+    int duration;
+    int full_count;                 // number of MP4E_STATUS_QUEUE_FULL results
+    int error;
+} producer_t;
+
+static int g_producers_done;
+static int g_released;
+
+static void release_sample(void * release_token, const void * data)
+{
+    (void)release_token;
+    free((void*)data);
+    __atomic_add_fetch(&g_released, 1, __ATOMIC_RELAXED);
+}
+
+/**
+*   Encoder thread: sample data is track ID, sample number, and filler
+*/
+static void * producer(void * arg)
+{
+    producer_t * p = (producer_t *)arg;
+    int i;
+    for (i = 0; i < p->frames; i++)
+    {
+        int bytes = 8 + (i*7 % 100);
+        unsigned char * data = (unsigned char *)malloc(bytes);
+        int result;
+        memset(data, i, bytes);
+        data[0] = (unsigned char)p->track_id;
+        data[1] = (unsigned char)(i >> 8);
+        data[2] = (unsigned char)i;
+        while (MP4E_STATUS_QUEUE_FULL == (result = MP4Q__put_sample(p->q, p->track_id, data, bytes,
+            (double)i*p->duration/p->time_scale, p->duration, MP4E_SAMPLE_RANDOM_ACCESS, release_sample, NULL)))
+        {
+            p->full_count++;
+            sched_yield();
+        }
+        p->error |= result != MP4E_STATUS_OK;
+    }
+    __atomic_add_fetch(&g_producers_done, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+/**
+*   Check output file; return 1 on success
+*/
+static int check(const char * file_name, int check_order)
+{
+    FILE * f = fopen(file_name, "rb");
+    MP4D_demux_t mp4 = {0,};
+    unsigned ntrack, i, j, ok;
+    mp4d_size_t last_offset = 0;
+    double last_time = -1;
+
+    if (!f || !MP4D__open(&mp4, f))
+    {
+        return 0;
+    }
+    ok = mp4.track_count == 2 && mp4.track[0].sample_count == AUDIO_FRAMES && mp4.track[1].sample_count == VIDEO_FRAMES;
+    for (ntrack = 0; ok && ntrack < mp4.track_count; ntrack++)
+    {
+        for (i = 0; ok && i < mp4.track[ntrack].sample_count; i++)
+        {
+            unsigned frame_bytes, timestamp, duration;
+            unsigned char head[3];
+            mp4d_size_t ofs = MP4D__frame_offset(&mp4, ntrack, i, &frame_bytes, &timestamp, &duration);
+            fseek(f, (long)ofs, SEEK_SET);
+            ok = frame_bytes == 8 + (i*7 % 100) && 3 == fread(head, 1, 3, f) &&
+                 head[0] == ntrack && head[1] == (i >> 8 & 0xFF) && head[2] == (i & 0xFF);
+        }
+    }
+
+    // walk samples of both tracks in the file order: timestamps must not decrease
+    for (i = j = 0; ok && check_order && (i < AUDIO_FRAMES || j < VIDEO_FRAMES);)
+    {
+        unsigned frame_bytes, duration, ta, tv;
+        mp4d_size_t oa = i < AUDIO_FRAMES ? MP4D__frame_offset(&mp4, 0, i, &frame_bytes, &ta, &duration) : (mp4d_size_t)-1;
+        mp4d_size_t ov = j < VIDEO_FRAMES ? MP4D__frame_offset(&mp4, 1, j, &frame_bytes, &tv, &duration) : (mp4d_size_t)-1;
+        mp4d_size_t ofs;
+        double t;
+        if (oa < ov)
+        {
+            t = (double)ta / mp4.track[0].timescale;
+            ofs = oa;
+            i++;
+        }
+        else
+        {
+            t = (double)tv / mp4.track[1].timescale;
+            ofs = ov;
+            j++;
+        }
+        ok = ofs > last_offset && t >= last_time - 1e-9;
+        last_offset = ofs;
+        last_time = t;
+    }
+    MP4D__close(&mp4);
+    fclose(f);
+    return ok;
+}
+
+int main(int argc, char* argv[])
+{
+    static const unsigned capacity[] = { 4, 1024 };
+    const char * file_name = (argc > 1) ? argv[1] : "queue_test.mp4";
+    unsigned test;
+    int fail = 0;
+
+    for (test = 0; test < sizeof(capacity)/sizeof(capacity[0]); test++)
+    {
+        MP4E_mux_t * mux = MP4E__open(fopen(file_name, "wb"), 0);
+        MP4Q_params_t params = {0,};
+        MP4E_track_t track;
+        producer_t audio, video;
+        pthread_t audio_thread, video_thread;
+        int error = 0;
+
+        memset(&track, 0, sizeof(track));
+        strcpy((char*)track.language, "und");
+        track.object_type_indication = MP4_OBJECT_TYPE_AUDIO_ISO_IEC_14496_3;
+        track.track_media_kind = e_audio;
+        track.u.a.channelcount = 2;
+        track.time_scale = 44100;
+        track.default_duration = 1024;
+        MP4E__add_track(mux, &track);
+        MP4E__set_dsi(mux, 0, g_dsi, sizeof(g_dsi));
+        track.object_type_indication = MP4_OBJECT_TYPE_AVC;
+        track.track_media_kind = e_video;
+        track.u.v.width = 320;
+        track.u.v.height = 240;
+        track.time_scale = 90000;
+        track.default_duration = 3000;
+        MP4E__add_track(mux, &track);
+        MP4E__set_sps(mux, 1, g_sps, sizeof(g_sps));
+        MP4E__set_pps(mux, 1, g_pps, sizeof(g_pps));
+
+        params.capacity = capacity[test];
+        params.track_count = 2;
+        memset(&audio, 0, sizeof(audio));
+        memset(&video, 0, sizeof(video));
+        audio.q = video.q = MP4Q__open(mux, &params);
+        audio.track_id = 0;
+        audio.frames = AUDIO_FRAMES;
+        audio.time_scale = 44100;
+        audio.duration = 1024;
+        video.track_id = 1;
+        video.frames = VIDEO_FRAMES;
+        video.time_scale = 90000;
+        video.duration = 3000;
+
+        g_producers_done = 0;
+        g_released = 0;
+        pthread_create(&audio_thread, NULL, producer, &audio);
+        pthread_create(&video_thread, NULL, producer, &video);
+        while (__atomic_load_n(&g_producers_done, __ATOMIC_ACQUIRE) < 2)
+        {
+            error |= MP4Q__drain(audio.q, 0) < 0;
+            sched_yield();
+        }
+        pthread_join(audio_thread, NULL);
+        pthread_join(video_thread, NULL);
+        error |= MP4Q__close(audio.q);
+        error |= MP4E__close(mux);
+        error |= audio.error | video.error;
+
+        if (error || g_released != AUDIO_FRAMES + VIDEO_FRAMES || !check(file_name, capacity[test] > AUDIO_FRAMES + VIDEO_FRAMES))
+        {
+            printf("queue test failed: capacity %u\n", capacity[test]);
+            fail = 1;
+        }
+    }
+    remove(file_name);
+    return fail;
+}
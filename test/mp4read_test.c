@@ -0,0 +1,184 @@
+/** 18.10.2026 @file
+*
+*   Check concurrent queries: several threads read all samples of one shared
+*   demultiplexer with MP4D__read_sample() from one file descriptor, and call
+*   other read-only functions. Sample data must match sequential fseek() and
+*   fread(); the demultiplexer and the FILE position must not be changed.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "mp4demux.h"
+
+#define THREAD_COUNT    8
+#define MAX_FRAME_BYTES (1024*1024)
+
+static MP4D_demux_t g_mp4;
+static int g_fd;
+static unsigned * g_hash[64];   // [track][sample] reference sample data hash
+
+static unsigned hash(const unsigned char * p, unsigned bytes, unsigned h)
+{
+    // FNV-1a
+    while (bytes--)
+    {
+        h = (h ^ *p++)*16777619u;
+    }
+    return h;
+}
+
+/**
+*   Hash of the demultiplexer data
+*/
+static unsigned demux_hash(const MP4D_demux_t * mp4)
+{
+    unsigned h = hash((const unsigned char *)mp4, sizeof(*mp4), 2166136261u), i;
+    for (i = 0; i < mp4->track_count; i++)
+    {
+        const MP4D_track_t * tr = mp4->track + i;
+        h = hash((const unsigned char *)tr, sizeof(*tr), h);
+        h = hash((const unsigned char *)tr->entry_size, tr->sample_count*sizeof(unsigned), h);
+        h = hash((const unsigned char *)tr->timestamp, tr->sample_count*sizeof(unsigned), h);
+        h = hash((const unsigned char *)tr->duration, tr->sample_count*sizeof(unsigned), h);
+        h = hash((const unsigned char *)tr->chunk_offset, tr->chunk_count*sizeof(mp4d_size_t), h);
+        h = hash((const unsigned char *)tr->sample_to_chunk, tr->sample_to_chunk_count*sizeof(MP4D_sample_to_chunk_t), h);
+        h = hash((const unsigned char *)tr->random_access, tr->random_access_count*sizeof(MP4D_random_access_t), h);
+        h = hash(tr->dsi, tr->dsi_bytes, h);
+    }
+    return h;
+}
+
+/**
+*   Read reference sample data with fseek() and fread()
+*   return 1 on success
+*/
+static int read_reference(FILE * f)
+{
+    static unsigned char buf[MAX_FRAME_BYTES];
+    unsigned ntrack, i;
+    for (ntrack = 0; ntrack < g_mp4.track_count; ntrack++)
+    {
+        g_hash[ntrack] = (unsigned *)malloc((g_mp4.track[ntrack].sample_count + 1)*sizeof(unsigned));
+        for (i = 0; i < g_mp4.track[ntrack].sample_count; i++)
+        {
+            unsigned bytes;
+            mp4d_size_t offset = MP4D__frame_offset(&g_mp4, ntrack, i, &bytes, NULL, NULL);
+            if (!g_hash[ntrack] || bytes > sizeof(buf) || fseek(f, (long)offset, SEEK_SET) || fread(buf, 1, bytes, f) != bytes)
+            {
+                return 0;
+            }
+            g_hash[ntrack][i] = hash(buf, bytes, 2166136261u);
+        }
+    }
+    return 1;
+}
+
+static void * reader_thread(void * arg)
+{
+    unsigned char * buf = (unsigned char *)malloc(MAX_FRAME_BYTES);
+    unsigned start = (unsigned)(size_t)arg, ntrack, i;
+    size_t errors = !buf;
+    for (ntrack = 0; buf && ntrack < g_mp4.track_count; ntrack++)
+    {
+        const MP4D_track_t * tr = g_mp4.track + ntrack;
+        for (i = 0; i < tr->sample_count; i++)
+        {
+            // each thread starts at different sample
+            unsigned n = (i + start*tr->sample_count/THREAD_COUNT) % tr->sample_count;
+            unsigned bytes, timestamp, duration, expected_bytes, expected_timestamp, expected_duration;
+            mp4d_size_t moof_offset;
+            int sps_bytes;
+            MP4D__frame_offset(&g_mp4, ntrack, n, &expected_bytes, &expected_timestamp, &expected_duration);
+            errors += !MP4D__read_sample(&g_mp4, g_fd, ntrack, n, buf, MAX_FRAME_BYTES, &bytes, &timestamp, &duration) ||
+                      bytes != expected_bytes || timestamp != expected_timestamp || duration != expected_duration ||
+                      hash(buf, bytes, 2166136261u) != g_hash[ntrack][n];
+            MP4D__seek_fragment(&g_mp4, ntrack, timestamp, &moof_offset, NULL);
+            MP4D__read_sps(&g_mp4, ntrack, 0, &sps_bytes);
+            MP4D__read_pps(&g_mp4, ntrack, 0, &sps_bytes);
+        }
+    }
+    free(buf);
+    return (void *)errors;
+}
+
+/**
+*   return 1 on success
+*/
+static int test_file(const char * file_name)
+{
+    static unsigned char buf[16];
+    pthread_t threads[THREAD_COUNT];
+    FILE * f = fopen(file_name, "rb");
+    unsigned ntrack, before, bytes = 0;
+    size_t i, errors = 0;
+    long position;
+    int ok = f && MP4D__open(&g_mp4, f);
+    if (!ok)
+    {
+        if (f)
+        {
+            fclose(f);
+        }
+        return 0;
+    }
+    memset(g_hash, 0, sizeof(g_hash));
+    ok = g_mp4.track_count <= 64 && read_reference(f) && !fseek(f, 0, SEEK_SET);
+    g_fd = fileno(f);
+    before = demux_hash(&g_mp4);
+    position = ftell(f);
+
+    for (i = 0; ok && i < THREAD_COUNT; i++)
+    {
+        ok = !pthread_create(threads + i, NULL, reader_thread, (void *)i);
+    }
+    while (i--)
+    {
+        void * result;
+        pthread_join(threads[i], &result);
+        errors += (size_t)result;
+    }
+    ok = ok && !errors && demux_hash(&g_mp4) == before && ftell(f) == position;
+
+    // invalid arguments, small buffer
+    ok = ok && g_mp4.track_count && g_mp4.track[0].sample_count &&
+         !MP4D__read_sample(&g_mp4, g_fd, g_mp4.track_count, 0, buf, sizeof(buf), &bytes, NULL, NULL) &&
+         !MP4D__read_sample(&g_mp4, g_fd, 0, g_mp4.track[0].sample_count, buf, sizeof(buf), &bytes, NULL, NULL) &&
+         !MP4D__read_sample(&g_mp4, -1, 0, 0, buf, sizeof(buf), &bytes, NULL, NULL);
+    MP4D__frame_offset(&g_mp4, 0, 0, &bytes, NULL, NULL);
+    if (ok && bytes > 0)
+    {
+        unsigned small_bytes = 0;
+        ok = !MP4D__read_sample(&g_mp4, g_fd, 0, 0, buf, bytes - 1, &small_bytes, NULL, NULL) && small_bytes == bytes;
+    }
+
+    for (ntrack = 0; ntrack < g_mp4.track_count && ntrack < 64; ntrack++)
+    {
+        free(g_hash[ntrack]);
+    }
+    MP4D__close(&g_mp4);
+    fclose(f);
+    return ok;
+}
+
+int main(int argc, char* argv[])
+{
+    static const char * files[] =
+    {
+        "vectors/ref/mp4mux_file.mp4", "vectors/ref/mp4mux_stream.mp4", "vectors/ref/transcoded.mp4"
+    };
+    int i, fail = 0;
+    (void)argc;
+    (void)argv;
+
+    for (i = 0; i < 3; i++)
+    {
+        if (!test_file(files[i]))
+        {
+            printf("read test failed: %s\n", files[i]);
+            fail = 1;
+        }
+    }
+    return fail;
+}
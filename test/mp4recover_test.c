@@ -0,0 +1,357 @@
+/** 18.10.2026 @file
+*
+*   Record audio and H.264 video in streaming mode (each sample in its own
+*   'mdat' box, index at the end of file), and simulate crash: cut the index
+*   and the end of the last sample. Check, that MP4E__recover_stream() makes
+*   the file readable, with all complete samples, and with key frames, found
+*   from NAL unit types. Check, that track configurations, which samples
+*   can't be assigned to by content, are rejected.
+*
+*   Build with -DMP4E_CAN_USE_RANDOM_FILE_ACCESS=0
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mp4demux.h"
+#include "mp4mux.h"
+#include "mp4test_util.h"
+
+#define VIDEO_FRAMES    150         // 5 seconds, 30 fps
+#define GOP             30
+#define AUDIO_FRAMES    215         // 5 seconds, 44100 Hz
+
+static unsigned read_u32(const unsigned char * p)
+{
+    return ((unsigned)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static int sample_bytes(int track, int i)
+{
+    return track ? 100 + i : 30 + i % 20;
+}
+
+/**
+*   Fill video sample: access unit delimiter, and slice NAL unit, IDR for key frame.
+*   Audio sample starts with 0xFF byte, so it is not parsed as NAL unit chain.
+*/
+static void make_sample(unsigned char * frame, int track, int i)
+{
+    int bytes = sample_bytes(track, i);
+    memset(frame, 0, bytes);
+    if (track)
+    {
+        frame[3] = 2;
+        frame[4] = 0x09;                            // access unit delimiter
+        frame[5] = 0x10;
+        frame[9] = (unsigned char)(bytes - 10);
+        frame[10] = (i % GOP) ? 0x41 : 0x65;        // non-IDR or IDR slice
+        frame[11] = (unsigned char)i;
+    }
+    else
+    {
+        frame[0] = 0xFF;
+        frame[11] = (unsigned char)i;
+    }
+}
+
+static void set_tracks(MP4E_recover_track_t tracks[2])
+{
+    MP4E_track_t * track = &tracks[0].info;
+    memset(tracks, 0, 2*sizeof(MP4E_recover_track_t));
+    strcpy((char*)track->language, "und");
+    track->object_type_indication = MP4_OBJECT_TYPE_AUDIO_ISO_IEC_14496_3;
+    track->track_media_kind = e_audio;
+    track->u.a.channelcount = 2;
+    track->time_scale = 44100;
+    track->default_duration = 1024;
+    tracks[0].dsi = g_dsi;
+    tracks[0].dsi_bytes = sizeof(g_dsi);
+    track = &tracks[1].info;
+    strcpy((char*)track->language, "und");
+    track->object_type_indication = MP4_OBJECT_TYPE_AVC;
+    track->track_media_kind = e_video;
+    track->u.v.width = 320;
+    track->u.v.height = 240;
+    track->time_scale = 90000;
+    track->default_duration = 3000;
+    tracks[1].sps = g_sps;
+    tracks[1].sps_bytes = sizeof(g_sps);
+    tracks[1].pps = g_pps;
+    tracks[1].pps_bytes = sizeof(g_pps);
+}
+
+/**
+*   Record test sequence: audio track 0, video track 1
+*   return 0 on success
+*/
+static int record(const char * file_name)
+{
+    static unsigned char frame[300];
+    MP4E_recover_track_t tracks[2];
+    MP4E_mux_t * mux = MP4E__open(fopen(file_name, "wb"), 0);
+    int a = 0, v = 0, error = 0;
+
+    if (!mux)
+    {
+        return 1;
+    }
+    set_tracks(tracks);
+    MP4E__add_track(mux, &tracks[0].info);
+    MP4E__set_dsi(mux, 0, g_dsi, sizeof(g_dsi));
+    MP4E__add_track(mux, &tracks[1].info);
+    MP4E__set_sps(mux, 1, g_sps, sizeof(g_sps));
+    MP4E__set_pps(mux, 1, g_pps, sizeof(g_pps));
+
+    while (a < AUDIO_FRAMES || v < VIDEO_FRAMES)
+    {
+        if (v >= VIDEO_FRAMES || (a < AUDIO_FRAMES && (double)a*1024/44100 < (double)v/30))
+        {
+            make_sample(frame, 0, a);
+            error |= MP4E__put_sample(mux, 0, frame, sample_bytes(0, a), 0, MP4E_SAMPLE_RANDOM_ACCESS);
+            a++;
+        }
+        else
+        {
+            make_sample(frame, 1, v);
+            error |= MP4E__put_sample(mux, 1, frame, sample_bytes(1, v), 0,
+                (v % GOP) ? MP4E_SAMPLE_DEFAULT : MP4E_SAMPLE_RANDOM_ACCESS);
+            v++;
+        }
+    }
+    error |= MP4E__close(mux);
+    return error;
+}
+
+/**
+*   Read file to memory; return number of bytes, or 0 on failure
+*/
+static size_t load(const char * file_name, unsigned char ** data)
+{
+    FILE * f = fopen(file_name, "rb");
+    long bytes = 0;
+    *data = NULL;
+    if (f && !fseek(f, 0, SEEK_END) && (bytes = ftell(f)) > 0 && !fseek(f, 0, SEEK_SET) &&
+        (*data = (unsigned char *)malloc(bytes)) != NULL && fread(*data, 1, bytes, f) != (size_t)bytes)
+    {
+        bytes = 0;
+    }
+    if (f)
+    {
+        fclose(f);
+    }
+    return (size_t)bytes;
+}
+
+/**
+*   Find the box with given type at any level in memory; return NULL if not found
+*/
+static const unsigned char * find_box(const unsigned char * p, const unsigned char * end, uint32_t box_name)
+{
+    while (p + 8 <= end && read_u32(p) >= 8)
+    {
+        if (read_u32(p + 4) == box_name)
+        {
+            return p;
+        }
+        if (read_u32(p + 4) == BOX_moov || read_u32(p + 4) == BOX_trak || read_u32(p + 4) == BOX_mdia ||
+            read_u32(p + 4) == BOX_minf || read_u32(p + 4) == BOX_stbl)
+        {
+            const unsigned char * box = find_box(p + 8, p + read_u32(p), box_name);
+            if (box)
+            {
+                return box;
+            }
+        }
+        p += read_u32(p);
+    }
+    return NULL;
+}
+
+/**
+*   Read recovered file with demultiplexer: check number of samples, and
+*   sample data; check, that 'stss' box lists video key frames.
+*   return 1 on success
+*/
+static int check_file(const char * file_name, unsigned video_samples, unsigned audio_samples)
+{
+    FILE * f = fopen(file_name, "rb");
+    MP4D_demux_t mp4 = {0,};
+    unsigned char * data;
+    const unsigned char * moov, * stss;
+    size_t bytes;
+    unsigned ntrack, i, ok;
+    if (!f || !MP4D__open(&mp4, f))
+    {
+        if (f)
+        {
+            fclose(f);
+        }
+        return 0;
+    }
+    ok = mp4.track_count == 2 && mp4.track[0].sample_count == audio_samples &&
+         mp4.track[1].sample_count == video_samples && mp4.track[0].dsi_bytes == sizeof(g_dsi) &&
+         mp4.track[1].dsi_bytes > 0 && mp4.track[1].SampleDescription.video.width == 320;
+    for (ntrack = 0; ok && ntrack < 2; ntrack++)
+    {
+        for (i = 0; ok && i < mp4.track[ntrack].sample_count; i++)
+        {
+            unsigned frame_bytes, timestamp, duration;
+            unsigned char head[12];
+            mp4d_size_t ofs = MP4D__frame_offset(&mp4, ntrack, i, &frame_bytes, &timestamp, &duration);
+            fseek(f, (long)ofs, SEEK_SET);
+            ok = frame_bytes == (unsigned)sample_bytes(ntrack, i) && sizeof(head) == fread(head, 1, sizeof(head), f) &&
+                 head[11] == (unsigned char)i && timestamp == i*(ntrack ? 3000u : 1024u);
+        }
+    }
+    MP4D__close(&mp4);
+    fclose(f);
+
+    // 'stss' box of audio track is omitted; video one lists key frames
+    bytes = load(file_name, &data);
+    moov = data ? find_box(data, data + bytes, BOX_moov) : NULL;
+    stss = moov ? find_box(moov + 8, moov + read_u32(moov), BOX_stss) : NULL;
+    ok &= stss && read_u32(stss + 12) == (video_samples + GOP - 1)/GOP;
+    for (i = 0; ok && i < read_u32(stss + 12); i++)
+    {
+        ok = read_u32(stss + 16 + 4*i) == i*GOP + 1;
+    }
+    free(data);
+    return ok;
+}
+
+/**
+*   Write first given bytes of recorded file, and try to recover it with
+*   unsupported track configuration: 3 tracks of mp4mux_stream layout (audio,
+*   AVC and private), or 2 AVC tracks
+*   return 1, if recovery is rejected, and the file is not changed
+*/
+static int check_rejection(const char * file_name, const unsigned char * data, size_t bytes)
+{
+    MP4E_recover_track_t tracks[3];
+    FILE * f;
+    int ok = 1, layout;
+    for (layout = 0; layout < 2; layout++)
+    {
+        set_tracks(tracks);
+        tracks[2] = tracks[layout ? 1 : 0];
+        if (!layout)
+        {
+            tracks[2].info.track_media_kind = e_private;
+            tracks[2].info.object_type_indication = MP4_OBJECT_TYPE_USER_PRIVATE;
+        }
+        f = fopen(file_name, "wb");
+        ok &= f && bytes == fwrite(data, 1, bytes, f);
+        if (f)
+        {
+            fclose(f);
+        }
+        f = fopen(file_name, "r+b");
+        ok &= f && MP4E__recover_stream(f, tracks, 3) == MP4E_STATUS_BAD_ARGUMENTS &&
+              !fseek(f, 0, SEEK_END) && ftell(f) == (long)bytes;
+        if (f)
+        {
+            fclose(f);
+        }
+    }
+    return ok;
+}
+
+/**
+*   Write first given bytes of recorded file, recover it, and check
+*   return 1 on success
+*/
+static int check_recovery(const char * file_name, const unsigned char * data, size_t bytes,
+                          unsigned video_samples, unsigned audio_samples)
+{
+    MP4E_recover_track_t tracks[2];
+    FILE * f = fopen(file_name, "wb");
+    int ok = f && bytes == fwrite(data, 1, bytes, f);
+    if (f)
+    {
+        fclose(f);
+    }
+    set_tracks(tracks);
+    f = fopen(file_name, "r+b");
+    ok &= f && MP4E__recover_stream(f, tracks, 2) == MP4E_STATUS_OK;
+    if (f)
+    {
+        fclose(f);
+    }
+    return ok && check_file(file_name, video_samples, audio_samples);
+}
+
+int main(int argc, char* argv[])
+{
+    const char * file_name = (argc > 1) ? argv[1] : "recover_test.mp4";
+    MP4E_recover_track_t tracks[2];
+    unsigned char * data;
+    size_t bytes, moov_pos, pos;
+    unsigned last_bytes;
+    FILE * f;
+    int fail = 0;
+
+    bytes = record(file_name) ? 0 : load(file_name, &data);
+    moov_pos = 0;
+    for (pos = 0; pos + 8 <= bytes && read_u32(data + pos) >= 8; pos += read_u32(data + pos))
+    {
+        if (read_u32(data + pos + 4) == BOX_moov)
+        {
+            moov_pos = pos;
+        }
+    }
+    // the last sample is audio one
+    last_bytes = sample_bytes(0, AUDIO_FRAMES - 1);
+    if (!moov_pos || read_u32(data + moov_pos - last_bytes - 8) != last_bytes + 8)
+    {
+        printf("recover test failed: record\n");
+        free(data);
+        return 1;
+    }
+
+    // complete file is not changed
+    set_tracks(tracks);
+    f = fopen(file_name, "r+b");
+    if (!f || MP4E__recover_stream(f, tracks, 2) != MP4E_STATUS_OK || fseek(f, 0, SEEK_END) ||
+        ftell(f) != (long)bytes || !check_file(file_name, VIDEO_FRAMES, AUDIO_FRAMES))
+    {
+        printf("recover test failed: complete file\n");
+        fail = 1;
+    }
+    if (f)
+    {
+        fclose(f);
+    }
+
+    // crash before 'moov'; in the middle of sample; in the middle of 'mdat' header
+    if (!check_recovery(file_name, data, moov_pos, VIDEO_FRAMES, AUDIO_FRAMES) ||
+        !check_recovery(file_name, data, moov_pos - 5, VIDEO_FRAMES, AUDIO_FRAMES - 1) ||
+        !check_recovery(file_name, data, moov_pos - last_bytes - 4, VIDEO_FRAMES, AUDIO_FRAMES - 1))
+    {
+        printf("recover test failed: recovery\n");
+        fail = 1;
+    }
+
+    // samples can't be assigned to 3 tracks
+    if (!check_rejection(file_name, data, moov_pos))
+    {
+        printf("recover test failed: track configuration\n");
+        fail = 1;
+    }
+
+    // no samples
+    f = fopen(file_name, "w+b");
+    if (!f || fwrite(data, 1, read_u32(data), f) != read_u32(data) || fflush(f) ||
+        MP4E__recover_stream(f, tracks, 2) != MP4E_STATUS_NOT_RECOVERABLE)
+    {
+        printf("recover test failed: empty file\n");
+        fail = 1;
+    }
+    if (f)
+    {
+        fclose(f);
+    }
+    remove(file_name);
+    free(data);
+    return fail;
+}
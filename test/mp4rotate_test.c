@@ -0,0 +1,250 @@
+/** 18.10.2026 @file
+*
+*   Record audio and video with output rotation by duration and by size.
+*   Finished files are closed after recording, as in the background. Check,
+*   that each file starts with video key frame, holds its samples from time 0,
+*   that files together hold all samples, and that cancelled rotation is
+*   retried at the next key frame.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mp4demux.h"
+#include "mp4mux.h"
+#include "mp4test_util.h"
+
+#define VIDEO_FRAMES    300         // 10 seconds, 30 fps
+#define GOP             30
+#define AUDIO_FRAMES    431         // 10 seconds, 44100 Hz
+#define MAX_FILES       8
+
+static const char * g_file_name;
+static MP4E_mux_t * g_finished[MAX_FILES];
+static int g_finished_count;
+static int g_cancel;                // # of rotations to cancel
+
+static void make_file_name(char * name, int file_number)
+{
+    sprintf(name, "%s.%d", g_file_name, file_number);
+}
+
+static int on_rotate(void * rotate_token, int file_number, MP4E_mux_t * finished, FILE ** mp4file, MP4E_sink_t * sink)
+{
+    char name[256];
+    (void)rotate_token;
+    (void)sink;
+    if (g_cancel)
+    {
+        g_cancel--;
+        return 1;
+    }
+    if (g_finished_count >= MAX_FILES || file_number != g_finished_count + 2)
+    {
+        return 1;
+    }
+    make_file_name(name, file_number);
+    *mp4file = fopen(name, "wb");
+    g_finished[g_finished_count++] = finished;
+    return 0;
+}
+
+static int sample_bytes(int track, int i)
+{
+    return track ? 100 + i % 200 : 30 + i % 20;
+}
+
+/**
+*   Record test sequence: audio track 0, video track 1. Sample data starts
+*   with track number, and 16-bit sample number.
+*   return 0 on success
+*/
+static int record(MP4E_params_t * params)
+{
+    static unsigned char frame[300];
+    char name[256];
+    MP4E_mux_t * mux;
+    MP4E_track_t track;
+    int a = 0, v = 0, i, error = 0;
+
+    make_file_name(name, 1);
+    params->mp4file = fopen(name, "wb");
+    params->rotate = on_rotate;
+    g_finished_count = 0;
+    mux = MP4E__open_ex(params);
+    if (!mux)
+    {
+        return 1;
+    }
+
+    memset(&track, 0, sizeof(track));
+    strcpy((char*)track.language, "und");
+    track.object_type_indication = MP4_OBJECT_TYPE_AUDIO_ISO_IEC_14496_3;
+    track.track_media_kind = e_audio;
+    track.u.a.channelcount = 2;
+    track.time_scale = 44100;
+    track.default_duration = 1024;
+    MP4E__add_track(mux, &track);
+    MP4E__set_dsi(mux, 0, g_dsi, sizeof(g_dsi));
+    track.object_type_indication = MP4_OBJECT_TYPE_AVC;
+    track.track_media_kind = e_video;
+    track.u.v.width = 320;
+    track.u.v.height = 240;
+    track.time_scale = 90000;
+    track.default_duration = 3000;
+    MP4E__add_track(mux, &track);
+    MP4E__set_sps(mux, 1, g_sps, sizeof(g_sps));
+    MP4E__set_pps(mux, 1, g_pps, sizeof(g_pps));
+    MP4E__set_text_comment(mux, "rotation");
+
+    while (a < AUDIO_FRAMES || v < VIDEO_FRAMES)
+    {
+        if (v >= VIDEO_FRAMES || (a < AUDIO_FRAMES && (double)a*1024/44100 < (double)v/30))
+        {
+            frame[0] = 0;
+            frame[1] = (unsigned char)(a >> 8);
+            frame[2] = (unsigned char)a;
+            error |= MP4E__put_sample(mux, 0, frame, sample_bytes(0, a), 0, MP4E_SAMPLE_RANDOM_ACCESS);
+            a++;
+        }
+        else
+        {
+            frame[0] = 1;
+            frame[1] = (unsigned char)(v >> 8);
+            frame[2] = (unsigned char)v;
+            error |= MP4E__put_sample(mux, 1, frame, sample_bytes(1, v), 0,
+                (v % GOP) ? MP4E_SAMPLE_DEFAULT : MP4E_SAMPLE_RANDOM_ACCESS);
+            v++;
+        }
+    }
+    error |= MP4E__close(mux);
+
+    // finalize previous files later
+    for (i = 0; i < g_finished_count; i++)
+    {
+        error |= MP4E__close(g_finished[i]);
+    }
+    return error;
+}
+
+/**
+*   Check one file: tracks configuration, samples continue from the previous
+*   file, and start from time 0; video starts with key frame.
+*   next_sample [IN/OUT]: number of the 1st sample of the file for each track
+*   return 1 on success
+*/
+static int check_file(int file_number, int next_sample[2], int fragmented)
+{
+    char name[256];
+    FILE * f;
+    MP4D_demux_t mp4 = {0,};
+    unsigned ntrack, i, ok;
+
+    make_file_name(name, file_number);
+    f = fopen(name, "rb");
+    if (!f || !MP4D__open(&mp4, f))
+    {
+        if (f)
+        {
+            fclose(f);
+        }
+        return 0;
+    }
+    ok = mp4.track_count == 2 && mp4.track[0].dsi_bytes == sizeof(g_dsi) && mp4.track[1].dsi_bytes > 0 &&
+         mp4.track[1].SampleDescription.video.width == 320 && (fragmented || mp4.track[1].sample_count > 0) &&
+         !next_sample[1] == (file_number == 1) && !(next_sample[1] % GOP) &&
+         (fragmented || (mp4.tag.comment && !strcmp((const char*)mp4.tag.comment, "rotation")));
+    for (ntrack = 0; ok && ntrack < 2; ntrack++)
+    {
+        if (fragmented)
+        {
+            // samples are listed in 'moof' boxes
+            MP4D_fragment_t fragment = {0,};
+            mp4d_size_t offset;
+            for (ok = MP4D__seek_fragment(&mp4, 1, 0, &offset, NULL), i = 0;
+                 ok && MP4D__read_fragment(&mp4, f, offset, ntrack, &fragment); offset = fragment.next_offset)
+            {
+                unsigned n;
+                for (n = 0; ok && n < fragment.sample_count; n++, i++)
+                {
+                    unsigned char head[3];
+                    const MP4D_fragment_sample_t * sample = fragment.sample + n;
+                    int k = next_sample[ntrack] + i;
+                    ok = !fseek(f, (long)sample->offset, SEEK_SET) && 3 == fread(head, 1, 3, f) &&
+                         head[0] == ntrack && head[1]*256 + head[2] == k && sample->bytes == (unsigned)sample_bytes(ntrack, k) &&
+                         sample->timestamp == i*(ntrack ? 3000u : 1024u);
+                }
+            }
+            MP4D__free_fragment(&mp4, &fragment);
+            next_sample[ntrack] += i;
+            continue;
+        }
+        for (i = 0; ok && i < mp4.track[ntrack].sample_count; i++)
+        {
+            unsigned frame_bytes, timestamp, duration;
+            unsigned char head[3];
+            int k = next_sample[ntrack] + i;
+            mp4d_size_t ofs = MP4D__frame_offset(&mp4, ntrack, i, &frame_bytes, &timestamp, &duration);
+            fseek(f, (long)ofs, SEEK_SET);
+            ok = frame_bytes == (unsigned)sample_bytes(ntrack, k) && 3 == fread(head, 1, 3, f) &&
+                 head[0] == ntrack && head[1]*256 + head[2] == k && timestamp == i*(ntrack ? 3000u : 1024u);
+        }
+        next_sample[ntrack] += mp4.track[ntrack].sample_count;
+    }
+    MP4D__close(&mp4);
+    fclose(f);
+    remove(name);
+    return ok;
+}
+
+/**
+*   Check all files of the recording; return number of files, or 0 on failure
+*/
+static int check_files(int fragmented)
+{
+    int next_sample[2] = { 0, 0 };
+    int i, ok = 1;
+    for (i = 1; i <= g_finished_count + 1; i++)
+    {
+        ok &= check_file(i, next_sample, fragmented);
+    }
+    ok &= next_sample[0] == AUDIO_FRAMES && next_sample[1] == VIDEO_FRAMES;
+    return ok ? g_finished_count + 1 : 0;
+}
+
+int main(int argc, char* argv[])
+{
+    MP4E_params_t params;
+    int fail = 0;
+    g_file_name = (argc > 1) ? argv[1] : "rotate_test.mp4";
+
+    // by duration: files start at the 1st key frame after 2.5 s: 0, 3, 6, 9 s
+    memset(&params, 0, sizeof(params));
+    params.rotate_duration_ms = 2500;
+    if (record(&params) || check_files(0) != 4)
+    {
+        printf("rotate test failed: duration\n");
+        fail = 1;
+    }
+
+    // by size: 2 cancelled rotations, then files of ~3 key frames
+    memset(&params, 0, sizeof(params));
+    params.rotate_bytes = 10000;
+    g_cancel = 2;
+    if (record(&params) || g_cancel || check_files(0) < 3)
+    {
+        printf("rotate test failed: size\n");
+        fail = 1;
+    }
+
+    // fragmented files
+    memset(&params, 0, sizeof(params));
+    params.enable_fragmentation = 1;
+    params.rotate_duration_ms = 4000;
+    if (record(&params) || check_files(1) != 3)
+    {
+        printf("rotate test failed: fragmented\n");
+        fail = 1;
+    }
+    return fail;
+}
@@ -0,0 +1,184 @@
+/** 18.10.2026 @file
+*
+*   Multiplex audio and video in segmented mode: init segment and each media
+*   segment go to separate in-memory sinks. Check, that segments start at video
+*   key frames after the target duration, and that 'sidx' box of each segment
+*   gives its byte size, start time and duration.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mp4mux.h"
+#include "mp4test_util.h"
+
+#define VIDEO_FRAMES    150         // 5 seconds, 30 fps
+#define GOP             30
+#define AUDIO_FRAMES    215         // 5 seconds, 44100 Hz
+#define SEGMENT_MS      1500
+#define MAX_SEGMENTS    16
+
+static buffer_t g_init;
+static buffer_t g_segment[MAX_SEGMENTS];
+static int g_segment_count;
+static int g_init_flushed;                  // flush callback calls
+static int g_segment_flushed[MAX_SEGMENTS];
+
+static int open_segment(void * segment_token, int segment_number, MP4E_sink_t * sink)
+{
+    (void)segment_token;
+    if (segment_number != g_segment_count + 1 || g_segment_count >= MAX_SEGMENTS)
+    {
+        return 1;
+    }
+    sink->write = buffer_write;
+    sink->token = &g_segment[g_segment_count++];
+    return 0;
+}
+
+static void on_flush(void * flush_token, mp4e_offset_t offset, mp4e_offset_t bytes, int flags)
+{
+    (void)flush_token;
+    if (flags == MP4E_FLUSH_HEADER && offset == 0 && bytes == g_init.bytes)
+    {
+        g_init_flushed++;
+    }
+    else if (flags == MP4E_FLUSH_SEGMENT_START && g_segment_count && offset == 0 &&
+             bytes == g_segment[g_segment_count - 1].bytes)
+    {
+        g_segment_flushed[g_segment_count - 1]++;
+    }
+}
+
+static unsigned read_u32(const unsigned char * p)
+{
+    return ((unsigned)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+/**
+*   Multiplex test sequence: audio track 0, video track 1; return 0 on success
+*/
+static int write_segments(void)
+{
+    static unsigned char frame[300];
+    MP4E_params_t params = {0,};
+    MP4E_sink_t sink = {0,};
+    MP4E_mux_t * mux;
+    MP4E_track_t track;
+    int a = 0, v = 0, error = 0;
+
+    sink.write = buffer_write;
+    sink.token = &g_init;
+    params.sink = &sink;
+    params.enable_fragmentation = 1;
+    params.segment_duration_ms = SEGMENT_MS;
+    params.segment_sink = open_segment;
+    params.flush = on_flush;
+    mux = MP4E__open_ex(&params);
+    if (!mux)
+    {
+        return 1;
+    }
+
+    memset(&track, 0, sizeof(track));
+    strcpy((char*)track.language, "und");
+    track.object_type_indication = MP4_OBJECT_TYPE_AUDIO_ISO_IEC_14496_3;
+    track.track_media_kind = e_audio;
+    track.u.a.channelcount = 2;
+    track.time_scale = 44100;
+    track.default_duration = 1024;
+    MP4E__add_track(mux, &track);
+    MP4E__set_dsi(mux, 0, g_dsi, sizeof(g_dsi));
+    track.object_type_indication = MP4_OBJECT_TYPE_AVC;
+    track.track_media_kind = e_video;
+    track.u.v.width = 320;
+    track.u.v.height = 240;
+    track.time_scale = 90000;
+    track.default_duration = 3000;
+    MP4E__add_track(mux, &track);
+    MP4E__set_sps(mux, 1, g_sps, sizeof(g_sps));
+    MP4E__set_pps(mux, 1, g_pps, sizeof(g_pps));
+
+    while (a < AUDIO_FRAMES || v < VIDEO_FRAMES)
+    {
+        if (v >= VIDEO_FRAMES || (a < AUDIO_FRAMES && (double)a*1024/44100 < (double)v/30))
+        {
+            frame[0] = (unsigned char)a++;
+            error |= MP4E__put_sample(mux, 0, frame, 50, 0, MP4E_SAMPLE_RANDOM_ACCESS);
+        }
+        else
+        {
+            frame[0] = (unsigned char)v;
+            error |= MP4E__put_sample(mux, 1, frame, sizeof(frame), 0,
+                (v % GOP) ? MP4E_SAMPLE_DEFAULT : MP4E_SAMPLE_RANDOM_ACCESS);
+            v++;
+        }
+    }
+    error |= MP4E__close(mux);
+    return error;
+}
+
+/**
+*   Check media segment n: styp, sidx, moof, mdat; return 1 on success
+*/
+static int check_segment(int n, int first_frame, int frames)
+{
+    const buffer_t * b = g_segment + n;
+    const unsigned char * styp = b->data, * sidx, * moof, * traf, * tfdt, * trun;
+    unsigned pos;
+    int ok, video_samples = 0;
+
+    ok = b->bytes > 24 + 52 + 8 && g_segment_flushed[n] == 1 && read_u32(styp + 4) == BOX_styp;
+    sidx = styp + read_u32(styp);
+    moof = sidx + read_u32(sidx);
+    ok &= read_u32(sidx + 4) == BOX_sidx && read_u32(moof + 4) == BOX_moof &&
+          read_u32(moof + read_u32(moof) + 4) == BOX_mdat;
+    // reference_ID, timescale, earliest_presentation_time, reference_count, referenced_size, duration, SAP
+    ok &= read_u32(sidx + 12) == 2 && read_u32(sidx + 16) == 90000 &&
+          read_u32(sidx + 24) == (unsigned)first_frame*3000 && read_u32(sidx + 36) == 1 &&
+          read_u32(sidx + 40) == b->bytes - (moof - b->data) && read_u32(sidx + 44) == (unsigned)frames*3000 &&
+          read_u32(sidx + 48) == 0x90000000;
+
+    for (pos = 8 + read_u32(moof + 8); ok && pos < read_u32(moof); pos += read_u32(traf))
+    {
+        traf = moof + pos;
+        tfdt = traf + 8 + read_u32(traf + 8);
+        trun = tfdt + read_u32(tfdt);
+        if (read_u32(traf + 8 + 12) == 2)
+        {
+            video_samples = read_u32(trun + 12);
+            // 1st video sample is key frame, and its data follows 'moof'
+            ok = read_u32(tfdt + 16) == (unsigned)first_frame*3000 && read_u32(trun + 20 + 8) == 0x2000000 &&
+                 moof[read_u32(trun + 16)] == (unsigned char)first_frame;
+        }
+    }
+    return ok && video_samples == frames;
+}
+
+int main(int argc, char* argv[])
+{
+    int fail = 0, i;
+    (void)argc;
+    (void)argv;
+
+    if (write_segments() || g_init_flushed != 1 || read_u32(g_init.data + 4) != BOX_ftyp ||
+        read_u32(g_init.data + read_u32(g_init.data) + 4) != BOX_moov ||
+        g_init.bytes != read_u32(g_init.data) + read_u32(g_init.data + read_u32(g_init.data)))
+    {
+        printf("segment test failed: init segment\n");
+        fail = 1;
+    }
+    // key frames at 0, 1, 2, 3, 4 s: segments start at 0, 2, 4 s
+    if (g_segment_count != 3 || !check_segment(0, 0, 60) ||
+        !check_segment(1, 60, 60) || !check_segment(2, 120, 30))
+    {
+        printf("segment test failed: media segments\n");
+        fail = 1;
+    }
+    free(g_init.data);
+    for (i = 0; i < g_segment_count; i++)
+    {
+        free(g_segment[i].data);
+    }
+    return fail;
+}
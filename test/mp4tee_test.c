@@ -0,0 +1,311 @@
+/** 18.10.2026 @file
+*
+*   Multiplex audio and video once to three outputs: progressive file,
+*   fragmented file, and CMAF chunks to in-memory sink, which keeps sample
+*   data by reference until close. Check, that all outputs have all samples,
+*   that sample data is not copied by the tee, and that each sample is
+*   released once, after the last output. Check, that the shared track table
+*   is changed and fed only by the tee.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mp4demux.h"
+#include "mp4tee.h"
+#include "mp4test_util.h"
+
+#define VIDEO_FRAMES    90          // 3 seconds, 30 fps
+#define GOP             30
+#define AUDIO_FRAMES    129         // ~3 seconds, 44100 Hz
+
+/*
+*   In-memory output, which keeps sample data by reference until close
+*/
+typedef struct
+{
+    const void * data;
+    MP4E_release_fn release;
+    void * release_token;
+} held_t;
+
+static buffer_t g_live;
+static held_t g_held[AUDIO_FRAMES + VIDEO_FRAMES];
+static int g_held_count;
+static int g_released[2][VIDEO_FRAMES + AUDIO_FRAMES];
+static int g_release_errors;
+
+static int buffer_write_ref(void * token, mp4e_offset_t offset, const void * data, size_t bytes,
+                            MP4E_release_fn release, void * release_token)
+{
+    held_t * h = g_held + g_held_count++;
+    h->data = data;
+    h->release = release;
+    h->release_token = release_token;
+    return buffer_write(token, offset, data, bytes);
+}
+
+static void release_held(void)
+{
+    int i;
+    for (i = 0; i < g_held_count; i++)
+    {
+        g_held[i].release(g_held[i].release_token, g_held[i].data);
+    }
+    g_held_count = 0;
+}
+
+/**
+*   Application release: sample data is the caller's buffer, not a copy
+*/
+static void release_sample(void * release_token, const void * data)
+{
+    const unsigned char * p = (const unsigned char *)data;
+    int track = p[0], n = p[1]*256 + p[2];
+    g_release_errors += (release_token != (void *)g_released) || g_released[track][n]++;
+    free((void *)data);
+}
+
+static int sample_bytes(int track, int i)
+{
+    return track ? 100 + (i*13 % 200) : 20 + (i*7 % 50);
+}
+
+/**
+*   Multiplex test sequence to the tee: audio track 0, video track 1.
+*   Sample data starts with track number, and 16-bit sample number.
+*   return 0 on success
+*/
+static int write_files(const char * progressive_name, const char * fragmented_name)
+{
+    MP4E_params_t outputs[3];
+    MP4E_sink_t sink = {0,};
+    MP4T_tee_t * tee;
+    MP4E_track_t track;
+    int a = 0, v = 0, error = 0;
+
+    memset(outputs, 0, sizeof(outputs));
+    outputs[0].mp4file = fopen(progressive_name, "wb");
+    outputs[1].mp4file = fopen(fragmented_name, "wb");
+    outputs[1].enable_fragmentation = 1;
+    sink.write = buffer_write;
+    sink.write_ref = buffer_write_ref;
+    sink.token = &g_live;
+    outputs[2].sink = &sink;
+    outputs[2].enable_fragmentation = 1;
+    outputs[2].cmaf_chunk_duration_ms = 200;
+    tee = MP4T__open(outputs, 3);
+    if (!tee)
+    {
+        return 1;
+    }
+
+    memset(&track, 0, sizeof(track));
+    strcpy((char*)track.language, "und");
+    track.object_type_indication = MP4_OBJECT_TYPE_AUDIO_ISO_IEC_14496_3;
+    track.track_media_kind = e_audio;
+    track.u.a.channelcount = 2;
+    track.time_scale = 44100;
+    track.default_duration = 1024;
+    error |= MP4T__add_track(tee, &track) != 0;
+    error |= MP4T__set_dsi(tee, 0, g_dsi, sizeof(g_dsi));
+    track.object_type_indication = MP4_OBJECT_TYPE_AVC;
+    track.track_media_kind = e_video;
+    track.u.v.width = 320;
+    track.u.v.height = 240;
+    track.time_scale = 90000;
+    track.default_duration = 3000;
+    error |= MP4T__add_track(tee, &track) != 1;
+    error |= MP4T__set_sps(tee, 1, g_sps, sizeof(g_sps));
+    error |= MP4T__set_pps(tee, 1, g_pps, sizeof(g_pps));
+    error |= MP4E__set_text_comment(MP4T__get_mux(tee, 0), "archive");
+
+    while (a < AUDIO_FRAMES || v < VIDEO_FRAMES)
+    {
+        int audio = v >= VIDEO_FRAMES || (a < AUDIO_FRAMES && (double)a*1024/44100 < (double)v/30);
+        int n = audio ? a++ : v++;
+        unsigned char * data = (unsigned char *)malloc(sample_bytes(!audio, n));
+        memset(data, 0, sample_bytes(!audio, n));
+        data[0] = (unsigned char)!audio;
+        data[1] = (unsigned char)(n >> 8);
+        data[2] = (unsigned char)n;
+        if (audio)
+        {
+            // copied by the tee
+            error |= MP4T__put_sample(tee, 0, data, sample_bytes(0, n), 0, MP4E_SAMPLE_RANDOM_ACCESS, NULL, NULL);
+            free(data);
+        }
+        else
+        {
+            error |= MP4T__put_sample_ts(tee, 1, data, sample_bytes(1, n), (mp4e_time_t)n*3000, (mp4e_time_t)n*3000,
+                (n % GOP) ? MP4E_SAMPLE_DEFAULT : MP4E_SAMPLE_RANDOM_ACCESS, release_sample, g_released);
+        }
+    }
+    // fragmented outputs are started; samples are passed only to the tee
+    error |= MP4T__set_sps(tee, 1, g_sps, sizeof(g_sps)) != MP4E_STATUS_ENCODE_IN_PROGRESS;
+    error |= MP4E__put_sample(MP4T__get_mux(tee, 1), 0, g_dsi, sizeof(g_dsi), 0, MP4E_SAMPLE_RANDOM_ACCESS) != 
+             MP4E_STATUS_BAD_ARGUMENTS;
+    error |= MP4T__close(tee);
+    return error;
+}
+
+static int rotate_stub(void * rotate_token, int file_number, MP4E_mux_t * finished, FILE ** mp4file, MP4E_sink_t * sink)
+{
+    (void)rotate_token;
+    (void)file_number;
+    (void)finished;
+    (void)mp4file;
+    (void)sink;
+    return 1;
+}
+
+/**
+*   Check, that output with rotation or in non-blocking mode is not accepted, 
+*   since track timing is shared
+*   return 1 on success
+*/
+static int check_rejected(int non_blocking)
+{
+    MP4E_params_t outputs[2];
+    MP4E_sink_t sink = {0,};
+    buffer_t buffer = {0,};
+    MP4T_tee_t * tee;
+
+    memset(outputs, 0, sizeof(outputs));
+    sink.write = buffer_write;
+    sink.token = &buffer;
+    outputs[0].sink = outputs[1].sink = &sink;
+    outputs[1].enable_fragmentation = 1;
+    if (non_blocking)
+    {
+        outputs[1].max_pending_bytes = 4096;
+    }
+    else
+    {
+        outputs[1].rotate = rotate_stub;
+    }
+    tee = MP4T__open(outputs, 2);
+    if (tee)
+    {
+        MP4T__close(tee);
+    }
+    free(buffer.data);
+    return !tee;
+}
+
+/**
+*   Check, that each video sample is released once, if released
+*/
+static int check_released(int expected)
+{
+    int i, ok = !g_release_errors;
+    for (i = 0; i < VIDEO_FRAMES; i++)
+    {
+        ok &= g_released[1][i] == expected;
+    }
+    return ok;
+}
+
+/**
+*   Read sample header from the file
+*/
+static int check_sample_data(FILE * f, mp4d_size_t offset, unsigned bytes, int track, int n)
+{
+    unsigned char head[3];
+    return !fseek(f, (long)offset, SEEK_SET) && 3 == fread(head, 1, 3, f) &&
+           head[0] == track && head[1]*256 + head[2] == n && bytes == (unsigned)sample_bytes(track, n);
+}
+
+/**
+*   Check all samples of the file, indexed in 'moov' or in fragments
+*   return 1 on success
+*/
+static int check_file(const char * file_name, int fragmented)
+{
+    FILE * f = fopen(file_name, "rb");
+    MP4D_demux_t mp4 = {0,};
+    unsigned ntrack, i, ok;
+    if (!f || !MP4D__open(&mp4, f))
+    {
+        if (f)
+        {
+            fclose(f);
+        }
+        return 0;
+    }
+    ok = mp4.track_count == 2 && mp4.track[0].dsi_bytes == sizeof(g_dsi) &&
+         (fragmented || (mp4.tag.comment && !strcmp((const char*)mp4.tag.comment, "archive")));
+    for (ntrack = 0; ok && ntrack < 2; ntrack++)
+    {
+        i = 0;
+        if (fragmented)
+        {
+            MP4D_fragment_t fragment = {0,};
+            mp4d_size_t offset;
+            for (ok = MP4D__seek_fragment(&mp4, 1, 0, &offset, NULL);
+                 ok && MP4D__read_fragment(&mp4, f, offset, ntrack, &fragment); offset = fragment.next_offset)
+            {
+                unsigned n;
+                for (n = 0; ok && n < fragment.sample_count; n++, i++)
+                {
+                    ok = check_sample_data(f, fragment.sample[n].offset, fragment.sample[n].bytes, ntrack, i);
+                }
+            }
+            MP4D__free_fragment(&mp4, &fragment);
+        }
+        else
+        {
+            for (i = 0; ok && i < mp4.track[ntrack].sample_count; i++)
+            {
+                unsigned frame_bytes, timestamp, duration;
+                mp4d_size_t ofs = MP4D__frame_offset(&mp4, ntrack, i, &frame_bytes, &timestamp, &duration);
+                ok = check_sample_data(f, ofs, frame_bytes, ntrack, i);
+            }
+        }
+        ok &= i == (ntrack ? VIDEO_FRAMES : AUDIO_FRAMES);
+    }
+    MP4D__close(&mp4);
+    fclose(f);
+    return ok;
+}
+
+int main(int argc, char* argv[])
+{
+    const char * file_name = (argc > 1) ? argv[1] : "tee_test.mp4";
+    char fragmented_name[256], live_name[256];
+    FILE * f;
+    int fail = 0, ok;
+
+    sprintf(fragmented_name, "%s.frag", file_name);
+    sprintf(live_name, "%s.live", file_name);
+    // CMAF output holds all samples (audio: the tee copy) until released
+    ok = !write_files(file_name, fragmented_name) && g_held_count == AUDIO_FRAMES + VIDEO_FRAMES && check_released(0);
+    release_held();
+    if (!ok || !check_released(1))
+    {
+        printf("tee test failed: release\n");
+        fail = 1;
+    }
+
+    f = fopen(live_name, "wb");
+    ok = f && g_live.bytes == fwrite(g_live.data, 1, g_live.bytes, f);
+    if (f)
+    {
+        fclose(f);
+    }
+    if (!check_file(file_name, 0) || !check_file(fragmented_name, 1) || !ok || !check_file(live_name, 1))
+    {
+        printf("tee test failed: outputs\n");
+        fail = 1;
+    }
+    if (!check_rejected(0) || !check_rejected(1))
+    {
+        printf("tee test failed: rotating or non-blocking output\n");
+        fail = 1;
+    }
+    remove(file_name);
+    remove(fragmented_name);
+    remove(live_name);
+    free(g_live.data);
+    return fail;
+}
@@ -0,0 +1,157 @@
+/** 18.10.2026 @file
+*
+*   Shared fixtures of the test programs
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "mp4mux.h"
+#include "mp4test_util.h"
+
+#define HEADER_BYTES    16  // block size, stored before the block
+#define MAX_AUDIO_TRACKS 6
+
+const unsigned char g_sps[24] = { 0x67, 0x42, 0xC0, 0x1E, 0xDA, 0x02, 0x80, 0xBF, 0xE5, 0x84, 0x00, 0x00, 0x03, 0x00, 0x04, 0x00, 0x00, 0x03, 0x00, 0xF2, 0x3C, 0x58, 0xBA, 0x80 };
+const unsigned char g_pps[5] = { 0x68, 0xCE, 0x0F, 0x2C, 0x80 };
+const unsigned char g_dsi[2] = { 0x12, 0x10 };
+
+size_t g_allocated;
+size_t g_used;
+size_t g_peak;
+
+static void * count_reallocate(void * context, void * ptr, size_t bytes)
+{
+    char * p = ptr ? (char *)ptr - HEADER_BYTES : NULL;
+    (void)context;
+    g_allocated += bytes;
+    g_used -= p ? *(size_t *)p : 0;
+    p = (char *)realloc(p, bytes + HEADER_BYTES);
+    if (!p)
+    {
+        return NULL;
+    }
+    *(size_t *)p = bytes;
+    g_used += bytes;
+    g_peak = g_used > g_peak ? g_used : g_peak;
+    return p + HEADER_BYTES;
+}
+
+static void * count_allocate(void * context, size_t bytes)
+{
+    return count_reallocate(context, NULL, bytes);
+}
+
+static void count_deallocate(void * context, void * ptr)
+{
+    (void)context;
+    if (ptr)
+    {
+        g_used -= *(size_t *)((char *)ptr - HEADER_BYTES);
+        free((char *)ptr - HEADER_BYTES);
+    }
+}
+
+const MP4_allocator_t g_count_allocator = { count_allocate, count_reallocate, count_deallocate, NULL };
+
+int buffer_write(void * token, mp4e_offset_t offset, const void * data, size_t bytes)
+{
+    buffer_t * b = (buffer_t *)token;
+    if (offset + bytes > b->bytes)
+    {
+        unsigned char * p = (unsigned char *)realloc(b->data, (size_t)offset + bytes);
+        if (!p)
+        {
+            return 1;
+        }
+        b->data = p;
+        b->bytes = (size_t)offset + bytes;
+    }
+    memcpy(b->data + offset, data, bytes);
+    return 0;
+}
+
+double now_us(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec*1e6 + t.tv_nsec/1e3;
+}
+
+int equal(const void * x, const void * y, size_t bytes)
+{
+    return !bytes || !memcmp(x, y, bytes);
+}
+
+int write_movie(const char * file_name, int seconds, int audio_tracks, int fragmented, int seed)
+{
+    static unsigned char frame[32];
+    static const char * languages[MAX_AUDIO_TRACKS] = { "eng", "fra", "deu", "spa", "ita", "rus" };
+    MP4E_params_t params = {0,};
+    MP4E_mux_t * mux;
+    MP4E_track_t track;
+    int a = 0, v = 0, error = 0, i;
+    int audio_frames = (int)((double)seconds*44100/1024), video_frames = seconds*30;
+
+    if (audio_tracks < 0 || audio_tracks > MAX_AUDIO_TRACKS)
+    {
+        return 0;
+    }
+    params.mp4file = fopen(file_name, "wb");
+    params.enable_fragmentation = fragmented;
+    mux = params.mp4file ? MP4E__open_ex(&params) : NULL;
+    if (!mux)
+    {
+        if (params.mp4file)
+        {
+            fclose(params.mp4file);
+        }
+        return 0;
+    }
+    memset(&track, 0, sizeof(track));
+    strcpy((char*)track.language, "und");
+    track.object_type_indication = MP4_OBJECT_TYPE_AVC;
+    track.track_media_kind = e_video;
+    track.u.v.width = 320;
+    track.u.v.height = 240;
+    track.time_scale = 90000;
+    track.default_duration = 3000;
+    MP4E__add_track(mux, &track);
+    MP4E__set_sps(mux, 0, g_sps, sizeof(g_sps));
+    MP4E__set_pps(mux, 0, g_pps, sizeof(g_pps));
+    track.object_type_indication = MP4_OBJECT_TYPE_AUDIO_ISO_IEC_14496_3;
+    track.track_media_kind = e_audio;
+    track.u.a.channelcount = 2;
+    track.time_scale = 44100;
+    track.default_duration = 1024;
+    for (i = 0; i < audio_tracks; i++)
+    {
+        strcpy((char*)track.language, languages[i]);
+        MP4E__add_track(mux, &track);
+        MP4E__set_dsi(mux, 1 + i, g_dsi, sizeof(g_dsi));
+    }
+    MP4E__set_text_comment(mux, "test movie");
+    if (!audio_tracks)
+    {
+        audio_frames = 0;
+    }
+    while (a < audio_frames || v < video_frames)
+    {
+        int audio = v >= video_frames || (a < audio_frames && (double)a*1024/44100 < (double)v/30);
+        int n = audio ? a++ : v++;
+        if (audio)
+        {
+            for (i = 0; i < audio_tracks; i++)
+            {
+                error |= MP4E__put_sample(mux, 1 + i, frame, 6 + (n + i + seed) % 7, 0, MP4E_SAMPLE_RANDOM_ACCESS);
+            }
+        }
+        else
+        {
+            error |= MP4E__put_sample(mux, 0, frame, 8 + (n + seed) % 23, 0, (n % 30) ? MP4E_SAMPLE_DEFAULT : MP4E_SAMPLE_RANDOM_ACCESS);
+        }
+    }
+    error |= MP4E__close(mux);
+    return !error;
+}
@@ -0,0 +1,68 @@
+/** 18.10.2026 @file
+*
+*   Shared fixtures of the test programs: AVC and AAC decoder configuration,
+*   generated test movie, in-memory output, counting allocator and timer.
+*   Link test/mp4test_util.c with the test program.
+*/
+
+#ifndef mp4test_util_H_INCLUDED
+#define mp4test_util_H_INCLUDED
+
+#include <stddef.h>
+#include "mp4mux.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif  //__cplusplus
+
+extern const unsigned char g_sps[24];   // 320x240 H.264 SPS
+extern const unsigned char g_pps[5];    // H.264 PPS
+extern const unsigned char g_dsi[2];    // AAC decoder specific info
+
+extern size_t g_allocated;  // total bytes, requested from g_count_allocator
+extern size_t g_used;       // bytes of blocks, allocated by g_count_allocator
+extern size_t g_peak;       // max g_used
+
+/**
+*   In-memory output: MP4E_sink_t::write = buffer_write, token = buffer_t *.
+*   Owner frees data.
+*/
+typedef struct
+{
+    unsigned char * data;
+    size_t bytes;
+} buffer_t;
+
+int buffer_write(void * token, mp4e_offset_t offset, const void * data, size_t bytes);
+
+/**
+*   malloc()-based allocator, which updates g_allocated, g_used and g_peak.
+*   Counters are reset by the test.
+*/
+extern const MP4_allocator_t g_count_allocator;
+
+/**
+*   Return monotonic time, us
+*/
+double now_us(void);
+
+/**
+*   Compare memory blocks
+*   return 1 if equal; empty blocks are equal
+*/
+int equal(const void * x, const void * y, size_t bytes);
+
+/**
+*   Write movie with small samples: H.264 video track 0 (320x240, 30 fps),
+*   and audio_tracks AAC tracks (44100 Hz, 1024 samples per frame), with
+*   languages "eng", "fra", "deu", "spa", "ita", "rus", and comment tag.
+*   Sample sizes vary with the track, the sample number and the seed.
+*   return 1 on success
+*/
+int write_movie(const char * file_name, int seconds, int audio_tracks, int fragmented, int seed);
+
+#ifdef __cplusplus
+}
+#endif //__cplusplus
+
+#endif //mp4test_util_H_INCLUDED
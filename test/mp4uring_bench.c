@@ -0,0 +1,216 @@
+/** 18.10.2026 @file
+*
+*   Per-stream CPU cost of many concurrent multiplexers, with stdio output,
+*   with shared io_uring ring, and with blocking fallback of the ring.
+*
+*   Usage: mp4uring_bench [output dir] [frames per stream] [stream count]...
+*   Default: current directory, 90 frames (3 seconds of 30 fps video), 1 64 512 streams
+*
+*   Synthetic camera streams (2 Mbit/s video, fragmented MP4) are multiplexed
+*   in round-robin order, as a single-threaded recording server would do.
+*   Output of stream 0 is checked against stdio output; return 1 on mismatch.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include "mp4mux.h"
+#include "mp4uring.h"
+#include "mp4test_util.h"
+
+#define FPS         30
+#define GOP         30
+#define IDR_BYTES   40000
+#define FRAME_BYTES 6000
+
+enum { e_stdio, e_uring, e_blocking, MODE_COUNT };
+static const char * g_mode_name[MODE_COUNT] = { "stdio", "io_uring", "ring, blocking" };
+
+static unsigned char g_frame[IDR_BYTES];
+
+/**
+*   Return CPU time (user + system) of the process in seconds
+*/
+static double cpu_seconds(void)
+{
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec)*1e-6;
+}
+
+static void stream_name(char * name, const char * dir, int mode, int stream)
+{
+    sprintf(name, "%s/bench_%d_%d.mp4", dir, mode, stream);
+}
+
+/**
+*   Return 1 if files are identical
+*/
+static int compare_files(const char * name1, const char * name2)
+{
+    FILE * f1 = fopen(name1, "rb"), * f2 = fopen(name2, "rb");
+    int c1, c2, same = f1 && f2;
+    while (same)
+    {
+        c1 = fgetc(f1);
+        c2 = fgetc(f2);
+        same = (c1 == c2);
+        if (c1 == EOF)
+        {
+            break;
+        }
+    }
+    if (f1) fclose(f1);
+    if (f2) fclose(f2);
+    return same;
+}
+
+/**
+*   Multiplex given number of streams; return 0 on success
+*/
+static int run(const char * dir, int mode, int stream_count, int frames, double * cpu, double * wall)
+{
+    MP4E_mux_t ** mux = (MP4E_mux_t **)calloc(stream_count, sizeof(MP4E_mux_t *));
+    MP4U_file_t ** file = (MP4U_file_t **)calloc(stream_count, sizeof(MP4U_file_t *));
+    MP4U_ring_t * ring = NULL;
+    MP4U_params_t ring_params = {0,};
+    double t0 = cpu_seconds(), w0 = now_us()*1e-6;
+    int i, n, error = !mux || !file;
+    char name[1024];
+
+    if (mode != e_stdio)
+    {
+        ring_params.disable_io_uring = (mode == e_blocking);
+        ring = MP4U__ring_open(&ring_params);
+        error |= !ring;
+    }
+    for (n = 0; n < stream_count && !error; n++)
+    {
+        MP4E_params_t params = {0,};
+        MP4E_sink_t sink;
+        MP4E_track_t track;
+
+        stream_name(name, dir, mode, n);
+        params.enable_fragmentation = 1;
+        if (mode == e_stdio)
+        {
+            params.mp4file = fopen(name, "wb");
+            error |= !params.mp4file;
+        }
+        else
+        {
+            file[n] = MP4U__file_open(ring, name);
+            error |= !file[n];
+            if (file[n])
+            {
+                MP4U__get_sink(file[n], &sink);
+                params.sink = &sink;
+            }
+        }
+        mux[n] = error ? NULL : MP4E__open_ex(&params);
+        if (!mux[n])
+        {
+            error = 1;
+            break;
+        }
+        memset(&track, 0, sizeof(track));
+        track.object_type_indication = MP4_OBJECT_TYPE_AVC;
+        strcpy((char*)track.language, "und");
+        track.track_media_kind = e_video;
+        track.time_scale = 90000;
+        track.default_duration = 90000 / FPS;
+        track.u.v.width = 1280;
+        track.u.v.height = 720;
+        MP4E__add_track(mux[n], &track);
+        MP4E__set_sps(mux[n], 0, g_sps, sizeof(g_sps));
+        MP4E__set_pps(mux[n], 0, g_pps, sizeof(g_pps));
+    }
+
+    for (i = 0; i < frames && !error; i++)
+    {
+        int kind = (i % GOP) ? MP4E_SAMPLE_DEFAULT : MP4E_SAMPLE_RANDOM_ACCESS;
+        int bytes = (i % GOP) ? FRAME_BYTES : IDR_BYTES;
+        for (n = 0; n < stream_count; n++)
+        {
+            error |= MP4E__put_sample(mux[n], 0, g_frame, bytes, 90000 / FPS, kind);
+        }
+        if (ring)
+        {
+            error |= MP4U__ring_submit(ring);
+        }
+    }
+
+    for (n = 0; n < stream_count; n++)
+    {
+        if (mux[n])
+        {
+            error |= MP4E__close(mux[n]);
+        }
+        if (file[n])
+        {
+            error |= MP4U__file_close(file[n]);
+        }
+    }
+    MP4U__ring_close(ring);
+    free(mux);
+    free(file);
+    *cpu = cpu_seconds() - t0;
+    *wall = now_us()*1e-6 - w0;
+    return error;
+}
+
+int main(int argc, char* argv[])
+{
+    static const int default_counts[] = { 1, 64, 512 };
+    const char * dir = argc > 1 ? argv[1] : ".";
+    int frames = argc > 2 ? atoi(argv[2]) : 3*FPS;
+    int count_num = argc > 3 ? argc - 3 : 3;
+    int c, mode, fail = 0;
+    char name1[1024], name2[1024];
+    MP4U_ring_t * ring = MP4U__ring_open(NULL);
+
+    printf("io_uring %savailable\n", MP4U__ring_is_async(ring) ? "" : "NOT ");
+    MP4U__ring_close(ring);
+    printf("%8s  %-16s %14s %12s\n", "streams", "output", "CPU us/stream/s", "wall, s");
+    for (c = 0; c < count_num; c++)
+    {
+        int stream_count = argc > 3 ? atoi(argv[3 + c]) : default_counts[c];
+        for (mode = 0; mode < MODE_COUNT; mode++)
+        {
+            double cpu, wall;
+            int n;
+            if (run(dir, mode, stream_count, frames, &cpu, &wall))
+            {
+                printf("%8d  %-16s failed\n", stream_count, g_mode_name[mode]);
+                fail = 1;
+            }
+            else
+            {
+                printf("%8d  %-16s %14.1f %12.3f\n", stream_count, g_mode_name[mode],
+                    cpu*1e6 / stream_count / ((double)frames / FPS), wall);
+            }
+            if (mode != e_stdio)
+            {
+                stream_name(name1, dir, e_stdio, 0);
+                stream_name(name2, dir, mode, 0);
+                if (!compare_files(name1, name2))
+                {
+                    printf("output mismatch: %s\n", g_mode_name[mode]);
+                    fail = 1;
+                }
+            }
+            for (n = 1; n < stream_count; n++)
+            {
+                stream_name(name1, dir, mode, n);
+                remove(name1);
+            }
+        }
+        for (mode = 0; mode < MODE_COUNT; mode++)
+        {
+            stream_name(name1, dir, mode, 0);
+            remove(name1);
+        }
+    }
+    return fail;
+}
@@ -0,0 +1,193 @@
+/** 18.10.2026 @file
+*
+*   Remux input file with FILE output, with write-behind writer (with and
+*   without O_DIRECT), and with io_uring output (with and without blocking
+*   fallback); output files must be identical.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mp4demux.h"
+#include "mp4mux.h"
+#include "mp4writer.h"
+#include "mp4uring.h"
+
+static int g_released;
+
+static void release_sample(void * release_token, const void * data)
+{
+    (void)release_token;
+    free((void*)data);
+    g_released++;
+}
+
+/**
+*   Copy all tracks of the input file to the multiplexer
+*/
+static void remux(FILE * input_file, MP4E_mux_t * mux)
+{
+    unsigned i, ntrack;
+    MP4D_demux_t mp4 = {0,};
+    MP4D__open(&mp4, input_file);
+
+    // all tracks must be added before 1st sample in fragmentation mode
+    for (ntrack = 0; ntrack < mp4.track_count; ntrack++)
+    {
+        MP4D_track_t *tr = mp4.track + ntrack;
+        MP4E_track_t tre;
+        int trid;
+        memset(&tre, 0, sizeof(tre));
+        tre.object_type_indication = tr->object_type_indication;
+        memcpy(tre.language, tr->language, 4);
+        tre.track_media_kind = tr->handler_type == MP4_HANDLER_TYPE_VIDE ? e_video :
+                               tr->handler_type == MP4_HANDLER_TYPE_SOUN ? e_audio : e_private;
+        tre.u.a.channelcount = tr->SampleDescription.audio.channelcount;
+        if (tre.track_media_kind == e_video)
+        {
+            tre.u.v.width = tr->SampleDescription.video.width;
+            tre.u.v.height = tr->SampleDescription.video.height;
+        }
+        tre.time_scale = tr->timescale;
+        trid = MP4E__add_track(mux, &tre);
+        if (tr->object_type_indication == MP4_OBJECT_TYPE_AVC)
+        {
+            int bytes, n;
+            const void * ps;
+            for (n = 0; NULL != (ps = MP4D__read_sps(&mp4, ntrack, n, &bytes)); n++)
+            {
+                MP4E__set_sps(mux, trid, ps, bytes);
+            }
+            for (n = 0; NULL != (ps = MP4D__read_pps(&mp4, ntrack, n, &bytes)); n++)
+            {
+                MP4E__set_pps(mux, trid, ps, bytes);
+            }
+        }
+        else
+        {
+            MP4E__set_dsi(mux, trid, tr->dsi, tr->dsi_bytes);
+        }
+    }
+
+    for (ntrack = 0; ntrack < mp4.track_count; ntrack++)
+    {
+        MP4D_track_t *tr = mp4.track + ntrack;
+        for (i = 0; i < tr->sample_count; i++)
+        {
+            unsigned frame_bytes, timestamp, duration;
+            mp4d_size_t ofs = MP4D__frame_offset(&mp4, ntrack, i, &frame_bytes, &timestamp, &duration);
+            // large buffer, to use pass-by-reference path of the writer
+            unsigned char * mem = calloc(1, frame_bytes + 64*1024);
+            fseek(input_file, (long)ofs, SEEK_SET);
+            fread(mem, 1, frame_bytes, input_file);
+            MP4E__put_sample_ref(mux, ntrack, mem, (i & 1) ? frame_bytes : frame_bytes + 64*1024, duration,
+                i ? MP4E_SAMPLE_DEFAULT : MP4E_SAMPLE_RANDOM_ACCESS, release_sample, NULL);
+        }
+    }
+    MP4D__close(&mp4);
+}
+
+/**
+*   Return 1 if files are identical
+*/
+static int compare_files(const char * name1, const char * name2)
+{
+    FILE * f1 = fopen(name1, "rb"), * f2 = fopen(name2, "rb");
+    int c1, c2, same = f1 && f2;
+    while (same)
+    {
+        c1 = fgetc(f1);
+        c2 = fgetc(f2);
+        same = (c1 == c2);
+        if (c1 == EOF)
+        {
+            break;
+        }
+    }
+    if (f1) fclose(f1);
+    if (f2) fclose(f2);
+    return same;
+}
+
+int main(int argc, char* argv[])
+{
+    int direct_io, blocking, fragmentation_mode, fail = 0;
+    char * file_name = (argc>1)?argv[1]:"input.mp4";
+    FILE * input_file = fopen(file_name, "rb");
+    if (!input_file)
+    {
+        printf("\ncant open %s\n", file_name);
+        return 1;
+    }
+
+    for (fragmentation_mode = 0; fragmentation_mode < 2; fragmentation_mode++)
+    {
+        MP4E_mux_t * mux = MP4E__open(fopen("writer_ref.mp4", "wb"), fragmentation_mode);
+        remux(input_file, mux);
+        MP4E__close(mux);
+
+        for (direct_io = 0; direct_io < 2; direct_io++)
+        {
+            MP4W_params_t wparams = {0,};
+            MP4E_params_t params = {0,};
+            MP4E_sink_t sink;
+            MP4W_writer_t * writer;
+            int error;
+
+            wparams.buffer_bytes = 4096;    // small buffers, to test buffers ring wrap
+            wparams.buffer_count = 3;
+            wparams.direct_io = direct_io;
+            wparams.preallocate_bytes = 1 << 20;
+            writer = MP4W__open("writer_out.mp4", &wparams);
+            MP4W__get_sink(writer, &sink);
+            params.sink = &sink;
+            params.enable_fragmentation = fragmentation_mode;
+            mux = MP4E__open_ex(&params);
+            g_released = 0;
+            remux(input_file, mux);
+            error = MP4E__close(mux);
+            error |= MP4W__close(writer);
+
+            if (error || !g_released || !compare_files("writer_ref.mp4", "writer_out.mp4"))
+            {
+                printf("writer test failed: fragmentation %d, direct_io %d\n", fragmentation_mode, direct_io);
+                fail = 1;
+            }
+        }
+
+        for (blocking = 0; blocking < 2; blocking++)
+        {
+            MP4U_params_t rparams = {0,};
+            MP4E_params_t params = {0,};
+            MP4E_sink_t sink;
+            MP4U_ring_t * ring;
+            MP4U_file_t * file;
+            int error;
+
+            rparams.entries = 4;            // small queue and chunks, to test queue wrap
+            rparams.chunk_bytes = 4096;
+            rparams.disable_io_uring = blocking;
+            ring = MP4U__ring_open(&rparams);
+            file = MP4U__file_open(ring, "writer_out.mp4");
+            MP4U__get_sink(file, &sink);
+            params.sink = &sink;
+            params.enable_fragmentation = fragmentation_mode;
+            mux = MP4E__open_ex(&params);
+            g_released = 0;
+            remux(input_file, mux);
+            error = MP4E__close(mux);
+            error |= MP4U__file_close(file);
+            MP4U__ring_close(ring);
+
+            if (error || !g_released || !compare_files("writer_ref.mp4", "writer_out.mp4"))
+            {
+                printf("io_uring output test failed: fragmentation %d, blocking %d\n", fragmentation_mode, blocking);
+                fail = 1;
+            }
+        }
+    }
+    fclose(input_file);
+    remove("writer_ref.mp4");
+    remove("writer_out.mp4");
+    return fail;
+}